@@ -0,0 +1,122 @@
+--[[
+Copyright (c) 2017, Vsevolod Stakhov <vsevolod@highsecure.ru>
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License.
+]]--
+
+-- Fast task accessors: with LuaJIT they call plain C functions via FFI
+-- instead of the stack API, otherwise they fall back to task methods.
+--
+-- local task_ffi = require "task_ffi"
+-- if task_ffi.has_symbol(task, 'R_SPF_ALLOW') then ... end
+--
+-- Functions accept either task object or `struct rspamd_task *` cdata.
+
+local exports = {}
+local has_ffi, ffi = pcall(require, "ffi")
+
+if has_ffi then
+  ffi.cdef[[
+  struct rspamd_task;
+  size_t rspamd_task_ffi_get_size (struct rspamd_task *task);
+  const char * rspamd_task_ffi_get_message_id (struct rspamd_task *task);
+  int rspamd_task_ffi_has_symbol (struct rspamd_task *task,
+      const char *symbol);
+  double rspamd_task_ffi_get_symbol_score (struct rspamd_task *task,
+      const char *symbol);
+  double rspamd_task_ffi_get_score (struct rspamd_task *task);
+  ]]
+
+  -- Task userdata stores a pointer to the task
+  local function task_ptr(task)
+    if type(task) == 'cdata' then
+      return task
+    end
+
+    return ffi.cast('struct rspamd_task **', task)[0]
+  end
+
+  exports.get_size = function(task)
+    return tonumber(ffi.C.rspamd_task_ffi_get_size(task_ptr(task)))
+  end
+
+  exports.get_message_id = function(task)
+    local mid = ffi.C.rspamd_task_ffi_get_message_id(task_ptr(task))
+
+    if mid == nil then
+      return nil
+    end
+
+    return ffi.string(mid)
+  end
+
+  exports.has_symbol = function(task, symbol)
+    return ffi.C.rspamd_task_ffi_has_symbol(task_ptr(task), symbol) ~= 0
+  end
+
+  exports.get_symbol_score = function(task, symbol)
+    local score = ffi.C.rspamd_task_ffi_get_symbol_score(task_ptr(task),
+      symbol)
+
+    -- NaN means that there is no such symbol
+    if score ~= score then
+      return nil
+    end
+
+    return score
+  end
+
+  exports.get_score = function(task)
+    return ffi.C.rspamd_task_ffi_get_score(task_ptr(task))
+  end
+else
+  exports.get_size = function(task)
+    return task:get_size()
+  end
+
+  exports.get_message_id = function(task)
+    return task:get_message_id()
+  end
+
+  exports.has_symbol = function(task, symbol)
+    return task:has_symbol(symbol)
+  end
+
+  exports.get_symbol_score = function(task, symbol)
+    local res = task:get_symbol(symbol)
+
+    if res then
+      for _,s in ipairs(res) do
+        if s['metric'] == 'default' then
+          return s['score']
+        end
+      end
+    end
+
+    return nil
+  end
+
+  exports.get_score = function(task)
+    local res = task:get_metric_score('default')
+
+    if res then
+      return res[1]
+    end
+
+    return 0.0
+  end
+end
+
+exports.has_ffi = has_ffi
+
+return exports
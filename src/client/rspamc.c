@@ -60,6 +60,8 @@ static gboolean mime_output = FALSE;
 static gboolean empty_input = FALSE;
 static gboolean compressed = FALSE;
 static gchar *key = NULL;
+/* Connections kept alive by server after the previous replies */
+static GQueue *idle_conns = NULL;
 static GList *children;
 
 #define ADD_CLIENT_HEADER(o, n, v) do { \
@@ -960,6 +962,8 @@ rspamc_stat_output (FILE *out, ucl_object_t *obj)
 		ucl_object_toint (ucl_object_lookup (obj, "chunks_freed")));
 	rspamd_printf_gstring (out_str, "Oversized chunks: %L\n",
 		ucl_object_toint (ucl_object_lookup (obj, "chunks_oversized")));
+	rspamd_printf_gstring (out_str, "Chunks reused: %L\n",
+		ucl_object_toint (ucl_object_lookup (obj, "chunks_reused")));
 	/* Fuzzy */
 
 	st = ucl_object_lookup (obj, "fuzzy_hashes");
@@ -1368,7 +1372,13 @@ rspamc_client_cb (struct rspamd_client_connection *conn,
 		fflush (out);
 	}
 
-	rspamd_client_destroy (conn);
+	if (rspamd_client_keepalive (conn)) {
+		g_queue_push_tail (idle_conns, conn);
+	}
+	else {
+		rspamd_client_destroy (conn);
+	}
+
 	g_free (cbdata->filename);
 	g_slice_free1 (sizeof (struct rspamc_callback_data), cbdata);
 }
@@ -1418,7 +1428,20 @@ rspamc_process_input (struct event_base *ev_base, struct rspamc_command *cmd,
 		}
 	}
 
-	conn = rspamd_client_init (ev_base, hostbuf, port, timeout, key);
+	conn = NULL;
+
+	while (conn == NULL && !g_queue_is_empty (idle_conns)) {
+		conn = g_queue_pop_head (idle_conns);
+
+		if (!rspamd_client_keepalive (conn)) {
+			rspamd_client_destroy (conn);
+			conn = NULL;
+		}
+	}
+
+	if (conn == NULL) {
+		conn = rspamd_client_init (ev_base, hostbuf, port, timeout, key);
+	}
 
 	if (conn != NULL) {
 		cbdata = g_slice_alloc (sizeof (struct rspamc_callback_data));
@@ -1599,6 +1622,7 @@ main (gint argc, gchar **argv, gchar **env)
 	struct sigaction sigpipe_act;
 
 	kwattrs = g_queue_new ();
+	idle_conns = g_queue_new ();
 
 	read_cmd_line (&argc, &argv);
 
@@ -1718,6 +1742,7 @@ main (gint argc, gchar **argv, gchar **env)
 	event_base_loop (ev_base, 0);
 
 	g_queue_free_full (kwattrs, g_free);
+	g_queue_free_full (idle_conns, (GDestroyNotify)rspamd_client_destroy);
 
 	/* Wait for children processes */
 	cur = g_list_first (children);
@@ -31,6 +31,8 @@ struct rspamd_client_request;
 
 /*
  * Since rspamd uses untagged HTTP we can pass a single message per socket
+ * at once, however, if server agrees to keep connection alive, then the next
+ * message could be sent when the previous reply is received
  */
 struct rspamd_client_connection {
 	gint fd;
@@ -41,6 +43,7 @@ struct rspamd_client_connection {
 	struct timeval timeout;
 	struct rspamd_http_connection *http_conn;
 	gboolean req_sent;
+	gboolean keepalive;
 	struct rspamd_client_request *req;
 	struct rspamd_keypair_cache *keys_cache;
 };
@@ -92,6 +95,7 @@ rspamd_client_error_handler (struct rspamd_http_connection *conn, GError *err)
 	struct rspamd_client_connection *c;
 
 	c = req->conn;
+	c->keepalive = FALSE;
 	req->cb (c, NULL, c->server_name->str, NULL, req->input, req->ud, err);
 }
 
@@ -119,6 +123,8 @@ rspamd_client_finish_handler (struct rspamd_http_connection *conn,
 		return 0;
 	}
 	else {
+		c->keepalive = rspamd_http_connection_is_keepalive (c->http_conn);
+
 		if (rspamd_http_message_get_body (msg, NULL) == NULL || msg->code != 200) {
 			err = g_error_new (RCLIENT_ERROR, msg->code, "HTTP error: %d, %.*s",
 					msg->code,
@@ -251,7 +257,7 @@ rspamd_client_init (struct event_base *ev_base, const gchar *name,
 	conn->http_conn = rspamd_http_connection_new (rspamd_client_body_handler,
 			rspamd_client_error_handler,
 			rspamd_client_finish_handler,
-			0,
+			RSPAMD_HTTP_CLIENT_KEEP_ALIVE,
 			RSPAMD_HTTP_CLIENT,
 			conn->keys_cache,
 			NULL);
@@ -301,6 +307,14 @@ rspamd_client_command (struct rspamd_client_connection *conn,
 	void *dict = NULL;
 	ZSTD_CCtx *zctx;
 
+	if (conn->req_sent) {
+		/* Connection is reused after the previous reply */
+		rspamd_client_request_free (conn->req);
+		rspamd_http_connection_reset (conn->http_conn);
+		conn->req_sent = FALSE;
+		conn->keepalive = FALSE;
+	}
+
 	req = g_slice_alloc0 (sizeof (struct rspamd_client_request));
 	req->conn = conn;
 	req->cb = cb;
@@ -439,6 +453,28 @@ rspamd_client_command (struct rspamd_client_connection *conn,
 	return TRUE;
 }
 
+gboolean
+rspamd_client_keepalive (struct rspamd_client_connection *conn)
+{
+	gchar c;
+	gssize r;
+
+	if (!conn->keepalive) {
+		return FALSE;
+	}
+
+	/* Server might have closed idle connection meanwhile */
+	r = recv (conn->fd, &c, sizeof (c), MSG_PEEK);
+
+	if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+		return TRUE;
+	}
+
+	conn->keepalive = FALSE;
+
+	return FALSE;
+}
+
 void
 rspamd_client_destroy (struct rspamd_client_connection *conn)
 {
@@ -81,6 +81,14 @@ gboolean rspamd_client_command (
 	const gchar *comp_dictionary,
 	GError **err);
 
+/**
+ * Checks if the server has kept connection alive after the last reply, so
+ * `rspamd_client_command` could be called once more for this connection
+ * @param conn
+ * @return TRUE if connection could be reused
+ */
+gboolean rspamd_client_keepalive (struct rspamd_client_connection *conn);
+
 /**
  * Destroy a connection to rspamd
  * @param conn
@@ -1410,6 +1410,12 @@ rspamd_controller_handle_history (struct rspamd_http_connection_entry *conn_ent,
 					row->len),			  "size",			0, false);
 			ucl_object_insert_key (obj,	   ucl_object_fromdouble (
 					row->scan_time),	  "scan_time",		0, false);
+			ucl_object_insert_key (obj, rspamd_roll_history_row_stages (row),
+					"stages", 0, false);
+			if (row->slow_symbols[0] != '\0') {
+				ucl_object_insert_key (obj, ucl_object_fromstring (
+						row->slow_symbols), "slow_symbols", 0, false);
+			}
 			if (row->user[0] != '\0') {
 				ucl_object_insert_key (obj, ucl_object_fromstring (
 						row->user), "user", 0, false);
@@ -2400,8 +2406,8 @@ rspamd_controller_handle_stat_common (
 	gboolean do_reset)
 {
 	struct rspamd_controller_session *session = conn_ent->ud;
-	ucl_object_t *top, *sub;
-	gint i;
+	ucl_object_t *top, *sub, *hist;
+	gint i, j;
 	guint64 spam = 0, ham = 0;
 	rspamd_mempool_stat_t mem_st;
 	struct rspamd_stat *stat, stat_copy;
@@ -2473,6 +2479,29 @@ rspamd_controller_handle_stat_common (
 	ucl_object_insert_key (top,
 		ucl_object_fromint (stat->control_connections_count),
 		"control_connections", 0, false);
+	ucl_object_insert_key (top,
+		ucl_object_fromint (stat->dns_cache_hits), "dns_cache_hits", 0, false);
+	ucl_object_insert_key (top,
+		ucl_object_fromint (stat->dns_cache_misses), "dns_cache_misses", 0,
+		false);
+
+	/* Histograms of stages times, keys are upper limits of buckets */
+	sub = ucl_object_typed_new (UCL_OBJECT);
+
+	for (i = 0; i < RSPAMD_TASK_TRACE_MAX; i++) {
+		hist = ucl_object_typed_new (UCL_OBJECT);
+
+		for (j = 0; j < RSPAMD_TASK_TRACE_BUCKETS; j++) {
+			ucl_object_insert_key (hist,
+				ucl_object_fromint (stat->stages_hist[i][j]),
+				rspamd_task_trace_bucket_name (j), 0, false);
+		}
+
+		ucl_object_insert_key (sub, hist, rspamd_task_trace_stage_name (i),
+			0, false);
+	}
+
+	ucl_object_insert_key (top, sub, "stages", 0, false);
 
 	ucl_object_insert_key (top,
 		ucl_object_fromint (mem_st.pools_allocated), "pools_allocated", 0,
@@ -2493,12 +2522,18 @@ rspamd_controller_handle_stat_common (
 	ucl_object_insert_key (top,
 		ucl_object_fromint (
 			mem_st.oversized_chunks), "chunks_oversized", 0, false);
+	ucl_object_insert_key (top,
+		ucl_object_fromint (mem_st.chunks_reused), "chunks_reused", 0, false);
 
 	if (do_reset) {
 		session->ctx->srv->stat->messages_scanned = 0;
 		session->ctx->srv->stat->messages_learned = 0;
 		session->ctx->srv->stat->connections_count = 0;
 		session->ctx->srv->stat->control_connections_count = 0;
+		session->ctx->srv->stat->dns_cache_hits = 0;
+		session->ctx->srv->stat->dns_cache_misses = 0;
+		memset (session->ctx->srv->stat->stages_hist, 0,
+				sizeof (session->ctx->srv->stat->stages_hist));
 		rspamd_mempool_stat_reset ();
 	}
 
@@ -2845,9 +2880,12 @@ rspamd_controller_accept_socket (gint fd, short what, void *arg)
 	}
 	/* Check for EAGAIN */
 	if (nfd == 0) {
+		worker->accept_wakeups ++;
 		return;
 	}
 
+	worker->accepted ++;
+
 	session = g_slice_alloc0 (sizeof (struct rspamd_controller_session));
 	session->pool = rspamd_mempool_new (rspamd_mempool_suggest_size (),
 			"csession");
@@ -3595,6 +3633,7 @@ start_controller_worker (struct rspamd_worker *worker)
 	ctx->resolver = dns_resolver_init (worker->srv->logger,
 			ctx->ev_base,
 			worker->srv->cfg);
+	ctx->resolver->stat = worker->srv->stat;
 
 	rspamd_upstreams_library_config (worker->srv->cfg, worker->srv->cfg->ups_ctx,
 			ctx->ev_base, ctx->resolver->r);
@@ -41,6 +41,9 @@
 #define DEFAULT_KEYPAIR_CACHE_SIZE 512
 #define DEFAULT_MASTER_TIMEOUT 10.0
 #define DEFAULT_UPDATES_MAXFAIL 3
+#define DEFAULT_IO_BATCH 1
+#define MAX_IO_BATCH 64
+#define MAX_DATAGRAM_SIZE 4096
 #define COOKIE_SIZE 128
 
 static const gchar *local_db_name = "local";
@@ -103,6 +106,14 @@ struct fuzzy_global_stat {
 	guint64 fuzzy_hashes_found[RSPAMD_FUZZY_EPOCH_MAX];
 	/**< amount of hashes found by epoch				*/
 	guint64 invalid_requests;
+	guint64 io_batches;
+	/**< number of batched receive calls				*/
+	guint64 io_batched_requests;
+	/**< number of requests received in batches			*/
+	guint64 io_reply_batches;
+	/**< number of batched send calls					*/
+	guint64 io_batched_replies;
+	/**< number of replies sent in batches				*/
 };
 
 struct fuzzy_key_stat {
@@ -159,6 +170,7 @@ struct rspamd_fuzzy_storage_ctx {
 	GQueue *updates_pending;
 	guint updates_failed;
 	guint updates_maxfail;
+	guint io_batch;
 	guint32 collection_id;
 	struct rspamd_dns_resolver *resolver;
 	struct rspamd_config *cfg;
@@ -171,13 +183,51 @@ enum fuzzy_cmd_type {
 	CMD_NORMAL,
 	CMD_SHINGLE,
 	CMD_ENCRYPTED_NORMAL,
-	CMD_ENCRYPTED_SHINGLE
+	CMD_ENCRYPTED_SHINGLE,
+	CMD_ENCRYPTED_MULTI
+};
+
+struct fuzzy_reply_slot {
+	struct sockaddr_storage addr;
+	socklen_t slen;
+	gsize len;
+	guchar data[sizeof (struct rspamd_fuzzy_encrypted_multi_reply)];
+};
+
+/*
+ * Replies for datagrams received within a single batch are accumulated
+ * here and flushed at once when the last session of the batch is done
+ */
+struct fuzzy_io_batch {
+	struct rspamd_fuzzy_storage_ctx *ctx;
+	struct fuzzy_reply_slot *replies;
+	guint nslots;
+	guint nreplies;
+	guint nsent;
+	gint fd;
+	struct event io;
+	ref_entry_t ref;
+};
+
+/*
+ * Commands of a multi request are processed as separate sessions, their
+ * replies are collected here and sent in a single datagram
+ */
+struct fuzzy_multi_request {
+	struct fuzzy_peer_cmd cmds[RSPAMD_FUZZY_MULTI_MAX];
+	struct rspamd_fuzzy_encrypted_multi_reply reply;
+	guint ncmds;
+	guint npending;
 };
 
 struct fuzzy_session {
 	struct rspamd_worker *worker;
 	rspamd_inet_addr_t *addr;
 	struct rspamd_fuzzy_storage_ctx *ctx;
+	struct fuzzy_io_batch *batch;
+	struct fuzzy_session *parent;
+	struct fuzzy_multi_request *multi;
+	guint idx;
 
 	union {
 		struct rspamd_fuzzy_encrypted_shingle_cmd enc_shingle;
@@ -224,6 +274,7 @@ struct fuzzy_master_update_session {
 };
 
 static void rspamd_fuzzy_write_reply (struct fuzzy_session *session);
+static void fuzzy_session_destroy (gpointer d);
 
 static gboolean
 rspamd_fuzzy_check_client (struct fuzzy_session *session)
@@ -592,6 +643,146 @@ rspamd_fuzzy_reply_io (gint fd, gshort what, gpointer d)
 	REF_RELEASE (session);
 }
 
+static gboolean
+rspamd_fuzzy_batch_flush (struct fuzzy_io_batch *batch)
+{
+	struct fuzzy_reply_slot *slot;
+	struct rspamd_fuzzy_storage_ctx *ctx = batch->ctx;
+#ifdef HAVE_SENDMMSG
+	struct mmsghdr msgs[MAX_IO_BATCH];
+	struct iovec iovs[MAX_IO_BATCH];
+	guint i, cnt;
+#endif
+	gint r;
+
+	while (batch->nsent < batch->nreplies) {
+#ifdef HAVE_SENDMMSG
+		cnt = MIN (batch->nreplies - batch->nsent, MAX_IO_BATCH);
+		memset (msgs, 0, sizeof (msgs[0]) * cnt);
+
+		for (i = 0; i < cnt; i ++) {
+			slot = &batch->replies[batch->nsent + i];
+			iovs[i].iov_base = slot->data;
+			iovs[i].iov_len = slot->len;
+			msgs[i].msg_hdr.msg_name = &slot->addr;
+			msgs[i].msg_hdr.msg_namelen = slot->slen;
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		r = sendmmsg (batch->fd, msgs, cnt, 0);
+#else
+		slot = &batch->replies[batch->nsent];
+		r = sendto (batch->fd, slot->data, slot->len, 0,
+				(struct sockaddr *)&slot->addr, slot->slen);
+
+		if (r != -1) {
+			r = 1;
+		}
+#endif
+
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			else if (errno == EWOULDBLOCK || errno == EAGAIN) {
+				return FALSE;
+			}
+
+			msg_err ("error while writing reply: %s", strerror (errno));
+			/* Skip the failed datagram and continue with the rest */
+			batch->nsent ++;
+		}
+		else {
+			ctx->stat.io_reply_batches ++;
+			ctx->stat.io_batched_replies += r;
+			batch->nsent += r;
+		}
+	}
+
+	return TRUE;
+}
+
+static void
+rspamd_fuzzy_batch_free (struct fuzzy_io_batch *batch)
+{
+	g_free (batch->replies);
+	g_slice_free1 (sizeof (*batch), batch);
+}
+
+static void
+rspamd_fuzzy_batch_io (gint fd, gshort what, gpointer d)
+{
+	struct fuzzy_io_batch *batch = d;
+
+	if (rspamd_fuzzy_batch_flush (batch)) {
+		rspamd_fuzzy_batch_free (batch);
+	}
+	else {
+		event_add (&batch->io, NULL);
+	}
+}
+
+static void
+fuzzy_io_batch_destroy (gpointer d)
+{
+	struct fuzzy_io_batch *batch = d;
+
+	if (rspamd_fuzzy_batch_flush (batch)) {
+		rspamd_fuzzy_batch_free (batch);
+	}
+	else {
+		/* Socket is full, wait for it to become writable */
+		event_set (&batch->io, batch->fd, EV_WRITE,
+				rspamd_fuzzy_batch_io, batch);
+		event_base_set (batch->ctx->ev_base, &batch->io);
+		event_add (&batch->io, NULL);
+	}
+}
+
+static struct fuzzy_io_batch *
+rspamd_fuzzy_batch_new (struct rspamd_fuzzy_storage_ctx *ctx, gint fd,
+		guint nslots)
+{
+	struct fuzzy_io_batch *batch;
+
+	batch = g_slice_alloc0 (sizeof (*batch));
+	batch->ctx = ctx;
+	batch->fd = fd;
+	batch->nslots = nslots;
+	batch->replies = g_malloc (sizeof (*batch->replies) * nslots);
+	REF_INIT_RETAIN (batch, fuzzy_io_batch_destroy);
+
+	return batch;
+}
+
+static gboolean
+rspamd_fuzzy_batch_add_reply (struct fuzzy_io_batch *batch,
+		gconstpointer data, gsize len, const rspamd_inet_addr_t *addr)
+{
+	struct fuzzy_reply_slot *slot;
+	const struct sockaddr *sa;
+	socklen_t slen;
+
+	if (batch->nreplies >= batch->nslots || len > sizeof (slot->data)) {
+		return FALSE;
+	}
+
+	sa = rspamd_inet_address_get_sa (addr, &slen);
+
+	if (slen > sizeof (slot->addr)) {
+		return FALSE;
+	}
+
+	slot = &batch->replies[batch->nreplies ++];
+	memcpy (&slot->addr, sa, slen);
+	slot->slen = slen;
+	memcpy (slot->data, data, len);
+	slot->len = len;
+
+	return TRUE;
+}
+
 static void
 rspamd_fuzzy_write_reply (struct fuzzy_session *session)
 {
@@ -599,7 +790,12 @@ rspamd_fuzzy_write_reply (struct fuzzy_session *session)
 	gsize len;
 	gconstpointer data;
 
-	if (session->cmd_type == CMD_ENCRYPTED_NORMAL ||
+	if (session->cmd_type == CMD_ENCRYPTED_MULTI) {
+		data = &session->multi->reply;
+		len = sizeof (session->multi->reply.hdr) +
+				sizeof (session->multi->reply.rep[0]) * session->multi->ncmds;
+	}
+	else if (session->cmd_type == CMD_ENCRYPTED_NORMAL ||
 				session->cmd_type == CMD_ENCRYPTED_SHINGLE) {
 		/* Encrypted reply */
 		data = &session->reply;
@@ -610,6 +806,12 @@ rspamd_fuzzy_write_reply (struct fuzzy_session *session)
 		len = sizeof (session->reply.rep);
 	}
 
+	if (session->batch && rspamd_fuzzy_batch_add_reply (session->batch,
+			data, len, session->addr)) {
+		/* Reply is sent when the whole batch is processed */
+		return;
+	}
+
 	r = rspamd_inet_address_sendto (session->fd, data, len, 0,
 			session->addr);
 
@@ -705,6 +907,28 @@ rspamd_fuzzy_update_stats (struct rspamd_fuzzy_storage_ctx *ctx,
 	}
 }
 
+static void
+rspamd_fuzzy_multi_add_reply (struct fuzzy_session *session)
+{
+	struct fuzzy_session *parent = session->parent;
+	struct fuzzy_multi_request *multi = parent->multi;
+
+	memcpy (&multi->reply.rep[session->idx], &session->reply.rep,
+			sizeof (multi->reply.rep[0]));
+
+	if (--multi->npending == 0) {
+		ottery_rand_bytes (multi->reply.hdr.nonce,
+				sizeof (multi->reply.hdr.nonce));
+		rspamd_cryptobox_encrypt_nm_inplace ((guchar *)multi->reply.rep,
+				sizeof (multi->reply.rep[0]) * multi->ncmds,
+				multi->reply.hdr.nonce,
+				parent->nm,
+				multi->reply.hdr.mac,
+				RSPAMD_CRYPTOBOX_MODE_25519);
+		rspamd_fuzzy_write_reply (parent);
+	}
+}
+
 static void
 rspamd_fuzzy_make_reply (struct rspamd_fuzzy_cmd *cmd,
 		struct rspamd_fuzzy_reply *result,
@@ -725,6 +949,11 @@ rspamd_fuzzy_make_reply (struct rspamd_fuzzy_cmd *cmd,
 				cmd->cmd,
 				result->value);
 
+		if (session->parent) {
+			rspamd_fuzzy_multi_add_reply (session);
+			return;
+		}
+
 		if (encrypted) {
 			/* We need also to encrypt reply */
 			ottery_rand_bytes (session->reply.hdr.nonce,
@@ -770,6 +999,9 @@ rspamd_fuzzy_check_callback (struct rspamd_fuzzy_reply *result, void *ud)
 		encrypted = TRUE;
 		is_shingle = TRUE;
 		break;
+	case CMD_ENCRYPTED_MULTI:
+		/* Commands are processed by the child sessions */
+		break;
 	}
 
 	rspamd_fuzzy_make_reply (cmd, result, session, encrypted, is_shingle);
@@ -810,6 +1042,9 @@ rspamd_fuzzy_process_command (struct fuzzy_session *session)
 		encrypted = TRUE;
 		is_shingle = TRUE;
 		break;
+	case CMD_ENCRYPTED_MULTI:
+		/* Commands are processed by the child sessions */
+		break;
 	}
 
 	if (G_UNLIKELY (cmd == NULL || up_len == 0)) {
@@ -909,6 +1144,47 @@ rspamd_fuzzy_process_command (struct fuzzy_session *session)
 	}
 }
 
+static void
+rspamd_fuzzy_process_multi (struct fuzzy_session *session)
+{
+	struct fuzzy_multi_request *multi = session->multi;
+	struct fuzzy_session *child;
+	struct fuzzy_peer_cmd *pcmd;
+	guint i;
+
+	multi->npending = multi->ncmds;
+
+	for (i = 0; i < multi->ncmds; i ++) {
+		pcmd = &multi->cmds[i];
+		session->worker->nconns++;
+		child = g_slice_alloc0 (sizeof (*child));
+		REF_INIT_RETAIN (child, fuzzy_session_destroy);
+		child->worker = session->worker;
+		child->fd = session->fd;
+		child->ctx = session->ctx;
+		child->time = session->time;
+		child->addr = rspamd_inet_address_copy (session->addr);
+		child->key_stat = session->key_stat;
+		child->epoch = session->epoch;
+		child->idx = i;
+		REF_RETAIN (session);
+		child->parent = session;
+
+		if (pcmd->is_shingle) {
+			child->cmd_type = CMD_ENCRYPTED_SHINGLE;
+			memcpy (&child->cmd.enc_shingle.cmd, &pcmd->cmd.shingle,
+					sizeof (child->cmd.enc_shingle.cmd));
+		}
+		else {
+			child->cmd_type = CMD_ENCRYPTED_NORMAL;
+			memcpy (&child->cmd.enc_normal.cmd, &pcmd->cmd.normal,
+					sizeof (child->cmd.enc_normal.cmd));
+		}
+
+		rspamd_fuzzy_process_command (child);
+		REF_RELEASE (child);
+	}
+}
 
 static enum rspamd_fuzzy_epoch
 rspamd_fuzzy_command_valid (struct rspamd_fuzzy_cmd *cmd, gint r)
@@ -950,32 +1226,28 @@ rspamd_fuzzy_command_valid (struct rspamd_fuzzy_cmd *cmd, gint r)
 }
 
 static gboolean
-rspamd_fuzzy_decrypt_command (struct fuzzy_session *s)
+rspamd_fuzzy_decrypt_command (struct fuzzy_session *s,
+		struct rspamd_fuzzy_encrypted_req_hdr *hdr,
+		guchar *payload, gsize payload_len)
 {
-	struct rspamd_fuzzy_encrypted_req_hdr *hdr;
-	guchar *payload;
-	gsize payload_len;
 	struct rspamd_cryptobox_pubkey *rk;
 	struct fuzzy_key *key;
+	const guchar *magic;
 
 	if (s->ctx->default_key == NULL) {
 		msg_warn ("received encrypted request when encryption is not enabled");
 		return FALSE;
 	}
 
-	if (s->cmd_type == CMD_ENCRYPTED_NORMAL) {
-		hdr = &s->cmd.enc_normal.hdr;
-		payload = (guchar *)&s->cmd.enc_normal.cmd;
-		payload_len = sizeof (s->cmd.enc_normal.cmd);
+	if (s->cmd_type == CMD_ENCRYPTED_MULTI) {
+		magic = fuzzy_encrypted_multi_magic;
 	}
 	else {
-		hdr = &s->cmd.enc_shingle.hdr;
-		payload = (guchar *) &s->cmd.enc_shingle.cmd;
-		payload_len = sizeof (s->cmd.enc_shingle.cmd);
+		magic = fuzzy_encrypted_magic;
 	}
 
 	/* Compare magic */
-	if (memcmp (hdr->magic, fuzzy_encrypted_magic, sizeof (hdr->magic)) != 0) {
+	if (memcmp (hdr->magic, magic, sizeof (hdr->magic)) != 0) {
 		msg_debug ("invalid magic for the encrypted packet");
 		return FALSE;
 	}
@@ -1017,11 +1289,88 @@ rspamd_fuzzy_decrypt_command (struct fuzzy_session *s)
 	return TRUE;
 }
 
+static gboolean
+rspamd_fuzzy_multi_from_wire (guchar *buf, guint buflen, struct fuzzy_session *s)
+{
+	struct rspamd_fuzzy_encrypted_req_hdr *hdr;
+	struct rspamd_fuzzy_multi_hdr mhdr;
+	struct rspamd_fuzzy_cmd *cmd;
+	struct fuzzy_peer_cmd *pcmd;
+	guchar *p;
+	gsize remain, cmdlen;
+	guint i;
+
+	s->cmd_type = CMD_ENCRYPTED_MULTI;
+	hdr = (struct rspamd_fuzzy_encrypted_req_hdr *)buf;
+	p = buf + sizeof (*hdr);
+	remain = buflen - sizeof (*hdr);
+
+	/* Payload is decrypted in place */
+	if (!rspamd_fuzzy_decrypt_command (s, hdr, p, remain)) {
+		return FALSE;
+	}
+
+	memcpy (&mhdr, p, sizeof (mhdr));
+	p += sizeof (mhdr);
+	remain -= sizeof (mhdr);
+
+	if (mhdr.version != RSPAMD_FUZZY_VERSION || mhdr.ncmds == 0 ||
+			mhdr.ncmds > RSPAMD_FUZZY_MULTI_MAX) {
+		msg_debug ("invalid multi command header: version %d, %d commands",
+				(gint)mhdr.version, (gint)mhdr.ncmds);
+		return FALSE;
+	}
+
+	s->multi = g_slice_alloc0 (sizeof (*s->multi));
+
+	for (i = 0; i < mhdr.ncmds; i ++) {
+		if (remain < sizeof (*cmd)) {
+			msg_debug ("short multi command: %uz bytes left for command %d",
+					remain, i);
+			return FALSE;
+		}
+
+		pcmd = &s->multi->cmds[i];
+		cmd = (struct rspamd_fuzzy_cmd *)p;
+		cmdlen = cmd->shingles_count > 0 ?
+				sizeof (pcmd->cmd.shingle) : sizeof (pcmd->cmd.normal);
+
+		if (remain < cmdlen ||
+				rspamd_fuzzy_command_valid (cmd, cmdlen) !=
+						RSPAMD_FUZZY_EPOCH10) {
+			msg_debug ("invalid command %d in multi request", i);
+			return FALSE;
+		}
+
+		pcmd->is_shingle = cmd->shingles_count > 0;
+		memcpy (&pcmd->cmd, p, cmdlen);
+		p += cmdlen;
+		remain -= cmdlen;
+	}
+
+	if (remain != 0) {
+		msg_debug ("garbage after multi command: %uz bytes", remain);
+		return FALSE;
+	}
+
+	s->multi->ncmds = mhdr.ncmds;
+	s->epoch = RSPAMD_FUZZY_EPOCH11;
+
+	return TRUE;
+}
+
 static gboolean
 rspamd_fuzzy_cmd_from_wire (guchar *buf, guint buflen, struct fuzzy_session *s)
 {
 	enum rspamd_fuzzy_epoch epoch;
 
+	if (buflen >= sizeof (struct rspamd_fuzzy_encrypted_req_hdr) +
+			sizeof (struct rspamd_fuzzy_multi_hdr) &&
+			memcmp (buf, fuzzy_encrypted_multi_magic,
+					sizeof (fuzzy_encrypted_multi_magic)) == 0) {
+		return rspamd_fuzzy_multi_from_wire (buf, buflen, s);
+	}
+
 	/* For now, we assume that recvfrom returns a complete datagramm */
 	switch (buflen) {
 	case sizeof (struct rspamd_fuzzy_cmd):
@@ -1050,7 +1399,9 @@ rspamd_fuzzy_cmd_from_wire (guchar *buf, guint buflen, struct fuzzy_session *s)
 		s->cmd_type = CMD_ENCRYPTED_NORMAL;
 		memcpy (&s->cmd.enc_normal, buf, sizeof (s->cmd.enc_normal));
 
-		if (!rspamd_fuzzy_decrypt_command (s)) {
+		if (!rspamd_fuzzy_decrypt_command (s, &s->cmd.enc_normal.hdr,
+				(guchar *)&s->cmd.enc_normal.cmd,
+				sizeof (s->cmd.enc_normal.cmd))) {
 			return FALSE;
 		}
 		epoch = rspamd_fuzzy_command_valid (&s->cmd.enc_normal.cmd,
@@ -1067,7 +1418,9 @@ rspamd_fuzzy_cmd_from_wire (guchar *buf, guint buflen, struct fuzzy_session *s)
 		s->cmd_type = CMD_ENCRYPTED_SHINGLE;
 		memcpy (&s->cmd.enc_shingle, buf, sizeof (s->cmd.enc_shingle));
 
-		if (!rspamd_fuzzy_decrypt_command (s)) {
+		if (!rspamd_fuzzy_decrypt_command (s, &s->cmd.enc_shingle.hdr,
+				(guchar *)&s->cmd.enc_shingle.cmd,
+				sizeof (s->cmd.enc_shingle.cmd))) {
 			return FALSE;
 		}
 		epoch = rspamd_fuzzy_command_valid (&s->cmd.enc_shingle.cmd.basic,
@@ -1257,6 +1610,19 @@ fuzzy_session_destroy (gpointer d)
 	rspamd_inet_address_destroy (session->addr);
 	rspamd_explicit_memzero (session->nm, sizeof (session->nm));
 	session->worker->nconns--;
+
+	if (session->batch) {
+		REF_RELEASE (session->batch);
+	}
+
+	if (session->multi) {
+		g_slice_free1 (sizeof (*session->multi), session->multi);
+	}
+
+	if (session->parent) {
+		REF_RELEASE (session->parent);
+	}
+
 	g_slice_free1 (sizeof (*session), session);
 }
 
@@ -1762,6 +2128,139 @@ accept_fuzzy_mirror_socket (gint fd, short what, void *arg)
 			ctx->ev_base);
 }
 
+static void
+rspamd_fuzzy_process_datagram (struct rspamd_worker *worker, gint fd,
+		guchar *buf, gssize r, rspamd_inet_addr_t *addr,
+		struct fuzzy_io_batch *batch)
+{
+	struct fuzzy_session *session;
+	guint64 *nerrors;
+
+	worker->nconns++;
+	session = g_slice_alloc0 (sizeof (*session));
+	REF_INIT_RETAIN (session, fuzzy_session_destroy);
+	session->worker = worker;
+	session->fd = fd;
+	session->ctx = worker->ctx;
+	session->time = (guint64) time (NULL);
+	session->addr = addr;
+
+	if (batch) {
+		REF_RETAIN (batch);
+		session->batch = batch;
+	}
+
+	if (rspamd_fuzzy_cmd_from_wire (buf, r, session)) {
+		if (session->cmd_type == CMD_ENCRYPTED_MULTI) {
+			rspamd_fuzzy_process_multi (session);
+		}
+		else {
+			rspamd_fuzzy_process_command (session);
+		}
+	}
+	else {
+		/* Discard input */
+		session->ctx->stat.invalid_requests ++;
+		msg_debug ("invalid fuzzy command of size %z received", r);
+
+		nerrors = rspamd_lru_hash_lookup (session->ctx->errors_ips,
+				addr, -1);
+
+		if (nerrors == NULL) {
+			nerrors = g_malloc (sizeof (*nerrors));
+			*nerrors = 1;
+			rspamd_lru_hash_insert (session->ctx->errors_ips,
+					rspamd_inet_address_copy (addr),
+					nerrors, -1, -1);
+		}
+		else {
+			*nerrors = *nerrors + 1;
+		}
+	}
+
+	REF_RELEASE (session);
+}
+
+#ifdef HAVE_RECVMMSG
+/*
+ * Read up to `io_batch` datagrams per syscall, replies are collected in
+ * the batch and sent with a single sendmmsg call (if available)
+ */
+static void
+rspamd_fuzzy_recv_batch (gint fd, struct rspamd_worker *worker,
+		struct rspamd_fuzzy_storage_ctx *ctx)
+{
+	struct mmsghdr msgs[MAX_IO_BATCH];
+	struct iovec iovs[MAX_IO_BATCH];
+	struct sockaddr_storage addrs[MAX_IO_BATCH];
+	/* Too large for the stack, datagrams are processed before the next call */
+	static guint8 bufs[MAX_IO_BATCH][MAX_DATAGRAM_SIZE];
+	struct fuzzy_io_batch *batch;
+	rspamd_inet_addr_t *addr;
+	guint i, nbatch;
+	gint r;
+
+	nbatch = MIN (ctx->io_batch, MAX_IO_BATCH);
+
+	for (;;) {
+		memset (msgs, 0, sizeof (msgs[0]) * nbatch);
+
+		for (i = 0; i < nbatch; i ++) {
+			iovs[i].iov_base = bufs[i];
+			iovs[i].iov_len = sizeof (bufs[i]);
+			msgs[i].msg_hdr.msg_name = &addrs[i];
+			msgs[i].msg_hdr.msg_namelen = sizeof (addrs[i]);
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+		}
+
+		r = recvmmsg (fd, msgs, nbatch, MSG_DONTWAIT, NULL);
+
+		if (r == -1) {
+			if (errno == EINTR) {
+				continue;
+			}
+			else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+
+				return;
+			}
+
+			msg_err ("got error while reading from socket: %d, %s",
+					errno,
+					strerror (errno));
+			return;
+		}
+		else if (r == 0) {
+			return;
+		}
+
+		ctx->stat.io_batches ++;
+		ctx->stat.io_batched_requests += r;
+		batch = rspamd_fuzzy_batch_new (ctx, fd, r);
+
+		for (i = 0; i < (guint)r; i ++) {
+			if (msgs[i].msg_hdr.msg_namelen < sizeof (struct sockaddr)) {
+				continue;
+			}
+
+			addr = rspamd_inet_address_from_sa (
+					(const struct sockaddr *)&addrs[i],
+					msgs[i].msg_hdr.msg_namelen);
+			rspamd_fuzzy_process_datagram (worker, fd, bufs[i],
+					msgs[i].msg_len, addr, batch);
+		}
+
+		/* Replies are flushed here unless some checks are still pending */
+		REF_RELEASE (batch);
+
+		if ((guint)r < nbatch) {
+			/* Socket is drained */
+			return;
+		}
+	}
+}
+#endif
+
 /*
  * Accept new connection and construct task
  */
@@ -1769,18 +2268,23 @@ static void
 accept_fuzzy_socket (gint fd, short what, void *arg)
 {
 	struct rspamd_worker *worker = (struct rspamd_worker *)arg;
-	struct fuzzy_session *session;
 	rspamd_inet_addr_t *addr;
 	gssize r;
-	guint8 buf[512];
-	guint64 *nerrors;
+	guint8 buf[MAX_DATAGRAM_SIZE];
 
 	/* Got some data */
 	if (what == EV_READ) {
+#ifdef HAVE_RECVMMSG
+		struct rspamd_fuzzy_storage_ctx *ctx = worker->ctx;
 
-		for (;;) {
-			worker->nconns++;
+		if (ctx->io_batch > 1) {
+			rspamd_fuzzy_recv_batch (fd, worker, ctx);
 
+			return;
+		}
+#endif
+
+		for (;;) {
 			r = rspamd_inet_address_recvfrom (fd,
 					buf,
 					sizeof (buf),
@@ -1802,39 +2306,7 @@ accept_fuzzy_socket (gint fd, short what, void *arg)
 				return;
 			}
 
-			session = g_slice_alloc0 (sizeof (*session));
-			REF_INIT_RETAIN (session, fuzzy_session_destroy);
-			session->worker = worker;
-			session->fd = fd;
-			session->ctx = worker->ctx;
-			session->time = (guint64) time (NULL);
-			session->addr = addr;
-
-			if (rspamd_fuzzy_cmd_from_wire (buf, r, session)) {
-				/* Check shingles count sanity */
-				rspamd_fuzzy_process_command (session);
-			}
-			else {
-				/* Discard input */
-				session->ctx->stat.invalid_requests ++;
-				msg_debug ("invalid fuzzy command of size %z received", r);
-
-				nerrors = rspamd_lru_hash_lookup (session->ctx->errors_ips,
-						addr, -1);
-
-				if (nerrors == NULL) {
-					nerrors = g_malloc (sizeof (*nerrors));
-					*nerrors = 1;
-					rspamd_lru_hash_insert (session->ctx->errors_ips,
-							rspamd_inet_address_copy (addr),
-							nerrors, -1, -1);
-				}
-				else {
-					*nerrors = *nerrors + 1;
-				}
-			}
-
-			REF_RELEASE (session);
+			rspamd_fuzzy_process_datagram (worker, fd, buf, r, addr, NULL);
 		}
 	}
 }
@@ -2012,6 +2484,26 @@ rspamd_fuzzy_stat_to_ucl (struct rspamd_fuzzy_storage_ctx *ctx, gboolean ip_stat
 			"invalid_requests",
 			0,
 			false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (ctx->stat.io_batches),
+			"io_batches",
+			0,
+			false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (ctx->stat.io_batched_requests),
+			"io_batched_requests",
+			0,
+			false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (ctx->stat.io_reply_batches),
+			"io_reply_batches",
+			0,
+			false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (ctx->stat.io_batched_replies),
+			"io_batched_replies",
+			0,
+			false);
 
 	if (ctx->errors_ips && ip_stat) {
 		ip_hash = rspamd_lru_hash_get_htable (ctx->errors_ips);
@@ -2380,6 +2872,7 @@ init_fuzzy (struct rspamd_config *cfg)
 	rspamd_mempool_add_destructor (cfg->cfg_pool,
 			(rspamd_mempool_destruct_t)rspamd_ptr_array_free_hard, ctx->mirrors);
 	ctx->updates_maxfail = DEFAULT_UPDATES_MAXFAIL;
+	ctx->io_batch = DEFAULT_IO_BATCH;
 	ctx->collection_id_file = RSPAMD_DBDIR "/fuzzy_collection.id";
 
 	rspamd_rcl_register_worker_option (cfg,
@@ -2548,6 +3041,17 @@ init_fuzzy (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_fuzzy_storage_ctx, updates_maxfail),
 			RSPAMD_CL_FLAG_UINT,
 			"Maximum number of updates to be failed before discarding");
+	rspamd_rcl_register_worker_option (cfg,
+			type,
+			"io_batch",
+			rspamd_rcl_parse_struct_integer,
+			ctx,
+			G_STRUCT_OFFSET (struct rspamd_fuzzy_storage_ctx, io_batch),
+			RSPAMD_CL_FLAG_UINT,
+			"Number of datagrams to read and reply with a single syscall "
+			"(requires recvmmsg), default: "
+			G_STRINGIFY (DEFAULT_IO_BATCH) ", maximum: "
+			G_STRINGIFY (MAX_IO_BATCH));
 	rspamd_rcl_register_worker_option (cfg,
 			type,
 			"collection_only",
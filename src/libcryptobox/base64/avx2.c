@@ -0,0 +1,161 @@
+/*-
+Copyright (c) 2013-2015, Alfred Klomp
+Copyright (c) 2016, Vsevolod Stakhov
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are
+met:
+
+- Redistributions of source code must retain the above copyright notice,
+  this list of conditions and the following disclaimer.
+
+- Redistributions in binary form must reproduce the above copyright
+  notice, this list of conditions and the following disclaimer in the
+  documentation and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "config.h"
+#include "platform_config.h"
+
+#ifdef HAVE_AVX2_INTRINSICS
+#include <immintrin.h>
+
+void base64_encode_ref (const unsigned char *in, size_t inlen,
+		char *out, size_t *outlen);
+
+static inline __m256i __attribute__((__target__("avx2")))
+dec_reshuffle (__m256i in)
+{
+	/* Merge 6-bit values into 24-bit groups and pack them */
+	const __m256i merge_ab_and_bc = _mm256_maddubs_epi16 (in,
+			_mm256_set1_epi32 (0x01400140));
+	__m256i out = _mm256_madd_epi16 (merge_ab_and_bc,
+			_mm256_set1_epi32 (0x00011000));
+
+	out = _mm256_shuffle_epi8 (out, _mm256_setr_epi8 (
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+			2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+	/* Pack 12 bytes from each lane together */
+	return _mm256_permutevar8x32_epi32 (out,
+			_mm256_setr_epi32 (0, 1, 2, 4, 5, 6, -1, -1));
+}
+
+#define BASE64_DECODE_FAST_LOOP do { \
+	const __m256i lut_lo = _mm256_setr_epi8 ( \
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A, \
+			0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+			0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A); \
+	const __m256i lut_hi = _mm256_setr_epi8 ( \
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, \
+			0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+			0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10); \
+	const __m256i lut_roll = _mm256_setr_epi8 ( \
+			0, 16, 19, 4, -65, -65, -71, -71, \
+			0, 0, 0, 0, 0, 0, 0, 0, \
+			0, 16, 19, 4, -65, -65, -71, -71, \
+			0, 0, 0, 0, 0, 0, 0, 0); \
+	const __m256i mask_2F = _mm256_set1_epi8 (0x2f); \
+	/* Store writes 32 bytes, so keep enough input for 8 extra bytes */ \
+	while (inlen >= 45) { \
+		__m256i str, hi_nibbles, lo_nibbles, hi, lo, eq_2F, roll; \
+		str = _mm256_loadu_si256 ((const __m256i *)c); \
+		hi_nibbles = _mm256_and_si256 (_mm256_srli_epi32 (str, 4), mask_2F); \
+		lo_nibbles = _mm256_and_si256 (str, mask_2F); \
+		hi = _mm256_shuffle_epi8 (lut_hi, hi_nibbles); \
+		lo = _mm256_shuffle_epi8 (lut_lo, lo_nibbles); \
+		/* Invalid characters are handled by the generic code */ \
+		if (!_mm256_testz_si256 (lo, hi)) { \
+			break; \
+		} \
+		eq_2F = _mm256_cmpeq_epi8 (str, mask_2F); \
+		roll = _mm256_shuffle_epi8 (lut_roll, \
+				_mm256_add_epi8 (eq_2F, hi_nibbles)); \
+		str = dec_reshuffle (_mm256_add_epi8 (str, roll)); \
+		_mm256_storeu_si256 ((__m256i *)o, str); \
+		c += 32; \
+		o += 24; \
+		outl += 24; \
+		inlen -= 32; \
+	} \
+} while (0)
+
+#define BASE64_DECODE_FUNC base64_decode_avx2
+#define BASE64_DECODE_ATTR __attribute__((__target__("avx2")))
+
+#include "decode_template.h"
+
+static inline __m256i __attribute__((__target__("avx2")))
+enc_reshuffle (__m256i in)
+{
+	__m256i t0, t1, t2, t3;
+
+	/* Spread each 3 input bytes to 4 bytes: b a c b */
+	in = _mm256_shuffle_epi8 (in, _mm256_set_epi8 (
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1,
+			10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+	/* Move 6-bit groups to the separate bytes */
+	t0 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x0FC0FC00));
+	t1 = _mm256_mulhi_epu16 (t0, _mm256_set1_epi32 (0x04000040));
+	t2 = _mm256_and_si256 (in, _mm256_set1_epi32 (0x003F03F0));
+	t3 = _mm256_mullo_epi16 (t2, _mm256_set1_epi32 (0x01000010));
+
+	return _mm256_or_si256 (t1, t3);
+}
+
+static inline __m256i __attribute__((__target__("avx2")))
+enc_translate (__m256i in)
+{
+	/* Offsets for ranges: A-Z, a-z, 0-9, '+' and '/' */
+	const __m256i lut = _mm256_setr_epi8 (
+			65, 71, -4, -4, -4, -4, -4, -4,
+			-4, -4, -4, -4, -19, -16, 0, 0,
+			65, 71, -4, -4, -4, -4, -4, -4,
+			-4, -4, -4, -4, -19, -16, 0, 0);
+	__m256i indices, mask;
+
+	indices = _mm256_subs_epu8 (in, _mm256_set1_epi8 (51));
+	mask = _mm256_cmpgt_epi8 (in, _mm256_set1_epi8 (25));
+	indices = _mm256_sub_epi8 (indices, mask);
+
+	return _mm256_add_epi8 (in, _mm256_shuffle_epi8 (lut, indices));
+}
+
+void __attribute__((__target__("avx2")))
+base64_encode_avx2 (const unsigned char *in, size_t inlen,
+		char *out, size_t *outlen)
+{
+	char *o = out;
+	size_t tail;
+	__m256i str;
+
+	/* Each lane loads 16 bytes but uses only 12 of them */
+	while (inlen >= 28) {
+		str = _mm256_inserti128_si256 (
+				_mm256_castsi128_si256 (_mm_loadu_si128 ((const __m128i *)in)),
+				_mm_loadu_si128 ((const __m128i *)(in + 12)), 1);
+		str = enc_translate (enc_reshuffle (str));
+		_mm256_storeu_si256 ((__m256i *)o, str);
+		in += 24;
+		o += 32;
+		inlen -= 24;
+	}
+
+	base64_encode_ref (in, inlen, o, &tail);
+	*outlen = (o - out) + tail;
+}
+#endif
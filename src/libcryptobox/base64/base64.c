@@ -18,8 +18,17 @@
 #include "cryptobox.h"
 #include "base64.h"
 #include "platform_config.h"
+#include "ottery.h"
+#include "util.h"
+#include "logger.h"
 
 extern unsigned long cpu_config;
+const char
+base64_table_enc[] =
+	"ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+	"abcdefghijklmnopqrstuvwxyz"
+	"0123456789+/";
+
 const uint8_t
 base64_table_dec[256] =
 {
@@ -47,22 +56,70 @@ typedef struct base64_impl {
 
 	int (*decode) (const char *in, size_t inlen,
 			unsigned char *out, size_t *outlen);
+	void (*encode) (const unsigned char *in, size_t inlen,
+			char *out, size_t *outlen);
 } base64_impl_t;
 
 #define BASE64_DECLARE(ext) \
-    int base64_decode_##ext(const char *in, size_t inlen, unsigned char *out, size_t *outlen);
+    int base64_decode_##ext(const char *in, size_t inlen, unsigned char *out, size_t *outlen); \
+    void base64_encode_##ext(const unsigned char *in, size_t inlen, char *out, size_t *outlen);
 #define BASE64_IMPL(cpuflags, desc, ext) \
-    {(cpuflags), desc, base64_decode_##ext}
+    {(cpuflags), desc, base64_decode_##ext, base64_encode_##ext}
 
 BASE64_DECLARE(ref);
 #define BASE64_REF BASE64_IMPL(0, "ref", ref)
 
+#ifdef HAVE_AVX2_INTRINSICS
+BASE64_DECLARE(avx2);
+#define BASE64_AVX2 BASE64_IMPL(CPUID_AVX2, "avx2", avx2)
+#endif
+#ifdef HAVE_SSSE3_INTRINSICS
+BASE64_DECLARE(ssse3);
+#define BASE64_SSSE3 BASE64_IMPL(CPUID_SSSE3, "ssse3", ssse3)
+#endif
+
+/* list implemenations from most optimized to least, with generic as the first entry */
 static const base64_impl_t base64_list[] = {
 		BASE64_REF,
+#ifdef BASE64_AVX2
+		BASE64_AVX2,
+#endif
+#ifdef BASE64_SSSE3
+		BASE64_SSSE3,
+#endif
 };
 
 static const base64_impl_t *base64_opt = &base64_list[0];
 
+static gboolean
+base64_test_impl (const base64_impl_t *impl)
+{
+	static const gchar in[] = "Zm9vYmFyIGJhc2U2NCBkZWNvZGluZyB0ZXN0IHN0cmluZyB0aGF0IGlz"
+			"IGxvbmcgZW5vdWdoIGZvciB2ZWN0b3IgY29kZSArLw==";
+	static const gchar expected[] = "foobar base64 decoding test string that is "
+			"long enough for vector code +/";
+	guchar out[sizeof (in)];
+	gchar enc[sizeof (in)];
+	gsize outlen, enclen;
+
+	if (!impl->decode (in, sizeof (in) - 1, out, &outlen)) {
+		return FALSE;
+	}
+
+	if (outlen != sizeof (expected) - 1 ||
+			memcmp (out, expected, outlen) != 0) {
+		return FALSE;
+	}
+
+	impl->encode (out, outlen, enc, &enclen);
+
+	if (enclen != sizeof (in) - 1 || memcmp (enc, in, enclen) != 0) {
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 const char *
 base64_load (void)
 {
@@ -71,13 +128,18 @@ base64_load (void)
 	if (cpu_config != 0) {
 		for (i = 0; i < G_N_ELEMENTS (base64_list); i++) {
 			if (base64_list[i].cpu_flags & cpu_config) {
-				base64_opt = &base64_list[i];
-				break;
+				if (base64_test_impl (&base64_list[i])) {
+					base64_opt = &base64_list[i];
+					break;
+				}
+
+				/* Try less optimized implementations before the generic one */
+				msg_err ("base64 %s implementation has failed self test, "
+						"disable it", base64_list[i].desc);
 			}
 		}
 	}
 
-
 	return base64_opt->desc;
 }
 
@@ -87,3 +149,82 @@ rspamd_cryptobox_base64_decode (const gchar *in, gsize inlen,
 {
 	return base64_opt->decode (in, inlen, out, outlen);
 }
+
+void
+rspamd_cryptobox_base64_encode (const guchar *in, gsize inlen,
+		gchar *out, gsize *outlen)
+{
+	base64_opt->encode (in, inlen, out, outlen);
+}
+
+double
+base64_test (gboolean generic, gsize niters, gsize len, gboolean decode)
+{
+	guchar *in, *tmp;
+	gchar *enc;
+	gsize outlen, enclen, cycles;
+	const base64_impl_t *impl;
+	double t1, t2;
+
+	g_assert (len > 0);
+	in = g_malloc (len);
+	tmp = g_malloc (len + 16);
+	enc = g_malloc (len / 3 * 4 + 8);
+	ottery_rand_bytes (in, len);
+
+	impl = generic ? &base64_list[0] : base64_opt;
+	impl->encode (in, len, enc, &enclen);
+
+	t1 = rspamd_get_ticks ();
+
+	for (cycles = 0; cycles < niters; cycles ++) {
+		if (decode) {
+			g_assert (impl->decode (enc, enclen, tmp, &outlen));
+		}
+		else {
+			impl->encode (in, len, enc, &enclen);
+		}
+	}
+
+	t2 = rspamd_get_ticks ();
+
+	g_assert (base64_list[0].decode (enc, enclen, tmp, &outlen));
+	g_assert (outlen == len && memcmp (in, tmp, len) == 0);
+
+	g_free (in);
+	g_free (tmp);
+	g_free (enc);
+
+	return t2 - t1;
+}
+
+guint
+base64_test_decode (const gchar *in, gsize inlen)
+{
+	guchar *out, *ref_out;
+	gsize outlen, ref_outlen;
+	gint ret, ref_ret;
+	guint i, nchecked = 0;
+
+	/* Vector code might store the whole register after the decoded data */
+	out = g_malloc (inlen + 32);
+	ref_out = g_malloc (inlen + 32);
+	ref_ret = base64_list[0].decode (in, inlen, ref_out, &ref_outlen);
+
+	for (i = 1; i < G_N_ELEMENTS (base64_list); i ++) {
+		if (!(base64_list[i].cpu_flags & cpu_config)) {
+			continue;
+		}
+
+		ret = base64_list[i].decode (in, inlen, out, &outlen);
+		g_assert_cmpint (ret, ==, ref_ret);
+		g_assert_cmpuint (outlen, ==, ref_outlen);
+		g_assert (memcmp (out, ref_out, outlen) == 0);
+		nchecked ++;
+	}
+
+	g_free (out);
+	g_free (ref_out);
+
+	return nchecked;
+}
@@ -20,4 +20,23 @@
 
 const char* base64_load (void);
 
+/**
+ * Benchmark base64 implementation
+ * @param generic use generic implementation instead of the platform optimized one
+ * @param niters number of iterations
+ * @param len length of random data to encode
+ * @param decode benchmark decoding instead of encoding
+ * @return time spent in seconds
+ */
+double base64_test (gboolean generic, gsize niters, gsize len, gboolean decode);
+
+/**
+ * Decode input by every implementation supported by CPU and check that
+ * results are the same as the generic implementation returns
+ * @param in base64 input that might be invalid
+ * @param inlen length of input
+ * @return number of implementations compared with the generic one
+ */
+guint base64_test_decode (const gchar *in, gsize inlen);
+
 #endif /* SRC_LIBCRYPTOBOX_BASE64_BASE64_H_ */
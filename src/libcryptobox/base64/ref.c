@@ -29,194 +29,49 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "config.h"
 
-extern const uint8_t base64_table_dec[256];
+#define BASE64_DECODE_FUNC base64_decode_ref
+#define BASE64_DECODE_ATTR
+#define BASE64_DECODE_FAST_LOOP do {} while (0)
 
-#define INNER_LOOP_64 do { \
-	while (inlen >= 13) { \
-		uint64_t str, res, dec; \
-		str = *(uint64_t *)c; \
-		str = GUINT64_TO_BE(str); \
-		if ((dec = base64_table_dec[str >> 56]) > 63) { \
-			break; \
-		} \
-		res = dec << 58; \
-		if ((dec = base64_table_dec[(str >> 48) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 52; \
-		if ((dec = base64_table_dec[(str >> 40) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 46; \
-		if ((dec = base64_table_dec[(str >> 32) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 40; \
-		if ((dec = base64_table_dec[(str >> 24) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 34; \
-		if ((dec = base64_table_dec[(str >> 16) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 28; \
-		if ((dec = base64_table_dec[(str >> 8) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 22; \
-		if ((dec = base64_table_dec[str & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 16; \
-		res = GUINT64_FROM_BE(res); \
-		*(uint64_t *)o = res; \
-		c += 8; \
-		o += 6; \
-		outl += 6; \
-		inlen -= 8; \
-	} \
-} while (0)
+#include "decode_template.h"
 
-#define INNER_LOOP_32 do { \
-	while (inlen >= 8) { \
-		uint32_t str, res, dec; \
-		str = *(uint32_t *)c; \
-		str = GUINT32_TO_BE(str); \
-		if ((dec = base64_table_dec[str >> 24]) > 63) { \
-			break; \
-		} \
-		res = dec << 26; \
-		if ((dec = base64_table_dec[(str >> 16) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 20; \
-		if ((dec = base64_table_dec[(str >> 8) & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 14; \
-		if ((dec = base64_table_dec[str & 0xFF]) > 63) { \
-			break; \
-		} \
-		res |= dec << 8; \
-		res = GUINT32_FROM_BE(res); \
-		*(uint32_t *)o = res; \
-		c += 4; \
-		o += 3; \
-		outl += 3; \
-		inlen -= 4; \
-	} \
-} while (0)
+extern const char base64_table_enc[];
 
-
-int
-base64_decode_ref (const char *in, size_t inlen,
-		unsigned char *out, size_t *outlen)
+void
+base64_encode_ref (const unsigned char *in, size_t inlen,
+		char *out, size_t *outlen)
 {
-	ssize_t ret = 0;
-	const uint8_t *c = (const uint8_t *)in;
-	uint8_t *o = (uint8_t *)out;
-	uint8_t q, carry;
-	size_t outl = 0;
-	size_t leftover = 0;
-
-repeat:
-	switch (leftover) {
-		for (;;) {
-		case 0:
-#if defined(__LP64__)
-			INNER_LOOP_64;
-#else
-			INNER_LOOP_32;
-#endif
-
-			if (inlen-- == 0) {
-				ret = 1;
-				break;
-			}
-			if ((q = base64_table_dec[*c++]) >= 254) {
-				ret = 0;
-				break;
-			}
-			carry = q << 2;
-			leftover++;
-
-		case 1:
-			if (inlen-- == 0) {
-				ret = 1;
-				break;
-			}
-			if ((q = base64_table_dec[*c++]) >= 254) {
-				ret = 0;
-				break;
-			}
-			*o++ = carry | (q >> 4);
-			carry = q << 4;
-			leftover++;
-			outl++;
-
-		case 2:
-			if (inlen-- == 0) {
-				ret = 1;
-				break;
-			}
-			if ((q = base64_table_dec[*c++]) >= 254) {
-				leftover++;
-
-				if (q == 254) {
-					if (inlen-- != 0) {
-						leftover = 0;
-						q = base64_table_dec[*c++];
-						ret = ((q == 254) && (inlen == 0)) ? 1 : 0;
-						break;
-					}
-					else {
-						ret = 1;
-						break;
-					}
-				}
-				/* If we get here, there was an error: */
-				break;
-			}
-			*o++ = carry | (q >> 2);
-			carry = q << 6;
-			leftover++;
-			outl++;
-
-		case 3:
-			if (inlen-- == 0) {
-				ret = 1;
-				break;
-			}
-			if ((q = base64_table_dec[*c++]) >= 254) {
-				leftover = 0;
-				/*
-				 * When q == 254, the input char is '='. Return 1 and EOF.
-				 * When q == 255, the input char is invalid. Return 0 and EOF.
-				 */
-				ret = ((q == 254) && (inlen == 0)) ? 1 : 0;
-				break;
-			}
-
-			*o++ = carry | q;
-			carry = 0;
-			leftover = 0;
-			outl++;
-		}
+	char *o = out;
+	uint32_t t;
+
+	while (inlen >= 3) {
+		t = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8) | in[2];
+		*o++ = base64_table_enc[t >> 18];
+		*o++ = base64_table_enc[(t >> 12) & 0x3F];
+		*o++ = base64_table_enc[(t >> 6) & 0x3F];
+		*o++ = base64_table_enc[t & 0x3F];
+		in += 3;
+		inlen -= 3;
 	}
 
-	if (!ret && inlen > 0) {
-		/* Skip to the next valid character in input */
-		while (base64_table_dec[*c] >= 254 && inlen > 0) {
-			c ++;
-			inlen --;
-		}
-
-		if (inlen > 0) {
-			goto repeat;
-		}
+	switch (inlen) {
+	case 2:
+		t = ((uint32_t)in[0] << 16) | ((uint32_t)in[1] << 8);
+		*o++ = base64_table_enc[t >> 18];
+		*o++ = base64_table_enc[(t >> 12) & 0x3F];
+		*o++ = base64_table_enc[(t >> 6) & 0x3F];
+		*o++ = '=';
+		break;
+	case 1:
+		t = ((uint32_t)in[0] << 16);
+		*o++ = base64_table_enc[t >> 18];
+		*o++ = base64_table_enc[(t >> 12) & 0x3F];
+		*o++ = '=';
+		*o++ = '=';
+		break;
+	default:
+		break;
 	}
 
-	*outlen = outl;
-
-	return ret;
+	*outlen = o - out;
 }
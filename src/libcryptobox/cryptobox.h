@@ -382,4 +382,15 @@ guint64 rspamd_cryptobox_fast_hash_specific (
  */
 gboolean rspamd_cryptobox_base64_decode (const gchar *in, gsize inlen,
 		guchar *out, gsize *outlen);
+
+/**
+ * Encode base64 using platform optimized code, output is padded and is not
+ * split into lines
+ * @param in input data
+ * @param inlen length of input
+ * @param out output buffer, must have at least `(inlen + 2) / 3 * 4` bytes
+ * @param outlen number of bytes written
+ */
+void rspamd_cryptobox_base64_encode (const guchar *in, gsize inlen,
+		gchar *out, gsize *outlen);
 #endif /* CRYPTOBOX_H_ */
@@ -24,6 +24,11 @@
 #include "hash.h"
 #include <math.h>
 
+#ifdef USABLE_JPEG
+#include <jpeglib.h>
+#include <setjmp.h>
+#endif
+
 #define RSPAMD_NORMALIZED_DIM 64
 
 static rspamd_lru_hash_t *images_hash = NULL;
@@ -220,7 +225,7 @@ process_bmp_image (struct rspamd_task *task, rspamd_ftok_t *data)
  * http://unix4lyfe.org/dct/
  */
 static void
-rspamd_image_dct_block (gint pixels[8][8], gdouble *out)
+rspamd_image_dct_block (const gint *pixels, gsize stride, gint *out)
 {
 	gint i;
 	gint rows[8][8];
@@ -237,14 +242,14 @@ rspamd_image_dct_block (gint pixels[8][8], gdouble *out)
 
 	/* transform rows */
 	for (i = 0; i < 8; i++) {
-		x0 = pixels[0][i];
-		x1 = pixels[1][i];
-		x2 = pixels[2][i];
-		x3 = pixels[3][i];
-		x4 = pixels[4][i];
-		x5 = pixels[5][i];
-		x6 = pixels[6][i];
-		x7 = pixels[7][i];
+		x0 = pixels[stride * 0 + i];
+		x1 = pixels[stride * 1 + i];
+		x2 = pixels[stride * 2 + i];
+		x3 = pixels[stride * 3 + i];
+		x4 = pixels[stride * 4 + i];
+		x5 = pixels[stride * 5 + i];
+		x6 = pixels[stride * 6 + i];
+		x7 = pixels[stride * 7 + i];
 
 		/* Stage 1 */
 		x8 = x7 + x0;
@@ -335,14 +340,14 @@ rspamd_image_dct_block (gint pixels[8][8], gdouble *out)
 		x3 -= x1;
 
 		/* Stage 4 and output */
-		out[i * 8] = (double) ((x6 + 16) >> 3);
-		out[i * 8 + 1] = (double) ((x4 + 16) >> 3);
-		out[i * 8 + 2] = (double) ((x8 + 16384) >> 13);
-		out[i * 8 + 3] = (double) ((x7 + 16384) >> 13);
-		out[i * 8 + 4] = (double) ((x2 - x5 + 16384) >> 13);
-		out[i * 8 + 5] = (double) ((x2 + x5 + 16384) >> 13);
-		out[i * 8 + 6] = (double) (((x3 >> 8) * r2 + 8192) >> 12);
-		out[i * 8 + 7] = (double) (((x0 >> 8) * r2 + 8192) >> 12);
+		out[i * 8] = ((x6 + 16) >> 3);
+		out[i * 8 + 1] = ((x4 + 16) >> 3);
+		out[i * 8 + 2] = ((x8 + 16384) >> 13);
+		out[i * 8 + 3] = ((x7 + 16384) >> 13);
+		out[i * 8 + 4] = ((x2 - x5 + 16384) >> 13);
+		out[i * 8 + 5] = ((x2 + x5 + 16384) >> 13);
+		out[i * 8 + 6] = (((x3 >> 8) * r2 + 8192) >> 12);
+		out[i * 8 + 7] = (((x0 >> 8) * r2 + 8192) >> 12);
 	}
 }
 
@@ -426,6 +431,126 @@ rspamd_image_save_hash (struct rspamd_task *task, struct rspamd_image *img)
 	}
 }
 
+#ifdef USABLE_JPEG
+struct rspamd_image_jpeg_error {
+	struct jpeg_error_mgr pub;
+	jmp_buf jb;
+	guchar *buf;
+};
+
+static void
+rspamd_image_jpeg_error_exit (j_common_ptr cinfo)
+{
+	struct rspamd_image_jpeg_error *err =
+			(struct rspamd_image_jpeg_error *)cinfo->err;
+
+	longjmp (err->jb, 1);
+}
+
+static void
+rspamd_image_jpeg_output_message (j_common_ptr cinfo)
+{
+	/* Do not write libjpeg warnings to stderr */
+}
+
+/*
+ * Decodes JPEG image at the largest reduced scale that is still not smaller
+ * than the normalized image, asking libjpeg for luminance only. The decoded
+ * grayscale buffer is then averaged by areas to the normalized size. Pixel
+ * (x, y) is stored at pixels[x * RSPAMD_NORMALIZED_DIM + y] in the same
+ * form as a grayscale truecolor pixel of libgd.
+ */
+static gboolean
+rspamd_image_jpeg_decode_scaled (struct rspamd_task *task,
+		struct rspamd_image *img, gint *pixels)
+{
+	struct jpeg_decompress_struct cinfo;
+	struct rspamd_image_jpeg_error err;
+	JSAMPROW row;
+	guint denom, width, height, x, y, sx, sy, x0, x1, y0, y1;
+	guint64 sum;
+
+	memset (&cinfo, 0, sizeof (cinfo));
+	memset (&err, 0, sizeof (err));
+	cinfo.err = jpeg_std_error (&err.pub);
+	err.pub.error_exit = rspamd_image_jpeg_error_exit;
+	err.pub.output_message = rspamd_image_jpeg_output_message;
+
+	if (setjmp (err.jb)) {
+		msg_info_task ("cannot decode jpeg image from %s at reduced scale",
+				img->filename);
+		jpeg_destroy_decompress (&cinfo);
+		g_free (err.buf);
+
+		return FALSE;
+	}
+
+	jpeg_create_decompress (&cinfo);
+	jpeg_mem_src (&cinfo, (guchar *)img->data->begin, img->data->len);
+	jpeg_read_header (&cinfo, TRUE);
+
+	/* Conversion to grayscale takes just the luminance channel */
+	cinfo.out_color_space = JCS_GRAYSCALE;
+	cinfo.scale_num = 1;
+
+	for (denom = 8; denom > 1; denom /= 2) {
+		cinfo.scale_denom = denom;
+		jpeg_calc_output_dimensions (&cinfo);
+
+		if (cinfo.output_width >= RSPAMD_NORMALIZED_DIM &&
+				cinfo.output_height >= RSPAMD_NORMALIZED_DIM) {
+			break;
+		}
+	}
+
+	cinfo.scale_denom = denom;
+	jpeg_start_decompress (&cinfo);
+	width = cinfo.output_width;
+	height = cinfo.output_height;
+
+	if (cinfo.output_components != 1 || width < RSPAMD_NORMALIZED_DIM ||
+			height < RSPAMD_NORMALIZED_DIM) {
+		jpeg_destroy_decompress (&cinfo);
+
+		return FALSE;
+	}
+
+	err.buf = g_malloc ((gsize)width * height);
+
+	while (cinfo.output_scanline < height) {
+		row = err.buf + (gsize)cinfo.output_scanline * width;
+		jpeg_read_scanlines (&cinfo, &row, 1);
+	}
+
+	jpeg_finish_decompress (&cinfo);
+	jpeg_destroy_decompress (&cinfo);
+
+	for (y = 0; y < RSPAMD_NORMALIZED_DIM; y ++) {
+		y0 = y * height / RSPAMD_NORMALIZED_DIM;
+		y1 = (y + 1) * height / RSPAMD_NORMALIZED_DIM;
+
+		for (x = 0; x < RSPAMD_NORMALIZED_DIM; x ++) {
+			x0 = x * width / RSPAMD_NORMALIZED_DIM;
+			x1 = (x + 1) * width / RSPAMD_NORMALIZED_DIM;
+			sum = 0;
+
+			for (sy = y0; sy < y1; sy ++) {
+				for (sx = x0; sx < x1; sx ++) {
+					sum += err.buf[(gsize)sy * width + sx];
+				}
+			}
+
+			sum /= (y1 - y0) * (x1 - x0);
+			pixels[x * RSPAMD_NORMALIZED_DIM + y] = sum * 0x010101;
+		}
+	}
+
+	g_free (err.buf);
+
+	return TRUE;
+}
+#endif
+
 #endif
 
 void
@@ -434,7 +559,8 @@ rspamd_image_normalize (struct rspamd_task *task, struct rspamd_image *img)
 #ifdef USABLE_GD
 	gdImagePtr src = NULL, dst = NULL;
 	guint i, j, k, l;
-	gdouble *dct;
+	gint *dct, *pixels;
+	gboolean decoded = FALSE;
 
 	if (img->data->len == 0 || img->data->len > G_MAXINT32) {
 		return;
@@ -453,36 +579,70 @@ rspamd_image_normalize (struct rspamd_task *task, struct rspamd_image *img)
 		return;
 	}
 
-	switch (img->type) {
-	case IMAGE_TYPE_JPG:
-		src = gdImageCreateFromJpegPtr (img->data->len, (void *)img->data->begin);
-		break;
-	case IMAGE_TYPE_PNG:
-		src = gdImageCreateFromPngPtr (img->data->len, (void *)img->data->begin);
-		break;
-	case IMAGE_TYPE_GIF:
-		src = gdImageCreateFromGifPtr (img->data->len, (void *)img->data->begin);
-		break;
-	case IMAGE_TYPE_BMP:
-		src = gdImageCreateFromBmpPtr (img->data->len, (void *)img->data->begin);
-		break;
-	default:
-		return;
-	}
+	dct = g_malloc0 (sizeof (gint) * RSPAMD_DCT_LEN * 2);
+	pixels = dct + RSPAMD_DCT_LEN;
 
-	if (src == NULL) {
-		msg_info_task ("cannot load image of type %s from %s",
-				rspamd_image_type_str (img->type), img->filename);
+#ifdef USABLE_JPEG
+	if (img->type == IMAGE_TYPE_JPG && task->cfg->images_scaled_decode) {
+		decoded = rspamd_image_jpeg_decode_scaled (task, img, pixels);
 	}
-	else {
-		gdImageSetInterpolationMethod (src, GD_BILINEAR_FIXED);
+#endif
+
+	if (!decoded) {
+		switch (img->type) {
+		case IMAGE_TYPE_JPG:
+			src = gdImageCreateFromJpegPtr (img->data->len,
+					(void *)img->data->begin);
+			break;
+		case IMAGE_TYPE_PNG:
+			src = gdImageCreateFromPngPtr (img->data->len,
+					(void *)img->data->begin);
+			break;
+		case IMAGE_TYPE_GIF:
+			src = gdImageCreateFromGifPtr (img->data->len,
+					(void *)img->data->begin);
+			break;
+		case IMAGE_TYPE_BMP:
+			src = gdImageCreateFromBmpPtr (img->data->len,
+					(void *)img->data->begin);
+			break;
+		default:
+			g_free (dct);
+			return;
+		}
+
+		if (src == NULL) {
+			msg_info_task ("cannot load image of type %s from %s",
+					rspamd_image_type_str (img->type), img->filename);
+		}
+		else {
+			gdImageSetInterpolationMethod (src, GD_BILINEAR_FIXED);
+
+			dst = gdImageScale (src, RSPAMD_NORMALIZED_DIM,
+					RSPAMD_NORMALIZED_DIM);
+			gdImageGrayScale (dst);
+			gdImageDestroy (src);
+
+			/*
+			 * Copy pixels to a contiguous buffer once, pixel (x, y) is stored
+			 * at pixels[x * RSPAMD_NORMALIZED_DIM + y]
+			 */
+			for (i = 0; i < RSPAMD_NORMALIZED_DIM; i ++) {
+				for (j = 0; j < RSPAMD_NORMALIZED_DIM; j ++) {
+					pixels[j * RSPAMD_NORMALIZED_DIM + i] =
+							gdImageTrueColor (dst) ?
+							gdImageTrueColorPixel (dst, j, i) :
+							gdImageGetPixel (dst, j, i);
+				}
+			}
 
-		dst = gdImageScale (src, RSPAMD_NORMALIZED_DIM, RSPAMD_NORMALIZED_DIM);
-		gdImageGrayScale (dst);
-		gdImageDestroy (src);
+			gdImageDestroy (dst);
+			decoded = TRUE;
+		}
+	}
 
+	if (decoded) {
 		img->is_normalized = TRUE;
-		dct = g_malloc0 (sizeof (gdouble) * RSPAMD_DCT_LEN);
 		img->dct = g_malloc0 (RSPAMD_DCT_LEN / NBBY);
 		rspamd_mempool_add_destructor (task->task_pool, g_free,
 				img->dct);
@@ -506,20 +666,9 @@ rspamd_image_normalize (struct rspamd_task *task, struct rspamd_image *img)
 		 */
 		for (i = 0; i < RSPAMD_NORMALIZED_DIM; i += 8) {
 			for (j = 0; j < RSPAMD_NORMALIZED_DIM; j += 8) {
-				gint p[8][8];
-
-				for (k = 0; k < 8; k ++) {
-					p[k][0] = gdImageGetPixel (dst, i + k, j);
-					p[k][1] = gdImageGetPixel (dst, i + k, j + 1);
-					p[k][2] = gdImageGetPixel (dst, i + k, j + 2);
-					p[k][3] = gdImageGetPixel (dst, i + k, j + 3);
-					p[k][4] = gdImageGetPixel (dst, i + k, j + 4);
-					p[k][5] = gdImageGetPixel (dst, i + k, j + 5);
-					p[k][6] = gdImageGetPixel (dst, i + k, j + 6);
-					p[k][7] = gdImageGetPixel (dst, i + k, j + 7);
-				}
-
-				rspamd_image_dct_block (p,
+				rspamd_image_dct_block (
+						pixels + i * RSPAMD_NORMALIZED_DIM + j,
+						RSPAMD_NORMALIZED_DIM,
 						dct + i * RSPAMD_NORMALIZED_DIM + j);
 
 				gdouble avg = 0.0;
@@ -548,10 +697,10 @@ rspamd_image_normalize (struct rspamd_task *task, struct rspamd_image *img)
 			}
 		}
 
-		gdImageDestroy (dst);
-		g_free (dct);
 		rspamd_image_save_hash (task, img);
 	}
+
+	g_free (dct);
 #endif
 }
 
@@ -68,8 +68,24 @@ language_elts_cmp (const void *a, const void *b)
 	return (sc - bb->script);
 }
 
+static int
+script_ratio_cmp (const void *a, const void *b)
+{
+	const struct rspamd_mime_script_ratio *sa = a, *sb = b;
+
+	if (sa->ratio > sb->ratio) {
+		return -1;
+	}
+	else if (sa->ratio < sb->ratio) {
+		return 1;
+	}
+
+	return (gint)sa->script - (gint)sb->script;
+}
+
 static void
-detect_text_language (struct rspamd_mime_text_part *part)
+detect_text_language (struct rspamd_task *task,
+		struct rspamd_mime_text_part *part)
 {
 	/* Keep sorted */
 	static const struct language_match language_codes[] = {
@@ -149,42 +165,44 @@ detect_text_language (struct rspamd_mime_text_part *part)
 			{ "nqo", "", G_UNICODE_SCRIPT_NKO }
 	};
 	const struct language_match *lm;
-	const int max_chars = 32;
 
 	if (part != NULL) {
 		if (IS_PART_UTF (part)) {
-			/* Try to detect encoding by several symbols */
-			const gchar *p, *pp;
-			gunichar c;
-			gint32 remain = part->content->len, max = 0, processed = 0;
-			gint32 scripts[G_N_ELEMENTS (language_codes)];
-			GUnicodeScript scc, sel = G_UNICODE_SCRIPT_COMMON;
-
-			p = part->content->data;
+			/* Build histogram of scripts over the whole part */
+			guint scripts[RSPAMD_UNICODE_SCRIPTS_MAX], nalpha, max = 0, i, j;
+			GUnicodeScript sel = G_UNICODE_SCRIPT_COMMON;
+
 			memset (scripts, 0, sizeof (scripts));
+			nalpha = rspamd_str_scripts_histogram (part->content->data,
+					part->content->len, scripts);
 
-			while (remain > 0 && processed < max_chars) {
-				c = g_utf8_get_char_validated (p, remain);
-				if (c == (gunichar) -2 || c == (gunichar) -1) {
-					break;
-				}
-				if (g_unichar_isalpha (c)) {
-					scc = g_unichar_get_script (c);
-					if (scc < (gint)G_N_ELEMENTS (scripts)) {
-						scripts[scc]++;
+			for (i = 0; i < G_N_ELEMENTS (scripts); i ++) {
+				if (scripts[i] > 0) {
+					part->nscripts ++;
+
+					if (scripts[i] > max) {
+						max = scripts[i];
+						sel = i;
 					}
-					processed ++;
 				}
-				pp = g_utf8_next_char (p);
-				remain -= pp - p;
-				p = pp;
 			}
-			for (remain = 0; remain < (gint)G_N_ELEMENTS (scripts); remain++) {
-				if (scripts[remain] > max) {
-					max = scripts[remain];
-					sel = remain;
+
+			if (part->nscripts > 0) {
+				part->scripts = rspamd_mempool_alloc (task->task_pool,
+						sizeof (*part->scripts) * part->nscripts);
+
+				for (i = 0, j = 0; i < G_N_ELEMENTS (scripts); i ++) {
+					if (scripts[i] > 0) {
+						part->scripts[j].script = i;
+						part->scripts[j].ratio = (gdouble)scripts[i] / nalpha;
+						j ++;
+					}
 				}
+
+				qsort (part->scripts, part->nscripts, sizeof (*part->scripts),
+						script_ratio_cmp);
 			}
+
 			part->script = sel;
 			lm = bsearch (&sel, language_codes, G_N_ELEMENTS (language_codes),
 					sizeof (language_codes[0]), &language_elts_cmp);
@@ -197,6 +215,92 @@ detect_text_language (struct rspamd_mime_text_part *part)
 	}
 }
 
+#ifdef WITH_SNOWBALL
+/* Stemmers are expensive to create, so we keep them per process */
+static GHashTable *stemmers = NULL;
+
+static struct sb_stemmer *
+rspamd_get_stemmer (struct rspamd_task *task, const gchar *lang)
+{
+	struct sb_stemmer *stem = NULL;
+
+	if (stemmers == NULL) {
+		stemmers = g_hash_table_new_full (rspamd_str_hash, rspamd_str_equal,
+				g_free, NULL);
+	}
+
+	if (!g_hash_table_lookup_extended (stemmers, lang, NULL,
+			(gpointer *)&stem)) {
+		stem = sb_stemmer_new (lang, "UTF_8");
+
+		if (stem == NULL) {
+			msg_debug_task ("<%s> cannot create lemmatizer for %s language",
+					task->message_id, lang);
+		}
+
+		/* Unsupported languages are cached as well */
+		g_hash_table_insert (stemmers, g_strdup (lang), stem);
+	}
+
+	return stem;
+}
+#endif
+
+/*
+ * Lowercases a word, the word is copied to the pool merely if it has
+ * some characters to change
+ */
+static void
+rspamd_normalize_word (rspamd_ftok_t *w, gboolean is_utf,
+		rspamd_mempool_t *pool)
+{
+	const gchar *p, *end;
+	gchar *dst, *d;
+	gboolean has_8bit = FALSE;
+
+	p = w->begin;
+	end = p + w->len;
+
+	/* Skip the prefix that is already normalized */
+	while (p < end) {
+		if (g_ascii_isupper (*p)) {
+			break;
+		}
+		else if (is_utf && (*p & 0x80)) {
+			has_8bit = TRUE;
+			break;
+		}
+
+		p ++;
+	}
+
+	if (p == end) {
+		return;
+	}
+
+	dst = rspamd_mempool_alloc (pool, w->len);
+	d = dst + (p - w->begin);
+	memcpy (dst, w->begin, d - dst);
+
+	while (p < end) {
+		if (is_utf && (*p & 0x80)) {
+			has_8bit = TRUE;
+			break;
+		}
+
+		*d++ = g_ascii_tolower (*p);
+		p ++;
+	}
+
+	if (has_8bit) {
+		/* Unicode lowercasing is required for the rest of the word */
+		memcpy (d, p, end - p);
+		rspamd_str_lc_utf8 (d, end - p);
+	}
+
+	w->begin = dst;
+}
+
 static void
 rspamd_extract_words (struct rspamd_task *task,
 		struct rspamd_mime_text_part *part)
@@ -211,11 +315,7 @@ rspamd_extract_words (struct rspamd_task *task,
 
 #ifdef WITH_SNOWBALL
 	if (part->language && part->language[0] != '\0' && IS_PART_UTF (part)) {
-		stem = sb_stemmer_new (part->language, "UTF_8");
-		if (stem == NULL) {
-			msg_debug_task ("<%s> cannot create lemmatizer for %s language",
-					task->message_id, part->language);
-		}
+		stem = rspamd_get_stemmer (task, part->language);
 	}
 #endif
 	/* Ugly workaround */
@@ -243,23 +343,19 @@ rspamd_extract_words (struct rspamd_task *task,
 				if (r != NULL) {
 					nlen = strlen (r);
 					nlen = MIN (nlen, w->len);
-					temp_word = rspamd_mempool_alloc (task->task_pool, nlen);
-					memcpy (temp_word, r, nlen);
-					w->begin = temp_word;
-					w->len = nlen;
-				}
-				else {
-					temp_word = rspamd_mempool_alloc (task->task_pool, w->len);
-					memcpy (temp_word, w->begin, w->len);
 
-					if (IS_PART_UTF (part)) {
-						rspamd_str_lc_utf8 (temp_word, w->len);
-					}
-					else {
-						rspamd_str_lc (temp_word, w->len);
+					/* Stemmer output is often a prefix of the original word */
+					if (memcmp (w->begin, r, nlen) != 0) {
+						temp_word = rspamd_mempool_alloc (task->task_pool, nlen);
+						memcpy (temp_word, r, nlen);
+						w->begin = temp_word;
 					}
 
-					w->begin = temp_word;
+					w->len = nlen;
+				}
+				else {
+					rspamd_normalize_word (w, IS_PART_UTF (part),
+							task->task_pool);
 				}
 			}
 
@@ -274,11 +370,6 @@ rspamd_extract_words (struct rspamd_task *task,
 			}
 		}
 	}
-#ifdef WITH_SNOWBALL
-	if (stem != NULL) {
-		sb_stemmer_delete (stem);
-	}
-#endif
 }
 
 static void
@@ -512,7 +603,7 @@ rspamd_message_process_text_part (struct rspamd_task *task,
 	}
 
 	/* Post process part */
-	detect_text_language (text_part);
+	detect_text_language (task, text_part);
 	rspamd_normalize_text_part (task, text_part);
 
 	if (!IS_PART_HTML (text_part)) {
@@ -73,9 +73,16 @@ struct rspamd_mime_part {
 #define IS_PART_RAW(part) (!((part)->flags & RSPAMD_MIME_TEXT_PART_FLAG_UTF))
 #define IS_PART_HTML(part) ((part)->flags & RSPAMD_MIME_TEXT_PART_FLAG_HTML)
 
+struct rspamd_mime_script_ratio {
+	GUnicodeScript script;
+	gdouble ratio;
+};
+
 struct rspamd_mime_text_part {
 	guint flags;
 	GUnicodeScript script;
+	struct rspamd_mime_script_ratio *scripts; /**< sorted by ratio descending	*/
+	guint nscripts;
 	const gchar *lang_code;
 	const gchar *language;
 	const gchar *real_charset;
@@ -17,6 +17,7 @@
 #include "config.h"
 #include "libutil/mem_pool.h"
 #include "libutil/regexp.h"
+#include "libutil/hash.h"
 #include "libserver/task.h"
 #include "mime_encoding.h"
 #include "message.h"
@@ -40,7 +41,28 @@ struct rspamd_charset_substitution {
 
 #include "mime_encoding_list.h"
 
+struct rspamd_charset_table {
+	const gchar *name;
+	const guint16 codes[128];
+};
+
+#include "mime_encoding_tables.h"
+
+/* Charset converter: either cached iconv or a built-in 8 bit table */
+struct rspamd_charset_converter {
+	union {
+		iconv_t conv;
+		const guint16 *cnv_table;
+	} d;
+	gboolean is_internal;
+};
+
+#define RSPAMD_CHARSET_MAX_CACHED 32
+#define RSPAMD_CHARSET_MAX_NAME 128
+
 static GHashTable *sub_hash = NULL;
+static GHashTable *tables_hash = NULL;
+static rspamd_lru_hash_t *converters_cache = NULL;
 
 
 static GQuark
@@ -131,6 +153,172 @@ rspamd_mime_detect_charset (const rspamd_ftok_t *in, rspamd_mempool_t *pool)
 	return ret;
 }
 
+static void
+rspamd_converter_dtor (gpointer p)
+{
+	struct rspamd_charset_converter *c = p;
+
+	if (!c->is_internal) {
+		iconv_close (c->d.conv);
+	}
+
+	g_slice_free1 (sizeof (*c), c);
+}
+
+/*
+ * Converters cache key: lowercased name without punctuation, so
+ * `Windows-1251`, `windows_1251` and `cp1251` share the same converter
+ */
+static gboolean
+rspamd_charset_cache_key (const gchar *in, gchar *out, gsize outlen)
+{
+	const gchar *p = in;
+	gchar *d = out, *end = out + outlen - 1;
+
+	if (g_ascii_strncasecmp (p, "windows", sizeof ("windows") - 1) == 0) {
+		*d++ = 'c';
+		*d++ = 'p';
+		p += sizeof ("windows") - 1;
+	}
+
+	while (*p) {
+		if (g_ascii_isalnum (*p)) {
+			if (d == end) {
+				return FALSE;
+			}
+
+			*d++ = g_ascii_tolower (*p);
+		}
+
+		p ++;
+	}
+
+	*d = '\0';
+
+	return TRUE;
+}
+
+static struct rspamd_charset_converter *
+rspamd_mime_get_converter_cached (const gchar *enc, GError **err)
+{
+	struct rspamd_charset_converter *conv;
+	const struct rspamd_charset_table *tbl;
+	gchar key[RSPAMD_CHARSET_MAX_NAME];
+	iconv_t ic;
+	guint i;
+
+	if (converters_cache == NULL) {
+		converters_cache = rspamd_lru_hash_new_full (RSPAMD_CHARSET_MAX_CACHED,
+				g_free, rspamd_converter_dtor,
+				rspamd_str_hash, rspamd_str_equal);
+		tables_hash = g_hash_table_new (rspamd_str_hash, rspamd_str_equal);
+
+		for (i = 0; i < G_N_ELEMENTS (charset_tables); i ++) {
+			g_hash_table_insert (tables_hash, (gpointer)charset_tables[i].name,
+					(gpointer)&charset_tables[i]);
+		}
+	}
+
+	if (!rspamd_charset_cache_key (enc, key, sizeof (key))) {
+		g_set_error (err, rspamd_iconv_error_quark (), EINVAL,
+				"too long charset name: %s", enc);
+
+		return NULL;
+	}
+
+	conv = rspamd_lru_hash_lookup (converters_cache, key, 0);
+
+	if (conv == NULL) {
+		tbl = g_hash_table_lookup (tables_hash, key);
+
+		if (tbl != NULL) {
+			conv = g_slice_alloc (sizeof (*conv));
+			conv->is_internal = TRUE;
+			conv->d.cnv_table = tbl->codes;
+		}
+		else {
+			ic = iconv_open (UTF8_CHARSET, enc);
+
+			if (ic == (iconv_t)-1) {
+				g_set_error (err, rspamd_iconv_error_quark (), EINVAL,
+						"cannot open iconv for: %s", enc);
+
+				return NULL;
+			}
+
+			conv = g_slice_alloc (sizeof (*conv));
+			conv->is_internal = FALSE;
+			conv->d.conv = ic;
+		}
+
+		rspamd_lru_hash_insert (converters_cache, g_strdup (key), conv, 0, 0);
+	}
+	else if (!conv->is_internal) {
+		/* Reset shift state left from the previous conversion */
+		iconv (conv->d.conv, NULL, NULL, NULL, NULL);
+	}
+
+	return conv;
+}
+
+/*
+ * Converts 8 bit text using a table, output must have space for
+ * `inlen * MAX (3, badlen)` bytes
+ */
+static gsize
+rspamd_converter_table_to_utf8 (const guint16 *table,
+		const guchar *in, gsize inlen, guchar *out,
+		const guchar *bad, gsize badlen)
+{
+	const guchar *p = in, *end = in + inlen;
+	guchar *d = out;
+	guint64 w;
+	guint16 cp;
+
+	while (p < end) {
+		/* Copy ASCII runs by words */
+		while (end - p >= (gssize)sizeof (w)) {
+			memcpy (&w, p, sizeof (w));
+
+			if (w & 0x8080808080808080ULL) {
+				break;
+			}
+
+			memcpy (d, p, sizeof (w));
+			p += sizeof (w);
+			d += sizeof (w);
+		}
+
+		if (p == end) {
+			break;
+		}
+
+		if (*p < 0x80) {
+			*d++ = *p++;
+			continue;
+		}
+
+		cp = table[*p - 0x80];
+		p ++;
+
+		if (cp == 0) {
+			memcpy (d, bad, badlen);
+			d += badlen;
+		}
+		else if (cp < 0x800) {
+			*d++ = 0xC0 | (cp >> 6);
+			*d++ = 0x80 | (cp & 0x3F);
+		}
+		else {
+			*d++ = 0xE0 | (cp >> 12);
+			*d++ = 0x80 | ((cp >> 6) & 0x3F);
+			*d++ = 0x80 | (cp & 0x3F);
+		}
+	}
+
+	return d - out;
+}
+
 gchar *
 rspamd_mime_text_to_utf8 (rspamd_mempool_t *pool,
 		gchar *input, gsize len, const gchar *in_enc,
@@ -141,16 +329,29 @@ rspamd_mime_text_to_utf8 (rspamd_mempool_t *pool,
 	iconv_t ic;
 	rspamd_fstring_t *dst;
 	gsize remain, ret, inremain = len;
+	struct rspamd_charset_converter *conv;
 
-	ic = iconv_open (UTF8_CHARSET, in_enc);
-
-	if (ic == (iconv_t)-1) {
-		g_set_error (err, rspamd_iconv_error_quark (), EINVAL,
-				"cannot open iconv for: %s", in_enc);
+	conv = rspamd_mime_get_converter_cached (in_enc, err);
 
+	if (conv == NULL) {
 		return NULL;
 	}
 
+	if (conv->is_internal) {
+		dst = rspamd_fstring_sized_new (len * 3 + 1);
+		dst->len = rspamd_converter_table_to_utf8 (conv->d.cnv_table,
+				(const guchar *)input, len, (guchar *)dst->str,
+				(const guchar *)"?", 1);
+		dst->str[dst->len] = '\0';
+		*olen = dst->len;
+		rspamd_mempool_add_destructor (pool,
+				(rspamd_mempool_destruct_t)rspamd_fstring_free, dst);
+
+		return dst->str;
+	}
+
+	ic = conv->d.conv;
+
 	/* Preallocate for half of characters to be converted */
 	outlen = len + len / 2 + 1;
 	dst = rspamd_fstring_sized_new (outlen);
@@ -191,7 +392,6 @@ rspamd_mime_text_to_utf8 (rspamd_mempool_t *pool,
 
 	*d = '\0';
 	*olen = dst->len;
-	iconv_close (ic);
 	rspamd_mempool_add_destructor (pool,
 			(rspamd_mempool_destruct_t)rspamd_fstring_free, dst);
 	msg_info_pool ("converted from %s to UTF-8 inlen: %z, outlen: %z",
@@ -210,6 +410,8 @@ rspamd_mime_to_utf8_byte_array (GByteArray *in,
 	iconv_t ic;
 	gsize remain, ret, inremain = in->len;
 	rspamd_ftok_t charset_tok;
+	struct rspamd_charset_converter *conv;
+	static const guchar replacement[] = {0xEF, 0xBF, 0xBD};
 
 	RSPAMD_FTOK_FROM_STR (&charset_tok, enc);
 
@@ -220,12 +422,23 @@ rspamd_mime_to_utf8_byte_array (GByteArray *in,
 		return TRUE;
 	}
 
-	ic = iconv_open (UTF8_CHARSET, enc);
+	conv = rspamd_mime_get_converter_cached (enc, NULL);
 
-	if (ic == (iconv_t)-1) {
+	if (conv == NULL) {
 		return FALSE;
 	}
 
+	if (conv->is_internal) {
+		g_byte_array_set_size (out, in->len * 3);
+		out->len = rspamd_converter_table_to_utf8 (conv->d.cnv_table,
+				in->data, in->len, out->data,
+				replacement, sizeof (replacement));
+
+		return TRUE;
+	}
+
+	ic = conv->d.conv;
+
 	/* Preallocate for half of characters to be converted */
 	outlen = inremain * 2 + 1;
 	g_byte_array_set_size (out, outlen);
@@ -279,7 +492,6 @@ rspamd_mime_to_utf8_byte_array (GByteArray *in,
 	}
 
 	out->len = d - out->data;
-	iconv_close (ic);
 
 	return TRUE;
 }
@@ -188,6 +188,9 @@ struct rspamd_worker_conf {
 	struct rspamd_worker_bind_conf *bind_conf;      /**< bind configuration									*/
 	guint16 count;                                  /**< number of workers									*/
 	GList *listen_socks;                            /**< listening sockets desctiptors						*/
+	GPtrArray *reuseport_socks;                     /**< own listening sockets of each worker				*/
+	gboolean reuseport;                             /**< create listening sockets for each worker			*/
+	gboolean cpu_affinity;                          /**< bind each worker to its own cpu					*/
 	guint32 rlimit_nofile;                          /**< max files limit									*/
 	guint32 rlimit_maxcore;                         /**< maximum core file size								*/
 	GHashTable *params;                             /**< params for worker									*/
@@ -221,6 +224,7 @@ enum rspamd_log_format_type {
 	RSPAMD_LOG_TIME_VIRTUAL,
 	RSPAMD_LOG_LUA,
 	RSPAMD_LOG_DIGEST,
+	RSPAMD_LOG_TRACE,
 };
 
 enum rspamd_log_format_flags {
@@ -313,6 +317,7 @@ struct rspamd_config {
 	gsize max_message;                              /**< maximum size for messages							*/
 	gsize max_pic_size;                             /**< maximum size for a picture to process				*/
 	gsize images_cache_size;                        /**< size of LRU cache for DCT data from images			*/
+	gboolean images_scaled_decode;                  /**< decode JPEG images at a reduced scale				*/
 
 	enum rspamd_log_type log_type;                  /**< log type											*/
 	gint log_facility;                              /**< log facility in case of syslog						*/
@@ -320,6 +325,8 @@ struct rspamd_config {
 	gchar *log_file;                                /**< path to logfile in case of file logging			*/
 	gboolean log_buffered;                          /**< whether logging is buffered						*/
 	guint32 log_buf_size;                           /**< length of log buffer								*/
+	gboolean log_async;                             /**< workers log via rings drained by main process		*/
+	gsize log_async_size;                           /**< size of log ring per worker						*/
 	const ucl_object_t *debug_ip_map;               /**< turn on debugging for specified ip addresses       */
 	gboolean log_urls;                              /**< whether we should log URLs                         */
 	GList *debug_symbols;                           /**< symbols to debug									*/
@@ -395,6 +402,9 @@ struct rspamd_config {
 	const ucl_object_t *nameservers;                /**< list of nameservers or NULL to parse resolv.conf	*/
 	guint32 dns_max_requests;                       /**< limit of DNS requests per task 					*/
 	gboolean enable_dnssec;                         /**< enable dnssec stub resolver						*/
+	guint32 dns_cache_size;                         /**< number of cached DNS replies per worker			*/
+	gdouble dns_cache_max_ttl;                      /**< maximum time to keep DNS reply in the cache		*/
+	gdouble dns_cache_negative_ttl;                 /**< time to keep negative DNS replies in the cache	*/
 
 	guint upstream_max_errors;						/**< upstream max errors before shutting off			*/
 	gdouble upstream_error_time;					/**< rate of upstream errors							*/
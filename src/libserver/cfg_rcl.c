@@ -1756,6 +1756,20 @@ rspamd_rcl_config_init (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_config, log_buf_size),
 			RSPAMD_CL_FLAG_INT_32,
 			"Size of log buffer in bytes (for file logging)");
+	rspamd_rcl_add_default_handler (sub,
+			"async",
+			rspamd_rcl_parse_struct_boolean,
+			G_STRUCT_OFFSET (struct rspamd_config, log_async),
+			0,
+			"Workers pass log lines to the main process via shared memory "
+			"instead of writing them (for file and console logging)");
+	rspamd_rcl_add_default_handler (sub,
+			"async_buffer",
+			rspamd_rcl_parse_struct_integer,
+			G_STRUCT_OFFSET (struct rspamd_config, log_async_size),
+			RSPAMD_CL_FLAG_INT_SIZE,
+			"Size of shared memory log ring per worker, lines are dropped "
+			"when it is full (1Mb by default)");
 	rspamd_rcl_add_default_handler (sub,
 			"log_urls",
 			rspamd_rcl_parse_struct_boolean,
@@ -2160,6 +2174,13 @@ rspamd_rcl_config_init (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_config, max_pic_size),
 			RSPAMD_CL_FLAG_INT_SIZE,
 			"Size of DCT data cache for images (256 elements by default)");
+	rspamd_rcl_add_default_handler (sub,
+			"images_scaled_decode",
+			rspamd_rcl_parse_struct_boolean,
+			G_STRUCT_OFFSET (struct rspamd_config, images_scaled_decode),
+			0,
+			"Decode JPEG images at a reduced scale when normalizing them (faster, "
+			"but fingerprints differ from the full decoding)");
 	rspamd_rcl_add_default_handler (sub,
 			"zstd_input_dictionary",
 			rspamd_rcl_parse_struct_string,
@@ -2233,6 +2254,24 @@ rspamd_rcl_config_init (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_config, enable_dnssec),
 			0,
 			"Enable DNSSEC support in Rspamd");
+	rspamd_rcl_add_default_handler (ssub,
+			"cache_size",
+			rspamd_rcl_parse_struct_integer,
+			G_STRUCT_OFFSET (struct rspamd_config, dns_cache_size),
+			RSPAMD_CL_FLAG_INT_32,
+			"Number of DNS replies cached by each worker (0 to disable cache)");
+	rspamd_rcl_add_default_handler (ssub,
+			"cache_max_ttl",
+			rspamd_rcl_parse_struct_time,
+			G_STRUCT_OFFSET (struct rspamd_config, dns_cache_max_ttl),
+			RSPAMD_CL_FLAG_TIME_FLOAT,
+			"Maximum time to cache DNS replies regardless of their TTL");
+	rspamd_rcl_add_default_handler (ssub,
+			"cache_negative_ttl",
+			rspamd_rcl_parse_struct_time,
+			G_STRUCT_OFFSET (struct rspamd_config, dns_cache_negative_ttl),
+			RSPAMD_CL_FLAG_TIME_FLOAT,
+			"Time to cache NXDOMAIN and empty DNS replies (0 to disable)");
 
 
 	/* New upstreams configuration */
@@ -2379,6 +2418,18 @@ rspamd_rcl_config_init (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_worker_conf, rlimit_maxcore),
 			RSPAMD_CL_FLAG_INT_32,
 			"Max size of core file in bytes");
+	rspamd_rcl_add_default_handler (sub,
+			"reuseport",
+			rspamd_rcl_parse_struct_boolean,
+			G_STRUCT_OFFSET (struct rspamd_worker_conf, reuseport),
+			0,
+			"Create a separate listening socket with SO_REUSEPORT for each worker");
+	rspamd_rcl_add_default_handler (sub,
+			"cpu_affinity",
+			rspamd_rcl_parse_struct_boolean,
+			G_STRUCT_OFFSET (struct rspamd_worker_conf, cpu_affinity),
+			0,
+			"Bind each worker to a separate cpu");
 
 	/**
 	 * Modules handler
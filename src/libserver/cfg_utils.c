@@ -115,6 +115,10 @@ rspamd_config_new (void)
 	cfg->dns_throttling_time = 10000;
 	/* 16 sockets per DNS server */
 	cfg->dns_io_per_server = 16;
+	/* Cache up to 2048 replies for at most one hour */
+	cfg->dns_cache_size = 2048;
+	cfg->dns_cache_max_ttl = 3600.0;
+	cfg->dns_cache_negative_ttl = 60.0;
 
 	/* 20 Kb */
 	cfg->max_diff = 20480;
@@ -145,6 +149,7 @@ rspamd_config_new (void)
 	cfg->history_rows = 200;
 	cfg->log_error_elts = 10;
 	cfg->log_error_elt_maxlen = 1000;
+	cfg->log_async_size = 1024 * 1024;
 	cfg->cache_reload_time = 30.0;
 
 	/* Default log line */
@@ -410,6 +415,9 @@ rspamd_config_process_var (struct rspamd_config *cfg, const rspamd_ftok_t *var,
 			rspamd_ftok_cstr_equal (&tok, "checksum", TRUE)) {
 		type = RSPAMD_LOG_DIGEST;
 	}
+	else if (rspamd_ftok_cstr_equal (&tok, "trace", TRUE)) {
+		type = RSPAMD_LOG_TRACE;
+	}
 	else {
 		msg_err_config ("unknown log variable: %T", &tok);
 		return FALSE;
@@ -945,6 +953,11 @@ rspamd_worker_conf_dtor (struct rspamd_worker_conf *wcf)
 	if (wcf) {
 		ucl_object_unref (wcf->options);
 		g_queue_free (wcf->active_workers);
+
+		if (wcf->reuseport_socks) {
+			g_ptr_array_free (wcf->reuseport_socks, TRUE);
+		}
+
 		g_hash_table_unref (wcf->params);
 		g_slice_free1 (sizeof (*wcf), wcf);
 	}
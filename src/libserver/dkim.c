@@ -1545,6 +1545,57 @@ rspamd_dkim_canonize_body (struct rspamd_dkim_common_ctx *ctx,
 	return FALSE;
 }
 
+/*
+ * Signatures with the same body canonicalization, digest and length limit
+ * share the same body hash, so keep the digest state in the task pool and
+ * copy it instead of canonizing the whole body once per signature
+ */
+static gboolean
+rspamd_dkim_canonize_body_cached (struct rspamd_dkim_common_ctx *ctx,
+	struct rspamd_task *task,
+	const gchar *start,
+	const gchar *end,
+	gboolean sign)
+{
+	EVP_MD_CTX *cached;
+	gchar key[64];
+
+	rspamd_snprintf (key, sizeof (key), "dkim_bh_%d_%d_%d_%uz",
+			sign ? 1 : 0,
+			ctx->body_canon_type,
+			EVP_MD_type (EVP_MD_CTX_md (ctx->body_hash)),
+			ctx->len);
+	cached = rspamd_mempool_get_variable (task->task_pool, key);
+
+	if (cached != NULL) {
+		msg_debug_dkim ("reuse cached body hash %s", key);
+
+		return EVP_MD_CTX_copy_ex (ctx->body_hash, cached) == 1;
+	}
+
+	if (!rspamd_dkim_canonize_body (ctx, start, end, sign)) {
+		return FALSE;
+	}
+
+	cached = EVP_MD_CTX_create ();
+
+	if (EVP_MD_CTX_copy (cached, ctx->body_hash) != 1) {
+		EVP_MD_CTX_destroy (cached);
+
+		return TRUE;
+	}
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
+	rspamd_mempool_set_variable (task->task_pool, key, cached,
+			(rspamd_mempool_destruct_t)EVP_MD_CTX_destroy);
+#else
+	rspamd_mempool_set_variable (task->task_pool, key, cached,
+			(rspamd_mempool_destruct_t)EVP_MD_CTX_free);
+#endif
+
+	return TRUE;
+}
+
 /* Update hash converting all CR and LF to CRLF */
 static void
 rspamd_dkim_hash_update (EVP_MD_CTX *ck, const gchar *begin, gsize len)
@@ -1823,7 +1874,8 @@ rspamd_dkim_check (rspamd_dkim_context_t *ctx,
 	}
 
 	/* Start canonization of body part */
-	if (!rspamd_dkim_canonize_body (&ctx->common, body_start, body_end, FALSE)) {
+	if (!rspamd_dkim_canonize_body_cached (&ctx->common, task,
+			body_start, body_end, FALSE)) {
 		return DKIM_RECORD_ERROR;
 	}
 	/* Now canonize headers */
@@ -2185,7 +2237,8 @@ rspamd_dkim_sign (struct rspamd_task *task,
 	}
 
 	/* Start canonization of body part */
-	if (!rspamd_dkim_canonize_body (&ctx->common, body_start, body_end, TRUE)) {
+	if (!rspamd_dkim_canonize_body_cached (&ctx->common, task,
+			body_start, body_end, TRUE)) {
 		return NULL;
 	}
 
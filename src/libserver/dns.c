@@ -47,15 +47,92 @@ struct rspamd_dns_request_ud {
 	gpointer ud;
 	rspamd_mempool_t *pool;
 	struct rdns_request *req;
+	struct rspamd_dns_resolver *resolver;
+	gchar *cache_key;
+	struct event cache_ev;
+	gboolean cache_pending;
 };
 
+/* Enough for the longest DNS name prefixed with the request type */
+#define RSPAMD_DNS_CACHE_KEY_MAX 300
+
+static gboolean
+rspamd_dns_cache_key (gchar *buf, gsize buflen, enum rdns_request_type type,
+		const gchar *name)
+{
+	gsize r;
+
+	r = rspamd_snprintf (buf, buflen, "%d:%s", (gint)type, name);
+
+	return r < buflen - 1;
+}
+
+/*
+ * Store reply in the cache: the request is retained, so it keeps the
+ * reply and its entries alive while an element stays in the cache
+ */
+static gboolean
+rspamd_dns_cache_reply (struct rspamd_dns_resolver *resolver,
+		struct rdns_reply *reply, gchar *key)
+{
+	struct rdns_reply_entry *elt;
+	gint32 min_ttl = G_MAXINT32;
+	guint ttl = 0;
+
+	switch (reply->code) {
+	case RDNS_RC_NOERROR:
+		if (reply->entries != NULL) {
+			DL_FOREACH (reply->entries, elt) {
+				if (elt->ttl < min_ttl) {
+					min_ttl = elt->ttl;
+				}
+			}
+
+			if (min_ttl > 0) {
+				ttl = MIN ((guint)min_ttl, resolver->cache_max_ttl);
+			}
+		}
+		else {
+			ttl = resolver->cache_negative_ttl;
+		}
+		break;
+	case RDNS_RC_NXDOMAIN:
+	case RDNS_RC_NOREC:
+		ttl = resolver->cache_negative_ttl;
+		break;
+	default:
+		/* Never cache temporary failures */
+		break;
+	}
+
+	if (ttl == 0) {
+		return FALSE;
+	}
+
+	rspamd_lru_hash_insert (resolver->cache, key,
+			rdns_request_retain (reply->request),
+			time (NULL), ttl);
+
+	return TRUE;
+}
+
 static void
 rspamd_dns_fin_cb (gpointer arg)
 {
 	struct rspamd_dns_request_ud *reqdata = (struct rspamd_dns_request_ud *)arg;
 
+	if (reqdata->cache_pending) {
+		/* Session is terminated before a cached reply has been delivered */
+		event_del (&reqdata->cache_ev);
+		reqdata->cache_pending = FALSE;
+	}
+
 	rdns_request_release (reqdata->req);
 
+	if (reqdata->cache_key) {
+		g_free (reqdata->cache_key);
+	}
+
 	if (reqdata->pool == NULL) {
 		g_slice_free1 (sizeof (struct rspamd_dns_request_ud), reqdata);
 	}
@@ -66,6 +143,14 @@ rspamd_dns_callback (struct rdns_reply *reply, gpointer ud)
 {
 	struct rspamd_dns_request_ud *reqdata = ud;
 
+	if (reqdata->cache_key) {
+		if (rspamd_dns_cache_reply (reqdata->resolver, reply,
+				reqdata->cache_key)) {
+			/* Key is now owned by the cache */
+			reqdata->cache_key = NULL;
+		}
+	}
+
 	reqdata->cb (reply, reqdata->ud);
 
 	if (reqdata->session) {
@@ -76,8 +161,40 @@ rspamd_dns_callback (struct rdns_reply *reply, gpointer ud)
 		rdns_request_retain (reply->request);
 		rspamd_session_remove_event (reqdata->session, rspamd_dns_fin_cb, reqdata);
 	}
-	else if (reqdata->pool == NULL) {
-		g_slice_free1 (sizeof (struct rspamd_dns_request_ud), reqdata);
+	else {
+		if (reqdata->cache_key) {
+			g_free (reqdata->cache_key);
+		}
+
+		if (reqdata->pool == NULL) {
+			g_slice_free1 (sizeof (struct rspamd_dns_request_ud), reqdata);
+		}
+	}
+}
+
+/*
+ * Delivers a cached reply: callers expect callbacks to be called after
+ * make_dns_request returns, so we cannot call them directly
+ */
+static void
+rspamd_dns_cached_callback (gint fd, short what, gpointer ud)
+{
+	struct rspamd_dns_request_ud *reqdata = ud;
+	struct rdns_request *req = reqdata->req;
+
+	reqdata->cache_pending = FALSE;
+	reqdata->cb (req->reply, reqdata->ud);
+
+	if (reqdata->session) {
+		/* Finaliser releases the request retained on cache hit */
+		rspamd_session_remove_event (reqdata->session, rspamd_dns_fin_cb, reqdata);
+	}
+	else {
+		rdns_request_release (req);
+
+		if (reqdata->pool == NULL) {
+			g_slice_free1 (sizeof (struct rspamd_dns_request_ud), reqdata);
+		}
 	}
 }
 
@@ -90,8 +207,11 @@ make_dns_request (struct rspamd_dns_resolver *resolver,
 	enum rdns_request_type type,
 	const char *name)
 {
-	struct rdns_request *req;
+	struct rdns_request *req = NULL;
 	struct rspamd_dns_request_ud *reqdata = NULL;
+	gchar keybuf[RSPAMD_DNS_CACHE_KEY_MAX];
+	gboolean use_cache = FALSE;
+	struct timeval tv;
 
 	g_assert (resolver != NULL);
 
@@ -99,6 +219,24 @@ make_dns_request (struct rspamd_dns_resolver *resolver,
 		return FALSE;
 	}
 
+	if (resolver->cache && name != NULL) {
+		use_cache = rspamd_dns_cache_key (keybuf, sizeof (keybuf), type, name);
+
+		if (use_cache) {
+			req = rspamd_lru_hash_lookup (resolver->cache, keybuf,
+					time (NULL));
+
+			if (resolver->stat) {
+				if (req != NULL) {
+					resolver->stat->dns_cache_hits ++;
+				}
+				else {
+					resolver->stat->dns_cache_misses ++;
+				}
+			}
+		}
+	}
+
 	if (pool != NULL) {
 		reqdata =
 			rspamd_mempool_alloc (pool, sizeof (struct rspamd_dns_request_ud));
@@ -110,6 +248,33 @@ make_dns_request (struct rspamd_dns_resolver *resolver,
 	reqdata->session = session;
 	reqdata->cb = cb;
 	reqdata->ud = ud;
+	reqdata->resolver = resolver;
+	reqdata->cache_key = NULL;
+	reqdata->cache_pending = FALSE;
+
+	if (req != NULL) {
+		/* Cache hit */
+		reqdata->req = rdns_request_retain (req);
+		reqdata->cache_pending = TRUE;
+		evtimer_set (&reqdata->cache_ev, rspamd_dns_cached_callback, reqdata);
+		event_base_set (resolver->ev_base, &reqdata->cache_ev);
+		tv.tv_sec = 0;
+		tv.tv_usec = 0;
+		event_add (&reqdata->cache_ev, &tv);
+
+		if (session) {
+			rspamd_session_add_event (session,
+					(event_finalizer_t)rspamd_dns_fin_cb,
+					reqdata,
+					g_quark_from_static_string ("dns resolver"));
+		}
+
+		return TRUE;
+	}
+
+	if (use_cache) {
+		reqdata->cache_key = g_strdup (keybuf);
+	}
 
 	req = rdns_make_request_full (resolver->r, rspamd_dns_callback, reqdata,
 			resolver->request_timeout, resolver->max_retransmits, 1, name,
@@ -126,6 +291,10 @@ make_dns_request (struct rspamd_dns_resolver *resolver,
 	}
 
 	if (req == NULL) {
+		if (reqdata->cache_key) {
+			g_free (reqdata->cache_key);
+		}
+
 		if (pool == NULL) {
 			g_slice_free1 (sizeof (struct rspamd_dns_request_ud), reqdata);
 		}
@@ -254,6 +423,19 @@ dns_resolver_init (rspamd_logger_t *logger,
 
 	rdns_resolver_set_logger (dns_resolver->r, rspamd_rnds_log_bridge, logger);
 
+	if (cfg != NULL && cfg->dns_cache_size > 0) {
+		dns_resolver->cache = rspamd_lru_hash_new_full (cfg->dns_cache_size,
+				g_free, (GDestroyNotify)rdns_request_release,
+				rspamd_strcase_hash, rspamd_strcase_equal);
+		dns_resolver->cache_max_ttl = cfg->dns_cache_max_ttl;
+		dns_resolver->cache_negative_ttl = cfg->dns_cache_negative_ttl;
+
+		if (dns_resolver->cache_max_ttl == 0) {
+			/* TTL equal to zero means no expiration for lru hash */
+			dns_resolver->cache_max_ttl = G_MAXUINT;
+		}
+	}
+
 	if (cfg == NULL || cfg->nameservers == NULL) {
 		/* Parse resolv.conf */
 		if (!rdns_resolver_parse_resolv_conf (dns_resolver->r, "/etc/resolv.conf")) {
@@ -23,16 +23,22 @@
 #include "logger.h"
 #include "rdns.h"
 #include "upstream.h"
+#include "hash.h"
 
 struct rspamd_config;
+struct rspamd_stat;
 
 struct rspamd_dns_resolver {
 	struct rdns_resolver *r;
 	struct event_base *ev_base;
 	struct upstream_list *ups;
 	struct rspamd_config *cfg;
+	rspamd_lru_hash_t *cache;		/**< replies cache (type + name -> request)	*/
+	struct rspamd_stat *stat;		/**< server statistics to record cache usage	*/
 	gdouble request_timeout;
 	guint max_retransmits;
+	guint cache_max_ttl;
+	guint cache_negative_ttl;
 };
 
 /* Rspamd DNS API */
@@ -44,7 +50,8 @@ struct rspamd_dns_resolver * dns_resolver_init (rspamd_logger_t *logger,
 	struct event_base *ev_base, struct rspamd_config *cfg);
 
 /**
- * Make a DNS request
+ * Make a DNS request, replies from the resolver's cache are delivered
+ * asynchronously just like the real ones
  * @param resolver resolver object
  * @param session async session to register event
  * @param pool memory pool for storage
@@ -91,7 +91,7 @@ enum rspamd_fuzzy_statement_idx {
 	RSPAMD_FUZZY_BACKEND_UPDATE_FLAG,
 	RSPAMD_FUZZY_BACKEND_INSERT_SHINGLE,
 	RSPAMD_FUZZY_BACKEND_CHECK,
-	RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE,
+	RSPAMD_FUZZY_BACKEND_CHECK_SHINGLES_BATCH,
 	RSPAMD_FUZZY_BACKEND_GET_DIGEST_BY_ID,
 	RSPAMD_FUZZY_BACKEND_DELETE,
 	RSPAMD_FUZZY_BACKEND_COUNT,
@@ -172,9 +172,30 @@ static struct rspamd_fuzzy_stmts {
 		.result = SQLITE_ROW
 	},
 	{
-		.idx = RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE,
-		.sql = "SELECT digest_id FROM shingles WHERE value=?1 AND number=?2",
-		.args = "IS",
+		/*
+		 * All RSPAMD_SHINGLE_SIZE shingles are looked up at once: each term
+		 * matches the unique index `s`, so sqlite evaluates it as a union
+		 * of index lookups
+		 */
+		.idx = RSPAMD_FUZZY_BACKEND_CHECK_SHINGLES_BATCH,
+		.sql = "SELECT number, digest_id FROM shingles WHERE "
+				"(value=?1 AND number=0) OR (value=?2 AND number=1) OR "
+				"(value=?3 AND number=2) OR (value=?4 AND number=3) OR "
+				"(value=?5 AND number=4) OR (value=?6 AND number=5) OR "
+				"(value=?7 AND number=6) OR (value=?8 AND number=7) OR "
+				"(value=?9 AND number=8) OR (value=?10 AND number=9) OR "
+				"(value=?11 AND number=10) OR (value=?12 AND number=11) OR "
+				"(value=?13 AND number=12) OR (value=?14 AND number=13) OR "
+				"(value=?15 AND number=14) OR (value=?16 AND number=15) OR "
+				"(value=?17 AND number=16) OR (value=?18 AND number=17) OR "
+				"(value=?19 AND number=18) OR (value=?20 AND number=19) OR "
+				"(value=?21 AND number=20) OR (value=?22 AND number=21) OR "
+				"(value=?23 AND number=22) OR (value=?24 AND number=23) OR "
+				"(value=?25 AND number=24) OR (value=?26 AND number=25) OR "
+				"(value=?27 AND number=26) OR (value=?28 AND number=27) OR "
+				"(value=?29 AND number=28) OR (value=?30 AND number=29) OR "
+				"(value=?31 AND number=30) OR (value=?32 AND number=31);",
+		.args = "IIIIIIIIIIIIIIIIIIIIIIIIIIIIIIII",
 		.stmt = NULL,
 		.result = SQLITE_ROW
 	},
@@ -492,6 +513,51 @@ rspamd_fuzzy_backend_sqlite_int64_cmp (const void *a, const void *b)
 	return (ia - ib);
 }
 
+/*
+ * Fills `shingle_values` with digest ids for each shingle (or -1 if a shingle
+ * is not found) using a single query for all shingles
+ */
+static void
+rspamd_fuzzy_backend_sqlite_check_shingles (
+		struct rspamd_fuzzy_backend_sqlite *backend,
+		const struct rspamd_fuzzy_shingle_cmd *shcmd,
+		gint64 *shingle_values)
+{
+	const guint64 *h = shcmd->sgl.hashes;
+	sqlite3_stmt *stmt;
+	gint64 num;
+	gint rc, i;
+
+	G_STATIC_ASSERT (RSPAMD_SHINGLE_SIZE == 32);
+
+	for (i = 0; i < RSPAMD_SHINGLE_SIZE; i ++) {
+		shingle_values[i] = -1;
+	}
+
+	rc = rspamd_fuzzy_backend_sqlite_run_stmt (backend, FALSE,
+			RSPAMD_FUZZY_BACKEND_CHECK_SHINGLES_BATCH,
+			h[0], h[1], h[2], h[3], h[4], h[5], h[6], h[7],
+			h[8], h[9], h[10], h[11], h[12], h[13], h[14], h[15],
+			h[16], h[17], h[18], h[19], h[20], h[21], h[22], h[23],
+			h[24], h[25], h[26], h[27], h[28], h[29], h[30], h[31]);
+	stmt = prepared_stmts[RSPAMD_FUZZY_BACKEND_CHECK_SHINGLES_BATCH].stmt;
+
+	while (rc == SQLITE_OK || rc == SQLITE_ROW) {
+		num = sqlite3_column_int64 (stmt, 0);
+
+		if (num >= 0 && num < RSPAMD_SHINGLE_SIZE) {
+			shingle_values[num] = sqlite3_column_int64 (stmt, 1);
+			msg_debug_fuzzy_backend ("found shingle %L -> %L: %L", num,
+					h[num], shingle_values[num]);
+		}
+
+		rc = sqlite3_step (stmt);
+	}
+
+	rspamd_fuzzy_backend_sqlite_cleanup_stmt (backend,
+			RSPAMD_FUZZY_BACKEND_CHECK_SHINGLES_BATCH);
+}
+
 struct rspamd_fuzzy_reply
 rspamd_fuzzy_backend_sqlite_check (struct rspamd_fuzzy_backend_sqlite *backend,
 		const struct rspamd_fuzzy_cmd *cmd, gint64 expire)
@@ -534,25 +600,8 @@ rspamd_fuzzy_backend_sqlite_check (struct rspamd_fuzzy_backend_sqlite *backend,
 
 		rspamd_fuzzy_backend_sqlite_cleanup_stmt (backend, RSPAMD_FUZZY_BACKEND_CHECK);
 		shcmd = (const struct rspamd_fuzzy_shingle_cmd *)cmd;
-
-		for (i = 0; i < RSPAMD_SHINGLE_SIZE; i ++) {
-			rc = rspamd_fuzzy_backend_sqlite_run_stmt (backend, FALSE,
-					RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE,
-					shcmd->sgl.hashes[i], i);
-			if (rc == SQLITE_OK) {
-				shingle_values[i] = sqlite3_column_int64 (
-						prepared_stmts[RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE].stmt,
-						0);
-			}
-			else {
-				shingle_values[i] = -1;
-			}
-			msg_debug_fuzzy_backend ("looking for shingle %L -> %L: %d", i,
-					shcmd->sgl.hashes[i], rc);
-		}
-
-		rspamd_fuzzy_backend_sqlite_cleanup_stmt (backend,
-				RSPAMD_FUZZY_BACKEND_CHECK_SHINGLE);
+		rspamd_fuzzy_backend_sqlite_check_shingles (backend, shcmd,
+				shingle_values);
 
 		qsort (shingle_values, RSPAMD_SHINGLE_SIZE, sizeof (gint64),
 				rspamd_fuzzy_backend_sqlite_int64_cmp);
@@ -8,6 +8,8 @@
 
 #define RSPAMD_FUZZY_VERSION 3
 #define RSPAMD_FUZZY_KEYLEN 8
+/* Maximum number of commands packed in a single datagram */
+#define RSPAMD_FUZZY_MULTI_MAX 8
 
 /* Commands for fuzzy storage */
 #define FUZZY_CHECK 0
@@ -24,6 +26,7 @@ enum rspamd_fuzzy_epoch {
 	RSPAMD_FUZZY_EPOCH8, /**< 0.8 till 0.9 */
 	RSPAMD_FUZZY_EPOCH9, /**< 0.9 + */
 	RSPAMD_FUZZY_EPOCH10, /**< 1.0+ encryption */
+	RSPAMD_FUZZY_EPOCH11, /**< 1.5+ multiple commands per datagram */
 	RSPAMD_FUZZY_EPOCH_MAX
 };
 
@@ -67,6 +70,22 @@ RSPAMD_PACKED(rspamd_fuzzy_encrypted_shingle_cmd) {
 	struct rspamd_fuzzy_shingle_cmd cmd;
 };
 
+/*
+ * Multiple commands encrypted as a single payload, each command is followed
+ * by its shingles if `shingles_count` is not zero
+ */
+RSPAMD_PACKED(rspamd_fuzzy_multi_hdr) {
+	guint8 version;
+	guint8 ncmds;
+	guint16 reserved;
+};
+
+RSPAMD_PACKED(rspamd_fuzzy_encrypted_multi_cmd) {
+	struct rspamd_fuzzy_encrypted_req_hdr hdr;
+	struct rspamd_fuzzy_multi_hdr mhdr;
+	guchar data[sizeof (struct rspamd_fuzzy_shingle_cmd) * RSPAMD_FUZZY_MULTI_MAX];
+};
+
 RSPAMD_PACKED(rspamd_fuzzy_encrypted_rep_hdr) {
 	guchar nonce[rspamd_cryptobox_MAX_NONCEBYTES];
 	guchar mac[rspamd_cryptobox_MAX_MACBYTES];
@@ -77,7 +96,17 @@ RSPAMD_PACKED(rspamd_fuzzy_encrypted_reply) {
 	struct rspamd_fuzzy_reply rep;
 };
 
+/*
+ * Replies for multiple commands are encrypted together and follow the order
+ * of commands in the request
+ */
+RSPAMD_PACKED(rspamd_fuzzy_encrypted_multi_reply) {
+	struct rspamd_fuzzy_encrypted_rep_hdr hdr;
+	struct rspamd_fuzzy_reply rep[RSPAMD_FUZZY_MULTI_MAX];
+};
+
 static const guchar fuzzy_encrypted_magic[4] = {'r', 's', 'f', 'e'};
+static const guchar fuzzy_encrypted_multi_magic[4] = {'r', 's', 'f', 'm'};
 
 struct rspamd_fuzzy_stat_entry {
 	const gchar *name;
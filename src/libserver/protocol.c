@@ -1256,6 +1256,7 @@ end:
 		__atomic_add_fetch (&task->worker->srv->stat->messages_scanned,
 				1, __ATOMIC_RELEASE);
 #endif
+		rspamd_task_trace_update_stat (task, task->worker->srv->stat);
 	}
 }
 
@@ -103,6 +103,7 @@ struct rspamd_re_cache {
 	gchar hash[rspamd_cryptobox_HASHBYTES + 1];
 #ifdef WITH_HYPERSCAN
 	gboolean hyperscan_loaded;
+	guint hs_classes_loaded;
 	gboolean disable_hyperscan;
 	gboolean vectorized_hyperscan;
 	hs_platform_info_t plt;
@@ -216,6 +217,40 @@ rspamd_re_cache_is_hs_loaded (struct rspamd_re_cache *cache)
 #endif
 }
 
+guint
+rspamd_re_cache_compare (struct rspamd_re_cache *cache,
+		struct rspamd_re_cache *old)
+{
+	GHashTableIter it;
+	gpointer k, v;
+	struct rspamd_re_class *re_class, *old_class;
+	guint nsame = 0;
+
+	g_assert (cache != NULL);
+	g_assert (old != NULL);
+
+	g_hash_table_iter_init (&it, cache->re_classes);
+
+	while (g_hash_table_iter_next (&it, &k, &v)) {
+		re_class = v;
+		old_class = g_hash_table_lookup (old->re_classes, &re_class->id);
+
+		if (old_class != NULL && strcmp (old_class->hash, re_class->hash) == 0) {
+			nsame ++;
+		}
+	}
+
+	if (strcmp (cache->hash, old->hash) == 0) {
+		msg_info_re_cache ("regexps are not changed, %ud classes", nsame);
+	}
+	else {
+		msg_info_re_cache ("%ud of %ud regexp classes are not changed",
+				nsame, g_hash_table_size (cache->re_classes));
+	}
+
+	return nsame;
+}
+
 rspamd_regexp_t *
 rspamd_re_cache_add (struct rspamd_re_cache *cache, rspamd_regexp_t *re,
 		enum rspamd_re_type type, gpointer type_data, gsize datalen)
@@ -463,7 +498,7 @@ rspamd_re_cache_runtime_new (struct rspamd_re_cache *cache)
 	rt->results = g_slice_alloc0 (cache->nre);
 	rt->stat.regexp_total = cache->nre;
 #ifdef WITH_HYPERSCAN
-	rt->has_hs = cache->hyperscan_loaded;
+	rt->has_hs = cache->hs_classes_loaded > 0;
 #endif
 
 	return rt;
@@ -1827,7 +1862,7 @@ rspamd_re_cache_is_valid_hyperscan_file (struct rspamd_re_cache *cache,
 
 gboolean
 rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
-		const char *cache_dir)
+		const char *cache_dir, gboolean forced)
 {
 	g_assert (cache != NULL);
 	g_assert (cache_dir != NULL);
@@ -1843,11 +1878,26 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 	struct rspamd_re_class *re_class;
 	struct rspamd_re_cache_elt *elt;
 	struct stat st;
+	hs_database_t *hs_db;
+	hs_scratch_t *hs_scratch;
+	guint nclasses = 0, nloaded = 0;
 
 	g_hash_table_iter_init (&it, cache->re_classes);
 
 	while (g_hash_table_iter_next (&it, &k, &v)) {
 		re_class = v;
+		nclasses ++;
+
+		if (re_class->hs_db != NULL && !forced) {
+			/*
+			 * Files are named by the class hash, so the loaded database is
+			 * the same as the one on disk
+			 */
+			total += re_class->nhs;
+			nloaded ++;
+			continue;
+		}
+
 		rspamd_snprintf (path, sizeof (path), "%s%c%s.hs", cache_dir,
 				G_DIR_SEPARATOR, re_class->hash);
 
@@ -1855,18 +1905,25 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 			msg_debug_re_cache ("load hyperscan database from '%s'",
 					re_class->hash);
 
+			/* File could be removed by hs_helper cleanup meanwhile */
 			fd = open (path, O_RDONLY);
 
-			/* Read number of regexps */
-			g_assert (fd != -1);
-			fstat (fd, &st);
+			if (fd == -1 || fstat (fd, &st) == -1) {
+				msg_err_re_cache ("cannot open %s: %s", path, strerror (errno));
+
+				if (fd != -1) {
+					close (fd);
+				}
+
+				goto keep_old;
+			}
 
 			map = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
 
 			if (map == MAP_FAILED) {
 				msg_err_re_cache ("cannot mmap %s: %s", path, strerror (errno));
 				close (fd);
-				return FALSE;
+				goto keep_old;
 			}
 
 			close (fd);
@@ -1882,10 +1939,9 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 				msg_err_re_cache ("bad number of expressions in %s: %d",
 						path, n);
 				munmap (map, st.st_size);
-				return FALSE;
+				goto keep_old;
 			}
 
-			total += n;
 			p += sizeof (n);
 			hs_ids = g_malloc (n * sizeof (*hs_ids));
 			memcpy (hs_ids, p, n * sizeof (*hs_ids));
@@ -1896,6 +1952,32 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 			/* Skip crc */
 			p += n * sizeof (*hs_ids) + sizeof (guint64);
 
+			/* Old database is replaced only when the new one is ready */
+			hs_db = NULL;
+			hs_scratch = NULL;
+
+			if ((ret = hs_deserialize_database (p, end - p, &hs_db))
+					!= HS_SUCCESS) {
+				msg_err_re_cache ("bad hs database in %s: %d", path, ret);
+				munmap (map, st.st_size);
+				g_free (hs_ids);
+				g_free (hs_flags);
+
+				goto keep_old;
+			}
+
+			munmap (map, st.st_size);
+
+			if ((ret = hs_alloc_scratch (hs_db, &hs_scratch)) != HS_SUCCESS) {
+				msg_err_re_cache ("cannot allocate scratch for %s: %d",
+						path, ret);
+				hs_free_database (hs_db);
+				g_free (hs_ids);
+				g_free (hs_flags);
+
+				goto keep_old;
+			}
+
 			/* Cleanup */
 			if (re_class->hs_scratch != NULL) {
 				hs_free_scratch (re_class->hs_scratch);
@@ -1909,24 +1991,8 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 				g_free (re_class->hs_ids);
 			}
 
-			re_class->hs_ids = NULL;
-			re_class->hs_scratch = NULL;
-			re_class->hs_db = NULL;
-
-			if ((ret = hs_deserialize_database (p, end - p, &re_class->hs_db))
-					!= HS_SUCCESS) {
-				msg_err_re_cache ("bad hs database in %s: %d", path, ret);
-				munmap (map, st.st_size);
-				g_free (hs_ids);
-				g_free (hs_flags);
-
-				return FALSE;
-			}
-
-			munmap (map, st.st_size);
-
-			g_assert (hs_alloc_scratch (re_class->hs_db,
-					&re_class->hs_scratch) == HS_SUCCESS);
+			re_class->hs_db = hs_db;
+			re_class->hs_scratch = hs_scratch;
 
 			/*
 			 * Now find hyperscan elts that are successfully compiled and
@@ -1947,12 +2013,32 @@ rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
 			re_class->hs_ids = hs_ids;
 			g_free (hs_flags);
 			re_class->nhs = n;
+			total += n;
+			nloaded ++;
+
+			continue;
 		}
 		else {
-			msg_err_re_cache ("invalid hyperscan hash file '%s'",
+			msg_debug_re_cache ("invalid or missing hyperscan hash file '%s'",
 					path);
-			return FALSE;
 		}
+
+keep_old:
+		if (re_class->hs_db != NULL) {
+			/* Previously loaded database is still valid for this class */
+			total += re_class->nhs;
+			nloaded ++;
+		}
+	}
+
+	/* Loaded classes are matched by hyperscan, others use pcre */
+	cache->hs_classes_loaded = nloaded;
+
+	if (nloaded < nclasses) {
+		msg_info_re_cache ("hyperscan databases of %ud of %ud classes (%d "
+				"regexps) have been loaded", nloaded, nclasses, total);
+
+		return FALSE;
 	}
 
 	msg_info_re_cache ("hyperscan database of %d regexps has been loaded", total);
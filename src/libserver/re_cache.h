@@ -87,6 +87,16 @@ void rspamd_re_cache_init (struct rspamd_re_cache *cache,
  */
 gboolean rspamd_re_cache_is_hs_loaded (struct rspamd_re_cache *cache);
 
+/**
+ * Compares regexp classes of an initialized cache with the classes of
+ * another cache by their hashes
+ * @param cache new cache
+ * @param old previous cache
+ * @return number of classes that are the same in both caches
+ */
+guint rspamd_re_cache_compare (struct rspamd_re_cache *cache,
+		struct rspamd_re_cache *old);
+
 /**
  * Get runtime data for a cache
  */
@@ -165,8 +175,12 @@ gboolean rspamd_re_cache_is_valid_hyperscan_file (struct rspamd_re_cache *cache,
 		const char *path, gboolean silent, gboolean try_load);
 
 /**
- * Loads all hyperscan regexps precompiled
+ * Loads all hyperscan regexps precompiled, classes that have no valid
+ * database in `cache_dir` are matched by pcre until the next call
+ * @param forced reload databases of classes that are already loaded, the
+ * old database of a class is replaced only once the new one is ready
+ * @return TRUE if all classes are loaded
  */
 gboolean rspamd_re_cache_load_hyperscan (struct rspamd_re_cache *cache,
-		const char *cache_dir);
+		const char *cache_dir, gboolean forced);
 #endif
@@ -71,7 +71,7 @@ void
 rspamd_roll_history_update (struct roll_history *history,
 	struct rspamd_task *task)
 {
-	guint row_num;
+	guint row_num, i;
 	struct roll_history_row *row;
 	struct rspamd_metric_result *metric_res;
 	struct history_metric_callback_data cbdata;
@@ -140,10 +140,41 @@ rspamd_roll_history_update (struct roll_history *history,
 	}
 
 	row->scan_time = rspamd_get_ticks () - task->time_real;
+
+	for (i = 0; i < RSPAMD_TASK_TRACE_MAX; i ++) {
+		if (task->trace.stage_start[i] != 0) {
+			row->stages_time[i] = task->trace.stage_time[i] * 1000.0;
+		}
+		else {
+			row->stages_time[i] = -1;
+		}
+	}
+
+	rspamd_task_trace_symbols_write (task, row->slow_symbols,
+			sizeof (row->slow_symbols));
 	row->len = task->msg.len;
 	g_atomic_int_set (&row->completed, TRUE);
 }
 
+ucl_object_t *
+rspamd_roll_history_row_stages (struct roll_history_row *row)
+{
+	ucl_object_t *obj;
+	guint i;
+
+	obj = ucl_object_typed_new (UCL_OBJECT);
+
+	for (i = 0; i < RSPAMD_TASK_TRACE_MAX; i ++) {
+		if (row->stages_time[i] >= 0) {
+			ucl_object_insert_key (obj,
+					ucl_object_fromdouble (row->stages_time[i]),
+					rspamd_task_trace_stage_name (i), 0, false);
+		}
+	}
+
+	return obj;
+}
+
 /**
  * Load previously saved history from file
  * @param history roll history object
@@ -157,10 +188,10 @@ rspamd_roll_history_load (struct roll_history *history, const gchar *filename)
 	struct stat st;
 	gchar magic[sizeof(rspamd_history_magic_old)];
 	ucl_object_t *top;
-	const ucl_object_t *cur, *elt;
+	const ucl_object_t *cur, *elt, *sub;
 	struct ucl_parser *parser;
 	struct roll_history_row *row;
-	guint n, i;
+	guint n, i, j;
 
 	g_assert (history != NULL);
 
@@ -284,6 +315,31 @@ rspamd_roll_history_load (struct roll_history *history, const gchar *filename)
 				row->scan_time = ucl_object_todouble (elt);
 			}
 
+			for (j = 0; j < RSPAMD_TASK_TRACE_MAX; j ++) {
+				row->stages_time[j] = -1;
+			}
+
+			elt = ucl_object_lookup (cur, "stages");
+
+			if (elt && ucl_object_type (elt) == UCL_OBJECT) {
+				for (j = 0; j < RSPAMD_TASK_TRACE_MAX; j ++) {
+					sub = ucl_object_lookup (elt,
+							rspamd_task_trace_stage_name (j));
+
+					if (sub && (ucl_object_type (sub) == UCL_FLOAT ||
+							ucl_object_type (sub) == UCL_INT)) {
+						row->stages_time[j] = ucl_object_todouble (sub);
+					}
+				}
+			}
+
+			elt = ucl_object_lookup (cur, "slow_symbols");
+
+			if (elt && ucl_object_type (elt) == UCL_STRING) {
+				rspamd_strlcpy (row->slow_symbols, ucl_object_tostring (elt),
+						sizeof (row->slow_symbols));
+			}
+
 			elt = ucl_object_lookup (cur, "score");
 
 			if (elt && ucl_object_type (elt) == UCL_FLOAT) {
@@ -360,6 +416,10 @@ rspamd_roll_history_save (struct roll_history *history, const gchar *filename)
 				"len", 0, false);
 		ucl_object_insert_key (elt, ucl_object_fromdouble (row->scan_time),
 				"scan_time", 0, false);
+		ucl_object_insert_key (elt, rspamd_roll_history_row_stages (row),
+				"stages", 0, false);
+		ucl_object_insert_key (elt, ucl_object_fromstring (row->slow_symbols),
+				"slow_symbols", 0, false);
 		ucl_object_insert_key (elt, ucl_object_fromdouble (row->score),
 				"score", 0, false);
 		ucl_object_insert_key (elt, ucl_object_fromdouble (row->required_score),
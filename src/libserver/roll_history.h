@@ -18,6 +18,7 @@
 
 #include "config.h"
 #include "mem_pool.h"
+#include "task.h"
 
 /*
  * Roll history is a special cycled buffer for checked messages, it is designed for writing history messages
@@ -28,6 +29,7 @@
 #define HISTORY_MAX_SYMBOLS 256
 #define HISTORY_MAX_USER 32
 #define HISTORY_MAX_ADDR 32
+#define HISTORY_MAX_SLOW_SYMBOLS 128
 
 struct rspamd_task;
 
@@ -39,6 +41,8 @@ struct roll_history_row {
 	gchar from_addr[HISTORY_MAX_ADDR];
 	gsize len;
 	gdouble scan_time;
+	gfloat stages_time[RSPAMD_TASK_TRACE_MAX];	/* in milliseconds, negative if not run */
+	gchar slow_symbols[HISTORY_MAX_SLOW_SYMBOLS];
 	gdouble score;
 	gdouble required_score;
 	gint action;
@@ -67,6 +71,13 @@ struct roll_history * rspamd_roll_history_new (rspamd_mempool_t *pool,
 void rspamd_roll_history_update (struct roll_history *history,
 	struct rspamd_task *task);
 
+/**
+ * Returns stages times of the history row as ucl object
+ * @param row history row
+ * @return new ucl object with stage name as key and time in milliseconds
+ */
+ucl_object_t * rspamd_roll_history_row_stages (struct roll_history_row *row);
+
 /**
  * Load previously saved history from file
  * @param history roll history object
@@ -101,6 +101,13 @@ static const struct rspamd_control_cmd_match {
 				},
 				.type = RSPAMD_CONTROL_FUZZY_SYNC
 		},
+		{
+				.name = {
+						.begin = "/reloadrules",
+						.len = sizeof ("/reloadrules") - 1
+				},
+				.type = RSPAMD_CONTROL_RELOAD_RULES
+		},
 };
 
 void
@@ -183,6 +190,7 @@ rspamd_control_write_reply (struct rspamd_control_session *session)
 	gdouble total_utime = 0, total_systime = 0;
 	struct ucl_parser *parser;
 	guint total_conns = 0;
+	guint64 total_accepted = 0;
 
 	rep = ucl_object_typed_new (UCL_OBJECT);
 	workers = ucl_object_typed_new (UCL_OBJECT);
@@ -205,6 +213,13 @@ rspamd_control_write_reply (struct rspamd_control_session *session)
 		case RSPAMD_CONTROL_STAT:
 			ucl_object_insert_key (cur, ucl_object_fromint (
 					elt->reply.reply.stat.conns), "conns", 0, false);
+			ucl_object_insert_key (cur, ucl_object_fromint (
+					elt->reply.reply.stat.accepted), "accepted", 0, false);
+			ucl_object_insert_key (cur, ucl_object_fromint (
+					elt->reply.reply.stat.accept_wakeups), "accept_wakeups",
+					0, false);
+			ucl_object_insert_key (cur, ucl_object_fromint (
+					elt->wrk->index), "index", 0, false);
 			ucl_object_insert_key (cur, ucl_object_fromdouble (
 					elt->reply.reply.stat.utime), "utime", 0, false);
 			ucl_object_insert_key (cur, ucl_object_fromdouble (
@@ -217,6 +232,7 @@ rspamd_control_write_reply (struct rspamd_control_session *session)
 			total_utime += elt->reply.reply.stat.utime;
 			total_systime += elt->reply.reply.stat.systime;
 			total_conns += elt->reply.reply.stat.conns;
+			total_accepted += elt->reply.reply.stat.accepted;
 
 			break;
 
@@ -282,6 +298,10 @@ rspamd_control_write_reply (struct rspamd_control_session *session)
 			ucl_object_insert_key (cur, ucl_object_fromint (
 					elt->reply.reply.fuzzy_sync.status), "status", 0, false);
 			break;
+		case RSPAMD_CONTROL_RELOAD_RULES:
+			ucl_object_insert_key (cur, ucl_object_fromint (
+					elt->reply.reply.reload_rules.status), "status", 0, false);
+			break;
 		default:
 			break;
 		}
@@ -301,6 +321,8 @@ rspamd_control_write_reply (struct rspamd_control_session *session)
 		cur = ucl_object_typed_new (UCL_OBJECT);
 		ucl_object_insert_key (cur, ucl_object_fromint (
 				total_conns), "conns", 0, false);
+		ucl_object_insert_key (cur, ucl_object_fromint (
+				total_accepted), "accepted", 0, false);
 		ucl_object_insert_key (cur, ucl_object_fromdouble (
 				total_utime), "utime", 0, false);
 		ucl_object_insert_key (cur, ucl_object_fromdouble (
@@ -552,6 +574,8 @@ rspamd_control_default_cmd_handler (gint fd,
 		}
 
 		rep.reply.stat.conns = cd->worker->nconns;
+		rep.reply.stat.accepted = cd->worker->accepted;
+		rep.reply.stat.accept_wakeups = cd->worker->accept_wakeups;
 		rep.reply.stat.uptime = rspamd_get_calendar_ticks () - cd->worker->start_time;
 		break;
 	case RSPAMD_CONTROL_RELOAD:
@@ -561,6 +585,10 @@ rspamd_control_default_cmd_handler (gint fd,
 	case RSPAMD_CONTROL_FUZZY_SYNC:
 	case RSPAMD_CONTROL_LOG_PIPE:
 		break;
+	case RSPAMD_CONTROL_RELOAD_RULES:
+		/* Workers that can swap rules in place register their own handler */
+		rep.reply.reload_rules.status = ENOTSUP;
+		break;
 	case RSPAMD_CONTROL_RERESOLVE:
 		if (cd->worker->srv->cfg) {
 			REF_RETAIN (cd->worker->srv->cfg);
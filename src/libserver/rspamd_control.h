@@ -32,6 +32,7 @@ enum rspamd_control_type {
 	RSPAMD_CONTROL_LOG_PIPE,
 	RSPAMD_CONTROL_FUZZY_STAT,
 	RSPAMD_CONTROL_FUZZY_SYNC,
+	RSPAMD_CONTROL_RELOAD_RULES,
 	RSPAMD_CONTROL_MAX
 };
 
@@ -73,6 +74,9 @@ struct rspamd_control_command {
 		struct {
 			guint unused;
 		} fuzzy_sync;
+		struct {
+			guint unused;
+		} reload_rules;
 	} cmd;
 };
 
@@ -81,6 +85,8 @@ struct rspamd_control_reply {
 	union {
 		struct {
 			guint conns;
+			guint64 accepted;
+			guint64 accept_wakeups;
 			gdouble uptime;
 			gdouble utime;
 			gdouble systime;
@@ -108,6 +114,9 @@ struct rspamd_control_reply {
 		struct {
 			guint status;
 		} fuzzy_sync;
+		struct {
+			guint status;
+		} reload_rules;
 	} reply;
 };
 
@@ -75,9 +75,21 @@ struct symbols_cache {
 	guint used_items;
 	guint64 total_hits;
 	struct rspamd_config *cfg;
-	rspamd_mempool_mutex_t *mtx;
 	gdouble reload_time;
 	gint peak_cb;
+	/* Per worker counters in shared memory */
+	guchar *slabs;
+	gsize slab_size;
+	guint nslabs;
+	guint slab_items;
+	struct symbols_cache_slab *own_slab;
+	/* Worker only: periodic resort of items */
+	struct rspamd_cache_refresh_cbdata *refresh;
+	/* Main process only: counters seen during the previous aggregation */
+	struct item_counters *seen_counters;
+	gdouble last_aggregate;
+	struct event aggregate_ev;
+	struct event_base *aggregate_ev_base;
 };
 
 struct counter_data {
@@ -86,25 +98,44 @@ struct counter_data {
 	guint64 number;
 };
 
+/* Written by the main process only */
 struct item_stat {
 	struct counter_data time_counter;
 	gdouble avg_time;
 	gdouble weight;
-	guint hits;
 	guint64 total_hits;
 	struct counter_data frequency_counter;
 	gdouble avg_frequency;
 	gdouble stddev_frequency;
+	/* Last frequency peak */
+	guint peaks;
+	gdouble peak_value;
+	gdouble peak_err;
 };
 
+/*
+ * Monotonic counters that are written by a single worker, so no locking
+ * or atomic operations are required to update them
+ */
+struct item_counters {
+	guint64 hits;
+	guint64 time_count;
+	gdouble time_sum;
+};
+
+struct symbols_cache_slab {
+	gint owner;
+	struct item_counters counters[];
+};
+
+#define SLAB_ALIGN 64
+#define CACHE_SLAB(cache, i) \
+	((struct symbols_cache_slab *)((cache)->slabs + (cache)->slab_size * (i)))
+
 struct cache_item {
 	/* This block is likely shared */
 	struct item_stat *st;
 
-	guint64 last_count;
-
-	/* Per process counter */
-	struct counter_data *cd;
 	gchar *symbol;
 	enum rspamd_symbol_type type;
 
@@ -371,6 +402,8 @@ rspamd_symbols_cache_resort (struct symbols_cache *cache)
 }
 
 /* Sort items in logical order */
+static void rspamd_symbols_cache_alloc_slabs (struct symbols_cache *cache);
+
 static void
 rspamd_symbols_cache_post_init (struct symbols_cache *cache)
 {
@@ -463,6 +496,7 @@ rspamd_symbols_cache_post_init (struct symbols_cache *cache)
 
 	g_ptr_array_sort_with_data (cache->prefilters, prefilters_cmp, cache);
 	g_ptr_array_sort_with_data (cache->postfilters, postfilters_cmp, cache);
+	rspamd_symbols_cache_alloc_slabs (cache);
 }
 
 static gboolean
@@ -583,7 +617,6 @@ rspamd_symbols_cache_load_items (struct symbols_cache *cache, const gchar *name)
 			elt = ucl_object_lookup (cur, "count");
 			if (elt) {
 				item->st->total_hits = ucl_object_toint (elt);
-				item->last_count = item->st->total_hits;
 			}
 
 			elt = ucl_object_lookup (cur, "frequency");
@@ -731,13 +764,6 @@ rspamd_symbols_cache_add_symbol (struct symbols_cache *cache,
 			sizeof (*item->st));
 	item->condition_cb = -1;
 	item->enabled = TRUE;
-
-	/*
-	 * We do not share cd to skip locking, instead we'll just calculate it on
-	 * save or accumulate
-	 */
-	item->cd = rspamd_mempool_alloc0 (cache->static_pool,
-			sizeof (struct counter_data));
 	item->func = func;
 	item->user_data = user_data;
 	item->priority = priority;
@@ -887,6 +913,16 @@ rspamd_symbols_cache_destroy (struct symbols_cache *cache)
 	if (cache != NULL) {
 		rspamd_symbols_cache_save (cache);
 
+		if (cache->aggregate_ev_base) {
+			event_del (&cache->aggregate_ev);
+		}
+
+		rspamd_symbols_cache_stop_refresh (cache);
+
+		if (cache->seen_counters) {
+			g_free (cache->seen_counters);
+		}
+
 		if (cache->delayed_deps) {
 			cur = cache->delayed_deps;
 
@@ -944,7 +980,6 @@ rspamd_symbols_cache_new (struct rspamd_config *cfg)
 	cache->prefilters = g_ptr_array_new ();
 	cache->postfilters = g_ptr_array_new ();
 	cache->composites = g_ptr_array_new ();
-	cache->mtx = rspamd_mempool_get_mutex (cache->static_pool);
 	cache->reload_time = cfg->cache_reload_time;
 	cache->total_hits = 1;
 	cache->total_weight = 1.0;
@@ -1211,6 +1246,7 @@ rspamd_symbols_cache_watcher_cb (gpointer sessiond, gpointer ud)
 
 	/* Specify that we are done with this item */
 	setbit (checkpoint->processed_bits, item->id * 2 + 1);
+	rspamd_task_trace_symbol_finish (task, item->symbol);
 
 	if (checkpoint->pass > 0) {
 		for (i = 0; i < (gint)checkpoint->waitq->len; i ++) {
@@ -1296,12 +1332,16 @@ rspamd_symbols_cache_check_symbol (struct rspamd_task *task,
 						(gint)(diff / 1000.));
 			}
 
-			if (rspamd_worker_is_normal (task->worker)) {
-				rspamd_set_counter (item->cd, diff);
+			if (rspamd_worker_is_normal (task->worker) && cache->own_slab &&
+					item->id < (gint)cache->slab_items) {
+				cache->own_slab->counters[item->id].time_sum += diff;
+				cache->own_slab->counters[item->id].time_count ++;
 			}
 
 			rspamd_session_watch_stop (task->s);
 			pending_after = rspamd_session_events_pending (task->s);
+			rspamd_task_trace_symbol (task, item->symbol, t1, t2 - t1,
+					pending_before != pending_after);
 
 			if (pending_before == pending_after) {
 				/* No new events registered */
@@ -1894,14 +1934,12 @@ rspamd_symbols_cache_resort_cb (gint fd, short what, gpointer ud)
 	gdouble tm;
 	struct rspamd_cache_refresh_cbdata *cbdata = ud;
 	struct symbols_cache *cache;
-	struct cache_item *item, *parent;
-	guint i;
-	gdouble cur_ticks;
+	struct cache_item *item;
+	guint i, peaks;
 
 	cache = cbdata->cache;
 	/* Plan new event */
 	tm = rspamd_time_jitter (cache->reload_time, 0);
-	cur_ticks = rspamd_get_ticks ();
 	msg_debug_cache ("resort symbols cache, next reload in %.2f seconds", tm);
 	g_assert (cache != NULL);
 	evtimer_set (&cbdata->resort_ev, rspamd_symbols_cache_resort_cb, cbdata);
@@ -1909,87 +1947,84 @@ rspamd_symbols_cache_resort_cb (gint fd, short what, gpointer ud)
 	double_to_tv (tm, &tv);
 	event_add (&cbdata->resort_ev, &tv);
 
-	if (rspamd_worker_is_normal (cbdata->w)) {
-		rspamd_mempool_lock_mutex (cache->mtx);
-
-		/* Gather stats from shared execution times */
+	if (rspamd_worker_is_normal (cbdata->w) && cbdata->w->index == 0 &&
+			cache->peak_cb != -1) {
+		/* Peaks are detected by the main process when aggregating counters */
 		for (i = 0; i < cache->items_by_id->len; i ++) {
 			item = g_ptr_array_index (cache->items_by_id, i);
-			item->st->total_hits += item->st->hits;
-			item->st->hits = 0;
-
-			if (item->last_count > 0 && cbdata->w->index == 0) {
-				/* Calculate frequency */
-				gdouble cur_err, cur_value;
-
-				cur_value = (item->st->total_hits - item->last_count) /
-						(cur_ticks - cbdata->last_resort);
-				rspamd_set_counter (&item->st->frequency_counter,
-						cur_value);
-				item->st->avg_frequency = item->st->frequency_counter.mean;
-				item->st->stddev_frequency = item->st->frequency_counter.stddev;
-
-				if (cur_value > 0) {
-					msg_debug_cache ("frequency for %s is %.2f, avg: %.2f",
-							item->symbol, cur_value, item->st->avg_frequency);
-				}
+			peaks = item->st->peaks;
 
-				cur_err = (item->st->avg_frequency - cur_value);
-				cur_err *= cur_err;
+			if (peaks != (guint)item->frequency_peaks) {
+				item->frequency_peaks = peaks;
+				rspamd_symbols_cache_call_peak_cb (cbdata->ev_base,
+						cache, item,
+						item->st->peak_value, item->st->peak_err);
+			}
+		}
+	}
 
-				/*
-				 * TODO: replace magic number
-				 */
-				if (item->st->frequency_counter.number > 10 &&
-						cur_err > item->st->stddev_frequency * 2) {
-					item->frequency_peaks ++;
-					msg_debug_cache ("peak found for %s is %.2f, avg: %.2f, "
-							"stddev: %.2f, error: %.2f, peaks: %d",
-						item->symbol, cur_value,
-						item->st->avg_frequency,
-						item->st->stddev_frequency,
-						cur_err,
-						item->frequency_peaks);
+	cbdata->last_resort = rspamd_get_ticks ();
+	rspamd_symbols_cache_resort (cache);
+}
 
-					if (cache->peak_cb != -1) {
-						rspamd_symbols_cache_call_peak_cb (cbdata->ev_base,
-								cache, item,
-								cur_value, cur_err);
-					}
-				}
-			}
+static void
+rspamd_symbols_cache_alloc_slabs (struct symbols_cache *cache)
+{
+	struct rspamd_worker_conf *cf;
+	GList *cur;
+	guint nworkers = 0;
 
-			item->last_count = item->st->total_hits;
+	cur = cache->cfg->workers;
 
-			if (item->cd->number > 0) {
-				if (item->type & (SYMBOL_TYPE_CALLBACK|SYMBOL_TYPE_NORMAL)) {
-					item->st->avg_time = item->cd->mean;
-					rspamd_set_counter (&item->st->time_counter,
-							item->st->avg_time);
-					item->st->avg_time = item->st->time_counter.mean;
-					memset (item->cd, 0, sizeof (*item->cd));
-				}
-			}
-		}
+	while (cur) {
+		cf = cur->data;
+		nworkers += cf->count;
+		cur = g_list_next (cur);
+	}
 
-		/* Sync virtual symbols */
-		for (i = 0; i < cache->items_by_id->len; i ++) {
-			item = g_ptr_array_index (cache->items_by_id, i);
+	cache->nslabs = MAX (nworkers, 1);
+	cache->slab_items = cache->items_by_id->len;
+	/* Avoid false sharing between workers */
+	cache->slab_size = sizeof (struct symbols_cache_slab) +
+			sizeof (struct item_counters) * cache->slab_items;
+	cache->slab_size = (cache->slab_size + SLAB_ALIGN - 1) &
+			~((gsize)SLAB_ALIGN - 1);
+	cache->slabs = rspamd_mempool_alloc0_shared (cache->static_pool,
+			cache->slab_size * cache->nslabs);
+}
 
-			if (item->parent != -1) {
-				parent = g_ptr_array_index (cache->items_by_id, item->parent);
+static struct symbols_cache_slab *
+rspamd_symbols_cache_claim_slab (struct symbols_cache *cache)
+{
+	struct symbols_cache_slab *slab;
+	gint pid = getpid (), owner;
+	guint i;
 
-				if (parent) {
-					item->st->avg_time = parent->st->avg_time;
-				}
-			}
+	/* Free slabs first, then slabs of the dead workers */
+	for (i = 0; i < cache->nslabs; i ++) {
+		slab = CACHE_SLAB (cache, i);
+
+		if (g_atomic_int_compare_and_exchange (&slab->owner, 0, pid)) {
+			return slab;
+		}
+	}
+
+	for (i = 0; i < cache->nslabs; i ++) {
+		slab = CACHE_SLAB (cache, i);
+		owner = g_atomic_int_get (&slab->owner);
+
+		if (owner == pid) {
+			return slab;
 		}
 
-		rspamd_mempool_unlock_mutex (cache->mtx);
+		if (kill (owner, 0) == -1 && errno == ESRCH &&
+				g_atomic_int_compare_and_exchange (&slab->owner, owner, pid)) {
+			/* Counters are monotonic, so they are just continued */
+			return slab;
+		}
 	}
 
-	cbdata->last_resort = cur_ticks;
-	rspamd_symbols_cache_resort (cache);
+	return NULL;
 }
 
 void
@@ -1999,12 +2034,31 @@ rspamd_symbols_cache_start_refresh (struct symbols_cache * cache,
 	struct timeval tv;
 	gdouble tm;
 	struct rspamd_cache_refresh_cbdata *cbdata;
+	struct cache_item *item;
+	guint i;
 
 	cbdata = rspamd_mempool_alloc0 (cache->static_pool, sizeof (*cbdata));
 	cbdata->last_resort = rspamd_get_ticks ();
 	cbdata->ev_base = ev_base;
 	cbdata->w = w;
 	cbdata->cache = cache;
+	cache->refresh = cbdata;
+
+	if (cache->slabs != NULL && cache->own_slab == NULL) {
+		cache->own_slab = rspamd_symbols_cache_claim_slab (cache);
+
+		if (cache->own_slab == NULL) {
+			msg_warn_cache ("no free slabs for symbols statistics, %d slabs "
+					"are used", cache->nslabs);
+		}
+	}
+
+	/* Do not report peaks found before this worker has started */
+	for (i = 0; i < cache->items_by_id->len; i ++) {
+		item = g_ptr_array_index (cache->items_by_id, i);
+		item->frequency_peaks = item->st->peaks;
+	}
+
 	tm = rspamd_time_jitter (cache->reload_time, 0);
 	msg_debug_cache ("next reload in %.2f seconds", tm);
 	g_assert (cache != NULL);
@@ -2014,6 +2068,139 @@ rspamd_symbols_cache_start_refresh (struct symbols_cache * cache,
 	event_add (&cbdata->resort_ev, &tv);
 }
 
+void
+rspamd_symbols_cache_stop_refresh (struct symbols_cache *cache)
+{
+	g_assert (cache != NULL);
+
+	if (cache->refresh) {
+		event_del (&cache->refresh->resort_ev);
+		cache->refresh = NULL;
+	}
+}
+
+static void
+rspamd_symbols_cache_aggregate_cb (gint fd, short what, gpointer ud)
+{
+	struct symbols_cache *cache = ud;
+	struct timeval tv;
+	struct cache_item *item, *parent;
+	struct item_counters *cnt, *seen;
+	struct symbols_cache_slab *slab;
+	gdouble tm, cur_ticks, interval, time_sum, cur_value, cur_err;
+	guint64 hits, time_count, v;
+	guint i, j;
+
+	tm = rspamd_time_jitter (cache->reload_time, 0);
+	double_to_tv (tm, &tv);
+	event_add (&cache->aggregate_ev, &tv);
+
+	cur_ticks = rspamd_get_ticks ();
+	interval = cur_ticks - cache->last_aggregate;
+	cache->last_aggregate = cur_ticks;
+
+	for (i = 0; i < cache->slab_items; i ++) {
+		item = g_ptr_array_index (cache->items_by_id, i);
+		hits = 0;
+		time_count = 0;
+		time_sum = 0;
+
+		for (j = 0; j < cache->nslabs; j ++) {
+			slab = CACHE_SLAB (cache, j);
+			cnt = &slab->counters[i];
+			seen = &cache->seen_counters[j * cache->slab_items + i];
+
+			/* Each counter is read once as workers update them concurrently */
+			v = cnt->hits;
+			hits += v - seen->hits;
+			seen->hits = v;
+			v = cnt->time_count;
+			time_count += v - seen->time_count;
+			seen->time_count = v;
+			tm = cnt->time_sum;
+			time_sum += tm - seen->time_sum;
+			seen->time_sum = tm;
+		}
+
+		item->st->total_hits += hits;
+
+		if (interval > 0) {
+			/* Calculate frequency */
+			cur_value = hits / interval;
+			rspamd_set_counter (&item->st->frequency_counter, cur_value);
+			item->st->avg_frequency = item->st->frequency_counter.mean;
+			item->st->stddev_frequency = item->st->frequency_counter.stddev;
+
+			if (cur_value > 0) {
+				msg_debug_cache ("frequency for %s is %.2f, avg: %.2f",
+						item->symbol, cur_value, item->st->avg_frequency);
+			}
+
+			cur_err = (item->st->avg_frequency - cur_value);
+			cur_err *= cur_err;
+
+			/*
+			 * TODO: replace magic number
+			 */
+			if (item->st->frequency_counter.number > 10 &&
+					cur_err > item->st->stddev_frequency * 2) {
+				item->st->peak_value = cur_value;
+				item->st->peak_err = cur_err;
+				item->st->peaks ++;
+				msg_debug_cache ("peak found for %s is %.2f, avg: %.2f, "
+						"stddev: %.2f, error: %.2f, peaks: %ud",
+						item->symbol, cur_value,
+						item->st->avg_frequency,
+						item->st->stddev_frequency,
+						cur_err,
+						item->st->peaks);
+			}
+		}
+
+		if (time_count > 0 &&
+				(item->type & (SYMBOL_TYPE_CALLBACK|SYMBOL_TYPE_NORMAL))) {
+			rspamd_set_counter (&item->st->time_counter,
+					time_sum / time_count);
+			item->st->avg_time = item->st->time_counter.mean;
+		}
+	}
+
+	/* Sync virtual symbols */
+	for (i = 0; i < cache->items_by_id->len; i ++) {
+		item = g_ptr_array_index (cache->items_by_id, i);
+
+		if (item->parent != -1) {
+			parent = g_ptr_array_index (cache->items_by_id, item->parent);
+
+			if (parent) {
+				item->st->avg_time = parent->st->avg_time;
+			}
+		}
+	}
+}
+
+void
+rspamd_symbols_cache_start_aggregation (struct symbols_cache *cache,
+		struct event_base *ev_base)
+{
+	struct timeval tv;
+
+	g_assert (cache != NULL);
+
+	if (cache->slabs == NULL || cache->aggregate_ev_base != NULL) {
+		return;
+	}
+
+	cache->seen_counters = g_malloc0 (sizeof (struct item_counters) *
+			cache->slab_items * cache->nslabs);
+	cache->last_aggregate = rspamd_get_ticks ();
+	cache->aggregate_ev_base = ev_base;
+	evtimer_set (&cache->aggregate_ev, rspamd_symbols_cache_aggregate_cb, cache);
+	event_base_set (ev_base, &cache->aggregate_ev);
+	double_to_tv (rspamd_time_jitter (cache->reload_time, 0), &tv);
+	event_add (&cache->aggregate_ev, &tv);
+}
+
 void
 rspamd_symbols_cache_inc_frequency (struct symbols_cache *cache,
 		const gchar *symbol)
@@ -2024,8 +2211,9 @@ rspamd_symbols_cache_inc_frequency (struct symbols_cache *cache,
 
 	item = g_hash_table_lookup (cache->items_by_symbol, symbol);
 
-	if (item != NULL) {
-		g_atomic_int_inc (&item->st->hits);
+	if (item != NULL && cache->own_slab &&
+			item->id < (gint)cache->slab_items) {
+		cache->own_slab->counters[item->id].hits ++;
 	}
 }
 
@@ -2349,6 +2537,47 @@ rspamd_symbols_cache_enable_symbol (struct symbols_cache *cache,
 	}
 }
 
+void
+rspamd_symbols_cache_inherit (struct symbols_cache *cache,
+		struct symbols_cache *old)
+{
+	struct cache_item *item, *old_item;
+	gdouble weight;
+	guint i, reused = 0;
+
+	g_assert (cache != NULL);
+	g_assert (old != NULL);
+
+	for (i = 0; i < cache->items_by_id->len; i ++) {
+		item = g_ptr_array_index (cache->items_by_id, i);
+		old_item = g_hash_table_lookup (old->items_by_symbol, item->symbol);
+
+		if (old_item == NULL || old_item->type != item->type) {
+			continue;
+		}
+
+		/* Weight is defined by the new metric */
+		weight = item->st->weight;
+		memcpy (item->st, old_item->st, sizeof (*item->st));
+		item->st->weight = weight;
+		item->frequency_peaks = old_item->frequency_peaks;
+		reused ++;
+	}
+
+	rspamd_symbols_cache_resort (cache);
+
+	if (cache->cksum == old->cksum && reused == old->items_by_id->len) {
+		msg_info_cache ("symbols are not changed, reused statistics of %ud "
+				"symbols", reused);
+	}
+	else {
+		msg_info_cache ("reused statistics of %ud symbols, %ud symbols are new, "
+				"%ud symbols are removed",
+				reused, cache->items_by_id->len - reused,
+				old->items_by_id->len - reused);
+	}
+}
+
 guint64
 rspamd_symbols_cache_get_cksum (struct symbols_cache *cache)
 {
@@ -195,6 +195,21 @@ ucl_object_t *rspamd_symbols_cache_counters (struct symbols_cache * cache);
 void rspamd_symbols_cache_start_refresh (struct symbols_cache * cache,
 		struct event_base *ev_base, struct rspamd_worker *w);
 
+/**
+ * Stop cache reloading started by `rspamd_symbols_cache_start_refresh`
+ * @param cache
+ */
+void rspamd_symbols_cache_stop_refresh (struct symbols_cache *cache);
+
+/**
+ * Start periodic aggregation of workers counters, must be called in the main
+ * process only
+ * @param cache
+ * @param ev_base
+ */
+void rspamd_symbols_cache_start_aggregation (struct symbols_cache *cache,
+		struct event_base *ev_base);
+
 /**
  * Increases counter for a specific symbol
  * @param cache
@@ -282,4 +297,13 @@ gboolean rspamd_symbols_cache_is_checked (struct rspamd_task *task,
  * @return
  */
 guint64 rspamd_symbols_cache_get_cksum (struct symbols_cache *cache);
+
+/**
+ * Copy statistics of symbols that are present in both caches from the old
+ * cache to the new one, e.g. on config reload
+ * @param cache new cache
+ * @param old previous cache
+ */
+void rspamd_symbols_cache_inherit (struct symbols_cache *cache,
+		struct symbols_cache *old);
 #endif
@@ -653,6 +653,236 @@ rspamd_task_select_processing_stage (struct rspamd_task *task, guint stages)
 	return RSPAMD_TASK_STAGE_DONE;
 }
 
+static const gchar *trace_stage_names[RSPAMD_TASK_TRACE_MAX] = {
+	[RSPAMD_TASK_TRACE_READ_MESSAGE] = "read_message",
+	[RSPAMD_TASK_TRACE_PRE_FILTERS] = "pre_filters",
+	[RSPAMD_TASK_TRACE_FILTERS] = "filters",
+	[RSPAMD_TASK_TRACE_CLASSIFIERS] = "classifiers",
+	[RSPAMD_TASK_TRACE_COMPOSITES] = "composites",
+	[RSPAMD_TASK_TRACE_POST_FILTERS] = "post_filters",
+	[RSPAMD_TASK_TRACE_LEARN] = "learn",
+};
+
+/* Upper limits of histogram buckets in seconds, the last bucket is unlimited */
+static const gdouble trace_buckets[RSPAMD_TASK_TRACE_BUCKETS - 1] = {
+	0.001, 0.005, 0.01, 0.05, 0.1, 0.5, 1.0, 5.0
+};
+
+static const gchar *trace_bucket_names[RSPAMD_TASK_TRACE_BUCKETS] = {
+	"1ms", "5ms", "10ms", "50ms", "100ms", "500ms", "1s", "5s", "inf"
+};
+
+/* Synchronous symbols that are faster than this are not traced */
+static const gdouble trace_symbol_limit = 0.001;
+/* Do not write more symbols than this to the log and history */
+static const guint trace_max_symbols = 5;
+
+static gint
+rspamd_task_trace_stage_idx (gint st)
+{
+	switch (st) {
+	case RSPAMD_TASK_STAGE_READ_MESSAGE:
+		return RSPAMD_TASK_TRACE_READ_MESSAGE;
+	case RSPAMD_TASK_STAGE_PRE_FILTERS:
+		return RSPAMD_TASK_TRACE_PRE_FILTERS;
+	case RSPAMD_TASK_STAGE_FILTERS:
+		return RSPAMD_TASK_TRACE_FILTERS;
+	case RSPAMD_TASK_STAGE_CLASSIFIERS_PRE:
+	case RSPAMD_TASK_STAGE_CLASSIFIERS:
+	case RSPAMD_TASK_STAGE_CLASSIFIERS_POST:
+		return RSPAMD_TASK_TRACE_CLASSIFIERS;
+	case RSPAMD_TASK_STAGE_COMPOSITES:
+		return RSPAMD_TASK_TRACE_COMPOSITES;
+	case RSPAMD_TASK_STAGE_POST_FILTERS:
+		return RSPAMD_TASK_TRACE_POST_FILTERS;
+	case RSPAMD_TASK_STAGE_LEARN_PRE:
+	case RSPAMD_TASK_STAGE_LEARN:
+	case RSPAMD_TASK_STAGE_LEARN_POST:
+		return RSPAMD_TASK_TRACE_LEARN;
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+static void
+rspamd_task_trace_stage_start (struct rspamd_task *task, gint st)
+{
+	gint idx = rspamd_task_trace_stage_idx (st);
+
+	/* Stage can be reentered after async events, so keep the first start */
+	if (idx >= 0 && task->trace.stage_start[idx] == 0) {
+		task->trace.stage_start[idx] = rspamd_get_ticks ();
+	}
+}
+
+static void
+rspamd_task_trace_stage_done (struct rspamd_task *task, gint st)
+{
+	gint idx = rspamd_task_trace_stage_idx (st);
+
+	if (idx >= 0 && task->trace.stage_start[idx] != 0) {
+		task->trace.stage_time[idx] = rspamd_get_ticks () -
+				task->trace.stage_start[idx];
+	}
+}
+
+void
+rspamd_task_trace_symbol (struct rspamd_task *task, const gchar *symbol,
+		gdouble start, gdouble exec, gboolean pending)
+{
+	struct rspamd_task_symbol_trace tr;
+
+	if (!pending && exec < trace_symbol_limit) {
+		return;
+	}
+
+	if (task->trace.symbols == NULL) {
+		task->trace.symbols = g_array_sized_new (FALSE, FALSE, sizeof (tr), 8);
+		rspamd_mempool_add_destructor (task->task_pool,
+				rspamd_array_free_hard, task->trace.symbols);
+	}
+
+	tr.symbol = symbol;
+	tr.start = start;
+	tr.exec = exec;
+	tr.total = pending ? 0 : exec;
+	g_array_append_val (task->trace.symbols, tr);
+}
+
+void
+rspamd_task_trace_symbol_finish (struct rspamd_task *task, const gchar *symbol)
+{
+	struct rspamd_task_symbol_trace *tr;
+	guint i;
+
+	if (task->trace.symbols == NULL) {
+		return;
+	}
+
+	for (i = 0; i < task->trace.symbols->len; i ++) {
+		tr = &g_array_index (task->trace.symbols,
+				struct rspamd_task_symbol_trace, i);
+
+		if (tr->total == 0 && strcmp (tr->symbol, symbol) == 0) {
+			tr->total = rspamd_get_ticks () - tr->start;
+			break;
+		}
+	}
+}
+
+static gint
+rspamd_task_trace_symbols_cmp (gconstpointer a, gconstpointer b)
+{
+	const struct rspamd_task_symbol_trace *t1 = a, *t2 = b;
+
+	/* Slowest first */
+	if (t1->total < t2->total) {
+		return 1;
+	}
+	else if (t1->total > t2->total) {
+		return -1;
+	}
+
+	return 0;
+}
+
+gsize
+rspamd_task_trace_symbols_write (struct rspamd_task *task, gchar *buf,
+		gsize len)
+{
+	GArray *sorted;
+	struct rspamd_task_symbol_trace *tr;
+	gdouble now;
+	gsize r = 0;
+	guint i;
+
+	if (len == 0) {
+		return 0;
+	}
+
+	buf[0] = '\0';
+
+	if (task->trace.symbols == NULL || task->trace.symbols->len == 0) {
+		return 0;
+	}
+
+	now = rspamd_get_ticks ();
+	sorted = g_array_sized_new (FALSE, FALSE,
+			sizeof (struct rspamd_task_symbol_trace),
+			task->trace.symbols->len);
+	g_array_append_vals (sorted, task->trace.symbols->data,
+			task->trace.symbols->len);
+
+	for (i = 0; i < sorted->len; i ++) {
+		tr = &g_array_index (sorted, struct rspamd_task_symbol_trace, i);
+
+		if (tr->total == 0) {
+			/* Still pending */
+			tr->total = now - tr->start;
+		}
+	}
+
+	g_array_sort (sorted, rspamd_task_trace_symbols_cmp);
+
+	for (i = 0; i < MIN (sorted->len, trace_max_symbols) && r < len - 1; i ++) {
+		tr = &g_array_index (sorted, struct rspamd_task_symbol_trace, i);
+		r += rspamd_snprintf (buf + r, len - r, "%s%s:%.2f(%.2f)",
+				i > 0 ? "," : "",
+				tr->symbol, tr->total * 1000.0, tr->exec * 1000.0);
+	}
+
+	g_array_free (sorted, TRUE);
+
+	return r;
+}
+
+void
+rspamd_task_trace_update_stat (struct rspamd_task *task,
+		struct rspamd_stat *stat)
+{
+	guint i, j;
+
+	for (i = 0; i < RSPAMD_TASK_TRACE_MAX; i ++) {
+		if (task->trace.stage_start[i] == 0) {
+			continue;
+		}
+
+		for (j = 0; j < RSPAMD_TASK_TRACE_BUCKETS - 1; j ++) {
+			if (task->trace.stage_time[i] < trace_buckets[j]) {
+				break;
+			}
+		}
+
+#ifndef HAVE_ATOMIC_BUILTINS
+		stat->stages_hist[i][j] ++;
+#else
+		__atomic_add_fetch (&stat->stages_hist[i][j], 1, __ATOMIC_RELEASE);
+#endif
+	}
+}
+
+const gchar *
+rspamd_task_trace_stage_name (enum rspamd_task_trace_stage st)
+{
+	if (st < RSPAMD_TASK_TRACE_MAX) {
+		return trace_stage_names[st];
+	}
+
+	return "unknown";
+}
+
+const gchar *
+rspamd_task_trace_bucket_name (guint bucket)
+{
+	if (bucket < RSPAMD_TASK_TRACE_BUCKETS) {
+		return trace_bucket_names[bucket];
+	}
+
+	return "unknown";
+}
+
 gboolean
 rspamd_task_process (struct rspamd_task *task, guint stages)
 {
@@ -680,6 +910,7 @@ rspamd_task_process (struct rspamd_task *task, guint stages)
 	task->flags |= RSPAMD_TASK_FLAG_PROCESSING;
 
 	st = rspamd_task_select_processing_stage (task, stages);
+	rspamd_task_trace_stage_start (task, st);
 
 	switch (st) {
 	case RSPAMD_TASK_STAGE_READ_MESSAGE:
@@ -772,6 +1003,8 @@ rspamd_task_process (struct rspamd_task *task, guint stages)
 	task->flags &= ~RSPAMD_TASK_FLAG_PROCESSING;
 
 	if (!ret || RSPAMD_TASK_IS_PROCESSED (task)) {
+		rspamd_task_trace_stage_done (task, st);
+
 		if (!ret) {
 			/* Set processed flags */
 			task->processed_stages |= RSPAMD_TASK_STAGE_DONE;
@@ -789,6 +1022,7 @@ rspamd_task_process (struct rspamd_task *task, guint stages)
 	else {
 		/* Mark the current stage as done and go to the next stage */
 		msg_debug_task ("completed stage %d", st);
+		rspamd_task_trace_stage_done (task, st);
 		task->processed_stages |= st;
 
 		/* Tail recursion */
@@ -1206,6 +1440,33 @@ rspamd_task_write_addr_list (struct rspamd_task *task,
 	return res;
 }
 
+/*
+ * Writes stages times and the slowest symbols in milliseconds:
+ * read_message:0.21,filters:52.10; DCC_CHECK:50.12(0.21)
+ */
+static gsize
+rspamd_task_log_trace (struct rspamd_task *task, gchar *buf, gsize len)
+{
+	gsize r = 0;
+	guint i;
+
+	for (i = 0; i < RSPAMD_TASK_TRACE_MAX && r < len - 1; i ++) {
+		if (task->trace.stage_start[i] != 0) {
+			r += rspamd_snprintf (buf + r, len - r, "%s%s:%.2f",
+					r > 0 ? "," : "",
+					rspamd_task_trace_stage_name (i),
+					task->trace.stage_time[i] * 1000.0);
+		}
+	}
+
+	if (task->trace.symbols && task->trace.symbols->len > 0 && r < len - 3) {
+		r += rspamd_snprintf (buf + r, len - r, "; ");
+		r += rspamd_task_trace_symbols_write (task, buf + r, len - r);
+	}
+
+	return r;
+}
+
 static rspamd_fstring_t *
 rspamd_task_log_variable (struct rspamd_task *task,
 		struct rspamd_log_format *lf, rspamd_fstring_t *logbuf)
@@ -1213,6 +1474,7 @@ rspamd_task_log_variable (struct rspamd_task *task,
 	rspamd_fstring_t *res = logbuf;
 	rspamd_ftok_t var = {.begin = NULL, .len = 0};
 	static gchar numbuf[64];
+	gchar tracebuf[512];
 
 	switch (lf->type) {
 	/* String vars */
@@ -1320,6 +1582,10 @@ rspamd_task_log_variable (struct rspamd_task *task,
 				(gint)sizeof (task->digest), task->digest);
 		var.begin = numbuf;
 		break;
+	case RSPAMD_LOG_TRACE:
+		var.len = rspamd_task_log_trace (task, tracebuf, sizeof (tracebuf));
+		var.begin = tracebuf;
+		break;
 	default:
 		var = rspamd_task_log_metric_res (task, lf);
 		break;
@@ -112,8 +112,41 @@ enum rspamd_task_stage {
 #define RSPAMD_TASK_IS_EMPTY(task) (((task)->flags & RSPAMD_TASK_FLAG_EMPTY))
 
 struct rspamd_email_address;
+struct rspamd_stat;
+struct rspamd_stat_tokens;
 enum rspamd_newlines_type;
 
+/**
+ * Stages that are timed by the task trace, several processing stages
+ * (e.g. classifiers pre, classifiers and classifiers post) are merged
+ */
+enum rspamd_task_trace_stage {
+	RSPAMD_TASK_TRACE_READ_MESSAGE = 0,
+	RSPAMD_TASK_TRACE_PRE_FILTERS,
+	RSPAMD_TASK_TRACE_FILTERS,
+	RSPAMD_TASK_TRACE_CLASSIFIERS,
+	RSPAMD_TASK_TRACE_COMPOSITES,
+	RSPAMD_TASK_TRACE_POST_FILTERS,
+	RSPAMD_TASK_TRACE_LEARN,
+	RSPAMD_TASK_TRACE_MAX
+};
+
+/* Number of histogram buckets for stages times */
+#define RSPAMD_TASK_TRACE_BUCKETS 9
+
+struct rspamd_task_symbol_trace {
+	const gchar *symbol;
+	gdouble start;									/**< when the symbol has been started				*/
+	gdouble exec;									/**< time spent in the symbol callback				*/
+	gdouble total;									/**< time including async events, 0 if pending		*/
+};
+
+struct rspamd_task_trace {
+	gdouble stage_start[RSPAMD_TASK_TRACE_MAX];		/**< monotonic time when a stage has been started	*/
+	gdouble stage_time[RSPAMD_TASK_TRACE_MAX];		/**< time spent in a stage including async waits	*/
+	GArray *symbols;								/**< async and slow symbols							*/
+};
+
 /**
  * Worker task structure
  */
@@ -124,6 +157,7 @@ struct rspamd_task {
 	gint sock;										/**< socket descriptor								*/
 	guint flags;									/**< Bit flags										*/
 	guint32 dns_requests;							/**< number of DNS requests per this task			*/
+	guint conn_requests;							/**< requests served before on the same connection	*/
 	gulong message_len;								/**< Message length									*/
 	gchar *helo;									/**< helo header value								*/
 	gchar *queue_id;								/**< queue id if specified							*/
@@ -152,7 +186,7 @@ struct rspamd_task {
 	GHashTable *raw_headers;						/**< list of raw headers							*/
 	GHashTable *results;							/**< hash table of metric_result indexed by
 													 *    metric's name									*/
-	GPtrArray *tokens;								/**< statistics tokens */
+	struct rspamd_stat_tokens *tokens;				/**< statistics tokens */
 
 	GPtrArray *rcpt_mime;
 	GPtrArray *rcpt_envelope;						/**< array of rspamd_email_address					*/
@@ -168,6 +202,7 @@ struct rspamd_task {
 	rspamd_mempool_t *task_pool;					/**< memory pool for task							*/
 	double time_real;
 	double time_virtual;
+	struct rspamd_task_trace trace;					/**< per stage and per symbol timings				*/
 	struct timeval tv;
 	gboolean (*fin_callback)(struct rspamd_task *task, void *arg);
 													/**< calback for filters finalizing					*/
@@ -309,4 +344,46 @@ void rspamd_task_add_request_header (struct rspamd_task *task,
  */
 void rspamd_task_write_log (struct rspamd_task *task);
 
+/**
+ * Record symbol execution in the task trace, symbols with pending
+ * async events are recorded until `rspamd_task_trace_symbol_finish` is called
+ * @param task
+ * @param symbol symbol name (must live as long as task)
+ * @param start monotonic time of the symbol start
+ * @param exec time spent in the symbol callback
+ * @param pending TRUE if symbol has registered async events
+ */
+void rspamd_task_trace_symbol (struct rspamd_task *task, const gchar *symbol,
+		gdouble start, gdouble exec, gboolean pending);
+
+/**
+ * Finish async symbol in the task trace
+ */
+void rspamd_task_trace_symbol_finish (struct rspamd_task *task,
+		const gchar *symbol);
+
+/**
+ * Write the slowest symbols from the trace as `sym:total(exec)` list with
+ * times in milliseconds
+ * @return number of bytes written
+ */
+gsize rspamd_task_trace_symbols_write (struct rspamd_task *task,
+		gchar *buf, gsize len);
+
+/**
+ * Add stages times of the task to the histograms of the server statistics
+ */
+void rspamd_task_trace_update_stat (struct rspamd_task *task,
+		struct rspamd_stat *stat);
+
+/**
+ * Returns name of the traced stage
+ */
+const gchar * rspamd_task_trace_stage_name (enum rspamd_task_trace_stage st);
+
+/**
+ * Returns name of the histogram bucket (its upper limit)
+ */
+const gchar * rspamd_task_trace_bucket_name (guint bucket);
+
 #endif /* TASK_H_ */
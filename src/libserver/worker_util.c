@@ -40,6 +40,10 @@
 #ifdef HAVE_GRP_H
 #include <grp.h>
 #endif
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
 #ifdef HAVE_LIBUTIL_H
 #include <libutil.h>
 #endif
@@ -515,6 +519,43 @@ rspamd_worker_set_limits (struct rspamd_main *rspamd_main,
 	}
 }
 
+static void
+rspamd_worker_set_affinity (struct rspamd_main *rspamd_main, guint index)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t allowed, set;
+	gint i, n;
+
+	if (sched_getaffinity (0, sizeof (allowed), &allowed) == -1) {
+		msg_warn_main ("cannot get cpu affinity: %s", strerror (errno));
+		return;
+	}
+
+	/* Workers are distributed over the allowed cpus */
+	n = index % CPU_COUNT (&allowed);
+
+	for (i = 0; i < CPU_SETSIZE; i ++) {
+		if (CPU_ISSET (i, &allowed) && n-- == 0) {
+			CPU_ZERO (&set);
+			CPU_SET (i, &set);
+
+			if (sched_setaffinity (0, sizeof (set), &set) == -1) {
+				msg_warn_main ("cannot bind worker %ud to cpu %d: %s",
+						index, i, strerror (errno));
+			}
+			else {
+				msg_info_main ("bind worker %ud to cpu %d", index, i);
+			}
+
+			break;
+		}
+	}
+#else
+	msg_warn_main ("cannot bind worker %ud to cpu: cpu affinity is not "
+			"supported", index);
+#endif
+}
+
 struct rspamd_worker *
 rspamd_fork_worker (struct rspamd_main *rspamd_main,
 		struct rspamd_worker_conf *cf,
@@ -546,12 +587,23 @@ rspamd_fork_worker (struct rspamd_main *rspamd_main,
 	wrk->ctx = cf->ctx;
 	wrk->finish_actions = g_ptr_array_new ();
 
+	if (rspamd_main->cfg->log_async &&
+			rspamd_main->cfg->log_type != RSPAMD_LOG_SYSLOG) {
+		/* Must be mapped before fork to be shared with the main process */
+		wrk->log_ring = rspamd_log_ring_new (rspamd_main->cfg->log_async_size);
+	}
+
 	wrk->pid = fork ();
 
 	switch (wrk->pid) {
 	case 0:
 		/* Update pid for logging */
 		rspamd_log_update_pid (cf->type, rspamd_main->logger);
+		rspamd_mempool_stat_update_pid ();
+
+		if (wrk->log_ring) {
+			rspamd_log_set_ring (rspamd_main->logger, wrk->log_ring);
+		}
 
 		/* Init PRNG after fork */
 		rc = ottery_init (rspamd_main->cfg->libs_ctx->ottery_cfg);
@@ -573,6 +625,16 @@ rspamd_fork_worker (struct rspamd_main *rspamd_main,
 		rspamd_worker_drop_priv (rspamd_main);
 		/* Set limits */
 		rspamd_worker_set_limits (rspamd_main, cf);
+
+		if (cf->cpu_affinity) {
+			rspamd_worker_set_affinity (rspamd_main, index);
+		}
+
+		if (cf->reuseport_socks && index < cf->reuseport_socks->len) {
+			/* Own sockets of this worker, the list is local for the child */
+			cf->listen_socks = g_list_concat (g_list_copy (cf->listen_socks),
+					g_list_copy (g_ptr_array_index (cf->reuseport_socks, index)));
+		}
 		/* Re-set stack limit */
 		getrlimit (RLIMIT_STACK, &rlim);
 		rlim.rlim_cur = 100 * 1024 * 1024;
@@ -18,6 +18,7 @@
 
 #include "config.h"
 #include "ucl.h"
+#include "fstring.h"
 
 #define RSPAMD_DEFAULT_BACKEND "mmap"
 
@@ -29,6 +30,7 @@ struct rspamd_stat_ctx;
 struct rspamd_token_result;
 struct rspamd_statfile;
 struct rspamd_task;
+struct rspamd_stat_tokens;
 
 struct rspamd_stat_backend {
 	const char *name;
@@ -36,12 +38,14 @@ struct rspamd_stat_backend {
 			struct rspamd_statfile *st);
 	gpointer (*runtime)(struct rspamd_task *task,
 			struct rspamd_statfile_config *stcf, gboolean learn, gpointer ctx);
-	gboolean (*process_tokens)(struct rspamd_task *task, GPtrArray *tokens,
+	gboolean (*process_tokens)(struct rspamd_task *task,
+			struct rspamd_stat_tokens *tokens,
 			gint id,
 			gpointer ctx);
 	void (*finalize_process)(struct rspamd_task *task,
 			gpointer runtime, gpointer ctx);
-	gboolean (*learn_tokens)(struct rspamd_task *task, GPtrArray *tokens,
+	gboolean (*learn_tokens)(struct rspamd_task *task,
+			struct rspamd_stat_tokens *tokens,
 			gint id,
 			gpointer ctx);
 	gulong (*total_learns)(struct rspamd_task *task,
@@ -66,13 +70,13 @@ struct rspamd_stat_backend {
 				struct rspamd_statfile_config *stcf, \
 				gboolean learn, gpointer ctx); \
 		gboolean rspamd_##name##_process_tokens (struct rspamd_task *task, \
-                GPtrArray *tokens, gint id, \
+                struct rspamd_stat_tokens *tokens, gint id, \
 				gpointer ctx); \
 		void rspamd_##name##_finalize_process (struct rspamd_task *task, \
 				gpointer runtime, \
 				gpointer ctx); \
 		gboolean rspamd_##name##_learn_tokens (struct rspamd_task *task, \
-                GPtrArray *tokens, gint id, \
+                struct rspamd_stat_tokens *tokens, gint id, \
 				gpointer ctx); \
 		void rspamd_##name##_finalize_learn (struct rspamd_task *task, \
 				gpointer runtime, \
@@ -96,9 +100,81 @@ struct rspamd_stat_backend {
 		void rspamd_##name##_close (gpointer ctx)
 
 RSPAMD_STAT_BACKEND_DEF(mmaped_file);
+
+typedef struct rspamd_mmaped_file_s rspamd_mmaped_file_t;
+
+/**
+ * Opens statfile converting it to the current format or size if needed
+ * @return statfile or NULL in case of error
+ */
+rspamd_mmaped_file_t *rspamd_mmaped_file_open (rspamd_mempool_t *pool,
+		const gchar *filename, size_t size,
+		struct rspamd_statfile_config *stcf);
+
+/**
+ * Creates new empty statfile of the specified size
+ * @return 0 on success
+ */
+gint rspamd_mmaped_file_create (const gchar *filename, size_t size,
+		struct rspamd_statfile_config *stcf,
+		rspamd_mempool_t *pool);
+
+/**
+ * Closes statfile opened by `rspamd_mmaped_file_open`
+ */
+gint rspamd_mmaped_file_close_file (rspamd_mempool_t *pool,
+		rspamd_mmaped_file_t *file);
+
+/**
+ * Returns value of the token or 0 if there is no such token
+ */
+double rspamd_mmaped_file_get_block (rspamd_mmaped_file_t *file,
+		guint32 h1, guint32 h2);
+
+/**
+ * Sets value of the token, expiring another token if statfile is full
+ */
+void rspamd_mmaped_file_set_block (rspamd_mempool_t *pool,
+		rspamd_mmaped_file_t *file, guint32 h1, guint32 h2, double value);
+
+/**
+ * Returns number of used blocks
+ */
+guint64 rspamd_mmaped_file_get_used (rspamd_mmaped_file_t *file);
+
+/**
+ * Gets revision and revision time of statfile
+ */
+gboolean rspamd_mmaped_file_get_revision (rspamd_mmaped_file_t *file,
+		guint64 *rev, time_t *time);
 RSPAMD_STAT_BACKEND_DEF(sqlite3);
 #ifdef WITH_HIREDIS
 RSPAMD_STAT_BACKEND_DEF(redis);
+
+/**
+ * Encodes `cmd key field1 ... fieldN` request for tokens as a RESP command
+ * @param tokens tokens array
+ * @param cmd command (e.g. HMGET)
+ * @param key hash name
+ * @param binary_keys use raw token ids as fields instead of decimal strings
+ * @return new fstring
+ */
+rspamd_fstring_t *rspamd_redis_tokens_to_query (
+		struct rspamd_stat_tokens *tokens, const gchar *cmd, const gchar *key,
+		gboolean binary_keys);
+
+/**
+ * Packs tokens and their values at `idx` into a binary argument for the
+ * learn script
+ * @param tokens tokens array
+ * @param idx index of values
+ * @param intvals round values to integers
+ * @param binary_keys use raw token ids as fields instead of decimal strings
+ * @return new fstring
+ */
+rspamd_fstring_t *rspamd_redis_tokens_to_learn_args (
+		struct rspamd_stat_tokens *tokens, gint idx, gboolean intvals,
+		gboolean binary_keys);
 #endif
 
 #endif /* BACKENDS_H_ */
@@ -18,6 +18,25 @@
 #include "unix-std.h"
 
 #define CHAIN_LENGTH 128
+/* Blocks are grouped in buckets of 64 bytes (cache line) since version 1.3 */
+#define BUCKET_BLOCKS 4
+#define BUCKET_ALIGN 64
+/* Maximum number of cuckoo displacements when inserting a new block */
+#define MAX_KICKS 32
+/* How many tokens ahead we prefetch buckets for */
+#define PREFETCH_DISTANCE 8
+/* Token id holds two 32 bit hashes in the host byte order */
+#define RSPAMD_MMAPED_TOKEN_HASHES(tokens, i, h1, h2) do { \
+	memcpy (&(h1), &(tokens)->data[(i)], sizeof (h1)); \
+	memcpy (&(h2), (const guchar *)&(tokens)->data[(i)] + sizeof (h1), \
+			sizeof (h2)); \
+} while (0)
+
+#ifdef __GNUC__
+#define STATFILE_PREFETCH(p) __builtin_prefetch ((p), 0, 1)
+#else
+#define STATFILE_PREFETCH(p) do { } while (0)
+#endif
 
 /* Section types */
 #define STATFILE_SECTION_COMMON 1
@@ -67,7 +86,7 @@ struct stat_file {
 /**
  * Common view of statfile object
  */
-typedef struct {
+struct rspamd_mmaped_file_s {
 #ifdef HAVE_PATH_MAX
 	gchar filename[PATH_MAX];               /**< name of file						*/
 #else
@@ -79,25 +98,204 @@ typedef struct {
 	off_t seek_pos;                         /**< current seek position				*/
 	struct stat_file_section cur_section;   /**< current section					*/
 	size_t len;                             /**< length of file(in bytes)			*/
+	guint64 nbuckets;                       /**< number of buckets (version 1.3)	*/
+	gboolean bucketed;                      /**< file uses bucketized layout		*/
 	struct rspamd_statfile_config *cf;
-} rspamd_mmaped_file_t;
+};
 
 
-#define RSPAMD_STATFILE_VERSION {'1', '2'}
-#define BACKUP_SUFFIX ".old"
+#define RSPAMD_STATFILE_VERSION {'1', '3'}
+/* Chained layout, converted on open */
+#define RSPAMD_STATFILE_VERSION_CHAINED {'1', '2'}
+/* Offset of the first block in bucketized layout */
+#define STATFILE_BUCKETS_OFFSET \
+	((sizeof (struct stat_file_header) + sizeof (struct stat_file_section) + \
+	BUCKET_ALIGN - 1) & ~(BUCKET_ALIGN - 1))
 
 static void rspamd_mmaped_file_set_block_common (rspamd_mempool_t *pool,
 	   rspamd_mmaped_file_t *file,
 	   guint32 h1, guint32 h2, double value);
 
-rspamd_mmaped_file_t * rspamd_mmaped_file_open (rspamd_mempool_t *pool,
+static rspamd_mmaped_file_t * rspamd_mmaped_file_open_common (
+		rspamd_mempool_t *pool,
 		const gchar *filename, size_t size,
-		struct rspamd_statfile_config *stcf);
-gint rspamd_mmaped_file_create (const gchar *filename, size_t size,
 		struct rspamd_statfile_config *stcf,
-		rspamd_mempool_t *pool);
-gint rspamd_mmaped_file_close_file (rspamd_mempool_t *pool,
-		rspamd_mmaped_file_t * file);
+		gboolean convert);
+
+/*
+ * Each token has two candidate buckets, so it is stored in one of
+ * 2 * BUCKET_BLOCKS blocks that occupy merely two cache lines
+ */
+static inline guint64
+rspamd_mmaped_file_bucket1 (rspamd_mmaped_file_t *file, guint32 h1, guint32 h2)
+{
+	return h1 % file->nbuckets;
+}
+
+static inline guint64
+rspamd_mmaped_file_bucket2 (rspamd_mmaped_file_t *file, guint32 h1, guint32 h2)
+{
+	guint64 b1, b2;
+
+	b1 = h1 % file->nbuckets;
+	b2 = (((guint64)h2 * 0x9E3779B97F4A7C15ULL) ^ h1) % file->nbuckets;
+
+	if (b2 == b1) {
+		b2 = (b1 + 1) % file->nbuckets;
+	}
+
+	return b2;
+}
+
+static inline struct stat_file_block *
+rspamd_mmaped_file_bucket (rspamd_mmaped_file_t *file, guint64 idx)
+{
+	return (struct stat_file_block *)((u_char *)file->map + file->seek_pos) +
+			idx * BUCKET_BLOCKS;
+}
+
+static inline void
+rspamd_mmaped_file_prefetch (rspamd_mmaped_file_t *file, guint32 h1, guint32 h2)
+{
+	STATFILE_PREFETCH (rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket1 (file, h1, h2)));
+	STATFILE_PREFETCH (rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket2 (file, h1, h2)));
+}
+
+static double
+rspamd_mmaped_file_get_block_bucketed (rspamd_mmaped_file_t *file,
+		guint32 h1, guint32 h2)
+{
+	struct stat_file_block *block;
+	guint i;
+
+	block = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket1 (file, h1, h2));
+
+	for (i = 0; i < BUCKET_BLOCKS; i ++) {
+		if (block[i].hash1 == h1 && block[i].hash2 == h2) {
+			return block[i].value;
+		}
+	}
+
+	block = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket2 (file, h1, h2));
+
+	for (i = 0; i < BUCKET_BLOCKS; i ++) {
+		if (block[i].hash1 == h1 && block[i].hash2 == h2) {
+			return block[i].value;
+		}
+	}
+
+	return 0;
+}
+
+static void
+rspamd_mmaped_file_set_block_bucketed (rspamd_mempool_t *pool,
+		rspamd_mmaped_file_t *file,
+		guint32 h1, guint32 h2, double value)
+{
+	struct stat_file_block *buckets[2], *block, *to_expire = NULL, cur, tmp;
+	struct stat_file_header *header;
+	guint64 idx, b1;
+	guint i, j, kick;
+	double min;
+
+	header = (struct stat_file_header *)file->map;
+	buckets[0] = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket1 (file, h1, h2));
+	buckets[1] = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket2 (file, h1, h2));
+
+	/* Update existing block */
+	for (j = 0; j < 2; j ++) {
+		for (i = 0; i < BUCKET_BLOCKS; i ++) {
+			block = &buckets[j][i];
+
+			if (block->hash1 == h1 && block->hash2 == h2) {
+				block->value = value;
+				return;
+			}
+		}
+	}
+
+	/* Find free block */
+	for (j = 0; j < 2; j ++) {
+		for (i = 0; i < BUCKET_BLOCKS; i ++) {
+			block = &buckets[j][i];
+
+			if (block->hash1 == 0 && block->hash2 == 0) {
+				block->hash1 = h1;
+				block->hash2 = h2;
+				block->value = value;
+				header->used_blocks++;
+
+				return;
+			}
+		}
+	}
+
+	/* Both buckets are full, move some blocks to their alternative buckets */
+	cur.hash1 = h1;
+	cur.hash2 = h2;
+	cur.value = value;
+	idx = rspamd_mmaped_file_bucket1 (file, h1, h2);
+
+	for (kick = 0; kick < MAX_KICKS; kick ++) {
+		block = &rspamd_mmaped_file_bucket (file, idx)[kick % BUCKET_BLOCKS];
+		memcpy (&tmp, block, sizeof (tmp));
+		memcpy (block, &cur, sizeof (cur));
+		memcpy (&cur, &tmp, sizeof (cur));
+
+		/* Now try to place the evicted block to its another bucket */
+		b1 = rspamd_mmaped_file_bucket1 (file, cur.hash1, cur.hash2);
+		idx = (idx == b1) ?
+				rspamd_mmaped_file_bucket2 (file, cur.hash1, cur.hash2) : b1;
+		block = rspamd_mmaped_file_bucket (file, idx);
+
+		for (i = 0; i < BUCKET_BLOCKS; i ++) {
+			if (block[i].hash1 == 0 && block[i].hash2 == 0) {
+				memcpy (&block[i], &cur, sizeof (cur));
+				header->used_blocks++;
+
+				return;
+			}
+		}
+	}
+
+	/*
+	 * Statfile is too full: the block evicted by the last kick competes with
+	 * the blocks of its buckets, and the one with the minimum value expires
+	 */
+	buckets[0] = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket1 (file, cur.hash1, cur.hash2));
+	buckets[1] = rspamd_mmaped_file_bucket (file,
+			rspamd_mmaped_file_bucket2 (file, cur.hash1, cur.hash2));
+	min = cur.value;
+
+	for (j = 0; j < 2; j ++) {
+		for (i = 0; i < BUCKET_BLOCKS; i ++) {
+			block = &buckets[j][i];
+
+			if (block->value < min) {
+				to_expire = block;
+				min = block->value;
+			}
+		}
+	}
+
+	if (to_expire) {
+		memcpy (&tmp, to_expire, sizeof (tmp));
+		memcpy (to_expire, &cur, sizeof (cur));
+	}
+	else {
+		memcpy (&tmp, &cur, sizeof (tmp));
+	}
+
+	msg_info_pool ("buckets are full in statfile %s, expire block %ud:%ud "
+			"with value %.2f", file->filename, tmp.hash1, tmp.hash2, tmp.value);
+}
 
 double
 rspamd_mmaped_file_get_block (rspamd_mmaped_file_t * file,
@@ -112,6 +310,10 @@ rspamd_mmaped_file_get_block (rspamd_mmaped_file_t * file,
 		return 0;
 	}
 
+	if (file->bucketed) {
+		return rspamd_mmaped_file_get_block_bucketed (file, h1, h2);
+	}
+
 	blocknum = h1 % file->cur_section.length;
 	c = (u_char *) file->map + file->seek_pos + blocknum *
 		sizeof (struct stat_file_block);
@@ -147,6 +349,11 @@ rspamd_mmaped_file_set_block_common (rspamd_mempool_t *pool,
 		return;
 	}
 
+	if (file->bucketed) {
+		rspamd_mmaped_file_set_block_bucketed (pool, file, h1, h2, value);
+		return;
+	}
+
 	blocknum = h1 % file->cur_section.length;
 	header = (struct stat_file_header *)file->map;
 	c = (u_char *) file->map + file->seek_pos + blocknum *
@@ -334,6 +541,7 @@ rspamd_mmaped_file_check (rspamd_mempool_t *pool, rspamd_mmaped_file_t * file)
 	struct stat_file *f;
 	gchar *c;
 	static gchar valid_version[] = RSPAMD_STATFILE_VERSION;
+	static gchar chained_version[] = RSPAMD_STATFILE_VERSION_CHAINED;
 
 
 	if (!file || !file->map) {
@@ -360,7 +568,13 @@ rspamd_mmaped_file_check (rspamd_mempool_t *pool, rspamd_mmaped_file_t * file)
 	if (*c == 1 && *(c + 1) == 0) {
 		return -1;
 	}
-	else if (memcmp (c, valid_version, sizeof (valid_version)) != 0) {
+	else if (memcmp (c, valid_version, sizeof (valid_version)) == 0) {
+		file->bucketed = TRUE;
+	}
+	else if (memcmp (c, chained_version, sizeof (chained_version)) == 0) {
+		file->bucketed = FALSE;
+	}
+	else {
 		/* Unknown version */
 		msg_info_pool ("file %s has invalid version %c.%c",
 			file->filename,
@@ -372,42 +586,77 @@ rspamd_mmaped_file_check (rspamd_mempool_t *pool, rspamd_mmaped_file_t * file)
 	/* Check first section and set new offset */
 	file->cur_section.code = f->section.code;
 	file->cur_section.length = f->section.length;
-	if (file->cur_section.length * sizeof (struct stat_file_block) >
-		file->len) {
+
+	if (file->bucketed) {
+		file->seek_pos = STATFILE_BUCKETS_OFFSET;
+		file->nbuckets = file->cur_section.length / BUCKET_BLOCKS;
+
+		if (file->nbuckets == 0 ||
+				file->cur_section.length % BUCKET_BLOCKS != 0) {
+			msg_info_pool ("file %s has invalid number of blocks: %uL",
+				file->filename,
+				file->cur_section.length);
+			return -1;
+		}
+	}
+	else {
+		file->seek_pos = sizeof (struct stat_file) -
+			sizeof (struct stat_file_block);
+	}
+
+	if (file->seek_pos + file->cur_section.length *
+			sizeof (struct stat_file_block) > file->len) {
 		msg_info_pool ("file %s is truncated: %z, must be %z",
 			file->filename,
 			file->len,
-			file->cur_section.length * sizeof (struct stat_file_block));
+			file->seek_pos + file->cur_section.length *
+			sizeof (struct stat_file_block));
 		return -1;
 	}
-	file->seek_pos = sizeof (struct stat_file) -
-		sizeof (struct stat_file_block);
 
 	return 0;
 }
 
 
+/*
+ * Waits until another process releases the lock of a statfile
+ */
+static void
+rspamd_mmaped_file_wait_lock (const gchar *lock)
+{
+	struct timespec sleep_ts = {
+			.tv_sec = 0,
+			.tv_nsec = 1000000
+	};
+
+	while (access (lock, F_OK) == 0) {
+		nanosleep (&sleep_ts, NULL);
+	}
+}
+
+/*
+ * Copies all blocks of the existing statfile to a new file of the specified
+ * size. The lock is held until the new file is renamed into place, so other
+ * processes wait for the conversion and then open the new file
+ */
 static rspamd_mmaped_file_t *
 rspamd_mmaped_file_reindex (rspamd_mempool_t *pool,
 		const gchar *filename,
-		size_t old_size,
 		size_t size,
 		struct rspamd_statfile_config *stcf)
 {
-	gchar *backup, *lock;
-	gint fd, lock_fd;
-	rspamd_mmaped_file_t *new, *old = NULL;
-	u_char *map, *pos;
+	gchar *tmp = NULL, *lock;
+	gint lock_fd;
+	rspamd_mmaped_file_t old, *new;
+	u_char *pos, *end;
 	struct stat_file_block *block;
 	struct stat_file_header *header, *nh;
-	struct timespec sleep_ts = {
-			.tv_sec = 0,
-			.tv_nsec = 1000000
-	};
+	struct stat st;
+	gboolean copy = TRUE;
 
 	if (size <
 		sizeof (struct stat_file_header) + sizeof (struct stat_file_section) +
-		sizeof (block)) {
+		sizeof (*block)) {
 		msg_err_pool ("file %s is too small to carry any statistic: %z",
 			filename,
 			size);
@@ -417,113 +666,124 @@ rspamd_mmaped_file_reindex (rspamd_mempool_t *pool,
 	lock = g_strconcat (filename, ".lock", NULL);
 	lock_fd = open (lock, O_WRONLY|O_CREAT|O_EXCL, 00600);
 
-	while (lock_fd == -1) {
-		/* Wait for lock */
-		lock_fd = open (lock, O_WRONLY|O_CREAT|O_EXCL, 00600);
-		if (lock_fd != -1) {
-			unlink (lock);
-			close (lock_fd);
-			g_free (lock);
-
-			return rspamd_mmaped_file_open (pool, filename, size, stcf);
-		}
-		else {
-			nanosleep (&sleep_ts, NULL);
-		}
-	}
-
-	backup = g_strconcat (filename, ".old", NULL);
-	if (rename (filename, backup) == -1) {
-		msg_err_pool ("cannot rename %s to %s: %s", filename, backup, strerror (
-				errno));
-		g_free (backup);
-		unlink (lock);
+	if (lock_fd == -1) {
+		/* Another process converts this file, open it when it is done */
+		rspamd_mmaped_file_wait_lock (lock);
 		g_free (lock);
-		close (lock_fd);
 
-		return NULL;
+		return rspamd_mmaped_file_open (pool, filename, size, stcf);
 	}
 
-	old = rspamd_mmaped_file_open (pool, backup, old_size, stcf);
+	memset (&old, 0, sizeof (old));
+	rspamd_strlcpy (old.filename, filename, sizeof (old.filename));
+	old.map = MAP_FAILED;
 
-	if (old == NULL) {
-		msg_warn_pool ("old file %s is invalid mmapped file, just move it",
-				backup);
+	if ((old.fd = open (filename, O_RDONLY)) == -1 ||
+			fstat (old.fd, &st) == -1) {
+		msg_err_pool ("cannot open file %s: %s", filename, strerror (errno));
+		goto err;
 	}
 
-	/* We need to release our lock here */
-	unlink (lock);
-	close (lock_fd);
-	g_free (lock);
+	old.len = st.st_size;
 
-	/* Now create new file with required size */
-	if (rspamd_mmaped_file_create (filename, size, stcf, pool) != 0) {
-		msg_err_pool ("cannot create new file");
-		rspamd_mmaped_file_close (old);
-		g_free (backup);
+	if ((old.map = mmap (NULL, old.len, PROT_READ, MAP_SHARED, old.fd, 0))
+			== MAP_FAILED) {
+		msg_err_pool ("cannot mmap file %s: %s", filename, strerror (errno));
+		goto err;
+	}
 
-		return NULL;
+	if (rspamd_mmaped_file_check (pool, &old) == -1) {
+		msg_warn_pool ("old file %s is invalid mmapped file, just replace it",
+				filename);
+		copy = FALSE;
 	}
+	else if (old.bucketed && labs ((glong)size - st.st_size) <=
+			(long)sizeof (struct stat_file) * 2) {
+		/* File has been converted by another process meanwhile */
+		munmap (old.map, old.len);
+		close (old.fd);
+		unlink (lock);
+		close (lock_fd);
+		g_free (lock);
 
-	new = rspamd_mmaped_file_open (pool, filename, size, stcf);
+		return rspamd_mmaped_file_open (pool, filename, size, stcf);
+	}
 
-	if (old) {
-		/* Now open new file and start copying */
-		fd = open (backup, O_RDONLY);
-		if (fd == -1 || new == NULL) {
-			if (fd != -1) {
-				close (fd);
-			}
+	/* Now create new file with required size */
+	tmp = g_strconcat (filename, ".new", NULL);
 
-			msg_err_pool ("cannot open file: %s", strerror (errno));
-			rspamd_mmaped_file_close (old);
-			g_free (backup);
-			return NULL;
-		}
+	if (rspamd_mmaped_file_create (tmp, size, stcf, pool) != 0) {
+		msg_err_pool ("cannot create new file %s", tmp);
+		goto err;
+	}
 
+	new = rspamd_mmaped_file_open_common (pool, tmp, size, stcf, FALSE);
 
+	if (new == NULL) {
+		msg_err_pool ("cannot open new file %s", tmp);
+		unlink (tmp);
+		goto err;
+	}
 
-		/* Now start reading blocks from old statfile */
-		if ((map =
-				mmap (NULL, old_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
-			msg_err_pool ("cannot mmap file: %s", strerror (errno));
-			close (fd);
-			rspamd_mmaped_file_close (old);
-			g_free (backup);
-			return NULL;
-		}
+	if (copy) {
+		/* Old file can have either chained or bucketized layout */
+		pos = (u_char *)old.map + old.seek_pos;
+		end = pos + old.cur_section.length * sizeof (*block);
 
-		pos = map + (sizeof (struct stat_file) - sizeof (struct stat_file_block));
+		while (pos < end) {
+			block = (struct stat_file_block *)pos;
 
-		if (pos - map < (gssize)old_size) {
-			while ((gssize)old_size - (pos - map) >= (gssize)sizeof (struct stat_file_block)) {
-				block = (struct stat_file_block *)pos;
-				if (block->hash1 != 0 && block->value != 0) {
-					rspamd_mmaped_file_set_block_common (pool,
-							new, block->hash1,
-							block->hash2, block->value);
-				}
-				pos += sizeof (block);
+			if (block->hash1 != 0 && block->value != 0) {
+				rspamd_mmaped_file_set_block_common (pool,
+						new, block->hash1,
+						block->hash2, block->value);
 			}
+
+			pos += sizeof (*block);
 		}
 
-		header = (struct stat_file_header *)map;
-		rspamd_mmaped_file_set_revision (new, header->revision, header->rev_time);
+		header = (struct stat_file_header *)old.map;
+		rspamd_mmaped_file_set_revision (new, header->revision,
+				header->rev_time);
 		nh = new->map;
 		/* Copy tokenizer configuration */
 		memcpy (nh->unused, header->unused, sizeof (header->unused));
 		nh->tokenizer_conf_len = header->tokenizer_conf_len;
+	}
 
-		munmap (map, old_size);
-		close (fd);
-		rspamd_mmaped_file_close_file (pool, old);
+	rspamd_mmaped_file_close_file (pool, new);
+
+	if (rename (tmp, filename) == -1) {
+		msg_err_pool ("cannot rename %s to %s: %s", tmp, filename,
+				strerror (errno));
+		unlink (tmp);
+		goto err;
 	}
 
-	unlink (backup);
-	g_free (backup);
+	munmap (old.map, old.len);
+	close (old.fd);
+	unlink (lock);
+	close (lock_fd);
+	g_free (lock);
+	g_free (tmp);
 
-	return new;
+	return rspamd_mmaped_file_open (pool, filename, size, stcf);
 
+err:
+	if (old.map != MAP_FAILED) {
+		munmap (old.map, old.len);
+	}
+
+	if (old.fd != -1) {
+		close (old.fd);
+	}
+
+	unlink (lock);
+	close (lock_fd);
+	g_free (lock);
+	g_free (tmp);
+
+	return NULL;
 }
 
 /*
@@ -561,23 +821,23 @@ rspamd_mmaped_file_t *
 rspamd_mmaped_file_open (rspamd_mempool_t *pool,
 		const gchar *filename, size_t size,
 		struct rspamd_statfile_config *stcf)
+{
+	return rspamd_mmaped_file_open_common (pool, filename, size, stcf, TRUE);
+}
+
+static rspamd_mmaped_file_t *
+rspamd_mmaped_file_open_common (rspamd_mempool_t *pool,
+		const gchar *filename, size_t size,
+		struct rspamd_statfile_config *stcf,
+		gboolean convert)
 {
 	struct stat st;
 	rspamd_mmaped_file_t *new_file;
 	gchar *lock;
-	gint lock_fd;
 
+	/* File could be converted by another process, so wait for it */
 	lock = g_strconcat (filename, ".lock", NULL);
-	lock_fd = open (lock, O_WRONLY|O_CREAT|O_EXCL, 00600);
-
-	if (lock_fd == -1) {
-		msg_info_pool ("cannot open file %s, it is locked by another process",
-				filename);
-		return NULL;
-	}
-
-	close (lock_fd);
-	unlink (lock);
+	rspamd_mmaped_file_wait_lock (lock);
 	g_free (lock);
 
 	if (stat (filename, &st) == -1) {
@@ -590,7 +850,7 @@ rspamd_mmaped_file_open (rspamd_mempool_t *pool,
 		&& size > sizeof (struct stat_file)) {
 		msg_warn_pool ("need to reindex statfile old size: %Hz, new size: %Hz",
 			(size_t)st.st_size, size);
-		return rspamd_mmaped_file_reindex (pool, filename, st.st_size, size, stcf);
+		return rspamd_mmaped_file_reindex (pool, filename, size, stcf);
 	}
 	else if (size < sizeof (struct stat_file)) {
 		msg_err_pool ("requested to shrink statfile to %Hz but it is too small",
@@ -645,6 +905,18 @@ rspamd_mmaped_file_open (rspamd_mempool_t *pool,
 	}
 
 	rspamd_file_unlock (new_file->fd, FALSE);
+
+	if (convert && !new_file->bucketed) {
+		/* Copy all blocks to a new file with bucketized layout */
+		msg_warn_pool ("convert statfile %s to version %c.%c",
+				filename, '1', '3');
+		rspamd_mmaped_file_close_file (pool, new_file);
+
+		return rspamd_mmaped_file_reindex (pool, filename,
+				size >= sizeof (struct stat_file) ? size : (size_t)st.st_size,
+				stcf);
+	}
+
 	new_file->cf = stcf;
 	new_file->pool = pool;
 	rspamd_mmaped_file_preload (new_file);
@@ -695,7 +967,7 @@ rspamd_mmaped_file_create (const gchar *filename,
 	struct rspamd_stat_tokenizer *tokenizer;
 	gint fd, lock_fd;
 	guint buflen = 0, nblocks;
-	gchar *buf = NULL, *lock;
+	gchar *buf = NULL, *lock, padding[BUCKET_ALIGN];
 	struct stat sb;
 	gpointer tok_conf;
 	gsize tok_conf_len;
@@ -704,9 +976,7 @@ rspamd_mmaped_file_create (const gchar *filename,
 			.tv_nsec = 1000000
 	};
 
-	if (size <
-		sizeof (struct stat_file_header) + sizeof (struct stat_file_section) +
-		sizeof (block)) {
+	if (size < STATFILE_BUCKETS_OFFSET + sizeof (block) * BUCKET_BLOCKS) {
 		msg_err_pool ("file %s is too small to carry any statistic: %z",
 			filename,
 			size);
@@ -740,9 +1010,9 @@ rspamd_mmaped_file_create (const gchar *filename,
 create:
 
 	msg_debug_pool ("create statfile %s of size %l", filename, (long)size);
-	nblocks =
-		(size - sizeof (struct stat_file_header) -
-		sizeof (struct stat_file_section)) / sizeof (struct stat_file_block);
+	nblocks = (size - STATFILE_BUCKETS_OFFSET) / sizeof (struct stat_file_block);
+	/* Use whole buckets only */
+	nblocks -= nblocks % BUCKET_BLOCKS;
 	header.total_blocks = nblocks;
 
 	if ((fd =
@@ -760,7 +1030,7 @@ create:
 
 	rspamd_fallocate (fd,
 		0,
-		sizeof (header) + sizeof (section) + sizeof (block) * nblocks);
+		STATFILE_BUCKETS_OFFSET + sizeof (block) * nblocks);
 
 	header.create_time = (guint64) time (NULL);
 	g_assert (stcf->clcf != NULL);
@@ -799,6 +1069,23 @@ create:
 		return -1;
 	}
 
+	/* Align blocks to the cache line */
+	memset (padding, 0, sizeof (padding));
+
+	if (write (fd, padding, STATFILE_BUCKETS_OFFSET - sizeof (header) -
+			sizeof (section)) == -1) {
+		msg_info_pool ("cannot write padding to file %s, error %d, %s",
+			filename,
+			errno,
+			strerror (errno));
+		close (fd);
+		unlink (lock);
+		close (lock_fd);
+		g_free (lock);
+
+		return -1;
+	}
+
 	/* Buffer for write 256 blocks at once */
 	if (nblocks > 256) {
 		buflen = sizeof (block) * 256;
@@ -948,25 +1235,54 @@ rspamd_mmaped_file_runtime (struct rspamd_task *task,
 	return (gpointer)mf;
 }
 
+/*
+ * Looks up all tokens at once prefetching buckets for the next tokens, so
+ * random memory accesses are overlapped
+ */
+static void
+rspamd_mmaped_file_get_blocks (rspamd_mmaped_file_t *file,
+		struct rspamd_stat_tokens *tokens, gint id)
+{
+	guint32 h1, h2;
+	gdouble *values;
+	guint i;
+
+	if (!file->map) {
+		return;
+	}
+
+	if (file->bucketed) {
+		for (i = 0; i < MIN (tokens->len, PREFETCH_DISTANCE); i++) {
+			RSPAMD_MMAPED_TOKEN_HASHES (tokens, i, h1, h2);
+			rspamd_mmaped_file_prefetch (file, h1, h2);
+		}
+	}
+
+	values = rspamd_stat_tokens_values (tokens, id);
+
+	for (i = 0; i < tokens->len; i++) {
+		if (file->bucketed && i + PREFETCH_DISTANCE < tokens->len) {
+			RSPAMD_MMAPED_TOKEN_HASHES (tokens, i + PREFETCH_DISTANCE, h1, h2);
+			rspamd_mmaped_file_prefetch (file, h1, h2);
+		}
+
+		RSPAMD_MMAPED_TOKEN_HASHES (tokens, i, h1, h2);
+		values[i] = rspamd_mmaped_file_get_block (file, h1, h2);
+	}
+}
+
 gboolean
-rspamd_mmaped_file_process_tokens (struct rspamd_task *task, GPtrArray *tokens,
+rspamd_mmaped_file_process_tokens (struct rspamd_task *task,
+		struct rspamd_stat_tokens *tokens,
 		gint id,
 		gpointer p)
 {
 	rspamd_mmaped_file_t *mf = p;
-	guint32 h1, h2;
-	rspamd_token_t *tok;
-	guint i;
 
 	g_assert (tokens != NULL);
 	g_assert (p != NULL);
 
-	for (i = 0; i < tokens->len; i++) {
-		tok = g_ptr_array_index (tokens, i);
-		memcpy (&h1, tok->data, sizeof (h1));
-		memcpy (&h2, tok->data + sizeof (h1), sizeof (h2));
-		tok->values[id] = rspamd_mmaped_file_get_block (mf, h1, h2);
-	}
+	rspamd_mmaped_file_get_blocks (mf, tokens, id);
 
 	if (mf->cf->is_spam) {
 		task->flags |= RSPAMD_TASK_FLAG_HAS_SPAM_TOKENS;
@@ -979,24 +1295,25 @@ rspamd_mmaped_file_process_tokens (struct rspamd_task *task, GPtrArray *tokens,
 }
 
 gboolean
-rspamd_mmaped_file_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
+rspamd_mmaped_file_learn_tokens (struct rspamd_task *task,
+		struct rspamd_stat_tokens *tokens,
 		gint id,
 		gpointer p)
 {
 	rspamd_mmaped_file_t *mf = p;
 	guint32 h1, h2;
-	rspamd_token_t *tok;
+	gdouble *values;
 	guint i;
 
 	g_assert (tokens != NULL);
 	g_assert (p != NULL);
 
+	values = rspamd_stat_tokens_values (tokens, id);
+
 	for (i = 0; i < tokens->len; i++) {
-		tok = g_ptr_array_index (tokens, i);
-		memcpy (&h1, tok->data, sizeof (h1));
-		memcpy (&h2, tok->data + sizeof (h1), sizeof (h2));
+		RSPAMD_MMAPED_TOKEN_HASHES (tokens, i, h1, h2);
 		rspamd_mmaped_file_set_block (task->task_pool, mf, h1, h2,
-				tok->values[id]);
+				values[i]);
 	}
 
 	return TRUE;
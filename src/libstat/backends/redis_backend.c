@@ -23,6 +23,7 @@
 #include "hiredis.h"
 #include "adapters/libevent.h"
 #include "ref.h"
+#include <openssl/evp.h>
 
 
 #define REDIS_CTX(p) (struct redis_stat_ctx *)(p)
@@ -33,6 +34,29 @@
 #define REDIS_DEFAULT_USERS_OBJECT "%s%l%r"
 #define REDIS_DEFAULT_TIMEOUT 0.5
 #define REDIS_STAT_TIMEOUT 30
+/* Maximum length of a token field: G_MAXUINT64 in decimal */
+#define REDIS_MAX_TOKEN_KEY 20
+/* `$` + length + 2 * CRLF */
+#define REDIS_BULK_OVERHEAD (REDIS_MAX_TOKEN_KEY + 5)
+
+/*
+ * Applies all increments for a message in a single call:
+ * KEYS[1] - hash name, ARGV[1] - packed tokens, ARGV[2] - increment command,
+ * ARGV[3] - learns increment
+ */
+static const gchar rspamd_redis_learn_script[] =
+		"local key = KEYS[1]\n"
+		"local data = ARGV[1]\n"
+		"local cmd = ARGV[2]\n"
+		"local pos, len = 1, #data\n"
+		"while pos <= len do\n"
+		"  local flen = string.byte(data, pos)\n"
+		"  local field = string.sub(data, pos + 1, pos + flen)\n"
+		"  local val = struct.unpack('<d', data, pos + flen + 1)\n"
+		"  redis.call(cmd, key, field, val)\n"
+		"  pos = pos + flen + 9\n"
+		"end\n"
+		"return redis.call('HINCRBY', key, 'learns', ARGV[3])\n";
 
 struct redis_stat_ctx {
 	struct rspamd_statfile_config *stcf;
@@ -44,7 +68,9 @@ struct redis_stat_ctx {
 	const gchar *dbname;
 	gdouble timeout;
 	gboolean enable_users;
+	gboolean binary_keys;
 	gint cbref_user;
+	gchar learn_sha[41];
 };
 
 enum rspamd_redis_connection_state {
@@ -64,9 +90,13 @@ struct redis_stat_runtime {
 	struct rspamd_statfile_config *stcf;
 	gchar *redis_object_expanded;
 	redisAsyncContext *redis;
+	rspamd_fstring_t *learn_args;
+	const gchar *learn_cmd;
+	const gchar *learn_delta;
 	guint64 learned;
 	gint id;
 	gboolean has_event;
+	gboolean script_sent;
 };
 
 /* Used to get statistics from redis */
@@ -334,74 +364,202 @@ rspamd_redis_maybe_auth (struct redis_stat_ctx *ctx, redisAsyncContext *redis)
 	}
 }
 
-static rspamd_fstring_t *
-rspamd_redis_tokens_to_query (struct rspamd_task *task, GPtrArray *tokens,
-		const gchar *arg0, const gchar *arg1, gboolean learn, gint idx,
-		gboolean intvals)
+static const gchar rspamd_redis_digits[] =
+		"0001020304050607080910111213141516171819"
+		"2021222324252627282930313233343536373839"
+		"4041424344454647484950515253545556575859"
+		"6061626364656667686970717273747576777879"
+		"8081828384858687888990919293949596979899";
+
+/*
+ * Writes decimal representation of `num` to `out` that must have at least
+ * REDIS_MAX_TOKEN_KEY bytes, returns number of bytes written
+ */
+static inline guint
+rspamd_redis_uint64_to_dec (guint64 num, gchar *out)
+{
+	gchar tmp[REDIS_MAX_TOKEN_KEY], *p;
+	guint idx, len;
+
+	p = tmp + sizeof (tmp);
+
+	while (num >= 100) {
+		idx = (num % 100) * 2;
+		num /= 100;
+		p -= 2;
+		p[0] = rspamd_redis_digits[idx];
+		p[1] = rspamd_redis_digits[idx + 1];
+	}
+
+	if (num >= 10) {
+		idx = num * 2;
+		p -= 2;
+		p[0] = rspamd_redis_digits[idx];
+		p[1] = rspamd_redis_digits[idx + 1];
+	}
+	else {
+		*--p = '0' + num;
+	}
+
+	len = tmp + sizeof (tmp) - p;
+	memcpy (out, p, len);
+
+	return len;
+}
+
+/* Writes `$<len>\r\n<data>\r\n`, `p` must have REDIS_BULK_OVERHEAD + len bytes */
+static inline gchar *
+rspamd_redis_write_bulk (gchar *p, const gchar *data, gsize len)
+{
+	*p++ = '$';
+	p += rspamd_redis_uint64_to_dec (len, p);
+	*p++ = '\r';
+	*p++ = '\n';
+	memcpy (p, data, len);
+	p += len;
+	*p++ = '\r';
+	*p++ = '\n';
+
+	return p;
+}
+
+static inline gchar *
+rspamd_redis_write_array_hdr (gchar *p, guint nelts)
+{
+	*p++ = '*';
+	p += rspamd_redis_uint64_to_dec (nelts, p);
+	*p++ = '\r';
+	*p++ = '\n';
+
+	return p;
+}
+
+/*
+ * Token field name within a hash: either decimal string (compatible with
+ * the existing databases) or 8 bytes of little endian token id
+ */
+static inline guint
+rspamd_redis_token_key (guint64 num, gboolean binary_keys, gchar *out)
+{
+	if (binary_keys) {
+		num = GUINT64_TO_LE (num);
+		memcpy (out, &num, sizeof (num));
+
+		return sizeof (num);
+	}
+
+	return rspamd_redis_uint64_to_dec (num, out);
+}
+
+rspamd_fstring_t *
+rspamd_redis_tokens_to_query (struct rspamd_stat_tokens *tokens,
+		const gchar *cmd, const gchar *key, gboolean binary_keys)
 {
 	rspamd_fstring_t *out;
-	rspamd_token_t *tok;
-	gchar n0[64], n1[64];
-	guint i, l0, l1, larg0, larg1;
-	guint64 num;
+	gchar *p, field[REDIS_MAX_TOKEN_KEY];
+	gsize lcmd, lkey;
+	guint i, flen;
 
 	g_assert (tokens != NULL);
 
-	larg0 = strlen (arg0);
-	larg1 = strlen (arg1);
-	out = rspamd_fstring_sized_new (1024);
+	lcmd = strlen (cmd);
+	lkey = strlen (key);
+	out = rspamd_fstring_sized_new (REDIS_BULK_OVERHEAD * (tokens->len + 3) +
+			lcmd + lkey + tokens->len * REDIS_MAX_TOKEN_KEY);
+	p = out->str;
+	p = rspamd_redis_write_array_hdr (p, tokens->len + 2);
+	p = rspamd_redis_write_bulk (p, cmd, lcmd);
+	p = rspamd_redis_write_bulk (p, key, lkey);
 
-	if (!learn) {
-		rspamd_printf_fstring (&out, ""
-				"*%d\r\n"
-				"$%d\r\n"
-				"%s\r\n"
-				"$%d\r\n"
-				"%s\r\n",
-				(tokens->len + 2),
-				larg0, arg0,
-				larg1, arg1);
+	for (i = 0; i < tokens->len; i ++) {
+		flen = rspamd_redis_token_key (tokens->data[i], binary_keys, field);
+		p = rspamd_redis_write_bulk (p, field, flen);
 	}
 
+	out->len = p - out->str;
+	g_assert (out->len <= out->allocated);
+
+	return out;
+}
+
+rspamd_fstring_t *
+rspamd_redis_tokens_to_learn_args (struct rspamd_stat_tokens *tokens,
+		gint idx, gboolean intvals, gboolean binary_keys)
+{
+	rspamd_fstring_t *out;
+	gchar *p;
+	guint i, flen;
+	gdouble val, *values;
+	guint64 bits;
+
+	g_assert (tokens != NULL);
+	values = rspamd_stat_tokens_values (tokens, idx);
+
+	out = rspamd_fstring_sized_new (tokens->len *
+			(1 + REDIS_MAX_TOKEN_KEY + sizeof (bits)) + 1);
+	p = out->str;
+
+	/*
+	 * Each record is packed as <field len: 1 byte><field><value: LE double>
+	 * and it is unpacked by the learn script using `struct.unpack`
+	 */
 	for (i = 0; i < tokens->len; i ++) {
-		tok = g_ptr_array_index (tokens, i);
-		memcpy (&num, tok->data, sizeof (num));
-
-		if (learn) {
-			rspamd_printf_fstring (&out, ""
-					"*4\r\n"
-					"$%d\r\n"
-					"%s\r\n"
-					"$%d\r\n"
-					"%s\r\n",
-					larg0, arg0,
-					larg1, arg1);
-
-			l0 = rspamd_snprintf (n0, sizeof (n0), "%uL", num);
-
-			if (intvals) {
-				l1 = rspamd_snprintf (n1, sizeof (n1), "%L",
-						(gint64)tok->values[idx]);
-			}
-			else {
-				l1 = rspamd_snprintf (n1, sizeof (n1), "%f",
-						tok->values[idx]);
-			}
+		flen = rspamd_redis_token_key (tokens->data[i], binary_keys, p + 1);
+		*p = (guchar)flen;
+		p += flen + 1;
 
-			rspamd_printf_fstring (&out, ""
-					"$%d\r\n"
-					"%s\r\n"
-					"$%d\r\n"
-					"%s\r\n", l0, n0, l1, n1);
-		}
-		else {
-			l0 = rspamd_snprintf (n0, sizeof (n0), "%uL", num);
-			rspamd_printf_fstring (&out, ""
-					"$%d\r\n"
-					"%s\r\n", l0, n0);
+		val = values[i];
+
+		if (intvals) {
+			val = (gdouble)(gint64)val;
 		}
+
+		memcpy (&bits, &val, sizeof (bits));
+		bits = GUINT64_TO_LE (bits);
+		memcpy (p, &bits, sizeof (bits));
+		p += sizeof (bits);
 	}
 
+	out->len = p - out->str;
+	g_assert (out->len <= out->allocated);
+
+	return out;
+}
+
+static rspamd_fstring_t *
+rspamd_redis_learn_command (struct redis_stat_runtime *rt, gboolean eval)
+{
+	rspamd_fstring_t *out;
+	const gchar *cmd, *script;
+	gsize lscript, lkey;
+	gchar *p;
+
+	if (eval) {
+		cmd = "EVAL";
+		script = rspamd_redis_learn_script;
+		lscript = sizeof (rspamd_redis_learn_script) - 1;
+	}
+	else {
+		cmd = "EVALSHA";
+		script = rt->ctx->learn_sha;
+		lscript = sizeof (rt->ctx->learn_sha) - 1;
+	}
+
+	lkey = strlen (rt->redis_object_expanded);
+	out = rspamd_fstring_sized_new (REDIS_BULK_OVERHEAD * 8 + lscript + lkey +
+			rt->learn_args->len + 32);
+	p = out->str;
+	p = rspamd_redis_write_array_hdr (p, 7);
+	p = rspamd_redis_write_bulk (p, cmd, strlen (cmd));
+	p = rspamd_redis_write_bulk (p, script, lscript);
+	p = rspamd_redis_write_bulk (p, "1", 1);
+	p = rspamd_redis_write_bulk (p, rt->redis_object_expanded, lkey);
+	p = rspamd_redis_write_bulk (p, rt->learn_args->str, rt->learn_args->len);
+	p = rspamd_redis_write_bulk (p, rt->learn_cmd, strlen (rt->learn_cmd));
+	p = rspamd_redis_write_bulk (p, rt->learn_delta, strlen (rt->learn_delta));
+	out->len = p - out->str;
+	g_assert (out->len <= out->allocated);
+
 	return out;
 }
 
@@ -801,12 +959,12 @@ rspamd_redis_processed (redisAsyncContext *c, gpointer r, gpointer priv)
 	struct redis_stat_runtime *rt = REDIS_RUNTIME (priv);
 	redisReply *reply = r, *elt;
 	struct rspamd_task *task;
-	rspamd_token_t *tok;
 	guint i, processed = 0, found = 0;
 	gulong val;
-	gdouble float_val;
+	gdouble float_val, *values;
 
 	task = rt->task;
+	values = rspamd_stat_tokens_values (task->tokens, rt->id);
 
 	if (c->err == 0) {
 		if (r != NULL) {
@@ -814,28 +972,27 @@ rspamd_redis_processed (redisAsyncContext *c, gpointer r, gpointer priv)
 
 				if (reply->elements == task->tokens->len) {
 					for (i = 0; i < reply->elements; i ++) {
-						tok = g_ptr_array_index (task->tokens, i);
 						elt = reply->element[i];
 
 						if (G_UNLIKELY (elt->type == REDIS_REPLY_INTEGER)) {
-							tok->values[rt->id] = elt->integer;
+							values[i] = elt->integer;
 							found ++;
 						}
 						else if (elt->type == REDIS_REPLY_STRING) {
 							if (rt->stcf->clcf->flags &
 									RSPAMD_FLAG_CLASSIFIER_INTEGER) {
 								rspamd_strtoul (elt->str, elt->len, &val);
-								tok->values[rt->id] = val;
+								values[i] = val;
 							}
 							else {
 								float_val = strtod (elt->str, NULL);
-								tok->values[rt->id] = float_val;
+								values[i] = float_val;
 							}
 
 							found ++;
 						}
 						else {
-							tok->values[rt->id] = 0;
+							values[i] = 0;
 						}
 
 						processed ++;
@@ -884,11 +1041,36 @@ static void
 rspamd_redis_learned (redisAsyncContext *c, gpointer r, gpointer priv)
 {
 	struct redis_stat_runtime *rt = REDIS_RUNTIME (priv);
+	redisReply *reply = r;
 	struct rspamd_task *task;
+	rspamd_fstring_t *query;
 
 	task = rt->task;
 
 	if (c->err == 0) {
+		if (reply != NULL && reply->type == REDIS_REPLY_ERROR) {
+			if (!rt->script_sent && reply->len >= (gint)sizeof ("NOSCRIPT") - 1 &&
+					memcmp (reply->str, "NOSCRIPT", sizeof ("NOSCRIPT") - 1) == 0) {
+				/* Script is not cached on this server, send it as is */
+				rt->script_sent = TRUE;
+				query = rspamd_redis_learn_command (rt, TRUE);
+				rspamd_mempool_add_destructor (task->task_pool,
+						(rspamd_mempool_destruct_t)rspamd_fstring_free, query);
+
+				if (redisAsyncFormattedCommand (rt->redis, rspamd_redis_learned,
+						rt, query->str, query->len) == REDIS_OK) {
+					return;
+				}
+
+				msg_err_task_check ("call to redis failed: %s",
+						rt->redis->errstr);
+			}
+			else {
+				msg_err_task_check ("cannot learn %s: %s",
+						rt->redis_object_expanded, reply->str);
+			}
+		}
+
 		rspamd_upstream_ok (rt->selected);
 	}
 	else {
@@ -1012,6 +1194,14 @@ rspamd_redis_try_ucl (struct redis_stat_ctx *backend,
 		backend->timeout = REDIS_DEFAULT_TIMEOUT;
 	}
 
+	elt = ucl_object_lookup (obj, "binary_keys");
+	if (elt) {
+		backend->binary_keys = ucl_object_toboolean (elt);
+	}
+	else {
+		backend->binary_keys = FALSE;
+	}
+
 	elt = ucl_object_lookup (obj, "password");
 	if (elt) {
 		backend->password = ucl_object_tostring (elt);
@@ -1039,6 +1229,8 @@ rspamd_redis_init (struct rspamd_stat_ctx *ctx,
 	struct rspamd_statfile_config *stf = st->stcf;
 	struct rspamd_redis_stat_elt *st_elt;
 	const ucl_object_t *obj;
+	guchar sha[EVP_MAX_MD_SIZE];
+	guint shalen = 0;
 	gboolean ret = FALSE;
 
 	backend = g_slice_alloc0 (sizeof (*backend));
@@ -1089,6 +1281,13 @@ rspamd_redis_init (struct rspamd_stat_ctx *ctx,
 	stf->clcf->flags |= RSPAMD_FLAG_CLASSIFIER_INCREMENTING_BACKEND;
 	backend->stcf = stf;
 
+	if (EVP_Digest (rspamd_redis_learn_script,
+			sizeof (rspamd_redis_learn_script) - 1,
+			sha, &shalen, EVP_sha1 (), NULL) == 1) {
+		rspamd_encode_hex_buf (sha, shalen, backend->learn_sha,
+				sizeof (backend->learn_sha));
+	}
+
 	st_elt = g_slice_alloc0 (sizeof (*st_elt));
 	st_elt->ev_base = ctx->ev_base;
 	st_elt->ctx = backend;
@@ -1186,7 +1385,7 @@ rspamd_redis_close (gpointer p)
 
 gboolean
 rspamd_redis_process_tokens (struct rspamd_task *task,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		gint id, gpointer p)
 {
 	struct redis_stat_runtime *rt = REDIS_RUNTIME (p);
@@ -1215,9 +1414,8 @@ rspamd_redis_process_tokens (struct rspamd_task *task,
 		double_to_tv (rt->ctx->timeout, &tv);
 		event_add (&rt->timeout_event, &tv);
 
-		query = rspamd_redis_tokens_to_query (task, tokens,
-				"HMGET", rt->redis_object_expanded, FALSE, -1,
-				rt->stcf->clcf->flags & RSPAMD_FLAG_CLASSIFIER_INTEGER);
+		query = rspamd_redis_tokens_to_query (tokens, "HMGET",
+				rt->redis_object_expanded, rt->ctx->binary_keys);
 		g_assert (query != NULL);
 		rspamd_mempool_add_destructor (task->task_pool,
 				(rspamd_mempool_destruct_t)rspamd_fstring_free, query);
@@ -1255,7 +1453,8 @@ rspamd_redis_finalize_process (struct rspamd_task *task, gpointer runtime,
 }
 
 gboolean
-rspamd_redis_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
+rspamd_redis_learn_tokens (struct rspamd_task *task,
+		struct rspamd_stat_tokens *tokens,
 		gint id, gpointer p)
 {
 	struct redis_stat_runtime *rt = REDIS_RUNTIME (p);
@@ -1263,8 +1462,6 @@ rspamd_redis_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
 	rspamd_inet_addr_t *addr;
 	struct timeval tv;
 	rspamd_fstring_t *query;
-	const gchar *redis_cmd;
-	rspamd_token_t *tok;
 	gint ret;
 
 	up = rspamd_upstream_get (rt->ctx->write_servers,
@@ -1301,17 +1498,19 @@ rspamd_redis_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
 			rt->stcf->symbol, rt->redis_object_expanded);
 
 	if (rt->stcf->clcf->flags & RSPAMD_FLAG_CLASSIFIER_INTEGER) {
-		redis_cmd = "HINCRBY";
+		rt->learn_cmd = "HINCRBY";
 	}
 	else {
-		redis_cmd = "HINCRBYFLOAT";
+		rt->learn_cmd = "HINCRBYFLOAT";
 	}
 
 	rt->id = id;
-	query = rspamd_redis_tokens_to_query (task, tokens,
-			redis_cmd, rt->redis_object_expanded, TRUE, id,
-			rt->stcf->clcf->flags & RSPAMD_FLAG_CLASSIFIER_INTEGER);
-	g_assert (query != NULL);
+	rt->learn_args = rspamd_redis_tokens_to_learn_args (tokens, id,
+			rt->stcf->clcf->flags & RSPAMD_FLAG_CLASSIFIER_INTEGER,
+			rt->ctx->binary_keys);
+	g_assert (rt->learn_args != NULL);
+	rspamd_mempool_add_destructor (task->task_pool,
+				(rspamd_mempool_destruct_t)rspamd_fstring_free, rt->learn_args);
 
 	/*
 	 * XXX:
@@ -1319,37 +1518,15 @@ rspamd_redis_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
 	 * we could understand that we are learning or unlearning
 	 */
 
-	tok = g_ptr_array_index (task->tokens, 0);
-
-	if (tok->values[id] > 0) {
-		rspamd_printf_fstring (&query, ""
-				"*4\r\n"
-				"$7\r\n"
-				"HINCRBY\r\n"
-				"$%d\r\n"
-				"%s\r\n"
-				"$6\r\n"
-				"learns\r\n"
-				"$1\r\n"
-				"1\r\n",
-				(gint)strlen (rt->redis_object_expanded),
-				rt->redis_object_expanded);
+	if (rspamd_stat_tokens_values (task->tokens, id)[0] > 0) {
+		rt->learn_delta = "1";
 	}
 	else {
-		rspamd_printf_fstring (&query, ""
-				"*4\r\n"
-				"$7\r\n"
-				"HINCRBY\r\n"
-				"$%d\r\n"
-				"%s\r\n"
-				"$6\r\n"
-				"learns\r\n"
-				"$2\r\n"
-				"-1\r\n",
-				(gint)strlen (rt->redis_object_expanded),
-				rt->redis_object_expanded);
+		rt->learn_delta = "-1";
 	}
 
+	/* All increments are applied by a single script call */
+	query = rspamd_redis_learn_command (rt, FALSE);
 	rspamd_mempool_add_destructor (task->task_pool,
 				(rspamd_mempool_destruct_t)rspamd_fstring_free, query);
 
@@ -667,26 +667,25 @@ rspamd_sqlite3_runtime (struct rspamd_task *task,
 
 gboolean
 rspamd_sqlite3_process_tokens (struct rspamd_task *task,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		gint id, gpointer p)
 {
 	struct rspamd_stat_sqlite3_db *bk;
 	struct rspamd_stat_sqlite3_rt *rt = p;
 	gint64 iv = 0, idx;
 	guint i;
-	rspamd_token_t *tok;
+	gdouble *values;
 
 	g_assert (p != NULL);
 	g_assert (tokens != NULL);
 
 	bk = rt->db;
+	values = rspamd_stat_tokens_values (tokens, id);
 
 	for (i = 0; i < tokens->len; i ++) {
-		tok = g_ptr_array_index (tokens, i);
-
 		if (bk == NULL) {
 			/* Statfile is does not exist, so all values are zero */
-			tok->values[id] = 0.0;
+			values[i] = 0.0;
 			continue;
 		}
 
@@ -714,15 +713,15 @@ rspamd_sqlite3_process_tokens (struct rspamd_task *task,
 			}
 		}
 
-		memcpy (&idx, tok->data, sizeof (idx));
+		idx = tokens->data[i];
 
 		if (rspamd_sqlite3_run_prstmt (task->task_pool, bk->sqlite, bk->prstmt,
 				RSPAMD_STAT_BACKEND_GET_TOKEN,
 				idx, rt->user_id, rt->lang_id, &iv) == SQLITE_OK) {
-			tok->values[id] = iv;
+			values[i] = iv;
 		}
 		else {
-			tok->values[id] = 0.0;
+			values[i] = 0.0;
 		}
 
 		if (rt->cf->is_spam) {
@@ -760,22 +759,23 @@ rspamd_sqlite3_finalize_process (struct rspamd_task *task, gpointer runtime,
 }
 
 gboolean
-rspamd_sqlite3_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
+rspamd_sqlite3_learn_tokens (struct rspamd_task *task,
+		struct rspamd_stat_tokens *tokens,
 		gint id, gpointer p)
 {
 	struct rspamd_stat_sqlite3_db *bk;
 	struct rspamd_stat_sqlite3_rt *rt = p;
 	gint64 iv = 0, idx;
 	guint i;
-	rspamd_token_t *tok;
+	gdouble *values;
 
 	g_assert (tokens != NULL);
 	g_assert (p != NULL);
 
 	bk = rt->db;
+	values = rspamd_stat_tokens_values (tokens, id);
 
 	for (i = 0; i < tokens->len; i++) {
-		tok = g_ptr_array_index (tokens, i);
 		if (bk == NULL) {
 			/* Statfile is does not exist, so all values are zero */
 			return FALSE;
@@ -805,8 +805,8 @@ rspamd_sqlite3_learn_tokens (struct rspamd_task *task, GPtrArray *tokens,
 			}
 		}
 
-		iv = tok->values[id];
-		memcpy (&idx, tok->data, sizeof (idx));
+		iv = values[i];
+		idx = tokens->data[i];
 
 		if (rspamd_sqlite3_run_prstmt (task->task_pool, bk->sqlite, bk->prstmt,
 				RSPAMD_STAT_BACKEND_SET_TOKEN,
@@ -100,7 +100,8 @@ static const double feature_weight[] = { 0, 1, 4, 27, 256, 3125, 46656, 823543 }
  */
 static void
 bayes_classify_token (struct rspamd_classifier *ctx,
-		rspamd_token_t *tok, struct bayes_task_closure *cl)
+		struct rspamd_stat_tokens *tokens, guint idx,
+		struct bayes_task_closure *cl)
 {
 	guint i;
 	gint id;
@@ -116,7 +117,7 @@ bayes_classify_token (struct rspamd_classifier *ctx,
 		id = g_array_index (ctx->statfiles_ids, gint, i);
 		st = g_ptr_array_index (ctx->ctx->statfiles, id);
 		g_assert (st != NULL);
-		val = tok->values[id];
+		val = rspamd_stat_tokens_values (tokens, id)[idx];
 
 		if (val > 0) {
 			if (st->stcf->is_spam) {
@@ -137,7 +138,8 @@ bayes_classify_token (struct rspamd_classifier *ctx,
 		ham_freq = ((double)ham_count / MAX (1., (double)ctx->ham_learns));
 		spam_prob = spam_freq / (spam_freq + ham_freq);
 		ham_prob = ham_freq / (spam_freq + ham_freq);
-		fw = feature_weight[tok->window_idx % G_N_ELEMENTS (feature_weight)];
+		fw = feature_weight[tokens->window_idx[idx] %
+				G_N_ELEMENTS (feature_weight)];
 		norm_sum = (spam_freq + ham_freq) * (spam_freq + ham_freq);
 		norm_sub = (spam_freq - ham_freq) * (spam_freq - ham_freq);
 
@@ -177,14 +179,13 @@ bayes_init (rspamd_mempool_t *pool, struct rspamd_classifier *cl)
 
 gboolean
 bayes_classify (struct rspamd_classifier * ctx,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		struct rspamd_task *task)
 {
 	double final_prob, h, s, *pprob;
 	gchar sumbuf[32];
 	struct rspamd_statfile *st = NULL;
 	struct bayes_task_closure cl;
-	rspamd_token_t *tok;
 	guint i;
 	gint id;
 
@@ -213,9 +214,7 @@ bayes_classify (struct rspamd_classifier * ctx,
 	}
 
 	for (i = 0; i < tokens->len; i ++) {
-		tok = g_ptr_array_index (tokens, i);
-
-		bayes_classify_token (ctx, tok, &cl);
+		bayes_classify_token (ctx, tokens, i, &cl);
 	}
 
 	h = 1 - inv_chi_square (task, cl.spam_prob, cl.processed_tokens);
@@ -298,7 +297,7 @@ bayes_classify (struct rspamd_classifier * ctx,
 
 gboolean
 bayes_learn_spam (struct rspamd_classifier * ctx,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		struct rspamd_task *task,
 		gboolean is_spam,
 		gboolean unlearn,
@@ -307,7 +306,7 @@ bayes_learn_spam (struct rspamd_classifier * ctx,
 	guint i, j;
 	gint id;
 	struct rspamd_statfile *st;
-	rspamd_token_t *tok;
+	gdouble *values;
 	gboolean incrementing;
 
 	g_assert (ctx != NULL);
@@ -315,33 +314,33 @@ bayes_learn_spam (struct rspamd_classifier * ctx,
 
 	incrementing = ctx->cfg->flags & RSPAMD_FLAG_CLASSIFIER_INCREMENTING_BACKEND;
 
-	for (i = 0; i < tokens->len; i++) {
-		tok = g_ptr_array_index (tokens, i);
-
-		for (j = 0; j < ctx->statfiles_ids->len; j++) {
-			id = g_array_index (ctx->statfiles_ids, gint, j);
-			st = g_ptr_array_index (ctx->ctx->statfiles, id);
-			g_assert (st != NULL);
+	/* Values of each statfile are contiguous, so process them row by row */
+	for (j = 0; j < ctx->statfiles_ids->len; j++) {
+		id = g_array_index (ctx->statfiles_ids, gint, j);
+		st = g_ptr_array_index (ctx->ctx->statfiles, id);
+		g_assert (st != NULL);
+		values = rspamd_stat_tokens_values (tokens, id);
 
+		for (i = 0; i < tokens->len; i++) {
 			if (!!st->stcf->is_spam == !!is_spam) {
 				if (incrementing) {
-					tok->values[id] = 1;
+					values[i] = 1;
 				}
 				else {
-					tok->values[id]++;
+					values[i]++;
 				}
 			}
-			else if (tok->values[id] > 0 && unlearn) {
+			else if (values[i] > 0 && unlearn) {
 				/* Unlearning */
 				if (incrementing) {
-					tok->values[id] = -1;
+					values[i] = -1;
 				}
 				else {
-					tok->values[id]--;
+					values[i]--;
 				}
 			}
 			else if (incrementing) {
-				tok->values[id] = 0;
+				values[i] = 0;
 			}
 		}
 	}
@@ -124,14 +124,13 @@ lua_classifier_init (rspamd_mempool_t *pool,
 }
 gboolean
 lua_classifier_classify (struct rspamd_classifier *cl,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		struct rspamd_task *task)
 {
 	struct rspamd_lua_classifier_ctx *ctx;
 	struct rspamd_task **ptask;
 	struct rspamd_classifier_config **pcfg;
 	lua_State *L;
-	rspamd_token_t *tok;
 	guint i;
 	guint64 v;
 
@@ -150,16 +149,14 @@ lua_classifier_classify (struct rspamd_classifier *cl,
 	lua_createtable (L, tokens->len, 0);
 
 	for (i = 0; i < tokens->len; i ++) {
-		tok = g_ptr_array_index (tokens, i);
-		v = 0;
-		memcpy (&v, tok->data, MIN (sizeof (v), tok->datalen));
+		v = tokens->data[i];
 		lua_createtable (L, 3, 0);
 		/* High word, low word, order */
 		lua_pushnumber (L, (guint32)(v >> 32));
 		lua_rawseti (L, -2, 1);
 		lua_pushnumber (L, (guint32)(v));
 		lua_rawseti (L, -2, 2);
-		lua_pushnumber (L, tok->window_idx);
+		lua_pushnumber (L, tokens->window_idx[i]);
 		lua_rawseti (L, -2, 3);
 		lua_rawseti (L, -2, i + 1);
 	}
@@ -177,7 +174,7 @@ lua_classifier_classify (struct rspamd_classifier *cl,
 
 gboolean
 lua_classifier_learn_spam (struct rspamd_classifier *cl,
-		GPtrArray *tokens,
+		struct rspamd_stat_tokens *tokens,
 		struct rspamd_task *task,
 		gboolean is_spam,
 		gboolean unlearn,
@@ -187,7 +184,6 @@ lua_classifier_learn_spam (struct rspamd_classifier *cl,
 	struct rspamd_task **ptask;
 	struct rspamd_classifier_config **pcfg;
 	lua_State *L;
-	rspamd_token_t *tok;
 	guint i;
 	guint64 v;
 
@@ -206,16 +202,14 @@ lua_classifier_learn_spam (struct rspamd_classifier *cl,
 	lua_createtable (L, tokens->len, 0);
 
 	for (i = 0; i < tokens->len; i ++) {
-		tok = g_ptr_array_index (tokens, i);
-		v = 0;
-		memcpy (&v, tok->data, MIN (sizeof (v), tok->datalen));
+		v = tokens->data[i];
 		lua_createtable (L, 3, 0);
 		/* High word, low word, order */
 		lua_pushnumber (L, (guint32)(v >> 32));
 		lua_rawseti (L, -2, 1);
 		lua_pushnumber (L, (guint32)(v));
 		lua_rawseti (L, -2, 2);
-		lua_pushnumber (L, tok->window_idx);
+		lua_pushnumber (L, tokens->window_idx[i]);
 		lua_rawseti (L, -2, 3);
 		lua_rawseti (L, -2, i + 1);
 	}
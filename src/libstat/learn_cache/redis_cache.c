@@ -181,8 +181,6 @@ static void
 rspamd_stat_cache_redis_generate_id (struct rspamd_task *task)
 {
 	rspamd_cryptobox_hash_state_t st;
-	rspamd_token_t *tok;
-	guint i;
 	guchar out[rspamd_cryptobox_HASHBYTES];
 	gchar *b32out;
 	gchar *user = NULL;
@@ -195,10 +193,9 @@ rspamd_stat_cache_redis_generate_id (struct rspamd_task *task)
 		rspamd_cryptobox_hash_update (&st, user, strlen (user));
 	}
 
-	for (i = 0; i < task->tokens->len; i ++) {
-		tok = g_ptr_array_index (task->tokens, i);
-		rspamd_cryptobox_hash_update (&st, tok->data, tok->datalen);
-	}
+	/* Token ids are contiguous, so they are hashed at once */
+	rspamd_cryptobox_hash_update (&st, (const guchar *)task->tokens->data,
+			task->tokens->len * sizeof (task->tokens->data[0]));
 
 	rspamd_cryptobox_hash_final (&st, out);
 
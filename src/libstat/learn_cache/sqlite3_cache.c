@@ -176,10 +176,8 @@ rspamd_stat_cache_sqlite3_check (struct rspamd_task *task,
 {
 	struct rspamd_stat_sqlite3_ctx *ctx = runtime;
 	rspamd_cryptobox_hash_state_t st;
-	rspamd_token_t *tok;
 	guchar *out;
 	gchar *user = NULL;
-	guint i;
 	gint rc;
 	gint64 flag;
 
@@ -198,10 +196,9 @@ rspamd_stat_cache_sqlite3_check (struct rspamd_task *task,
 			rspamd_cryptobox_hash_update (&st, user, strlen (user));
 		}
 
-		for (i = 0; i < task->tokens->len; i ++) {
-			tok = g_ptr_array_index (task->tokens, i);
-			rspamd_cryptobox_hash_update (&st, tok->data, tok->datalen);
-		}
+		/* Token ids are contiguous, so they are hashed at once */
+		rspamd_cryptobox_hash_update (&st, (const guchar *)task->tokens->data,
+				task->tokens->len * sizeof (task->tokens->data[0]));
 
 		rspamd_cryptobox_hash_final (&st, out);
 
@@ -51,13 +51,55 @@ struct rspamd_statfile {
 	gpointer bkcf;
 };
 
-#define RSPAMD_MAX_TOKEN_LEN 8
-typedef struct token_node_s {
-	guchar data[RSPAMD_MAX_TOKEN_LEN];
-	guint window_idx;
-	guint datalen;
-	gdouble values[];
-} rspamd_token_t;
+/*
+ * Statistics tokens are stored as a structure of arrays: token ids and window
+ * indexes are contiguous and values of each statfile form a separate row of
+ * `allocated` elements, so classifiers and backends scan memory sequentially
+ */
+struct rspamd_stat_tokens {
+	guint64 *data; /* token ids */
+	guint *window_idx; /* window index of each token */
+	gdouble *values; /* nvalues rows, one per statfile */
+	guint len;
+	guint allocated;
+	guint nvalues;
+};
+
+/**
+ * Creates new tokens vector
+ * @param reserved number of tokens to preallocate
+ * @param nvalues number of values per token (statfiles count)
+ * @return new tokens vector that should be freed by `rspamd_stat_tokens_free`
+ */
+struct rspamd_stat_tokens * rspamd_stat_tokens_new (guint reserved,
+		guint nvalues);
+
+/**
+ * Ensures that at least `n` more tokens can be added without reallocation
+ */
+void rspamd_stat_tokens_reserve (struct rspamd_stat_tokens *tokens, guint n);
+
+void rspamd_stat_tokens_free (struct rspamd_stat_tokens *tokens);
+
+/* Returns values of statfile `id` for all tokens */
+static inline gdouble *
+rspamd_stat_tokens_values (struct rspamd_stat_tokens *tokens, gint id)
+{
+	return tokens->values + (gsize)id * tokens->allocated;
+}
+
+static inline void
+rspamd_stat_tokens_add (struct rspamd_stat_tokens *tokens, guint64 data,
+		guint window_idx)
+{
+	if (G_UNLIKELY (tokens->len >= tokens->allocated)) {
+		rspamd_stat_tokens_reserve (tokens, MAX (tokens->allocated, 16));
+	}
+
+	tokens->data[tokens->len] = data;
+	tokens->window_idx[tokens->len] = window_idx;
+	tokens->len ++;
+}
 
 struct rspamd_stat_async_elt;
 
@@ -218,9 +218,10 @@ rspamd_stat_process_tokenize (struct rspamd_stat_ctx *st_ctx,
 		reserved_len += 5;
 	}
 
-	task->tokens = g_ptr_array_sized_new (reserved_len);
+	task->tokens = rspamd_stat_tokens_new (reserved_len,
+			st_ctx->statfiles->len);
 	rspamd_mempool_add_destructor (task->task_pool,
-			rspamd_ptr_array_free_hard, task->tokens);
+			(rspamd_mempool_destruct_t)rspamd_stat_tokens_free, task->tokens);
 	pdiff = rspamd_mempool_get_variable (task->task_pool, "parts_distance");
 
 	for (i = 0; i < task->text_parts->len; i ++) {
@@ -261,14 +261,12 @@ rspamd_tokenizer_osb (struct rspamd_stat_ctx *ctx,
 		GArray *words,
 		gboolean is_utf,
 		const gchar *prefix,
-		GPtrArray *result)
+		struct rspamd_stat_tokens *result)
 {
-	rspamd_token_t *new_tok = NULL;
 	rspamd_ftok_t *token;
 	struct rspamd_osb_tokenizer_config *osb_cf;
-	guint64 *hashpipe, cur, seed;
+	guint64 *hashpipe, cur, seed, tok;
 	guint32 h1, h2;
-	gsize token_size;
 	guint processed = 0, i, w, window_size;
 
 	if (words == NULL) {
@@ -288,8 +286,10 @@ rspamd_tokenizer_osb (struct rspamd_stat_ctx *ctx,
 
 	hashpipe = g_alloca (window_size * sizeof (hashpipe[0]));
 	memset (hashpipe, 0xfe, window_size * sizeof (hashpipe[0]));
-	token_size = sizeof (rspamd_token_t) + sizeof (gdouble) * ctx->statfiles->len;
-	g_assert (token_size > 0);
+	/* Each word produces at most window_size - 1 tokens */
+	if (window_size > 1) {
+		rspamd_stat_tokens_reserve (result, words->len * (window_size - 1));
+	}
 
 	for (w = 0; w < words->len; w ++) {
 		token = &g_array_index (words, rspamd_ftok_t, w);
@@ -314,22 +314,19 @@ rspamd_tokenizer_osb (struct rspamd_stat_ctx *ctx,
 		}
 
 #define ADD_TOKEN do {\
-    new_tok = rspamd_mempool_alloc0 (pool, token_size); \
-    new_tok->datalen = sizeof (gint64); \
     if (osb_cf->ht == RSPAMD_OSB_HASH_COMPAT) { \
         h1 = ((guint32)hashpipe[0]) * primes[0] + \
             ((guint32)hashpipe[i]) * primes[i << 1]; \
         h2 = ((guint32)hashpipe[0]) * primes[1] + \
             ((guint32)hashpipe[i]) * primes[(i << 1) - 1]; \
-        memcpy(new_tok->data, &h1, sizeof (h1)); \
-        memcpy(new_tok->data + sizeof (h1), &h2, sizeof (h2)); \
+        memcpy (&tok, &h1, sizeof (h1)); \
+        memcpy ((guchar *)&tok + sizeof (h1), &h2, sizeof (h2)); \
     } \
     else { \
         cur = hashpipe[0] * primes[0] + hashpipe[i] * primes[i << 1]; \
-        memcpy (new_tok->data, &cur, sizeof (cur)); \
+        tok = cur; \
     } \
-    new_tok->window_idx = i + 1; \
-    g_ptr_array_add (result, new_tok); \
+    rspamd_stat_tokens_add (result, tok, i + 1); \
   } while(0)
 
 		if (processed < window_size) {
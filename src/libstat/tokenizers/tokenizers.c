@@ -55,16 +55,61 @@ const gchar t_delimiters[255] = {
 	0, 0, 0, 0, 0
 };
 
-gint
-token_node_compare_func (gconstpointer a, gconstpointer b)
+struct rspamd_stat_tokens *
+rspamd_stat_tokens_new (guint reserved, guint nvalues)
 {
-	const rspamd_token_t *aa = a, *bb = b;
+	struct rspamd_stat_tokens *tokens;
 
-	if (aa->datalen != bb->datalen) {
-		return aa->datalen - bb->datalen;
+	tokens = g_malloc0 (sizeof (*tokens));
+	tokens->nvalues = nvalues;
+	rspamd_stat_tokens_reserve (tokens, MAX (reserved, 16));
+
+	return tokens;
+}
+
+void
+rspamd_stat_tokens_reserve (struct rspamd_stat_tokens *tokens, guint n)
+{
+	gdouble *values;
+	guint allocated, i;
+
+	if (tokens->len + n <= tokens->allocated) {
+		return;
 	}
 
-	return memcmp (aa->data, bb->data, aa->datalen);
+	allocated = MAX (tokens->len + n, tokens->allocated * 2);
+	tokens->data = g_realloc (tokens->data,
+			allocated * sizeof (tokens->data[0]));
+	tokens->window_idx = g_realloc (tokens->window_idx,
+			allocated * sizeof (tokens->window_idx[0]));
+
+	/* Rows are interleaved by `allocated`, so they are moved one by one */
+	values = g_malloc0 ((gsize)allocated * tokens->nvalues *
+			sizeof (gdouble));
+
+	if (tokens->values) {
+		for (i = 0; i < tokens->nvalues; i ++) {
+			memcpy (values + (gsize)i * allocated,
+					rspamd_stat_tokens_values (tokens, i),
+					tokens->len * sizeof (gdouble));
+		}
+
+		g_free (tokens->values);
+	}
+
+	tokens->values = values;
+	tokens->allocated = allocated;
+}
+
+void
+rspamd_stat_tokens_free (struct rspamd_stat_tokens *tokens)
+{
+	if (tokens) {
+		g_free (tokens->data);
+		g_free (tokens->window_idx);
+		g_free (tokens->values);
+		g_free (tokens);
+	}
 }
 
 /* Get next word from specified f_str_t buf */
@@ -11,6 +11,7 @@
 
 struct rspamd_tokenizer_runtime;
 struct rspamd_stat_ctx;
+struct rspamd_stat_tokens;
 
 /* Common tokenizer structure */
 struct rspamd_stat_tokenizer {
@@ -22,13 +23,9 @@ struct rspamd_stat_tokenizer {
 			GArray *words,
 			gboolean is_utf,
 			const gchar *prefix,
-			GPtrArray *result);
+			struct rspamd_stat_tokens *result);
 };
 
-/* Compare two token nodes */
-gint token_node_compare_func (gconstpointer a, gconstpointer b);
-
-
 /* Tokenize text into array of words (rspamd_ftok_t type) */
 GArray * rspamd_tokenize_text (gchar *text, gsize len, gboolean is_utf,
 		struct rspamd_config *cfg, GList *exceptions, gboolean compat,
@@ -40,7 +37,7 @@ gint rspamd_tokenizer_osb (struct rspamd_stat_ctx *ctx,
 		GArray *words,
 		gboolean is_utf,
 		const gchar *prefix,
-		GPtrArray *result);
+		struct rspamd_stat_tokens *result);
 
 gpointer rspamd_tokenizer_osb_get_config (rspamd_mempool_t *pool,
 		struct rspamd_tokenizer_config *cf,
@@ -830,12 +830,13 @@ rspamd_inet_address_connect (const rspamd_inet_addr_t *addr, gint type,
 
 int
 rspamd_inet_address_listen (const rspamd_inet_addr_t *addr, gint type,
-		gboolean async)
+		enum rspamd_inet_address_listen_opts opts)
 {
 	gint fd, r;
 	gint on = 1;
 	const struct sockaddr *sa;
 	const char *path;
+	gboolean async = !!(opts & RSPAMD_INET_ADDRESS_LISTEN_ASYNC);
 
 	if (addr == NULL) {
 		return -1;
@@ -860,6 +861,22 @@ rspamd_inet_address_listen (const rspamd_inet_addr_t *addr, gint type,
 
 	(void)setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, (const void *)&on, sizeof (gint));
 
+	if (opts & RSPAMD_INET_ADDRESS_LISTEN_REUSEPORT) {
+#ifdef SO_REUSEPORT
+		if (setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, (const void *)&on,
+				sizeof (gint)) == -1) {
+			msg_warn ("cannot set SO_REUSEPORT: %d, '%s'", errno,
+					strerror (errno));
+			close (fd);
+			return -1;
+		}
+#else
+		msg_warn ("SO_REUSEPORT is not supported on this platform");
+		close (fd);
+		return -1;
+#endif
+	}
+
 #ifdef HAVE_IPV6_V6ONLY
 	if (addr->af == AF_INET6) {
 		/* We need to set this flag to avoid errors */
@@ -971,6 +988,21 @@ rspamd_inet_address_sendto (gint fd, const void *buf, gsize len, gint fl,
 	return r;
 }
 
+const struct sockaddr*
+rspamd_inet_address_get_sa (const rspamd_inet_addr_t *addr,
+		socklen_t *sz)
+{
+	g_assert (addr != NULL);
+	*sz = addr->slen;
+
+	if (addr->af == AF_UNIX) {
+		return (const struct sockaddr *)&addr->u.un->addr;
+	}
+	else {
+		return (const struct sockaddr *)&addr->u.in.addr.sa;
+	}
+}
+
 static gboolean
 rspamd_check_port_priority (const char *line, guint default_port,
 		guint *priority, gchar *out,
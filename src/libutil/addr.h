@@ -160,6 +160,16 @@ gssize rspamd_inet_address_recvfrom (gint fd, void *buf, gsize len, gint fl,
 gssize rspamd_inet_address_sendto (gint fd, const void *buf, gsize len, gint fl,
 		const rspamd_inet_addr_t *addr);
 
+/**
+ * Returns socket address structure and its length for the specified address
+ * (suitable for sendmsg(2) family of calls)
+ * @param addr
+ * @param sz output length of the socket address
+ * @return
+ */
+const struct sockaddr* rspamd_inet_address_get_sa (const rspamd_inet_addr_t *addr,
+		socklen_t *sz);
+
 /**
  * Set port for inet address
  */
@@ -174,15 +184,22 @@ void rspamd_inet_address_set_port (rspamd_inet_addr_t *addr, uint16_t port);
 int rspamd_inet_address_connect (const rspamd_inet_addr_t *addr, gint type,
 	gboolean async);
 
+enum rspamd_inet_address_listen_opts {
+	RSPAMD_INET_ADDRESS_LISTEN_DEFAULT = 0,
+	RSPAMD_INET_ADDRESS_LISTEN_ASYNC = (1u << 0),
+	/* Several sockets could be bound to the same inet address and port */
+	RSPAMD_INET_ADDRESS_LISTEN_REUSEPORT = (1u << 1),
+};
+
 /**
  * Listen on a specified inet address
  * @param addr
  * @param type
- * @param async
+ * @param opts options for the listening socket
  * @return
  */
 int rspamd_inet_address_listen (const rspamd_inet_addr_t *addr, gint type,
-	gboolean async);
+	enum rspamd_inet_address_listen_opts opts);
 /**
  * Check whether specified ip is valid (not INADDR_ANY or INADDR_NONE) for ipv4 or ipv6
  * @param ptr pointer to struct in_addr or struct in6_addr
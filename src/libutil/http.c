@@ -43,6 +43,7 @@ enum rspamd_http_priv_flags {
 	RSPAMD_HTTP_CONN_FLAG_NEW_HEADER = 1 << 1,
 	RSPAMD_HTTP_CONN_FLAG_RESETED = 1 << 2,
 	RSPAMD_HTTP_CONN_FLAG_TOO_LARGE = 1 << 3,
+	RSPAMD_HTTP_CONN_FLAG_KEEP_ALIVE = 1 << 4,
 };
 
 #define IS_CONN_ENCRYPTED(c) ((c)->flags & RSPAMD_HTTP_CONN_FLAG_ENCRYPTED)
@@ -956,6 +957,13 @@ rspamd_http_on_message_complete (http_parser * parser)
 			event_del (&priv->ev);
 		}
 
+		if (http_should_keep_alive (parser)) {
+			priv->flags |= RSPAMD_HTTP_CONN_FLAG_KEEP_ALIVE;
+		}
+		else {
+			priv->flags &= ~RSPAMD_HTTP_CONN_FLAG_KEEP_ALIVE;
+		}
+
 		rspamd_http_connection_ref (conn);
 		ret = conn->finish_handler (conn, priv->msg);
 		conn->finished = TRUE;
@@ -1198,20 +1206,25 @@ rspamd_http_event_handler (int fd, short what, gpointer ud)
 		}
 		else if (r == 0) {
 			/* We can still call http parser */
-			if (http_parser_execute (&priv->parser, &priv->parser_cb, d, r)
-					!= (size_t)r) {
-				if (!conn->finished) {
-					err = g_error_new (HTTP_ERROR,
-							errno,
-							"IO read error: unexpected EOF");
-					conn->error_handler (conn, err);
-					g_error_free (err);
-				}
-				REF_RELEASE (pbuf);
-				rspamd_http_connection_unref (conn);
+			http_parser_execute (&priv->parser, &priv->parser_cb, d, r);
 
-				return;
+			/*
+			 * Parser accepts EOF silently in its initial state, e.g. when
+			 * an idle keep-alive connection is closed by peer, so EOF is an
+			 * error unless it has completed a message
+			 */
+			if (!conn->finished) {
+				err = g_error_new (HTTP_ERROR,
+						errno,
+						"IO read error: unexpected EOF");
+				conn->error_handler (conn, err);
+				g_error_free (err);
 			}
+
+			REF_RELEASE (pbuf);
+			rspamd_http_connection_unref (conn);
+
+			return;
 		}
 		else {
 			if (!priv->ssl) {
@@ -1553,6 +1566,7 @@ rspamd_http_connection_read_message_common (struct rspamd_http_connection *conn,
 		conn->type == RSPAMD_HTTP_SERVER ? HTTP_REQUEST : HTTP_RESPONSE);
 	priv->msg = req;
 	req->flags = flags;
+	priv->flags &= ~RSPAMD_HTTP_CONN_FLAG_KEEP_ALIVE;
 
 	if (flags & RSPAMD_HTTP_FLAG_SHMEM) {
 		req->body_buf.c.shared.shm_fd = -1;
@@ -1736,6 +1750,17 @@ rspamd_http_message_write_header (const gchar* mime_type, gboolean encrypted,
 	gchar datebuf[64];
 	gint meth_len = 0;
 	struct tm t, *ptm;
+	const gchar *conn_type;
+
+	if (conn->type == RSPAMD_HTTP_CLIENT) {
+		/* Client asks for keep-alive and server decides */
+		conn_type = (conn->opts & RSPAMD_HTTP_CLIENT_KEEP_ALIVE) ?
+				"keep-alive" : "close";
+	}
+	else {
+		conn_type = rspamd_http_connection_is_keepalive (conn) ?
+				"keep-alive" : "close";
+	}
 
 	if (conn->type == RSPAMD_HTTP_SERVER) {
 		/* Format reply */
@@ -1755,34 +1780,36 @@ rspamd_http_message_write_header (const gchar* mime_type, gboolean encrypted,
 				meth_len =
 						rspamd_snprintf (repbuf, replen,
 								"HTTP/1.1 %d %V\r\n"
-								"Connection: close\r\n"
+								"Connection: %s\r\n"
 								"Server: %s\r\n"
 								"Date: %s\r\n"
 								"Content-Length: %z\r\n"
 								"Content-Type: %s", /* NO \r\n at the end ! */
-								msg->code, msg->status, "rspamd/" RVERSION, datebuf,
+								msg->code, msg->status, conn_type,
+								"rspamd/" RVERSION, datebuf,
 								bodylen, mime_type);
 				enclen += meth_len;
 				/* External reply */
 				rspamd_printf_fstring (buf,
 						"HTTP/1.1 200 OK\r\n"
-						"Connection: close\r\n"
+						"Connection: %s\r\n"
 						"Server: rspamd\r\n"
 						"Date: %s\r\n"
 						"Content-Length: %z\r\n"
 						"Content-Type: application/octet-stream\r\n",
-						datebuf, enclen);
+						conn_type, datebuf, enclen);
 			}
 			else {
 				meth_len =
 						rspamd_printf_fstring (buf,
 								"HTTP/1.1 %d %V\r\n"
-								"Connection: close\r\n"
+								"Connection: %s\r\n"
 								"Server: %s\r\n"
 								"Date: %s\r\n"
 								"Content-Length: %z\r\n"
 								"Content-Type: %s\r\n",
-								msg->code, msg->status, "rspamd/" RVERSION, datebuf,
+								msg->code, msg->status, conn_type,
+								"rspamd/" RVERSION, datebuf,
 								bodylen, mime_type);
 			}
 		}
@@ -1821,35 +1848,35 @@ rspamd_http_message_write_header (const gchar* mime_type, gboolean encrypted,
 				if (host != NULL) {
 					rspamd_printf_fstring (buf,
 							"%s %s HTTP/1.1\r\n"
-							"Connection: close\r\n"
+							"Connection: %s\r\n"
 							"Host: %s\r\n"
 							"Content-Length: %z\r\n",
-							"POST", "/post", host, enclen);
+							"POST", "/post", conn_type, host, enclen);
 				}
 				else {
 					rspamd_printf_fstring (buf,
 							"%s %s HTTP/1.1\r\n"
-							"Connection: close\r\n"
+							"Connection: %s\r\n"
 							"Host: %V\r\n"
 							"Content-Length: %z\r\n",
-							"POST", "/post", msg->host, enclen);
+							"POST", "/post", conn_type, msg->host, enclen);
 				}
 			}
 			else {
 				if (host != NULL) {
 					rspamd_printf_fstring (buf,
-							"%s %V HTTP/1.1\r\nConnection: close\r\nHost: %s\r\nContent-Length: %z\r\n",
-							http_method_str (msg->method), msg->url, host,
-							bodylen);
+							"%s %V HTTP/1.1\r\nConnection: %s\r\nHost: %s\r\nContent-Length: %z\r\n",
+							http_method_str (msg->method), msg->url, conn_type,
+							host, bodylen);
 				}
 				else {
 					rspamd_printf_fstring (buf,
 							"%s %V HTTP/1.1\r\n"
-							"Connection: close\r\n"
+							"Connection: %s\r\n"
 							"Host: %V\r\n"
 							"Content-Length: %z\r\n",
-							http_method_str (msg->method), msg->url, msg->host,
-							bodylen);
+							http_method_str (msg->method), msg->url, conn_type,
+							msg->host, bodylen);
 				}
 			}
 		}
@@ -1908,7 +1935,14 @@ rspamd_http_connection_write_message_common (struct rspamd_http_connection *conn
 	buf = priv->buf->data;
 
 	if (priv->peer_key && priv->local_key) {
-		priv->msg->peer_key = priv->peer_key;
+		if (priv->msg->peer_key == NULL) {
+			priv->msg->peer_key = priv->peer_key;
+		}
+		else {
+			/* Reused connection, message has its own key */
+			rspamd_pubkey_unref (priv->peer_key);
+		}
+
 		priv->peer_key = NULL;
 		priv->flags |= RSPAMD_HTTP_CONN_FLAG_ENCRYPTED;
 	}
@@ -3337,6 +3371,12 @@ rspamd_http_connection_set_key (struct rspamd_http_connection *conn,
 	struct rspamd_http_connection_private *priv = conn->priv;
 
 	g_assert (key != NULL);
+
+	if (priv->local_key) {
+		/* Connection could be reused with a rotated key */
+		rspamd_keypair_unref (priv->local_key);
+	}
+
 	priv->local_key = rspamd_keypair_ref (key);
 }
 
@@ -3355,6 +3395,17 @@ rspamd_http_connection_get_peer_key (struct rspamd_http_connection *conn)
 	return NULL;
 }
 
+gboolean
+rspamd_http_connection_is_keepalive (struct rspamd_http_connection *conn)
+{
+	if (!(conn->opts & RSPAMD_HTTP_CLIENT_KEEP_ALIVE)) {
+		return FALSE;
+	}
+
+	/* Peer must agree to keep connection alive */
+	return (conn->priv->flags & RSPAMD_HTTP_CONN_FLAG_KEEP_ALIVE) != 0;
+}
+
 gboolean
 rspamd_http_connection_is_encrypted (struct rspamd_http_connection *conn)
 {
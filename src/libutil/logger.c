@@ -52,6 +52,40 @@ struct rspamd_logger_error_log {
 	guint cur_row;
 };
 
+/*
+ * Asynchronous logging: a worker appends formatted lines to its own shared
+ * memory ring and the main process drains rings to the log. Each ring has
+ * a single producer and a single consumer, so it needs no locks
+ */
+#define RSPAMD_LOG_RING_ALIGN 16
+#define RSPAMD_LOG_RING_ALIGNED(len) \
+	(((len) + RSPAMD_LOG_RING_ALIGN - 1) & ~(RSPAMD_LOG_RING_ALIGN - 1))
+#define RSPAMD_LOG_RING_MIN_SIZE (RSPAMD_LOGBUF_SIZE * 8)
+/* Record that skips the rest of the ring up to its end */
+#define RSPAMD_LOG_RING_PAD G_MAXUINT32
+/* Maximum records written by a single writev */
+#define RSPAMD_LOG_RING_BATCH 64
+
+struct rspamd_log_ring_rec {
+	guint32 len;
+	gint32 level_flags;
+	gint64 ts;
+};
+
+struct rspamd_log_ring {
+	/* Written by producer (worker) */
+	guint head;
+	guint dropped;
+	pid_t pid;
+	guchar __padding1[64 - sizeof (guint) * 2 - sizeof (pid_t)];
+	/* Written by consumer (main process) */
+	guint tail;
+	guint reported;
+	guint size;
+	guchar __padding2[64 - sizeof (guint) * 3];
+	guchar data[];
+};
+
 /**
  * Static structure that store logging parameters
  * It is NOT shared between processes and is created by main process
@@ -88,6 +122,7 @@ struct rspamd_logger_s {
 	rspamd_mempool_mutex_t *mtx;
 	guint saved_loglevel;
 	guint64 log_cnt[4];
+	struct rspamd_log_ring *ring;
 };
 
 static const gchar lf_chr = '\n';
@@ -477,6 +512,8 @@ rspamd_log_update_pid (GQuark ptype, rspamd_logger_t *rspamd_log)
 {
 	rspamd_log->pid = getpid ();
 	rspamd_log->process_type = ptype;
+	/* Ring can have only one producer */
+	rspamd_log->ring = NULL;
 
 	/* We also need to clear all messages pending */
 	if (rspamd_log->repeats > 0) {
@@ -783,6 +820,89 @@ file_log_helper (rspamd_logger_t *rspamd_log,
 	}
 }
 
+gboolean
+rspamd_log_ring_push (struct rspamd_log_ring *ring,
+		gint level_flags,
+		time_t ts,
+		const struct iovec *iov,
+		guint iovcnt)
+{
+	struct rspamd_log_ring_rec *rec;
+	guint head, tail, off, tailroom, avail, need, i;
+	gsize len = 0;
+	guchar *p;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+
+	if (len >= ring->size) {
+		g_atomic_int_inc (&ring->dropped);
+
+		return FALSE;
+	}
+
+	need = RSPAMD_LOG_RING_ALIGNED (sizeof (*rec) + len);
+	head = ring->head;
+	tail = g_atomic_int_get (&ring->tail);
+	off = head & (ring->size - 1);
+	tailroom = ring->size - off;
+	avail = ring->size - (head - tail);
+
+	if (need > tailroom) {
+		/* Records are never wrapped, so skip the end of the ring */
+		if (need + tailroom > avail) {
+			g_atomic_int_inc (&ring->dropped);
+
+			return FALSE;
+		}
+
+		rec = (struct rspamd_log_ring_rec *)(ring->data + off);
+		rec->len = RSPAMD_LOG_RING_PAD;
+		head += tailroom;
+		off = 0;
+	}
+	else if (need > avail) {
+		g_atomic_int_inc (&ring->dropped);
+
+		return FALSE;
+	}
+
+	rec = (struct rspamd_log_ring_rec *)(ring->data + off);
+	rec->len = len;
+	rec->level_flags = level_flags;
+	rec->ts = ts;
+	p = (guchar *)(rec + 1);
+
+	for (i = 0; i < iovcnt; i++) {
+		memcpy (p, iov[i].iov_base, iov[i].iov_len);
+		p += iov[i].iov_len;
+	}
+
+	/* Publish record to the consumer */
+	g_atomic_int_set (&ring->head, head + need);
+
+	return TRUE;
+}
+
+/*
+ * Write message to the async ring if any or to the file
+ */
+static void
+file_log_write (rspamd_logger_t *rspamd_log,
+		gint level_flags,
+		time_t now,
+		const struct iovec *iov,
+		guint iovcnt)
+{
+	if (rspamd_log->ring) {
+		rspamd_log_ring_push (rspamd_log->ring, level_flags, now, iov, iovcnt);
+	}
+	else {
+		file_log_helper (rspamd_log, iov, iovcnt);
+	}
+}
+
 /**
  * Syslog interface for logging
  */
@@ -847,13 +967,16 @@ file_log_function (const gchar *module, const gchar *id,
 	guint64 cksum;
 	size_t mlen, mremain;
 	const gchar *cptype = NULL;
-	gboolean got_time = FALSE;
+	gboolean got_time = FALSE, async;
 	rspamd_logger_t *rspamd_log = arg;
 
 	if (!rspamd_log->enabled) {
 		return;
 	}
 
+	/* Time and colors are added by the main process */
+	async = rspamd_log->ring != NULL;
+
 	/* Check throttling due to write errors */
 	if (rspamd_log->throttling) {
 		now = time (NULL);
@@ -982,7 +1105,7 @@ file_log_function (const gchar *module, const gchar *id,
 		}
 
 		/* Format time */
-		if (!rspamd_log->cfg->log_systemd) {
+		if (!rspamd_log->cfg->log_systemd && !async) {
 			tms = localtime (&now);
 
 			strftime (timebuf, sizeof (timebuf), "%F %H:%M:%S", tms);
@@ -990,7 +1113,7 @@ file_log_function (const gchar *module, const gchar *id,
 
 		cptype = g_quark_to_string (rspamd_log->process_type);
 
-		if (rspamd_log->cfg->log_color) {
+		if (rspamd_log->cfg->log_color && !async) {
 			if (level_flags & G_LOG_LEVEL_INFO) {
 				/* White */
 				r = rspamd_snprintf (tmpbuf, sizeof (tmpbuf), "\033[0;37m");
@@ -1008,7 +1131,14 @@ file_log_function (const gchar *module, const gchar *id,
 			r = 0;
 		}
 
-		if (!rspamd_log->cfg->log_systemd) {
+		if (async && !rspamd_log->cfg->log_systemd) {
+			r += rspamd_snprintf (tmpbuf + r,
+					sizeof (tmpbuf) - r,
+					"#%P(%s) ",
+					rspamd_log->pid,
+					cptype);
+		}
+		else if (!rspamd_log->cfg->log_systemd) {
 			r += rspamd_snprintf (tmpbuf + r,
 					sizeof (tmpbuf) - r,
 					"%s #%P(%s) ",
@@ -1065,11 +1195,11 @@ file_log_function (const gchar *module, const gchar *id,
 			iov[4].iov_base = "\033[0m";
 			iov[4].iov_len = sizeof ("\033[0m") - 1;
 			/* Call helper (for buffering) */
-			file_log_helper (rspamd_log, iov, 5);
+			file_log_write (rspamd_log, level_flags, now, iov, 5);
 		}
 		else {
 			/* Call helper (for buffering) */
-			file_log_helper (rspamd_log, iov, 4);
+			file_log_write (rspamd_log, level_flags, now, iov, 4);
 		}
 	}
 	else {
@@ -1081,11 +1211,11 @@ file_log_function (const gchar *module, const gchar *id,
 			iov[2].iov_base = "\033[0m";
 			iov[2].iov_len = sizeof ("\033[0m") - 1;
 			/* Call helper (for buffering) */
-			file_log_helper (rspamd_log, iov, 3);
+			file_log_write (rspamd_log, level_flags, 0, iov, 3);
 		}
 		else {
 			/* Call helper (for buffering) */
-			file_log_helper (rspamd_log, iov, 2);
+			file_log_write (rspamd_log, level_flags, 0, iov, 2);
 		}
 	}
 }
@@ -1267,3 +1397,164 @@ rspamd_log_errorbuf_export (const rspamd_logger_t *logger)
 
 	return top;
 }
+
+struct rspamd_log_ring *
+rspamd_log_ring_new (gsize size)
+{
+	struct rspamd_log_ring *ring;
+	gsize rsize = RSPAMD_LOG_RING_MIN_SIZE;
+
+	while (rsize < size && rsize < G_MAXINT32) {
+		rsize <<= 1;
+	}
+
+#if defined(HAVE_MMAP_ANON)
+	ring = mmap (NULL, sizeof (*ring) + rsize, PROT_READ | PROT_WRITE,
+			MAP_ANON | MAP_SHARED, -1, 0);
+#elif defined(HAVE_MMAP_ZERO)
+	gint fd;
+
+	fd = open ("/dev/zero", O_RDWR);
+
+	if (fd == -1) {
+		return NULL;
+	}
+
+	ring = mmap (NULL, sizeof (*ring) + rsize, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	close (fd);
+#else
+#error No mmap methods are defined
+#endif
+
+	if (ring == MAP_FAILED) {
+		msg_err ("cannot allocate %z bytes of shared memory for log ring",
+				sizeof (*ring) + rsize);
+
+		return NULL;
+	}
+
+	ring->size = rsize;
+
+	return ring;
+}
+
+void
+rspamd_log_ring_free (struct rspamd_log_ring *ring)
+{
+	if (ring) {
+		munmap (ring, sizeof (*ring) + ring->size);
+	}
+}
+
+void
+rspamd_log_set_ring (rspamd_logger_t *logger, struct rspamd_log_ring *ring)
+{
+	logger->ring = ring;
+
+	if (ring) {
+		ring->pid = logger->pid;
+	}
+}
+
+/*
+ * Writes batch of records and releases their space in the ring
+ */
+static void
+rspamd_log_ring_flush (rspamd_logger_t *rspamd_log,
+		struct rspamd_log_ring *ring,
+		struct iovec *iov,
+		guint niov,
+		guint tail)
+{
+	if (niov > 0) {
+		direct_write_log_line (rspamd_log, iov, niov, TRUE);
+	}
+
+	g_atomic_int_set (&ring->tail, tail);
+}
+
+guint
+rspamd_log_ring_drain (rspamd_logger_t *rspamd_log,
+		struct rspamd_log_ring *ring)
+{
+	struct iovec iov[RSPAMD_LOG_RING_BATCH * 3];
+	struct rspamd_log_ring_rec *rec;
+	gchar timebuf[32];
+	struct tm *tms;
+	time_t last_ts = -1, ts;
+	gsize tlen = 0;
+	guint head, tail, off, niov = 0, nrec = 0, total = 0, dropped;
+	gboolean need_time, need_color;
+
+	need_time = rspamd_log->cfg->log_extended && !rspamd_log->cfg->log_systemd;
+	need_color = rspamd_log->cfg->log_extended && rspamd_log->cfg->log_color;
+	head = g_atomic_int_get (&ring->head);
+	tail = ring->tail;
+
+	while (tail != head) {
+		off = tail & (ring->size - 1);
+		rec = (struct rspamd_log_ring_rec *)(ring->data + off);
+
+		if (rec->len == RSPAMD_LOG_RING_PAD) {
+			tail += ring->size - off;
+			continue;
+		}
+
+		ts = rec->ts;
+
+		if (nrec == RSPAMD_LOG_RING_BATCH || (need_time && ts != last_ts)) {
+			/* Time buffer is shared by all records in a batch */
+			rspamd_log_ring_flush (rspamd_log, ring, iov, niov, tail);
+			niov = 0;
+			nrec = 0;
+		}
+
+		if (need_color) {
+			if (rec->level_flags & G_LOG_LEVEL_INFO) {
+				iov[niov].iov_base = "\033[0;37m";
+				iov[niov++].iov_len = sizeof ("\033[0;37m") - 1;
+			}
+			else if (rec->level_flags & G_LOG_LEVEL_WARNING) {
+				iov[niov].iov_base = "\033[0;32m";
+				iov[niov++].iov_len = sizeof ("\033[0;32m") - 1;
+			}
+			else if (rec->level_flags & G_LOG_LEVEL_CRITICAL) {
+				iov[niov].iov_base = "\033[1;31m";
+				iov[niov++].iov_len = sizeof ("\033[1;31m") - 1;
+			}
+		}
+
+		if (need_time) {
+			if (ts != last_ts) {
+				tms = localtime (&ts);
+				tlen = strftime (timebuf, sizeof (timebuf) - 1, "%F %H:%M:%S",
+						tms);
+				timebuf[tlen++] = ' ';
+				last_ts = ts;
+			}
+
+			iov[niov].iov_base = timebuf;
+			iov[niov++].iov_len = tlen;
+		}
+
+		iov[niov].iov_base = (void *)(rec + 1);
+		iov[niov++].iov_len = rec->len;
+		nrec ++;
+		total ++;
+		tail += RSPAMD_LOG_RING_ALIGNED (sizeof (*rec) + rec->len);
+	}
+
+	rspamd_log_ring_flush (rspamd_log, ring, iov, niov, tail);
+	dropped = g_atomic_int_get (&ring->dropped);
+
+	if (dropped != ring->reported) {
+		rspamd_common_log_function (rspamd_log, G_LOG_LEVEL_WARNING,
+				"logger", NULL, G_STRFUNC,
+				"log ring of process %P is full, %ud lines have been dropped",
+				ring->pid, dropped - ring->reported);
+		ring->reported = dropped;
+	}
+
+	return total;
+}
@@ -153,6 +153,47 @@ void rspamd_log_lock (rspamd_logger_t *logger);
  */
 const guint64* rspamd_log_counters (rspamd_logger_t *logger);
 
+struct rspamd_log_ring;
+
+/**
+ * Allocates shared memory ring for asynchronous logging, it should be
+ * created before fork so both worker and main process could access it
+ * @param size size of ring in bytes (rounded up to a power of two)
+ * @return new ring or NULL
+ */
+struct rspamd_log_ring * rspamd_log_ring_new (gsize size);
+
+/**
+ * Unmaps log ring, all records should be drained before
+ */
+void rspamd_log_ring_free (struct rspamd_log_ring *ring);
+
+/**
+ * Makes file logger to append lines to the ring instead of writing them,
+ * must be called after `rspamd_log_update_pid` in a worker process
+ */
+void rspamd_log_set_ring (rspamd_logger_t *logger,
+		struct rspamd_log_ring *ring);
+
+/**
+ * Appends a formatted line to the ring, it is called by file logger when
+ * a ring is set and must be called by the ring producer only
+ * @param ts time to be written for this line when the ring is drained
+ * @return FALSE if there is no space in the ring and the line is dropped
+ */
+gboolean rspamd_log_ring_push (struct rspamd_log_ring *ring,
+		gint level_flags,
+		time_t ts,
+		const struct iovec *iov,
+		guint iovcnt);
+
+/**
+ * Writes all pending lines from the ring to the log adding timestamps
+ * @return number of lines written
+ */
+guint rspamd_log_ring_drain (rspamd_logger_t *logger,
+		struct rspamd_log_ring *ring);
+
 /**
  * Returns errors ring buffer as ucl array
  * @param logger
@@ -54,6 +54,7 @@
 #endif
 
 static const gchar *hash_fill = "1";
+static const guint64 map_hash_seed = 0xb32ad7c55eb2e647ULL;
 static void free_http_cbdata_common (struct http_callback_data *cbd, gboolean plan_new);
 static void free_http_cbdata_dtor (gpointer p);
 static void free_http_cbdata (struct http_callback_data *cbd);
@@ -1240,6 +1241,15 @@ rspamd_map_remove_all (struct rspamd_config *cfg)
 			unlink (map->cache->shmem_name);
 		}
 
+		if (g_atomic_int_compare_and_exchange (&map->cache->snapshot_available,
+				1, 0)) {
+#ifdef HAVE_SANE_SHMEM
+			shm_unlink (map->cache->snapshot_shmem_name);
+#else
+			unlink (map->cache->snapshot_shmem_name);
+#endif
+		}
+
 		if (map->dtor) {
 			map->dtor (map->dtor_data);
 		}
@@ -2496,3 +2506,368 @@ rspamd_match_regexp_map (struct rspamd_regexp_map *map,
 
 	return ret;
 }
+
+#define RSPAMD_MAP_SNAPSHOT_MAGIC 0x70616e736170616dULL
+
+struct rspamd_map_snapshot_hdr {
+	guint64 magic;
+	guint64 cksum;
+	guint64 nbuckets;
+	guint64 nelts;
+};
+
+/* Offsets are calculated from the beginning of snapshot, 0 means empty bucket */
+struct rspamd_map_snapshot_bucket {
+	guint64 hash;
+	guint64 key_off;
+	guint64 value_off;
+};
+
+struct rspamd_map_snapshot {
+	gpointer base;
+	gsize len;
+	gboolean shared;
+	/* Raw data collected while reading */
+	rspamd_fstring_t *raw;
+	const gchar *default_value;
+};
+
+static void
+rspamd_map_snapshot_destroy (struct rspamd_map_snapshot *snap)
+{
+	if (snap->base) {
+		if (snap->shared) {
+			munmap (snap->base, snap->len);
+		}
+		else {
+			g_free (snap->base);
+		}
+	}
+
+	if (snap->raw) {
+		rspamd_fstring_free (snap->raw);
+	}
+
+	g_slice_free1 (sizeof (*snap), snap);
+}
+
+static gchar *
+rspamd_map_snapshot_read_common (gchar *chunk,
+		gint len,
+		struct map_cb_data *data,
+		gboolean final,
+		const gchar *default_value)
+{
+	struct rspamd_map_snapshot *snap;
+
+	if (data->cur_data == NULL) {
+		snap = g_slice_alloc0 (sizeof (*snap));
+		snap->raw = rspamd_fstring_sized_new (MAX (len + 1, 64));
+		snap->default_value = default_value;
+		data->cur_data = snap;
+	}
+
+	snap = data->cur_data;
+
+	/*
+	 * We delay parsing as other worker might have already compiled the
+	 * same data
+	 */
+	if (len > 0) {
+		snap->raw = rspamd_fstring_append (snap->raw, chunk, len);
+	}
+
+	if (final) {
+		/* Do not glue the last line with the next backend */
+		snap->raw = rspamd_fstring_append (snap->raw, "\n", 1);
+	}
+
+	return chunk + len;
+}
+
+gchar *
+rspamd_hosts_snapshot_read (
+	gchar * chunk,
+	gint len,
+	struct map_cb_data *data,
+	gboolean final)
+{
+	return rspamd_map_snapshot_read_common (chunk, len, data, final, hash_fill);
+}
+
+gchar *
+rspamd_kv_snapshot_read (
+	gchar * chunk,
+	gint len,
+	struct map_cb_data *data,
+	gboolean final)
+{
+	return rspamd_map_snapshot_read_common (chunk, len, data, final, "");
+}
+
+static gboolean
+rspamd_map_snapshot_attach (struct rspamd_map *map,
+		struct rspamd_map_snapshot *snap, guint64 cksum)
+{
+	struct rspamd_map_snapshot_hdr *hdr;
+	gpointer base;
+	gsize len;
+
+	if (g_atomic_int_get (&map->cache->snapshot_available) != 1 ||
+			map->cache->snapshot_cksum != cksum) {
+		return FALSE;
+	}
+
+	base = rspamd_shmem_xmap (map->cache->snapshot_shmem_name, PROT_READ, &len);
+
+	if (base == NULL) {
+		msg_err_map ("cannot map snapshot from %s: %s",
+				map->cache->snapshot_shmem_name, strerror (errno));
+		return FALSE;
+	}
+
+	hdr = base;
+
+	if (len < map->cache->snapshot_len || len < sizeof (*hdr) ||
+			hdr->magic != RSPAMD_MAP_SNAPSHOT_MAGIC || hdr->cksum != cksum) {
+		msg_err_map ("cannot map snapshot from %s: bad snapshot",
+				map->cache->snapshot_shmem_name);
+		munmap (base, len);
+		return FALSE;
+	}
+
+	snap->base = base;
+	snap->len = len;
+	snap->shared = TRUE;
+
+	return TRUE;
+}
+
+static gpointer
+rspamd_map_snapshot_alloc_shared (gsize len, gchar *shm_name, gsize namelen)
+{
+	gpointer base;
+	gint fd;
+
+#ifdef HAVE_SANE_SHMEM
+#if defined(__DragonFly__)
+	rspamd_strlcpy (shm_name, "/tmp/rmap.XXXXXXXXXXXXXXXXXXXX", namelen);
+#else
+	rspamd_strlcpy (shm_name, "/rmap.XXXXXXXXXXXXXXXXXXXX", namelen);
+#endif
+	fd = rspamd_shmem_mkstemp (shm_name);
+#else
+	rspamd_strlcpy (shm_name, "/tmp/rmap.XXXXXXXXXXXXXXXXXXXX", namelen);
+	fd = mkstemp (shm_name);
+#endif
+
+	if (fd == -1) {
+		return NULL;
+	}
+
+	if (ftruncate (fd, len) == -1) {
+		close (fd);
+		goto err;
+	}
+
+	base = mmap (NULL, len, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	close (fd);
+
+	if (base == MAP_FAILED) {
+		goto err;
+	}
+
+	return base;
+
+err:
+#ifdef HAVE_SANE_SHMEM
+	shm_unlink (shm_name);
+#else
+	unlink (shm_name);
+#endif
+
+	return NULL;
+}
+
+static void
+rspamd_map_snapshot_compile (struct rspamd_map *map,
+		struct rspamd_map_snapshot *snap, guint64 cksum)
+{
+	struct rspamd_map_snapshot_hdr *hdr;
+	struct rspamd_map_snapshot_bucket *buckets, *bk;
+	struct map_cb_data cbdata;
+	GHashTable *htb;
+	GHashTableIter it;
+	gpointer k, v;
+	gchar shm_name[256], *str;
+	guint64 nbuckets = 2, mask, idx, h;
+	gsize total, strings_len = 0, klen, vlen;
+	guchar *base;
+
+	htb = g_hash_table_new_full (rspamd_strcase_hash, rspamd_strcase_equal,
+			g_free, g_free);
+	memset (&cbdata, 0, sizeof (cbdata));
+	cbdata.map = map;
+	cbdata.cur_data = htb;
+	rspamd_parse_kv_list (snap->raw->str, snap->raw->len, &cbdata,
+			hash_insert_helper, snap->default_value, TRUE);
+
+	/* Keep load factor less than 0.5 */
+	while (nbuckets < g_hash_table_size (htb) * 2) {
+		nbuckets <<= 1;
+	}
+
+	g_hash_table_iter_init (&it, htb);
+
+	while (g_hash_table_iter_next (&it, &k, &v)) {
+		strings_len += strlen (k) + strlen (v) + 2;
+	}
+
+	total = sizeof (*hdr) + nbuckets * sizeof (*buckets) + strings_len;
+	base = rspamd_map_snapshot_alloc_shared (total, shm_name, sizeof (shm_name));
+
+	if (base != NULL) {
+		snap->shared = TRUE;
+	}
+	else {
+		msg_warn_map ("cannot allocate shared snapshot, use private one: %s",
+				strerror (errno));
+		base = g_malloc0 (total);
+		snap->shared = FALSE;
+	}
+
+	hdr = (struct rspamd_map_snapshot_hdr *)base;
+	hdr->magic = RSPAMD_MAP_SNAPSHOT_MAGIC;
+	hdr->cksum = cksum;
+	hdr->nbuckets = nbuckets;
+	hdr->nelts = g_hash_table_size (htb);
+	buckets = (struct rspamd_map_snapshot_bucket *)(hdr + 1);
+	str = (gchar *)(buckets + nbuckets);
+	mask = nbuckets - 1;
+
+	g_hash_table_iter_init (&it, htb);
+
+	while (g_hash_table_iter_next (&it, &k, &v)) {
+		klen = strlen (k);
+		vlen = strlen (v);
+		h = rspamd_icase_hash (k, klen, map_hash_seed);
+
+		for (idx = h & mask; ; idx = (idx + 1) & mask) {
+			bk = &buckets[idx];
+
+			if (bk->key_off == 0) {
+				break;
+			}
+		}
+
+		bk->hash = h;
+		bk->key_off = str - (gchar *)base;
+		memcpy (str, k, klen + 1);
+		str += klen + 1;
+		bk->value_off = str - (gchar *)base;
+		memcpy (str, v, vlen + 1);
+		str += vlen + 1;
+	}
+
+	g_hash_table_unref (htb);
+	snap->base = base;
+	snap->len = total;
+
+	if (snap->shared) {
+		mprotect (base, total, PROT_READ);
+
+		/* Publish snapshot for other workers, map is locked here */
+		if (g_atomic_int_compare_and_exchange (&map->cache->snapshot_available,
+				1, 0)) {
+#ifdef HAVE_SANE_SHMEM
+			shm_unlink (map->cache->snapshot_shmem_name);
+#else
+			unlink (map->cache->snapshot_shmem_name);
+#endif
+		}
+
+		rspamd_strlcpy (map->cache->snapshot_shmem_name, shm_name,
+				sizeof (map->cache->snapshot_shmem_name));
+		map->cache->snapshot_cksum = cksum;
+		map->cache->snapshot_len = total;
+		g_atomic_int_set (&map->cache->snapshot_available, 1);
+	}
+}
+
+void
+rspamd_map_snapshot_fin (struct map_cb_data *data)
+{
+	struct rspamd_map *map = data->map;
+	struct rspamd_map_snapshot *snap = data->cur_data;
+	struct rspamd_map_snapshot_hdr *hdr;
+	guint64 cksum;
+	gboolean attached;
+
+	if (snap == NULL) {
+		return;
+	}
+
+	if (data->prev_data) {
+		rspamd_map_snapshot_destroy (data->prev_data);
+	}
+
+	cksum = rspamd_cryptobox_fast_hash (snap->raw->str, snap->raw->len,
+			map_hash_seed);
+	attached = rspamd_map_snapshot_attach (map, snap, cksum);
+
+	if (!attached) {
+		rspamd_map_snapshot_compile (map, snap, cksum);
+	}
+
+	rspamd_fstring_free (snap->raw);
+	snap->raw = NULL;
+	hdr = snap->base;
+
+	msg_info_map ("%s %s hash of %uL elements (%z bytes)",
+			attached ? "attached" : "compiled",
+			snap->shared ? "shared" : "private",
+			hdr->nelts, snap->len);
+}
+
+const gchar *
+rspamd_map_snapshot_lookup (struct rspamd_map_snapshot *snap,
+		const gchar *key, gsize keylen)
+{
+	const struct rspamd_map_snapshot_hdr *hdr;
+	const struct rspamd_map_snapshot_bucket *buckets, *bk;
+	const gchar *base, *k;
+	guint64 h, idx, mask;
+
+	if (snap == NULL || snap->base == NULL) {
+		return NULL;
+	}
+
+	base = snap->base;
+	hdr = snap->base;
+
+	if (hdr->nelts == 0) {
+		return NULL;
+	}
+
+	buckets = (const struct rspamd_map_snapshot_bucket *)(hdr + 1);
+	mask = hdr->nbuckets - 1;
+	h = rspamd_icase_hash (key, keylen, map_hash_seed);
+
+	for (idx = h & mask; ; idx = (idx + 1) & mask) {
+		bk = &buckets[idx];
+
+		if (bk->key_off == 0) {
+			break;
+		}
+
+		if (bk->hash == h) {
+			k = base + bk->key_off;
+
+			if (g_ascii_strncasecmp (k, key, keylen) == 0 && k[keylen] == '\0') {
+				return base + bk->value_off;
+			}
+		}
+	}
+
+	return NULL;
+}
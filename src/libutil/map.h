@@ -115,6 +115,38 @@ gchar * rspamd_kv_list_read (
 	gboolean final);
 void rspamd_kv_list_fin (struct map_cb_data *data);
 
+/**
+ * Snapshot maps are compiled to a compact read-only hash table once and
+ * then shared between all workers using shared memory, these callbacks
+ * accept the same format as hosts and kv lists.
+ * Only hosts and kv lists have snapshots: radix and regexp maps keep their
+ * own structures in each worker, as well as plugin maps that need
+ * GHashTable semantics
+ */
+struct rspamd_map_snapshot;
+
+gchar * rspamd_hosts_snapshot_read (
+	gchar *chunk,
+	gint len,
+	struct map_cb_data *data,
+	gboolean final);
+gchar * rspamd_kv_snapshot_read (
+	gchar *chunk,
+	gint len,
+	struct map_cb_data *data,
+	gboolean final);
+void rspamd_map_snapshot_fin (struct map_cb_data *data);
+
+/**
+ * Find value for the specified key (case insensitive) in a map snapshot
+ * @param snap
+ * @param key
+ * @param keylen
+ * @return value or NULL if key has not been found
+ */
+const gchar * rspamd_map_snapshot_lookup (struct rspamd_map_snapshot *snap,
+		const gchar *key, gsize keylen);
+
 /**
  * Regexp list is a list of regular expressions
  */
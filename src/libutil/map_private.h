@@ -66,6 +66,11 @@ struct rspamd_map_cachepoint {
 	gsize len;
 	time_t last_checked;
 	gchar shmem_name[256];
+	/* Compiled snapshot of the map data shared between workers */
+	gint snapshot_available;
+	guint64 snapshot_cksum;
+	gsize snapshot_len;
+	gchar snapshot_shmem_name[256];
 };
 
 struct rspamd_map {
@@ -42,8 +42,69 @@
  */
 #undef MEMORY_GREEDY
 
-/* Internal statistic */
-static rspamd_mempool_stat_t *mem_pool_stat = NULL;
+/* Number of processes that have their own statistics slots */
+#define RSPAMD_MEMPOOL_STAT_SLOTS 128
+/* Number of tags that are used to learn pools sizes */
+#define RSPAMD_MEMPOOL_MAX_ENTRIES 64
+/* Number of pools used to learn the preallocated size for a tag */
+#define RSPAMD_MEMPOOL_SIZE_SAMPLES 64
+#define RSPAMD_MEMPOOL_MAX_LEARNED_SIZE (1024 * 1024)
+/* Limits for chunks that are kept for reuse */
+#define RSPAMD_MEMPOOL_FREE_CHUNKS 64
+#define RSPAMD_MEMPOOL_FREE_BYTES (8 * 1024 * 1024)
+
+/*
+ * Internal statistic: each process updates its own slot with no atomics,
+ * all slots live in the shared memory and are summed on demand.
+ * Slot 0 is shared by processes that have failed to get their own slots.
+ * Counters are updated modulo 2^32, so a sum is correct even if a process
+ * frees chunks accounted by another one (e.g. by its parent before fork)
+ */
+union rspamd_mempool_stat_slot {
+	struct {
+		rspamd_mempool_stat_t st;
+		pid_t owner;
+	} s;
+	guchar pad[64]; /* Cache line */
+};
+
+static union rspamd_mempool_stat_slot *mem_pool_stat = NULL;
+static rspamd_mempool_stat_t *local_stat = NULL;
+static gboolean local_stat_shared = FALSE;
+
+#define POOL_STAT_ADD(field, val) do {                                     \
+	if (G_UNLIKELY (local_stat == NULL)) {                                  \
+		rspamd_mempool_stat_claim ();                                       \
+	}                                                                       \
+	if (G_UNLIKELY (local_stat_shared)) {                                   \
+		g_atomic_int_add (&local_stat->field, (val));                       \
+	}                                                                       \
+	else {                                                                  \
+		local_stat->field += (val);                                         \
+	}                                                                       \
+} while (0)
+
+/*
+ * Sizes of pools with the same tag are used to preallocate the first chunk
+ * of new pools, so the typical pool has a single chunk
+ */
+struct rspamd_mempool_entry_point {
+	gchar tag[MEMPOOL_TAG_LEN];
+	gsize suggested_size;
+	guint cur_sample;
+	guint32 samples[RSPAMD_MEMPOOL_SIZE_SAMPLES];
+};
+
+static struct rspamd_mempool_entry_point entries[RSPAMD_MEMPOOL_MAX_ENTRIES];
+static guint entries_count = 0;
+
+/* Chunks of deleted pools, the oldest ones come first */
+static struct {
+	struct _pool_chain *chunks[RSPAMD_MEMPOOL_FREE_CHUNKS];
+	guint nchunks;
+	gsize bytes;
+} free_chunks;
+
 /* Environment variable */
 static gboolean env_checked = FALSE;
 static gboolean always_malloc = FALSE;
@@ -61,6 +122,150 @@ pool_chain_free (struct _pool_chain *chain)
 			chain->len - occupied : 0);
 }
 
+static void
+rspamd_mempool_stat_claim (void)
+{
+	pid_t pid = getpid (), owner;
+	guint i;
+
+	for (i = 1; i < RSPAMD_MEMPOOL_STAT_SLOTS; i ++) {
+		owner = mem_pool_stat[i].s.owner;
+
+		/* Slots of dead processes are reused with their counters */
+		if (owner == 0 || owner == pid ||
+				(kill (owner, 0) == -1 && errno == ESRCH)) {
+			if (g_atomic_int_compare_and_exchange (&mem_pool_stat[i].s.owner,
+					owner, pid)) {
+				local_stat = &mem_pool_stat[i].s.st;
+				local_stat_shared = FALSE;
+
+				return;
+			}
+		}
+	}
+
+	local_stat = &mem_pool_stat[0].s.st;
+	local_stat_shared = TRUE;
+}
+
+static struct rspamd_mempool_entry_point *
+rspamd_mempool_get_entry (const gchar *tag)
+{
+	struct rspamd_mempool_entry_point *entry;
+	guint i;
+
+	for (i = 0; i < entries_count; i ++) {
+		if (strcmp (entries[i].tag, tag) == 0) {
+			return &entries[i];
+		}
+	}
+
+	if (entries_count < G_N_ELEMENTS (entries)) {
+		entry = &entries[entries_count ++];
+		rspamd_strlcpy (entry->tag, tag, sizeof (entry->tag));
+
+		return entry;
+	}
+
+	return NULL;
+}
+
+static gint
+rspamd_mempool_samples_cmp (const void *a, const void *b)
+{
+	guint32 s1 = *(const guint32 *)a, s2 = *(const guint32 *)b;
+
+	return s1 < s2 ? -1 : (s1 > s2 ? 1 : 0);
+}
+
+static void
+rspamd_mempool_entry_update (struct rspamd_mempool_entry_point *entry,
+		gsize used)
+{
+	guint32 sorted[RSPAMD_MEMPOOL_SIZE_SAMPLES];
+
+	entry->samples[entry->cur_sample ++] = MIN (used,
+			RSPAMD_MEMPOOL_MAX_LEARNED_SIZE);
+
+	if (entry->cur_sample == G_N_ELEMENTS (entry->samples)) {
+		/* Use 90th percentile of the recent pools sizes */
+		entry->cur_sample = 0;
+		memcpy (sorted, entry->samples, sizeof (sorted));
+		qsort (sorted, G_N_ELEMENTS (sorted), sizeof (sorted[0]),
+				rspamd_mempool_samples_cmp);
+		entry->suggested_size = sorted[G_N_ELEMENTS (sorted) * 9 / 10];
+	}
+}
+
+/*
+ * Find the best fitting chunk among the recycled ones, chunks that are more
+ * than twice larger than requested are not used to avoid memory waste
+ */
+static struct _pool_chain *
+rspamd_mempool_chain_reuse (gsize size)
+{
+	struct _pool_chain *chain, *best = NULL;
+	guint i, best_idx = 0;
+
+	for (i = 0; i < free_chunks.nchunks; i ++) {
+		chain = free_chunks.chunks[i];
+
+		if (chain->len >= size && chain->len / 2 <= size &&
+				(best == NULL || chain->len < best->len)) {
+			best = chain;
+			best_idx = i;
+		}
+	}
+
+	if (best) {
+		free_chunks.nchunks --;
+		free_chunks.bytes -= best->len;
+		memmove (&free_chunks.chunks[best_idx],
+				&free_chunks.chunks[best_idx + 1],
+				(free_chunks.nchunks - best_idx) * sizeof (best));
+	}
+
+	return best;
+}
+
+static void
+rspamd_mempool_chain_free (struct _pool_chain *chain,
+		enum rspamd_mempool_chain_type pool_type)
+{
+	struct _pool_chain *old;
+	gsize len = chain->len + sizeof (struct _pool_chain);
+
+	POOL_STAT_ADD (bytes_allocated, -((gint)chain->len));
+	POOL_STAT_ADD (chunks_allocated, -1);
+
+	if (pool_type == RSPAMD_MEMPOOL_SHARED) {
+		munmap ((void *)chain, len);
+
+		return;
+	}
+
+	if (chain->len > RSPAMD_MEMPOOL_FREE_BYTES / 4) {
+		g_slice_free1 (len, chain);
+
+		return;
+	}
+
+	/* Evict the oldest chunks */
+	while (free_chunks.nchunks > 0 &&
+			(free_chunks.nchunks == G_N_ELEMENTS (free_chunks.chunks) ||
+			free_chunks.bytes + chain->len > RSPAMD_MEMPOOL_FREE_BYTES)) {
+		old = free_chunks.chunks[0];
+		free_chunks.nchunks --;
+		free_chunks.bytes -= old->len;
+		memmove (&free_chunks.chunks[0], &free_chunks.chunks[1],
+				free_chunks.nchunks * sizeof (old));
+		g_slice_free1 (old->len + sizeof (struct _pool_chain), old);
+	}
+
+	free_chunks.chunks[free_chunks.nchunks ++] = chain;
+	free_chunks.bytes += chain->len;
+}
+
 static struct _pool_chain *
 rspamd_mempool_chain_new (gsize size, enum rspamd_mempool_chain_type pool_type)
 {
@@ -107,19 +312,27 @@ rspamd_mempool_chain_new (gsize size, enum rspamd_mempool_chain_type pool_type)
 #else
 #error No mmap methods are defined
 #endif
-		g_atomic_int_inc (&mem_pool_stat->shared_chunks_allocated);
-		g_atomic_int_add (&mem_pool_stat->bytes_allocated, size);
+		chain->len = size;
+		POOL_STAT_ADD (shared_chunks_allocated, 1);
 	}
 	else {
-		map = g_slice_alloc (sizeof (struct _pool_chain) + size);
-		chain = map;
-		chain->begin = ((guint8 *) chain) + sizeof (struct _pool_chain);
-		g_atomic_int_add (&mem_pool_stat->bytes_allocated, size);
-		g_atomic_int_inc (&mem_pool_stat->chunks_allocated);
+		chain = rspamd_mempool_chain_reuse (size);
+
+		if (chain == NULL) {
+			map = g_slice_alloc (sizeof (struct _pool_chain) + size);
+			chain = map;
+			chain->begin = ((guint8 *) chain) + sizeof (struct _pool_chain);
+			chain->len = size;
+		}
+		else {
+			POOL_STAT_ADD (chunks_reused, 1);
+		}
+
+		POOL_STAT_ADD (chunks_allocated, 1);
 	}
 
+	POOL_STAT_ADD (bytes_allocated, chain->len);
 	chain->pos = align_ptr (chain->begin, MEM_ALIGNMENT);
-	chain->len = size;
 	chain->lock = NULL;
 
 	return chain;
@@ -196,6 +409,7 @@ rspamd_mempool_t *
 rspamd_mempool_new (gsize size, const gchar *tag)
 {
 	rspamd_mempool_t *new;
+	struct _pool_chain *chain;
 	gpointer map;
 	unsigned char uidbuf[10];
 	const gchar hexdigits[] = "0123456789abcdef";
@@ -206,38 +420,38 @@ rspamd_mempool_new (gsize size, const gchar *tag)
 	if (mem_pool_stat == NULL) {
 #if defined(HAVE_MMAP_ANON)
 		map = mmap (NULL,
-				sizeof (rspamd_mempool_stat_t),
+				sizeof (*mem_pool_stat) * RSPAMD_MEMPOOL_STAT_SLOTS,
 				PROT_READ | PROT_WRITE,
 				MAP_ANON | MAP_SHARED,
 				-1,
 				0);
 		if (map == MAP_FAILED) {
 			msg_err ("cannot allocate %z bytes, aborting",
-				sizeof (rspamd_mempool_stat_t));
+				sizeof (*mem_pool_stat) * RSPAMD_MEMPOOL_STAT_SLOTS);
 			abort ();
 		}
-		mem_pool_stat = (rspamd_mempool_stat_t *)map;
+		mem_pool_stat = map;
 #elif defined(HAVE_MMAP_ZERO)
 		gint fd;
 
 		fd = open ("/dev/zero", O_RDWR);
 		g_assert (fd != -1);
 		map = mmap (NULL,
-				sizeof (rspamd_mempool_stat_t),
+				sizeof (*mem_pool_stat) * RSPAMD_MEMPOOL_STAT_SLOTS,
 				PROT_READ | PROT_WRITE,
 				MAP_SHARED,
 				fd,
 				0);
 		if (map == MAP_FAILED) {
 			msg_err ("cannot allocate %z bytes, aborting",
-				sizeof (rspamd_mempool_stat_t));
+				sizeof (*mem_pool_stat) * RSPAMD_MEMPOOL_STAT_SLOTS);
 			abort ();
 		}
-		mem_pool_stat = (rspamd_mempool_stat_t *)map;
+		mem_pool_stat = map;
 #else
 #       error No mmap methods are defined
 #endif
-		memset (map, 0, sizeof (rspamd_mempool_stat_t));
+		memset (map, 0, sizeof (*mem_pool_stat) * RSPAMD_MEMPOOL_STAT_SLOTS);
 	}
 
 	if (!env_checked) {
@@ -260,6 +474,15 @@ rspamd_mempool_new (gsize size, const gchar *tag)
 
 	if (tag) {
 		rspamd_strlcpy (new->tag.tagname, tag, sizeof (new->tag.tagname));
+		new->entry = rspamd_mempool_get_entry (new->tag.tagname);
+
+		if (new->entry && new->entry->suggested_size > size &&
+				!always_malloc) {
+			chain = rspamd_mempool_chain_new (
+					new->entry->suggested_size + MEM_ALIGNMENT,
+					RSPAMD_MEMPOOL_NORMAL);
+			rspamd_mempool_append_chain (new, chain, RSPAMD_MEMPOOL_NORMAL);
+		}
 	}
 	else {
 		new->tag.tagname[0] = '\0';
@@ -273,7 +496,7 @@ rspamd_mempool_new (gsize size, const gchar *tag)
 	}
 	new->tag.uid[19] = '\0';
 
-	mem_pool_stat->pools_allocated++;
+	POOL_STAT_ADD (pools_allocated, 1);
 
 	return new;
 }
@@ -317,7 +540,7 @@ memory_pool_alloc_common (rspamd_mempool_t * pool, gsize size,
 						pool_type);
 			}
 			else {
-				mem_pool_stat->oversized_chunks++;
+				POOL_STAT_ADD (oversized_chunks, 1);
 				new = rspamd_mempool_chain_new (
 						size + pool->elt_len + MEM_ALIGNMENT, pool_type);
 			}
@@ -507,7 +730,7 @@ rspamd_mempool_delete (rspamd_mempool_t * pool)
 	struct _pool_destructors *destructor;
 	gpointer ptr;
 	guint i, j;
-	gsize len;
+	gsize used = 0;
 
 	POOL_MTX_LOCK ();
 
@@ -526,18 +749,12 @@ rspamd_mempool_delete (rspamd_mempool_t * pool)
 		if (pool->pools[i]) {
 			for (j = 0; j < pool->pools[i]->len; j++) {
 				cur = g_ptr_array_index (pool->pools[i], j);
-				g_atomic_int_add (&mem_pool_stat->bytes_allocated,
-						-((gint)cur->len));
-				g_atomic_int_add (&mem_pool_stat->chunks_allocated, -1);
 
-				len = cur->len + sizeof (struct _pool_chain);
-
-				if (i == RSPAMD_MEMPOOL_SHARED) {
-					munmap ((void *)cur, len);
-				}
-				else {
-					g_slice_free1 (len, cur);
+				if (i == RSPAMD_MEMPOOL_NORMAL) {
+					used += cur->pos - cur->begin;
 				}
+
+				rspamd_mempool_chain_free (cur, i);
 			}
 
 			g_ptr_array_free (pool->pools[i], TRUE);
@@ -557,7 +774,11 @@ rspamd_mempool_delete (rspamd_mempool_t * pool)
 		g_ptr_array_free (pool->trash_stack, TRUE);
 	}
 
-	g_atomic_int_inc (&mem_pool_stat->pools_freed);
+	if (pool->entry && used > 0) {
+		rspamd_mempool_entry_update (pool->entry, used);
+	}
+
+	POOL_STAT_ADD (pools_freed, 1);
 	POOL_MTX_UNLOCK ();
 	g_slice_free (rspamd_mempool_t, pool);
 }
@@ -567,52 +788,66 @@ rspamd_mempool_cleanup_tmp (rspamd_mempool_t * pool)
 {
 	struct _pool_chain *cur;
 	guint i;
-	gsize len;
 
 	POOL_MTX_LOCK ();
 
 	if (pool->pools[RSPAMD_MEMPOOL_TMP]) {
 		for (i = 0; i < pool->pools[RSPAMD_MEMPOOL_TMP]->len; i++) {
 			cur = g_ptr_array_index (pool->pools[RSPAMD_MEMPOOL_TMP], i);
-			g_atomic_int_add (&mem_pool_stat->bytes_allocated,
-					-((gint)cur->len));
-			g_atomic_int_add (&mem_pool_stat->chunks_allocated, -1);
-			len = cur->len + sizeof (struct _pool_chain);
-
-			g_slice_free1 (len, cur);
+			rspamd_mempool_chain_free (cur, RSPAMD_MEMPOOL_TMP);
 		}
 
 		g_ptr_array_free (pool->pools[RSPAMD_MEMPOOL_TMP], TRUE);
 		pool->pools[RSPAMD_MEMPOOL_TMP] = NULL;
 	}
 
-	g_atomic_int_inc (&mem_pool_stat->pools_freed);
+	POOL_STAT_ADD (pools_freed, 1);
 	POOL_MTX_UNLOCK ();
 }
 
 void
 rspamd_mempool_stat (rspamd_mempool_stat_t * st)
 {
+	rspamd_mempool_stat_t *cur;
+	guint i;
+
 	if (mem_pool_stat != NULL) {
-		st->pools_allocated = mem_pool_stat->pools_allocated;
-		st->pools_freed = mem_pool_stat->pools_freed;
-		st->shared_chunks_allocated = mem_pool_stat->shared_chunks_allocated;
-		st->bytes_allocated = mem_pool_stat->bytes_allocated;
-		st->chunks_allocated = mem_pool_stat->chunks_allocated;
-		st->shared_chunks_allocated = mem_pool_stat->shared_chunks_allocated;
-		st->chunks_freed = mem_pool_stat->chunks_freed;
-		st->oversized_chunks = mem_pool_stat->oversized_chunks;
+		memset (st, 0, sizeof (*st));
+
+		for (i = 0; i < RSPAMD_MEMPOOL_STAT_SLOTS; i ++) {
+			cur = &mem_pool_stat[i].s.st;
+			st->pools_allocated += cur->pools_allocated;
+			st->pools_freed += cur->pools_freed;
+			st->bytes_allocated += cur->bytes_allocated;
+			st->chunks_allocated += cur->chunks_allocated;
+			st->shared_chunks_allocated += cur->shared_chunks_allocated;
+			st->chunks_freed += cur->chunks_freed;
+			st->oversized_chunks += cur->oversized_chunks;
+			st->chunks_reused += cur->chunks_reused;
+		}
 	}
 }
 
 void
 rspamd_mempool_stat_reset (void)
 {
+	guint i;
+
 	if (mem_pool_stat != NULL) {
-		memset (mem_pool_stat, 0, sizeof (rspamd_mempool_stat_t));
+		for (i = 0; i < RSPAMD_MEMPOOL_STAT_SLOTS; i ++) {
+			memset (&mem_pool_stat[i].s.st, 0, sizeof (rspamd_mempool_stat_t));
+		}
 	}
 }
 
+void
+rspamd_mempool_stat_update_pid (void)
+{
+	/* The slot is claimed on the next update of statistics */
+	local_stat = NULL;
+	local_stat_shared = FALSE;
+}
+
 /* By default allocate 8Kb chunks of memory */
 #define FIXED_POOL_SIZE 8192
 gsize
@@ -90,6 +90,7 @@ struct rspamd_mempool_tag {
  * Memory pool type
  */
 struct rspamd_mutex_s;
+struct rspamd_mempool_entry_point;
 typedef struct memory_pool_s {
 	GPtrArray *pools[RSPAMD_MEMPOOL_MAX];
 	GArray *destructors;
@@ -97,6 +98,7 @@ typedef struct memory_pool_s {
 	GHashTable *variables;                  /**< private memory pool variables			*/
 	gsize elt_len;							/**< size of an element						*/
 	struct rspamd_mempool_tag tag;          /**< memory pool tag						*/
+	struct rspamd_mempool_entry_point *entry; /**< sizes learned for this tag		*/
 } rspamd_mempool_t;
 
 /**
@@ -110,12 +112,14 @@ typedef struct memory_pool_stat_s {
 	guint shared_chunks_allocated;      /**< shared chunks allocated							*/
 	guint chunks_freed;                 /**< chunks freed										*/
 	guint oversized_chunks;             /**< oversized chunks									*/
+	guint chunks_reused;                /**< chunks taken from the recycled ones				*/
 } rspamd_mempool_stat_t;
 
 
 
 /**
- * Allocate new memory poll
+ * Allocate new memory poll. If pools with the same tag usually grow larger
+ * than `size`, then the first page is preallocated with the typical size
  * @param size size of pool's page
  * @return new memory pool object
  */
@@ -288,6 +292,11 @@ void rspamd_mempool_stat (rspamd_mempool_stat_t *st);
  */
 void rspamd_mempool_stat_reset (void);
 
+/**
+ * Must be called after fork to use a separate statistics slot in the child
+ */
+void rspamd_mempool_stat_update_pid (void);
+
 /**
  * Get optimal pool size based on page size for this system
  * @return size of memory page in system
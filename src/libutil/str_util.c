@@ -730,7 +730,7 @@ rspamd_encode_base64_common (const guchar *in, gsize inlen, gint str_len,
 	} } \
 while (0)
 
-	gsize allocated_len = (inlen / 3) * 4 + 5;
+	gsize allocated_len = (inlen / 3) * 4 + 5, blk, olen;
 	gchar *out, *o;
 	guint64 n;
 	guint32 rem, t, carry;
@@ -771,6 +771,23 @@ while (0)
 	cols = 0;
 
 	while (inlen > 6) {
+		if (str_len <= 0 || cols <= str_len - 8) {
+			/* Encode the rest of the line using platform optimized code */
+			blk = (str_len <= 0) ? inlen : (gsize)(str_len - cols) / 4 * 3;
+			blk = MIN (blk, inlen - 6);
+			blk -= blk % 3;
+
+			if (blk >= 48) {
+				rspamd_cryptobox_base64_encode (in, blk, o, &olen);
+				o += olen;
+				cols += olen;
+				in += blk;
+				inlen -= blk;
+
+				continue;
+			}
+		}
+
 		n = *(guint64 *)in;
 		n = GUINT64_TO_BE (n);
 
@@ -2073,3 +2090,139 @@ rspamd_memrchr (const void *m, gint c, gsize len)
 
 	return NULL;
 }
+
+#define SCRIPT_NONE (RSPAMD_UNICODE_SCRIPTS_MAX - 1)
+#define SWAR_ONES G_GUINT64_CONSTANT (0x0101010101010101)
+#define SWAR_HIGH G_GUINT64_CONSTANT (0x8080808080808080)
+#define UTF8_CONT(c) (((c) & 0xc0) == 0x80)
+
+/* Script of each alphabetic character in BMP, SCRIPT_NONE for others */
+static guint8 *bmp_scripts = NULL;
+
+static void
+rspamd_str_init_bmp_scripts (void)
+{
+	gunichar c;
+	GUnicodeScript sc;
+
+	bmp_scripts = g_malloc (0x10000);
+
+	for (c = 0; c < 0x10000; c ++) {
+		bmp_scripts[c] = SCRIPT_NONE;
+
+		if (g_unichar_isalpha (c)) {
+			sc = g_unichar_get_script (c);
+
+			if (sc >= 0 && sc < SCRIPT_NONE) {
+				bmp_scripts[c] = sc;
+			}
+		}
+	}
+}
+
+guint
+rspamd_str_scripts_histogram (const gchar *in, gsize len, guint *hist)
+{
+	const guchar *p = (const guchar *)in, *end = p + len;
+	guint64 w, letters;
+	guint nalpha = 0, n;
+	gunichar c;
+	GUnicodeScript sc;
+
+	if (G_UNLIKELY (bmp_scripts == NULL)) {
+		rspamd_str_init_bmp_scripts ();
+	}
+
+	while (p < end) {
+		if (end - p >= (gssize)sizeof (w)) {
+			memcpy (&w, p, sizeof (w));
+
+			if ((w & SWAR_HIGH) == 0) {
+				/*
+				 * 8 ASCII characters: fold case and set the high bit for
+				 * each byte in ['a'; 'z'], no carries are possible as
+				 * all bytes are less than 0x80
+				 */
+				w |= SWAR_ONES * 0x20;
+				letters = (w + SWAR_ONES * (0x80 - 'a')) &
+						~(w + SWAR_ONES * (0x80 - 'z' - 1)) & SWAR_HIGH;
+				n = ((letters >> 7) * SWAR_ONES) >> 56;
+				hist[G_UNICODE_SCRIPT_LATIN] += n;
+				nalpha += n;
+				p += sizeof (w);
+
+				continue;
+			}
+		}
+
+		if (*p < 0x80) {
+			if (g_ascii_isalpha (*p)) {
+				hist[G_UNICODE_SCRIPT_LATIN] ++;
+				nalpha ++;
+			}
+
+			p ++;
+			continue;
+		}
+
+		if ((*p & 0xe0) == 0xc0 && end - p >= 2 && UTF8_CONT (p[1])) {
+			c = ((p[0] & 0x1f) << 6) | (p[1] & 0x3f);
+
+			if (c < 0x80) {
+				p ++;
+				continue;
+			}
+
+			p += 2;
+		}
+		else if ((*p & 0xf0) == 0xe0 && end - p >= 3 && UTF8_CONT (p[1]) &&
+				UTF8_CONT (p[2])) {
+			c = ((p[0] & 0x0f) << 12) | ((p[1] & 0x3f) << 6) | (p[2] & 0x3f);
+
+			if (c < 0x800 || (c >= 0xd800 && c <= 0xdfff)) {
+				p ++;
+				continue;
+			}
+
+			p += 3;
+		}
+		else if ((*p & 0xf8) == 0xf0 && end - p >= 4 && UTF8_CONT (p[1]) &&
+				UTF8_CONT (p[2]) && UTF8_CONT (p[3])) {
+			c = ((p[0] & 0x07) << 18) | ((p[1] & 0x3f) << 12) |
+					((p[2] & 0x3f) << 6) | (p[3] & 0x3f);
+
+			if (c < 0x10000 || c > 0x10ffff) {
+				p ++;
+				continue;
+			}
+
+			p += 4;
+		}
+		else {
+			/* Invalid sequence */
+			p ++;
+			continue;
+		}
+
+		if (c < 0x10000) {
+			sc = bmp_scripts[c];
+		}
+		else if (g_unichar_isalpha (c)) {
+			sc = g_unichar_get_script (c);
+
+			if (sc < 0 || sc >= SCRIPT_NONE) {
+				sc = SCRIPT_NONE;
+			}
+		}
+		else {
+			sc = SCRIPT_NONE;
+		}
+
+		if (sc != SCRIPT_NONE) {
+			hist[sc] ++;
+			nalpha ++;
+		}
+	}
+
+	return nalpha;
+}
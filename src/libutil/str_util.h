@@ -354,4 +354,16 @@ const void *rspamd_memrchr (const void *m, gint c, gsize len);
  */
 gsize rspamd_memcspn (const gchar *s, const gchar *e, gsize len);
 
+#define RSPAMD_UNICODE_SCRIPTS_MAX 256
+
+/**
+ * Counts alphabetic characters in utf8 string for each unicode script,
+ * invalid utf8 sequences are skipped
+ * @param in input
+ * @param len length of input
+ * @param hist zeroed array of RSPAMD_UNICODE_SCRIPTS_MAX counters indexed by `GUnicodeScript`
+ * @return number of alphabetic characters found
+ */
+guint rspamd_str_scripts_histogram (const gchar *in, gsize len, guint *hist);
+
 #endif /* SRC_LIBUTIL_STR_UTIL_H_ */
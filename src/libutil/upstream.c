@@ -58,10 +58,16 @@ struct upstream {
 	ref_entry_t ref;
 };
 
+struct upstream_ring_point {
+	guint64 hash;
+	struct upstream *up;
+};
+
 struct upstream_list {
 	struct upstream_ctx *ctx;
 	GPtrArray *ups;
 	GPtrArray *alive;
+	GArray *ring; /* struct upstream_ring_point, sorted by hash */
 	rspamd_mutex_t *lock;
 	guint64 hash_seed;
 	guint cur_elt;
@@ -98,6 +104,8 @@ static gdouble default_revive_time = 60;
 static gdouble default_revive_jitter = 0.4;
 static gdouble default_error_time = 10;
 static gdouble default_dns_timeout = 1.0;
+/* Virtual nodes per upstream in the consistent hashing ring */
+static const guint ring_points_per_upstream = 160;
 static guint default_dns_retransmits = 2;
 
 void
@@ -573,6 +581,13 @@ rspamd_upstreams_add_upstream (struct upstream_list *ups,
 	}
 
 	g_ptr_array_add (ups->ups, up);
+
+	if (ups->ring) {
+		/* Ring will be rebuilt on the next request */
+		g_array_free (ups->ring, TRUE);
+		ups->ring = NULL;
+	}
+
 	up->ud = data;
 	up->cur_weight = up->weight;
 	up->ls = ups;
@@ -653,6 +668,12 @@ rspamd_upstreams_parse_line (struct upstream_list *ups,
 		ups->rot_alg = RSPAMD_UPSTREAM_SEQUENTIAL;
 		p += sizeof ("sequential:") - 1;
 	}
+	else if (g_ascii_strncasecmp (p,
+			"consistent:",
+			sizeof ("consistent:") - 1) == 0) {
+		ups->rot_alg = RSPAMD_UPSTREAM_CONSISTENT;
+		p += sizeof ("consistent:") - 1;
+	}
 
 	while (p < end) {
 		len = strcspn (p, separators);
@@ -714,6 +735,11 @@ rspamd_upstreams_destroy (struct upstream_list *ups)
 		}
 
 		g_ptr_array_free (ups->ups, TRUE);
+
+		if (ups->ring) {
+			g_array_free (ups->ring, TRUE);
+		}
+
 		rspamd_mutex_free (ups->lock);
 		g_slice_free1 (sizeof (*ups), ups);
 	}
@@ -841,6 +867,109 @@ rspamd_upstream_get_hashed (struct upstream_list *ups, const guint8 *key, guint
 	return g_ptr_array_index (ups->alive, idx);
 }
 
+static gint
+rspamd_upstream_ring_cmp (gconstpointer a, gconstpointer b)
+{
+	const struct upstream_ring_point *p1 = a, *p2 = b;
+
+	if (p1->hash < p2->hash) {
+		return -1;
+	}
+	else if (p1->hash > p2->hash) {
+		return 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Builds ketama like ring: each upstream owns several points on the ring
+ * that depend on its name and port only, so membership changes move merely
+ * keys that belong to the affected upstream
+ */
+static void
+rspamd_upstream_build_ring (struct upstream_list *ups)
+{
+	struct upstream_ring_point pt;
+	struct upstream_addr_elt *elt;
+	struct upstream *up;
+	guint i, j;
+	guint64 seed;
+
+	ups->ring = g_array_sized_new (FALSE, FALSE, sizeof (pt),
+			ups->ups->len * ring_points_per_upstream);
+
+	for (i = 0; i < ups->ups->len; i ++) {
+		up = g_ptr_array_index (ups->ups, i);
+		seed = ups->hash_seed;
+
+		if (up->addrs.addr && up->addrs.addr->len > 0) {
+			elt = g_ptr_array_index (up->addrs.addr, 0);
+			seed ^= rspamd_inet_address_get_port (elt->addr);
+		}
+
+		for (j = 0; j < ring_points_per_upstream; j ++) {
+			pt.hash = rspamd_cryptobox_fast_hash_specific (
+					RSPAMD_CRYPTOBOX_XXHASH64,
+					up->name, strlen (up->name), seed + j);
+			pt.up = up;
+			g_array_append_val (ups->ring, pt);
+		}
+	}
+
+	g_array_sort (ups->ring, rspamd_upstream_ring_cmp);
+}
+
+static struct upstream*
+rspamd_upstream_get_consistent (struct upstream_list *ups, const guint8 *key,
+		guint keylen)
+{
+	struct upstream_ring_point *pt;
+	struct upstream *up = NULL;
+	guint64 k;
+	guint lo, hi, mid, i;
+
+	k = rspamd_cryptobox_fast_hash_specific (RSPAMD_CRYPTOBOX_XXHASH64,
+			key, keylen, ups->hash_seed);
+
+	RSPAMD_UPSTREAM_LOCK (ups->lock);
+
+	if (ups->ring == NULL) {
+		rspamd_upstream_build_ring (ups);
+	}
+
+	/* Find the first point that is not less than the key */
+	lo = 0;
+	hi = ups->ring->len;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		pt = &g_array_index (ups->ring, struct upstream_ring_point, mid);
+
+		if (pt->hash < k) {
+			lo = mid + 1;
+		}
+		else {
+			hi = mid;
+		}
+	}
+
+	/* Go clockwise skipping dead upstreams */
+	for (i = 0; i < ups->ring->len; i ++) {
+		pt = &g_array_index (ups->ring, struct upstream_ring_point,
+				(lo + i) % ups->ring->len);
+
+		if (pt->up->active_idx != -1) {
+			up = pt->up;
+			break;
+		}
+	}
+
+	RSPAMD_UPSTREAM_UNLOCK (ups->lock);
+
+	return up;
+}
+
 static struct upstream*
 rspamd_upstream_get_common (struct upstream_list *ups,
 		enum rspamd_upstream_rotation default_type,
@@ -863,7 +992,8 @@ rspamd_upstream_get_common (struct upstream_list *ups,
 		type = default_type != RSPAMD_UPSTREAM_UNDEF ? default_type : ups->rot_alg;
 	}
 
-	if (type == RSPAMD_UPSTREAM_HASHED && (keylen == 0 || key == NULL)) {
+	if ((type == RSPAMD_UPSTREAM_HASHED || type == RSPAMD_UPSTREAM_CONSISTENT) &&
+			(keylen == 0 || key == NULL)) {
 		/* Cannot use hashed rotation when no key is specified, switch to random */
 		type = RSPAMD_UPSTREAM_RANDOM;
 	}
@@ -876,6 +1006,9 @@ rspamd_upstream_get_common (struct upstream_list *ups,
 	case RSPAMD_UPSTREAM_HASHED:
 		up = rspamd_upstream_get_hashed (ups, key, keylen);
 		break;
+	case RSPAMD_UPSTREAM_CONSISTENT:
+		up = rspamd_upstream_get_consistent (ups, key, keylen);
+		break;
 	case RSPAMD_UPSTREAM_ROUND_ROBIN:
 		up = rspamd_upstream_get_round_robin (ups, TRUE);
 		break;
@@ -12,6 +12,7 @@ enum rspamd_upstream_rotation {
 	RSPAMD_UPSTREAM_ROUND_ROBIN,
 	RSPAMD_UPSTREAM_MASTER_SLAVE,
 	RSPAMD_UPSTREAM_SEQUENTIAL,
+	RSPAMD_UPSTREAM_CONSISTENT,
 	RSPAMD_UPSTREAM_UNDEF
 };
 
@@ -183,7 +184,7 @@ gpointer rspamd_upstream_get_data (struct upstream *up);
 /**
  * Get new upstream from the list
  * @param ups upstream list
- * @param type type of rotation algorithm, for `RSPAMD_UPSTREAM_HASHED` it is required to specify `key` and `keylen` as arguments
+ * @param type type of rotation algorithm, for `RSPAMD_UPSTREAM_HASHED` and `RSPAMD_UPSTREAM_CONSISTENT` it is required to specify `key` and `keylen` as arguments
  * @return
  */
 struct upstream* rspamd_upstream_get (struct upstream_list *ups,
@@ -193,7 +194,7 @@ struct upstream* rspamd_upstream_get (struct upstream_list *ups,
 /**
  * Get new upstream from the list
  * @param ups upstream list
- * @param type type of rotation algorithm, for `RSPAMD_UPSTREAM_HASHED` it is required to specify `key` and `keylen` as arguments
+ * @param type type of rotation algorithm, for `RSPAMD_UPSTREAM_HASHED` and `RSPAMD_UPSTREAM_CONSISTENT` it is required to specify `key` and `keylen` as arguments
  * @return
  */
 struct upstream* rspamd_upstream_get_forced (struct upstream_list *ups,
@@ -159,6 +159,7 @@ void
 luaopen_cdb (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{cdb}");
+	rspamd_lua_class_register (L, "rspamd{cdb}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
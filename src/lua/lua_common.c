@@ -47,6 +47,30 @@ lua_error_quark (void)
 	return g_quark_from_static_string ("lua-routines");
 }
 
+/*
+ * Push class metatable (or nil if no such class) on the stack
+ */
+static inline void
+rspamd_lua_push_class (lua_State *L, const gchar *classname)
+{
+	lua_pushlightuserdata (L, (void *)classname);
+	lua_rawget (L, LUA_REGISTRYINDEX);
+
+	if (lua_isnil (L, -1)) {
+		/* Not the string the class has been registered with */
+		lua_pop (L, 1);
+		luaL_getmetatable (L, classname);
+	}
+}
+
+void
+rspamd_lua_class_register (lua_State *L, const gchar *classname)
+{
+	lua_pushlightuserdata (L, (void *)classname);
+	lua_pushvalue (L, -2);
+	lua_rawset (L, LUA_REGISTRYINDEX);
+}
+
 /* Util functions */
 /**
  * Create new class and store metatable on top of the stack
@@ -68,6 +92,7 @@ rspamd_lua_new_class (lua_State * L,
 	lua_pushstring (L, classname);  /* mt,"__index",it,"class",classname */
 	lua_rawset (L, -3);         /* mt,"__index",it */
 	luaL_register (L, NULL, methods);
+	rspamd_lua_class_register (L, classname);
 }
 
 /**
@@ -148,7 +173,7 @@ rspamd_lua_class_tostring (lua_State * L)
 void
 rspamd_lua_setclass (lua_State * L, const gchar *classname, gint objidx)
 {
-	luaL_getmetatable (L, classname);
+	rspamd_lua_push_class (L, classname);
 	if (objidx < 0) {
 		objidx--;
 	}
@@ -287,12 +312,14 @@ rspamd_lua_init ()
 	luaopen_lpeg (L);
 
 	luaL_newmetatable (L, "rspamd{ev_base}");
+	rspamd_lua_class_register (L, "rspamd{ev_base}");
 	lua_pushstring (L, "class");
 	lua_pushstring (L, "rspamd{ev_base}");
 	lua_rawset (L, -3);
 	lua_pop (L, 1);
 
 	luaL_newmetatable (L, "rspamd{session}");
+	rspamd_lua_class_register (L, "rspamd{session}");
 	lua_pushstring (L, "class");
 	lua_pushstring (L, "rspamd{session}");
 	lua_rawset (L, -3);
@@ -456,7 +483,7 @@ rspamd_lua_check_class (lua_State *L, gint index, const gchar *name)
 		p = lua_touserdata (L, index);
 		if (p) {
 			if (lua_getmetatable (L, index)) {
-				lua_getfield (L, LUA_REGISTRYINDEX, name);  /* get correct metatable */
+				rspamd_lua_push_class (L, name);  /* get correct metatable */
 				if (lua_rawequal (L, -1, -2)) {  /* does it have the correct mt? */
 					lua_pop (L, 2);  /* remove both metatables */
 					return p;
@@ -1022,7 +1049,7 @@ rspamd_lua_check_udata_common (lua_State *L, gint pos, const gchar *classname,
 	else {
 		/* Match class */
 		if (lua_getmetatable (L, pos)) {
-			luaL_getmetatable (L, classname);
+			rspamd_lua_push_class (L, classname);
 
 			if (!lua_rawequal (L, -1, -2)) {
 				p = NULL;
@@ -1209,6 +1236,8 @@ lua_worker_get_stat (lua_State *L)
 		ucl_object_insert_key (top,
 			ucl_object_fromint (
 				mem_st.oversized_chunks), "chunks_oversized", 0, false);
+		ucl_object_insert_key (top,
+			ucl_object_fromint (mem_st.chunks_reused), "chunks_reused", 0, false);
 
 		ucl_object_push_lua (L, top, true);
 		ucl_object_unref (top);
@@ -85,6 +85,7 @@ struct rspamd_lua_regexp {
 };
 
 struct rspamd_map;
+struct rspamd_map_snapshot;
 struct lua_map_callback_data;
 struct radix_tree_compressed;
 
@@ -105,7 +106,7 @@ struct rspamd_lua_map {
 
 	union {
 		struct radix_tree_compressed *radix;
-		GHashTable *hash;
+		struct rspamd_map_snapshot *snapshot;
 		struct lua_map_callback_data *cbdata;
 		struct rspamd_regexp_map *re_map;
 	} data;
@@ -149,6 +150,14 @@ const gchar * rspamd_lua_table_get (lua_State *L, const gchar *index);
  */
 gint rspamd_lua_class_tostring (lua_State *L);
 
+/**
+ * Register metatable on the top of the stack as the metatable of the
+ * specified class. Classname must be a static string: its address is used
+ * as the registry key, so class checks with the same string do not
+ * require names lookups
+ */
+void rspamd_lua_class_register (lua_State *L, const gchar *classname);
+
 /**
  * Check whether the argument at specified index is of the specified class
  */
@@ -206,6 +215,15 @@ gint rspamd_lua_push_header (lua_State * L,
 struct rspamd_task *lua_check_task (lua_State * L, gint pos);
 struct rspamd_task *lua_check_task_maybe (lua_State * L, gint pos);
 
+/* Task accessors for LuaJIT FFI */
+gsize rspamd_task_ffi_get_size (struct rspamd_task *task);
+const gchar * rspamd_task_ffi_get_message_id (struct rspamd_task *task);
+gboolean rspamd_task_ffi_has_symbol (struct rspamd_task *task,
+		const gchar *symbol);
+gdouble rspamd_task_ffi_get_symbol_score (struct rspamd_task *task,
+		const gchar *symbol);
+gdouble rspamd_task_ffi_get_score (struct rspamd_task *task);
+
 struct rspamd_lua_map *lua_check_map (lua_State * L, gint pos);
 
 /**
@@ -1406,6 +1406,7 @@ void
 luaopen_cryptobox (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{cryptobox_pubkey}");
+	rspamd_lua_class_register (L, "rspamd{cryptobox_pubkey}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -1418,6 +1419,7 @@ luaopen_cryptobox (lua_State * L)
 	rspamd_lua_add_preload (L, "rspamd_cryptobox_pubkey", lua_load_pubkey);
 
 	luaL_newmetatable (L, "rspamd{cryptobox_keypair}");
+	rspamd_lua_class_register (L, "rspamd{cryptobox_keypair}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -1430,6 +1432,7 @@ luaopen_cryptobox (lua_State * L)
 	rspamd_lua_add_preload (L, "rspamd_cryptobox_keypair", lua_load_keypair);
 
 	luaL_newmetatable (L, "rspamd{cryptobox_signature}");
+	rspamd_lua_class_register (L, "rspamd{cryptobox_signature}");
 
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
@@ -1443,6 +1446,7 @@ luaopen_cryptobox (lua_State * L)
 	rspamd_lua_add_preload (L, "rspamd_cryptobox_signature", lua_load_signature);
 
 	luaL_newmetatable (L, "rspamd{cryptobox_hash}");
+	rspamd_lua_class_register (L, "rspamd{cryptobox_hash}");
 
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
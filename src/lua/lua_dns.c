@@ -577,6 +577,7 @@ luaopen_dns_resolver (lua_State * L)
 {
 
 	luaL_newmetatable (L, "rspamd{resolver}");
+	rspamd_lua_class_register (L, "rspamd{resolver}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -389,6 +389,7 @@ void
 luaopen_expression (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{expr}");
+	rspamd_lua_class_register (L, "rspamd{expr}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
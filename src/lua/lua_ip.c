@@ -555,6 +555,7 @@ void
 luaopen_ip (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{ip}");
+	rspamd_lua_class_register (L, "rspamd{ip}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
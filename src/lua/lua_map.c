@@ -225,16 +225,14 @@ lua_config_add_hash_map (lua_State *L)
 		map_line = luaL_checkstring (L, 2);
 		description = lua_tostring (L, 3);
 		map = rspamd_mempool_alloc0 (cfg->cfg_pool, sizeof (*map));
-		map->data.hash = g_hash_table_new (rspamd_strcase_hash,
-				rspamd_strcase_equal);
+		map->data.snapshot = NULL;
 		map->type = RSPAMD_LUA_MAP_SET;
 
 		if ((m = rspamd_map_add (cfg, map_line, description,
-				rspamd_hosts_read,
-				rspamd_hosts_fin,
-				(void **)&map->data.hash)) == NULL) {
+				rspamd_hosts_snapshot_read,
+				rspamd_map_snapshot_fin,
+				(void **)&map->data.snapshot)) == NULL) {
 			msg_warn_config ("invalid set map %s", map_line);
-			g_hash_table_destroy (map->data.hash);
 			lua_pushnil (L);
 			return 1;
 		}
@@ -264,16 +262,14 @@ lua_config_add_kv_map (lua_State *L)
 		map_line = luaL_checkstring (L, 2);
 		description = lua_tostring (L, 3);
 		map = rspamd_mempool_alloc0 (cfg->cfg_pool, sizeof (*map));
-		map->data.hash = g_hash_table_new (rspamd_strcase_hash,
-				rspamd_strcase_equal);
+		map->data.snapshot = NULL;
 		map->type = RSPAMD_LUA_MAP_HASH;
 
 		if ((m = rspamd_map_add (cfg, map_line, description,
-				rspamd_kv_list_read,
-				rspamd_kv_list_fin,
-				(void **)&map->data.hash)) == NULL) {
+				rspamd_kv_snapshot_read,
+				rspamd_map_snapshot_fin,
+				(void **)&map->data.snapshot)) == NULL) {
 			msg_warn_config ("invalid hash map %s", map_line);
-			g_hash_table_destroy (map->data.hash);
 			lua_pushnil (L);
 			return 1;
 		}
@@ -424,13 +420,13 @@ lua_config_add_map (lua_State *L)
 		}
 		else if (strcmp (type, "set") == 0) {
 			map = rspamd_mempool_alloc0 (cfg->cfg_pool, sizeof (*map));
-			map->data.hash = NULL;
+			map->data.snapshot = NULL;
 			map->type = RSPAMD_LUA_MAP_SET;
 
 			if ((m = rspamd_map_add_from_ucl (cfg, map_obj, description,
-					rspamd_hosts_read,
-					rspamd_hosts_fin,
-					(void **)&map->data.hash)) == NULL) {
+					rspamd_hosts_snapshot_read,
+					rspamd_map_snapshot_fin,
+					(void **)&map->data.snapshot)) == NULL) {
 				lua_pushnil (L);
 				ucl_object_unref (map_obj);
 
@@ -439,13 +435,13 @@ lua_config_add_map (lua_State *L)
 		}
 		else if (strcmp (type, "map") == 0 || strcmp (type, "hash") == 0) {
 			map = rspamd_mempool_alloc0 (cfg->cfg_pool, sizeof (*map));
-			map->data.hash = NULL;
+			map->data.snapshot = NULL;
 			map->type = RSPAMD_LUA_MAP_HASH;
 
 			if ((m = rspamd_map_add_from_ucl (cfg, map_obj, description,
-					rspamd_kv_list_read,
-					rspamd_kv_list_fin,
-					(void **)&map->data.hash)) == NULL) {
+					rspamd_kv_snapshot_read,
+					rspamd_map_snapshot_fin,
+					(void **)&map->data.snapshot)) == NULL) {
 				lua_pushnil (L);
 				ucl_object_unref (map_obj);
 
@@ -591,8 +587,9 @@ lua_map_get_key (lua_State * L)
 		else if (map->type == RSPAMD_LUA_MAP_SET) {
 			key = lua_map_process_string_key (L, 2, &len);
 
-			if (key && map->data.hash) {
-				ret = g_hash_table_lookup (map->data.hash, key) != NULL;
+			if (key && map->data.snapshot) {
+				ret = rspamd_map_snapshot_lookup (map->data.snapshot,
+						key, len) != NULL;
 			}
 		}
 		else if (map->type == RSPAMD_LUA_MAP_REGEXP) {
@@ -611,8 +608,9 @@ lua_map_get_key (lua_State * L)
 			/* key-value map */
 			key = lua_map_process_string_key (L, 2, &len);
 
-			if (key && map->data.hash) {
-				value = g_hash_table_lookup (map->data.hash, key);
+			if (key && map->data.snapshot) {
+				value = rspamd_map_snapshot_lookup (map->data.snapshot,
+						key, len);
 			}
 
 			if (value) {
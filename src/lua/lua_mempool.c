@@ -459,6 +459,7 @@ void
 luaopen_mempool (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{mempool}");
+	rspamd_lua_class_register (L, "rspamd{mempool}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -117,6 +117,12 @@ LUA_FUNCTION_DEF (textpart, get_html);
  * @return {string} short abbreviation (such as `ru`) for the script's language
  */
 LUA_FUNCTION_DEF (textpart, get_language);
+/***
+ * @method text_part:get_scripts()
+ * Returns ratios of unicode scripts among alphabetic characters of the text part. Does not work with raw parts
+ * @return {table} table indexed by ISO 15924 script code (such as `Cyrl`) with ratios in range [0, 1]
+ */
+LUA_FUNCTION_DEF (textpart, get_scripts);
 /***
  * @method text_part:get_mimepart()
  * Returns the mime part object corresponding to this text part
@@ -138,6 +144,7 @@ static const struct luaL_reg textpartlib_m[] = {
 	LUA_INTERFACE_DEF (textpart, is_html),
 	LUA_INTERFACE_DEF (textpart, get_html),
 	LUA_INTERFACE_DEF (textpart, get_language),
+	LUA_INTERFACE_DEF (textpart, get_scripts),
 	LUA_INTERFACE_DEF (textpart, get_mimepart),
 	{"__tostring", rspamd_lua_class_tostring},
 	{NULL, NULL}
@@ -567,6 +574,41 @@ lua_textpart_get_language (lua_State * L)
 	return 1;
 }
 
+static gint
+lua_textpart_get_scripts (lua_State * L)
+{
+	struct rspamd_mime_text_part *part = lua_check_textpart (L);
+	guint i;
+#if GLIB_CHECK_VERSION(2,30,0)
+	guint32 tag;
+	gchar code[5];
+#endif
+
+	if (part == NULL) {
+		return luaL_error (L, "invalid arguments");
+	}
+
+	lua_createtable (L, 0, part->nscripts);
+
+	for (i = 0; i < part->nscripts; i ++) {
+#if GLIB_CHECK_VERSION(2,30,0)
+		tag = g_unicode_script_to_iso15924 (part->scripts[i].script);
+		code[0] = (tag >> 24) & 0xff;
+		code[1] = (tag >> 16) & 0xff;
+		code[2] = (tag >> 8) & 0xff;
+		code[3] = tag & 0xff;
+		code[4] = '\0';
+		lua_pushstring (L, code);
+#else
+		lua_pushnumber (L, part->scripts[i].script);
+#endif
+		lua_pushnumber (L, part->scripts[i].ratio);
+		lua_settable (L, -3);
+	}
+
+	return 1;
+}
+
 static gint
 lua_textpart_get_mimepart (lua_State * L)
 {
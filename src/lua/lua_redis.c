@@ -1320,6 +1320,7 @@ void
 luaopen_redis (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{redis}");
+	rspamd_lua_class_register (L, "rspamd{redis}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
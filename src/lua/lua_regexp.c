@@ -734,6 +734,7 @@ void
 luaopen_regexp (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{regexp}");
+	rspamd_lua_class_register (L, "rspamd{regexp}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
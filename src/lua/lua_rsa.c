@@ -654,6 +654,7 @@ void
 luaopen_rsa (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{rsa_pubkey}");
+	rspamd_lua_class_register (L, "rspamd{rsa_pubkey}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -666,6 +667,7 @@ luaopen_rsa (lua_State * L)
 	rspamd_lua_add_preload (L, "rspamd_rsa_pubkey", lua_load_pubkey);
 
 	luaL_newmetatable (L, "rspamd{rsa_privkey}");
+	rspamd_lua_class_register (L, "rspamd{rsa_privkey}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -678,6 +680,7 @@ luaopen_rsa (lua_State * L)
 	rspamd_lua_add_preload (L, "rspamd_rsa_privkey", lua_load_privkey);
 
 	luaL_newmetatable (L, "rspamd{rsa_signature}");
+	rspamd_lua_class_register (L, "rspamd{rsa_signature}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -843,6 +843,77 @@ lua_check_task_maybe (lua_State * L, gint pos)
 	return ud ? *((struct rspamd_task **)ud) : NULL;
 }
 
+/*
+ * Plain C accessors for LuaJIT FFI that avoid the stack API, the task
+ * pointer could be obtained from the task userdata as
+ * `ffi.cast('struct rspamd_task **', task)[0]`. Lua code should use them
+ * via `task_ffi` module from rules
+ */
+gsize
+rspamd_task_ffi_get_size (struct rspamd_task *task)
+{
+	return task ? task->msg.len : 0;
+}
+
+const gchar *
+rspamd_task_ffi_get_message_id (struct rspamd_task *task)
+{
+	return task ? task->message_id : NULL;
+}
+
+gboolean
+rspamd_task_ffi_has_symbol (struct rspamd_task *task, const gchar *symbol)
+{
+	struct rspamd_metric_result *mres;
+
+	if (task == NULL || symbol == NULL) {
+		return FALSE;
+	}
+
+	mres = g_hash_table_lookup (task->results, DEFAULT_METRIC);
+
+	return mres != NULL && g_hash_table_lookup (mres->symbols, symbol) != NULL;
+}
+
+gdouble
+rspamd_task_ffi_get_symbol_score (struct rspamd_task *task,
+		const gchar *symbol)
+{
+	struct rspamd_metric_result *mres;
+	struct rspamd_symbol_result *s;
+
+	if (task == NULL || symbol == NULL) {
+		return NAN;
+	}
+
+	mres = g_hash_table_lookup (task->results, DEFAULT_METRIC);
+
+	if (mres == NULL ||
+			(s = g_hash_table_lookup (mres->symbols, symbol)) == NULL) {
+		return NAN;
+	}
+
+	return s->score;
+}
+
+gdouble
+rspamd_task_ffi_get_score (struct rspamd_task *task)
+{
+	struct rspamd_metric_result *mres;
+
+	if (task == NULL) {
+		return NAN;
+	}
+
+	mres = g_hash_table_lookup (task->results, DEFAULT_METRIC);
+
+	if (mres == NULL || isnan (mres->score)) {
+		return 0.0;
+	}
+
+	return mres->score;
+}
+
 static struct rspamd_image *
 lua_check_image (lua_State * L)
 {
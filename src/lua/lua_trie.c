@@ -355,6 +355,7 @@ void
 luaopen_trie (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{trie}");
+	rspamd_lua_class_register (L, "rspamd{trie}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -332,6 +332,7 @@ void
 luaopen_upstream (lua_State * L)
 {
 	luaL_newmetatable (L, "rspamd{upstream_list}");
+	rspamd_lua_class_register (L, "rspamd{upstream_list}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -346,6 +347,7 @@ luaopen_upstream (lua_State * L)
 	lua_pop (L, 1);                      /* remove metatable from stack */
 
 	luaL_newmetatable (L, "rspamd{upstream}");
+	rspamd_lua_class_register (L, "rspamd{upstream}");
 	lua_pushstring (L, "__index");
 	lua_pushvalue (L, -2);
 	lua_settable (L, -3);
@@ -86,6 +86,7 @@ struct fuzzy_rule {
 	gboolean read_only;
 	gboolean skip_unknown;
 	gboolean fuzzy_images;
+	gboolean batch;
 	gint learn_condition_cb;
 };
 
@@ -486,6 +487,10 @@ fuzzy_parse_rule (struct rspamd_config *cfg, const ucl_object_t *obj,
 		rule->fuzzy_images = ucl_obj_toboolean (value);
 	}
 
+	if ((value = ucl_object_lookup (obj, "batch")) != NULL) {
+		rule->batch = ucl_obj_toboolean (value);
+	}
+
 	if ((value = ucl_object_lookup (obj, "algorithm")) != NULL) {
 		rule->algorithm_str = ucl_object_tostring (value);
 
@@ -561,6 +566,12 @@ fuzzy_parse_rule (struct rspamd_config *cfg, const ucl_object_t *obj,
 				RSPAMD_CRYPTOBOX_MODE_25519);
 	}
 
+	if (rule->batch && rule->peer_key == NULL) {
+		msg_warn_config ("fuzzy rule %s: batching requires encryption_key, "
+				"send commands one by one", rule->name);
+		rule->batch = FALSE;
+	}
+
 	if ((value = ucl_object_lookup (obj, "learn_condition")) != NULL) {
 		lua_script = ucl_object_tostring (value);
 
@@ -809,6 +820,16 @@ fuzzy_check_module_init (struct rspamd_config *cfg, struct module_ctx **ctx)
 			0,
 			NULL,
 			0);
+	rspamd_rcl_add_doc_by_path (cfg,
+			"fuzzy_check.rule",
+			"If true then send multiple encrypted commands in a single datagram "
+			"(requires fuzzy storage 1.5+)",
+			"batch",
+			UCL_BOOLEAN,
+			NULL,
+			0,
+			NULL,
+			0);
 	rspamd_rcl_add_doc_by_path (cfg,
 			"fuzzy_check.rule",
 			"Default symbol for rule (if no flags defined or matched)",
@@ -1120,6 +1141,15 @@ fuzzy_encrypt_cmd (struct fuzzy_rule *rule,
 			rspamd_pubkey_alg (rule->peer_key));
 }
 
+/*
+ * Batched rules encrypt the whole datagram rather than each command
+ */
+static inline gboolean
+fuzzy_rule_encrypt_single (struct fuzzy_rule *rule)
+{
+	return rule->peer_key != NULL && !rule->batch;
+}
+
 static struct fuzzy_cmd_io *
 fuzzy_cmd_stat (struct fuzzy_rule *rule,
 		int c,
@@ -1149,7 +1179,7 @@ fuzzy_cmd_stat (struct fuzzy_rule *rule,
 	io->tag = cmd->tag;
 	memcpy (&io->cmd, cmd, sizeof (io->cmd));
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		fuzzy_encrypt_cmd (rule, &enccmd->hdr, (guchar *)cmd, sizeof (*cmd));
 		io->io.iov_base = enccmd;
 		io->io.iov_len = sizeof (*enccmd);
@@ -1206,7 +1236,7 @@ fuzzy_cmd_hash (struct fuzzy_rule *rule,
 
 	memcpy (&io->cmd, cmd, sizeof (io->cmd));
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		fuzzy_encrypt_cmd (rule, &enccmd->hdr, (guchar *)cmd, sizeof (*cmd));
 		io->io.iov_base = enccmd;
 		io->io.iov_len = sizeof (*enccmd);
@@ -1330,7 +1360,7 @@ fuzzy_cmd_from_text_part (struct fuzzy_rule *rule,
 	io->flags = 0;
 	memcpy (&io->cmd, &shcmd->basic, sizeof (io->cmd));
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		/* Encrypt data */
 		fuzzy_encrypt_cmd (rule, &encshcmd->hdr, (guchar *) shcmd, sizeof (*shcmd));
 		io->io.iov_base = encshcmd;
@@ -1418,7 +1448,7 @@ fuzzy_cmd_from_image_part (struct fuzzy_rule *rule,
 	io->flags = FUZZY_CMD_FLAG_IMAGE;
 	memcpy (&io->cmd, &shcmd->basic, sizeof (io->cmd));
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		/* Encrypt data */
 		fuzzy_encrypt_cmd (rule, &encshcmd->hdr, (guchar *) shcmd, sizeof (*shcmd));
 		io->io.iov_base = encshcmd;
@@ -1467,7 +1497,7 @@ fuzzy_cmd_from_data_part (struct fuzzy_rule *rule,
 	io->tag = cmd->tag;
 	memcpy (&io->cmd, cmd, sizeof (io->cmd));
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		g_assert (enccmd != NULL);
 		fuzzy_encrypt_cmd (rule, &enccmd->hdr, (guchar *) cmd, sizeof (*cmd));
 		io->io.iov_base = enccmd;
@@ -1500,13 +1530,73 @@ fuzzy_cmd_to_wire (gint fd, struct iovec *io)
 	return TRUE;
 }
 
+/*
+ * Encrypt and send the pending commands of a multi request
+ */
+static gboolean
+fuzzy_cmd_batch_flush (gint fd, struct fuzzy_rule *rule,
+		struct rspamd_fuzzy_encrypted_multi_cmd *mcmd, gsize *len)
+{
+	struct iovec io;
+
+	if (mcmd->mhdr.ncmds == 0) {
+		return TRUE;
+	}
+
+	mcmd->mhdr.version = RSPAMD_FUZZY_PLUGIN_VERSION;
+	fuzzy_encrypt_cmd (rule, &mcmd->hdr, (guchar *)&mcmd->mhdr,
+			sizeof (mcmd->mhdr) + *len);
+	memcpy (mcmd->hdr.magic, fuzzy_encrypted_multi_magic,
+			sizeof (mcmd->hdr.magic));
+	io.iov_base = mcmd;
+	io.iov_len = sizeof (mcmd->hdr) + sizeof (mcmd->mhdr) + *len;
+	memset (&mcmd->mhdr, 0, sizeof (mcmd->mhdr));
+	*len = 0;
+
+	return fuzzy_cmd_to_wire (fd, &io);
+}
+
+/*
+ * Append a command to the multi request, the request is sent when it is full
+ */
+static gboolean
+fuzzy_cmd_batch_add (gint fd, struct fuzzy_rule *rule,
+		struct rspamd_fuzzy_encrypted_multi_cmd *mcmd, gsize *len,
+		struct fuzzy_cmd_io *io)
+{
+	gsize cmdlen;
+
+	if (mcmd->mhdr.ncmds == RSPAMD_FUZZY_MULTI_MAX) {
+		if (!fuzzy_cmd_batch_flush (fd, rule, mcmd, len)) {
+			return FALSE;
+		}
+	}
+
+	/* Unencrypted command is followed by shingles only if it has them */
+	cmdlen = io->cmd.shingles_count > 0 ?
+			sizeof (struct rspamd_fuzzy_shingle_cmd) :
+			sizeof (struct rspamd_fuzzy_cmd);
+	g_assert (io->io.iov_len >= cmdlen);
+	memcpy (mcmd->data + *len, io->io.iov_base, cmdlen);
+	*len += cmdlen;
+	mcmd->mhdr.ncmds ++;
+
+	return TRUE;
+}
+
 static gboolean
-fuzzy_cmd_vector_to_wire (gint fd, GPtrArray *v)
+fuzzy_cmd_vector_to_wire (gint fd, struct fuzzy_rule *rule, GPtrArray *v)
 {
 	guint i;
 	gboolean all_sent = TRUE, all_replied = TRUE;
 	struct fuzzy_cmd_io *io;
 	gboolean processed = FALSE;
+	struct rspamd_fuzzy_encrypted_multi_cmd mcmd;
+	gsize mlen = 0;
+
+	if (rule->batch) {
+		memset (&mcmd.mhdr, 0, sizeof (mcmd.mhdr));
+	}
 
 	/* First try to resend unsent commands */
 	for (i = 0; i < v->len; i ++) {
@@ -1519,7 +1609,12 @@ fuzzy_cmd_vector_to_wire (gint fd, GPtrArray *v)
 		all_replied = FALSE;
 
 		if (!(io->flags & FUZZY_CMD_FLAG_SENT)) {
-			if (!fuzzy_cmd_to_wire (fd, &io->io)) {
+			if (rule->batch) {
+				if (!fuzzy_cmd_batch_add (fd, rule, &mcmd, &mlen, io)) {
+					return FALSE;
+				}
+			}
+			else if (!fuzzy_cmd_to_wire (fd, &io->io)) {
 				return FALSE;
 			}
 			processed = TRUE;
@@ -1528,6 +1623,10 @@ fuzzy_cmd_vector_to_wire (gint fd, GPtrArray *v)
 		}
 	}
 
+	if (rule->batch && !fuzzy_cmd_batch_flush (fd, rule, &mcmd, &mlen)) {
+		return FALSE;
+	}
+
 	if (all_sent && !all_replied) {
 		/* Now try to resend each command in the vector */
 		for (i = 0; i < v->len; i++) {
@@ -1538,12 +1637,54 @@ fuzzy_cmd_vector_to_wire (gint fd, GPtrArray *v)
 			}
 		}
 
-		return fuzzy_cmd_vector_to_wire (fd, v);
+		return fuzzy_cmd_vector_to_wire (fd, rule, v);
 	}
 
 	return processed;
 }
 
+/*
+ * Decrypt replies of a multi request in place, so they could be read
+ * as unencrypted replies
+ */
+static gboolean
+fuzzy_decrypt_multi_reply (guchar **pos, gint *r, struct fuzzy_rule *rule)
+{
+	struct rspamd_fuzzy_encrypted_rep_hdr *hdr;
+	guchar *p = *pos;
+	gsize remain;
+
+	if (*r <= (gint)sizeof (*hdr)) {
+		return FALSE;
+	}
+
+	remain = *r - sizeof (*hdr);
+
+	if (remain % sizeof (struct rspamd_fuzzy_reply) != 0) {
+		msg_info ("invalid size of multi reply: %d", *r);
+		return FALSE;
+	}
+
+	hdr = (struct rspamd_fuzzy_encrypted_rep_hdr *)p;
+	rspamd_keypair_cache_process (fuzzy_module_ctx->keypairs_cache,
+			rule->local_key, rule->peer_key);
+
+	if (!rspamd_cryptobox_decrypt_nm_inplace (p + sizeof (*hdr),
+			remain,
+			hdr->nonce,
+			rspamd_pubkey_get_nm (rule->peer_key),
+			hdr->mac,
+			rspamd_pubkey_alg (rule->peer_key))) {
+		msg_info ("cannot decrypt reply");
+		return FALSE;
+	}
+
+	*pos = p + sizeof (*hdr);
+	*r = remain;
+
+	return TRUE;
+}
+
 /*
  * Read replies one-by-one and remove them from req array
  */
@@ -1560,7 +1701,7 @@ fuzzy_process_reply (guchar **pos, gint *r, GPtrArray *req,
 	struct rspamd_fuzzy_encrypted_reply encrep;
 	gboolean found = FALSE;
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		required_size = sizeof (encrep);
 	}
 	else {
@@ -1571,7 +1712,7 @@ fuzzy_process_reply (guchar **pos, gint *r, GPtrArray *req,
 		return NULL;
 	}
 
-	if (rule->peer_key) {
+	if (fuzzy_rule_encrypt_single (rule)) {
 		memcpy (&encrep, p, sizeof (encrep));
 		*pos += required_size;
 		*r -= required_size;
@@ -1731,6 +1872,11 @@ fuzzy_check_try_read (struct fuzzy_client_session *session)
 
 		ret = 0;
 
+		if (session->rule->batch && !fuzzy_decrypt_multi_reply (&p, &r,
+				session->rule)) {
+			r = 0;
+		}
+
 		while ((rep = fuzzy_process_reply (&p, &r,
 				session->commands, session->rule, &cmd, &io)) != NULL) {
 			if (rep->prob > 0.5) {
@@ -1836,7 +1982,8 @@ fuzzy_check_io_callback (gint fd, short what, void *arg)
 		}
 	}
 	else if (what & EV_WRITE) {
-		if (!fuzzy_cmd_vector_to_wire (fd, session->commands)) {
+		if (!fuzzy_cmd_vector_to_wire (fd, session->rule,
+				session->commands)) {
 			ret = return_error;
 		}
 		else {
@@ -1981,6 +2128,11 @@ fuzzy_controller_io_callback (gint fd, short what, void *arg)
 			p = buf;
 			ret = return_want_more;
 
+			if (session->rule->batch && !fuzzy_decrypt_multi_reply (&p, &r,
+					session->rule)) {
+				r = 0;
+			}
+
 			while ((rep = fuzzy_process_reply (&p, &r,
 					session->commands, session->rule, &cmd, &io)) != NULL) {
 				if ((map =
@@ -2051,7 +2203,8 @@ fuzzy_controller_io_callback (gint fd, short what, void *arg)
 	}
 	else if (what & EV_WRITE) {
 			/* Send commands to storage */
-			if (!fuzzy_cmd_vector_to_wire (fd, session->commands)) {
+			if (!fuzzy_cmd_vector_to_wire (fd, session->rule,
+				session->commands)) {
 				if (*(session->err) == NULL) {
 					g_set_error (session->err,
 						g_quark_from_static_string ("fuzzy check"),
@@ -81,6 +81,7 @@ rspamadm_control_help (gboolean full_help)
 				"Supported commands:\n"
 				"stat - show statistics\n"
 				"reload - reload workers dynamic data\n"
+				"reload_rules - reload symbols and regexps in normal workers\n"
 				"reresolve - resolve upstreams addresses\n";
 	}
 	else {
@@ -198,6 +199,10 @@ rspamadm_control (gint argc, gchar **argv)
 	else if (g_ascii_strcasecmp (cmd, "reload") == 0) {
 		path = "/reload";
 	}
+	else if (g_ascii_strcasecmp (cmd, "reloadrules") == 0 ||
+			g_ascii_strcasecmp (cmd, "reload_rules") == 0) {
+		path = "/reloadrules";
+	}
 	else if (g_ascii_strcasecmp (cmd, "reresolve") == 0) {
 		path = "/reresolve";
 	}
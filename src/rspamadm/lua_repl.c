@@ -736,7 +736,8 @@ rspamadm_lua (gint argc, gchar **argv)
 		for (i = 0; i < addrs->len; i ++) {
 			rspamd_inet_addr_t *addr = g_ptr_array_index (addrs, i);
 
-			fd = rspamd_inet_address_listen (addr, SOCK_STREAM, TRUE);
+			fd = rspamd_inet_address_listen (addr, SOCK_STREAM,
+					RSPAMD_INET_ADDRESS_LISTEN_ASYNC);
 			if (fd != -1) {
 				struct event *ev;
 
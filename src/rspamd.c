@@ -64,6 +64,9 @@
 /* 10 seconds after getting termination signal to terminate all workers with SIGKILL */
 #define TERMINATION_ATTEMPTS 50
 
+/* 100 milliseconds between draining of workers log rings */
+#define LOG_RINGS_DRAIN_MSEC 100
+
 static gboolean load_rspamd_config (struct rspamd_main *rspamd_main,
 		struct rspamd_config *cfg,
 		gboolean init_modules,
@@ -93,11 +96,17 @@ static GHashTable *ucl_vars = NULL;
 
 static gint term_attempts = 0;
 
+/* Drains log rings of workers for asynchronous logging */
+static struct event log_rings_ev;
+static gboolean log_rings_watched = FALSE;
+
 /* List of unrelated forked processes */
 static GArray *other_workers = NULL;
 
 /* List of active listen sockets indexed by worker type */
 static GHashTable *listen_sockets = NULL;
+/* Listening sockets created for each worker separately */
+static GHashTable *reuseport_sockets = NULL;
 
 /* Defined in modules.c */
 extern module_t *modules[];
@@ -302,7 +311,10 @@ reread_config (struct rspamd_main *rspamd_main)
 	}
 	else {
 		msg_debug_main ("replacing config");
+		rspamd_symbols_cache_inherit (tmp_cfg->cache, old_cfg->cache);
 		REF_RELEASE (old_cfg);
+		rspamd_symbols_cache_start_aggregation (tmp_cfg->cache,
+				rspamd_main->ev_base);
 		msg_info_main ("config has been reread successfully");
 	}
 }
@@ -348,19 +360,21 @@ rspamd_fork_delayed (struct rspamd_worker_conf *cf,
 
 static GList *
 create_listen_socket (GPtrArray *addrs, guint cnt,
-		enum rspamd_worker_socket_type listen_type)
+		enum rspamd_worker_socket_type listen_type,
+		enum rspamd_inet_address_listen_opts opts)
 {
 	GList *result = NULL;
 	gint fd;
 	guint i;
 	struct rspamd_worker_listen_socket *ls;
 
+	opts |= RSPAMD_INET_ADDRESS_LISTEN_ASYNC;
 	g_ptr_array_sort (addrs, rspamd_inet_address_compare_ptr);
 	for (i = 0; i < cnt; i ++) {
 
 		if (listen_type & RSPAMD_WORKER_SOCKET_TCP) {
 			fd = rspamd_inet_address_listen (g_ptr_array_index (addrs, i),
-					SOCK_STREAM, TRUE);
+					SOCK_STREAM, opts);
 			if (fd != -1) {
 				ls = g_slice_alloc0 (sizeof (*ls));
 				ls->addr = g_ptr_array_index (addrs, i);
@@ -371,7 +385,7 @@ create_listen_socket (GPtrArray *addrs, guint cnt,
 		}
 		if (listen_type & RSPAMD_WORKER_SOCKET_UDP) {
 			fd = rspamd_inet_address_listen (g_ptr_array_index (addrs, i),
-					SOCK_DGRAM, TRUE);
+					SOCK_DGRAM, opts);
 			if (fd != -1) {
 				ls = g_slice_alloc0 (sizeof (*ls));
 				ls->addr = g_ptr_array_index (addrs, i);
@@ -471,7 +485,7 @@ systemd_get_socket (struct rspamd_main *rspamd_main, gint number)
 }
 
 static inline uintptr_t
-make_listen_key (struct rspamd_worker_bind_conf *cf)
+make_listen_key (struct rspamd_worker_bind_conf *cf, gint index)
 {
 	rspamd_cryptobox_fast_hash_state_t st;
 	guint i, keylen = 0;
@@ -496,9 +510,118 @@ make_listen_key (struct rspamd_worker_bind_conf *cf)
 		}
 	}
 
+	if (index >= 0) {
+		/* Own socket of a specific worker */
+		rspamd_cryptobox_fast_hash_update (&st, "reuseport", sizeof ("reuseport"));
+		rspamd_cryptobox_fast_hash_update (&st, &index, sizeof (index));
+	}
+
 	return rspamd_cryptobox_fast_hash_final (&st);
 }
 
+/*
+ * SO_REUSEPORT is used for inet sockets of workers that are spawned
+ * in several processes
+ */
+static gboolean
+bind_conf_can_reuseport (struct rspamd_worker_conf *cf,
+		struct rspamd_worker_bind_conf *bcf)
+{
+	guint i;
+
+	if (!cf->reuseport || bcf->is_systemd || cf->count <= 1 ||
+			(cf->worker->flags &
+			(RSPAMD_WORKER_UNIQUE|RSPAMD_WORKER_THREADED))) {
+		return FALSE;
+	}
+
+	for (i = 0; i < bcf->cnt; i ++) {
+		if (rspamd_inet_address_get_af (g_ptr_array_index (bcf->addrs, i)) ==
+				AF_UNIX) {
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+create_reuseport_sockets (struct rspamd_main *rspamd_main,
+		struct rspamd_worker_conf *cf,
+		struct rspamd_worker_bind_conf *bcf,
+		GHashTable *seen)
+{
+	GList *ls, *cur;
+	guintptr key;
+	guint i;
+
+	if (cf->reuseport_socks == NULL) {
+		cf->reuseport_socks = g_ptr_array_sized_new (cf->count);
+		g_ptr_array_set_size (cf->reuseport_socks, cf->count);
+	}
+
+	for (i = 0; i < cf->count; i ++) {
+		key = make_listen_key (bcf, i);
+		ls = g_hash_table_lookup (reuseport_sockets, (gpointer)key);
+
+		if (ls == NULL) {
+			ls = create_listen_socket (bcf->addrs, bcf->cnt,
+					cf->worker->listen_type,
+					RSPAMD_INET_ADDRESS_LISTEN_REUSEPORT);
+
+			if (ls == NULL) {
+				msg_err_main ("cannot listen on socket %s for worker %ud: %s",
+						bcf->name, i, strerror (errno));
+
+				return FALSE;
+			}
+
+			g_hash_table_insert (reuseport_sockets, (gpointer)key, ls);
+		}
+
+		g_hash_table_insert (seen, (gpointer)key, ls);
+		cur = g_ptr_array_index (cf->reuseport_socks, i);
+		/* Lists are copied as they are not shared between workers */
+		g_ptr_array_index (cf->reuseport_socks, i) = g_list_concat (cur,
+				g_list_copy (ls));
+	}
+
+	return TRUE;
+}
+
+/*
+ * Sockets that are not used by the current configuration are closed, otherwise
+ * kernel could still route connections to them
+ */
+static void
+close_unused_reuseport_sockets (struct rspamd_main *rspamd_main,
+		GHashTable *seen)
+{
+	GHashTableIter it;
+	gpointer k, v;
+	GList *cur;
+	struct rspamd_worker_listen_socket *ls;
+
+	g_hash_table_iter_init (&it, reuseport_sockets);
+
+	while (g_hash_table_iter_next (&it, &k, &v)) {
+		if (g_hash_table_lookup (seen, k) == NULL) {
+			/* Structures could be still used by configs of old workers */
+			for (cur = v; cur != NULL; cur = g_list_next (cur)) {
+				ls = cur->data;
+
+				if (ls->fd != -1) {
+					msg_info_main ("close unused listening socket %d", ls->fd);
+					close (ls->fd);
+					ls->fd = -1;
+				}
+			}
+
+			g_hash_table_iter_remove (&it);
+		}
+	}
+}
+
 static void
 spawn_worker_type (struct rspamd_main *rspamd_main, struct event_base *ev_base,
 		struct rspamd_worker_conf *cf)
@@ -533,11 +656,13 @@ spawn_workers (struct rspamd_main *rspamd_main, struct event_base *ev_base)
 	struct rspamd_worker_bind_conf *bcf;
 	gboolean listen_ok = FALSE;
 	GPtrArray *seen_mandatory_workers;
+	GHashTable *seen_reuseport;
 	worker_t **cw, *wrk;
 	guint i;
 
 	/* Special hack for hs_helper if it's not defined in a config */
 	seen_mandatory_workers = g_ptr_array_new ();
+	seen_reuseport = g_hash_table_new (g_direct_hash, g_direct_equal);
 	cur = rspamd_main->cfg->workers;
 
 	while (cur) {
@@ -553,7 +678,16 @@ spawn_workers (struct rspamd_main *rspamd_main, struct event_base *ev_base)
 			}
 			if (cf->worker->flags & RSPAMD_WORKER_HAS_SOCKET) {
 				LL_FOREACH (cf->bind_conf, bcf) {
-					key = make_listen_key (bcf);
+					if (bind_conf_can_reuseport (cf, bcf)) {
+						if (create_reuseport_sockets (rspamd_main, cf, bcf,
+								seen_reuseport)) {
+							listen_ok = TRUE;
+						}
+
+						continue;
+					}
+
+					key = make_listen_key (bcf, -1);
 
 					if ((p =
 						g_hash_table_lookup (listen_sockets,
@@ -647,9 +781,57 @@ spawn_workers (struct rspamd_main *rspamd_main, struct event_base *ev_base)
 		}
 	}
 
+	close_unused_reuseport_sockets (rspamd_main, seen_reuseport);
+	g_hash_table_unref (seen_reuseport);
 	g_ptr_array_free (seen_mandatory_workers, TRUE);
 }
 
+static void
+rspamd_drain_log_ring (gpointer key, gpointer value, gpointer unused)
+{
+	struct rspamd_worker *w = value;
+
+	if (w->log_ring) {
+		rspamd_log_ring_drain (w->srv->logger, w->log_ring);
+	}
+}
+
+static void
+rspamd_log_rings_handler (gint fd, short what, gpointer arg)
+{
+	struct rspamd_main *rspamd_main = arg;
+
+	g_hash_table_foreach (rspamd_main->workers, rspamd_drain_log_ring, NULL);
+}
+
+static void
+rspamd_log_rings_watch (struct rspamd_main *rspamd_main)
+{
+	struct timeval tv;
+
+	if (rspamd_main->cfg->log_async && !log_rings_watched) {
+		event_set (&log_rings_ev, -1, EV_TIMEOUT|EV_PERSIST,
+				rspamd_log_rings_handler, rspamd_main);
+		event_base_set (rspamd_main->ev_base, &log_rings_ev);
+		msec_to_tv (LOG_RINGS_DRAIN_MSEC, &tv);
+		event_add (&log_rings_ev, &tv);
+		log_rings_watched = TRUE;
+	}
+}
+
+/*
+ * Writes lines left by a terminated worker and releases its ring
+ */
+static void
+rspamd_free_log_ring (struct rspamd_worker *w)
+{
+	if (w->log_ring) {
+		rspamd_log_ring_drain (w->srv->logger, w->log_ring);
+		rspamd_log_ring_free (w->log_ring);
+		w->log_ring = NULL;
+	}
+}
+
 static void
 kill_old_workers (gpointer key, gpointer value, gpointer unused)
 {
@@ -706,6 +888,7 @@ wait_for_workers (gpointer key, gpointer value, gpointer unused)
 		return FALSE;
 	}
 
+	rspamd_free_log_ring (w);
 	msg_info_main ("%s process %P terminated %s",
 			g_quark_to_string (w->type), w->pid,
 			WTERMSIG (res) == SIGKILL ? "hardly" : "softly");
@@ -924,6 +1107,7 @@ rspamd_hup_handler (gint signo, short what, gpointer arg)
 	reread_config (rspamd_main);
 	rspamd_check_core_limits (rspamd_main);
 	spawn_workers (rspamd_main, rspamd_main->ev_base);
+	rspamd_log_rings_watch (rspamd_main);
 }
 
 static void
@@ -949,6 +1133,7 @@ rspamd_cld_handler (gint signo, short what, gpointer arg)
 
 			g_hash_table_remove (rspamd_main->workers, GSIZE_TO_POINTER (
 					wrk));
+			rspamd_free_log_ring (cur);
 
 			if (cur->wanna_die) {
 				/* Do not refork workers that are intended to be terminated */
@@ -1166,6 +1351,9 @@ main (gint argc, gchar **argv, gchar **env)
 		}
 	}
 
+	/* Workers need them to reload rules */
+	rspamd_main->ucl_vars = ucl_vars;
+
 	if (config_test || is_debug) {
 		rspamd_main->cfg->log_level = G_LOG_LEVEL_DEBUG;
 	}
@@ -1194,6 +1382,7 @@ main (gint argc, gchar **argv, gchar **env)
 
 	/* Init listen sockets hash */
 	listen_sockets = g_hash_table_new (g_direct_hash, g_direct_equal);
+	reuseport_sockets = g_hash_table_new (g_direct_hash, g_direct_equal);
 
 	/* If we want to test lua skip everything except it */
 	if (lua_tests != NULL && lua_tests[0] != NULL) {
@@ -1327,7 +1516,7 @@ main (gint argc, gchar **argv, gchar **env)
 		}
 		else {
 			control_fd = rspamd_inet_address_listen (control_addr, SOCK_STREAM,
-					TRUE);
+					RSPAMD_INET_ADDRESS_LISTEN_ASYNC);
 			if (control_fd == -1) {
 				msg_err_main ("cannot open control socket at path: %s",
 						rspamd_main->cfg->control_socket_path);
@@ -1375,6 +1564,8 @@ main (gint argc, gchar **argv, gchar **env)
 	rspamd_mempool_lock_mutex (rspamd_main->start_mtx);
 	spawn_workers (rspamd_main, ev_base);
 	rspamd_mempool_unlock_mutex (rspamd_main->start_mtx);
+	rspamd_log_rings_watch (rspamd_main);
+	rspamd_symbols_cache_start_aggregation (rspamd_main->cfg->cache, ev_base);
 
 	if (control_fd != -1) {
 		msg_info_main ("listening for control commands on %s",
@@ -1423,6 +1614,10 @@ main (gint argc, gchar **argv, gchar **env)
 	event_base_loop (ev_base, 0);
 	event_del (&term_ev);
 
+	if (log_rings_watched) {
+		event_del (&log_rings_ev);
+	}
+
 	/* Maybe save roll history */
 	if (rspamd_main->cfg->history_file) {
 		rspamd_roll_history_save (rspamd_main->history,
@@ -48,6 +48,8 @@ struct rspamd_worker {
 	pid_t pid;                      /**< pid of worker									*/
 	guint index;                    /**< index number									*/
 	guint nconns;                   /**< current connections count						*/
+	guint64 accepted;               /**< total accepted connections						*/
+	guint64 accept_wakeups;         /**< accept wakeups with no pending connections		*/
 	gboolean wanna_die;             /**< worker is terminating							*/
 	gdouble start_time;             /**< start time										*/
 	struct rspamd_main *srv;        /**< pointer to server structure					*/
@@ -63,6 +65,7 @@ struct rspamd_worker {
 	struct event srv_ev;            /**< used by main for read workers' requests		*/
 	gpointer control_data;          /**< used by control protocol to handle commands	*/
 	GPtrArray *finish_actions;      /**< called when worker is terminated				*/
+	struct rspamd_log_ring *log_ring; /**< async log lines written by worker			*/
 };
 
 struct rspamd_abstract_worker_ctx {
@@ -226,6 +229,9 @@ struct rspamd_stat {
 	guint connections_count;                            /**< total connections count						*/
 	guint control_connections_count;                    /**< connections count to control interface			*/
 	guint messages_learned;                             /**< messages learned								*/
+	guint dns_cache_hits;                               /**< DNS replies served from workers caches		*/
+	guint dns_cache_misses;                             /**< DNS requests sent to the resolvers			*/
+	guint stages_hist[RSPAMD_TASK_TRACE_MAX][RSPAMD_TASK_TRACE_BUCKETS]; /**< histograms of stages times	*/
 };
 
 /**
@@ -250,6 +256,7 @@ struct rspamd_main {
 	gboolean cores_throttling;                                  /**< turn off cores when limits are exceeded		*/
 	struct roll_history *history;                               /**< rolling history								*/
 	struct event_base *ev_base;
+	GHashTable *ucl_vars;                                       /**< config variables from the command line		*/
 };
 
 enum rspamd_exception_type {
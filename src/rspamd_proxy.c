@@ -34,6 +34,9 @@
 /* Rotate keys each minute by default */
 #define DEFAULT_ROTATION_TIME 60.0
 #define DEFAULT_RETRIES 5
+/* Idle connections to each upstream, pool is disabled by default */
+#define DEFAULT_KEEPALIVE_MAX 0
+#define DEFAULT_KEEPALIVE_TIMEOUT 60.0
 
 #define msg_err_session(...) rspamd_default_log_function (G_LOG_LEVEL_CRITICAL, \
         session->pool->tag.tagname, session->pool->tag.uid, \
@@ -118,12 +121,29 @@ struct rspamd_proxy_ctx {
 	GArray *cmp_refs;
 	/* Maximum count for retries */
 	guint max_retries;
+	/* Idle keep-alive connections indexed by upstream */
+	GHashTable *idle_conns;
+	/* Maximum idle connections per upstream, 0 disables keep-alive */
+	guint keepalive_max;
+	gdouble keepalive_timeout;
+	struct timeval keepalive_tv;
+};
+
+struct rspamd_proxy_idle_conn {
+	struct rspamd_proxy_ctx *ctx;
+	struct upstream *up;
+	struct rspamd_http_connection *conn;
+	GQueue *queue;
+	GList *entry;
+	struct event ev;
+	gint fd;
 };
 
 enum rspamd_backend_flags {
 	RSPAMD_BACKEND_REPLIED = 1 << 0,
 	RSPAMD_BACKEND_CLOSED = 1 << 1,
 	RSPAMD_BACKEND_PARSED = 1 << 2,
+	RSPAMD_BACKEND_REUSED = 1 << 3,
 };
 
 struct rspamd_proxy_session;
@@ -593,6 +613,155 @@ err:
 	return FALSE;
 }
 
+static void
+proxy_idle_conn_free (struct rspamd_proxy_idle_conn *ic)
+{
+	event_del (&ic->ev);
+	g_queue_delete_link (ic->queue, ic->entry);
+	rspamd_http_connection_unref (ic->conn);
+	close (ic->fd);
+	g_slice_free1 (sizeof (*ic), ic);
+}
+
+static void
+proxy_idle_queue_free (gpointer p)
+{
+	GQueue *q = p;
+
+	while (!g_queue_is_empty (q)) {
+		proxy_idle_conn_free (g_queue_peek_head (q));
+	}
+
+	g_queue_free (q);
+}
+
+static void
+proxy_idle_conn_event (gint fd, short what, gpointer ud)
+{
+	struct rspamd_proxy_idle_conn *ic = ud;
+
+	/* Backend has closed connection, sent some garbage or we have timed out */
+	msg_debug ("remove idle connection to %s: %s",
+			rspamd_inet_address_to_string (rspamd_upstream_addr (ic->up)),
+			(what & EV_READ) ? "closed by backend" : "timeout");
+	proxy_idle_conn_free (ic);
+}
+
+/*
+ * Removes all idle connections to the specified upstream
+ */
+static void
+proxy_idle_conns_purge (struct rspamd_proxy_ctx *ctx, struct upstream *up)
+{
+	GQueue *q;
+
+	q = g_hash_table_lookup (ctx->idle_conns, up);
+
+	if (q) {
+		while (!g_queue_is_empty (q)) {
+			proxy_idle_conn_free (g_queue_peek_head (q));
+		}
+	}
+}
+
+/*
+ * Stores backend connection in the idle pool, takes ownership of both
+ * connection and socket
+ */
+static void
+proxy_idle_conn_release (struct rspamd_proxy_ctx *ctx, struct upstream *up,
+		struct rspamd_http_connection *conn, gint fd)
+{
+	struct rspamd_proxy_idle_conn *ic;
+	GQueue *q;
+
+	q = g_hash_table_lookup (ctx->idle_conns, up);
+
+	if (q == NULL) {
+		q = g_queue_new ();
+		g_hash_table_insert (ctx->idle_conns, up, q);
+	}
+
+	if (g_queue_get_length (q) >= ctx->keepalive_max) {
+		rspamd_http_connection_unref (conn);
+		close (fd);
+
+		return;
+	}
+
+	ic = g_slice_alloc0 (sizeof (*ic));
+	ic->ctx = ctx;
+	ic->up = up;
+	ic->conn = conn;
+	ic->fd = fd;
+	ic->queue = q;
+	/* Most recently used connections are reused first */
+	g_queue_push_head (q, ic);
+	ic->entry = q->head;
+
+	event_set (&ic->ev, fd, EV_READ, proxy_idle_conn_event, ic);
+	event_base_set (ctx->ev_base, &ic->ev);
+	event_add (&ic->ev, &ctx->keepalive_tv);
+}
+
+/*
+ * Checks that idle connection has not been closed by backend: events loop
+ * might have not processed EOF for it yet
+ */
+static gboolean
+proxy_idle_conn_is_alive (gint fd)
+{
+	gchar c;
+	gssize r;
+
+	r = recv (fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+	if (r == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+		return TRUE;
+	}
+
+	/* EOF, error or some unexpected data */
+	return FALSE;
+}
+
+/*
+ * Gets idle connection to the specified upstream if any
+ */
+static gboolean
+proxy_idle_conn_get (struct rspamd_proxy_ctx *ctx, struct upstream *up,
+		struct rspamd_http_connection **pconn, gint *pfd)
+{
+	struct rspamd_proxy_idle_conn *ic;
+	GQueue *q;
+
+	q = g_hash_table_lookup (ctx->idle_conns, up);
+
+	if (q == NULL) {
+		return FALSE;
+	}
+
+	while (!g_queue_is_empty (q)) {
+		ic = g_queue_peek_head (q);
+
+		if (!proxy_idle_conn_is_alive (ic->fd)) {
+			msg_debug ("remove idle connection to %s: closed by backend",
+					rspamd_inet_address_to_string (rspamd_upstream_addr (ic->up)));
+			proxy_idle_conn_free (ic);
+			continue;
+		}
+
+		g_queue_pop_head (q);
+		event_del (&ic->ev);
+		*pconn = ic->conn;
+		*pfd = ic->fd;
+		g_slice_free1 (sizeof (*ic), ic);
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
 gpointer
 init_rspamd_proxy (struct rspamd_config *cfg)
 {
@@ -618,6 +787,12 @@ init_rspamd_proxy (struct rspamd_config *cfg)
 	rspamd_mempool_add_destructor (cfg->cfg_pool,
 			(rspamd_mempool_destruct_t)rspamd_array_free_hard, ctx->cmp_refs);
 	ctx->max_retries = DEFAULT_RETRIES;
+	ctx->keepalive_max = DEFAULT_KEEPALIVE_MAX;
+	ctx->keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+	ctx->idle_conns = g_hash_table_new_full (g_direct_hash, g_direct_equal,
+			NULL, proxy_idle_queue_free);
+	rspamd_mempool_add_destructor (cfg->cfg_pool,
+			(rspamd_mempool_destruct_t)g_hash_table_unref, ctx->idle_conns);
 
 	rspamd_rcl_register_worker_option (cfg,
 			type,
@@ -680,6 +855,25 @@ init_rspamd_proxy (struct rspamd_config *cfg)
 			G_STRUCT_OFFSET (struct rspamd_proxy_ctx, max_retries),
 			RSPAMD_CL_FLAG_UINT,
 			"Maximum number of retries for master connection");
+	rspamd_rcl_register_worker_option (cfg,
+			type,
+			"keepalive_max_idle",
+			rspamd_rcl_parse_struct_integer,
+			ctx,
+			G_STRUCT_OFFSET (struct rspamd_proxy_ctx, keepalive_max),
+			RSPAMD_CL_FLAG_UINT,
+			"Maximum number of idle keep-alive connections per upstream, "
+			"default: " G_STRINGIFY (DEFAULT_KEEPALIVE_MAX)
+			" (connections are not reused)");
+	rspamd_rcl_register_worker_option (cfg,
+			type,
+			"keepalive_timeout",
+			rspamd_rcl_parse_struct_time,
+			ctx,
+			G_STRUCT_OFFSET (struct rspamd_proxy_ctx, keepalive_timeout),
+			RSPAMD_CL_FLAG_TIME_FLOAT,
+			"Time to keep idle connections to upstreams, default: "
+			G_STRINGIFY (DEFAULT_KEEPALIVE_TIMEOUT) " seconds");
 
 	return ctx;
 }
@@ -1126,8 +1320,18 @@ proxy_backend_master_error_handler (struct rspamd_http_connection *conn, GError
 		rspamd_inet_address_to_string (rspamd_upstream_addr (session->master_conn->up)),
 		err->message,
 		session->ctx->max_retries - session->retries);
-	session->retries ++;
-	rspamd_upstream_fail (bk_conn->up);
+
+	if (!(bk_conn->flags & RSPAMD_BACKEND_REUSED)) {
+		session->retries ++;
+		rspamd_upstream_fail (bk_conn->up);
+		proxy_idle_conns_purge (session->ctx, bk_conn->up);
+	}
+	/*
+	 * Reused connection could be closed by backend meanwhile, such a failure
+	 * is not counted as a retry: it consumes the idle connection, so the pool
+	 * is exhausted sooner or later
+	 */
+
 	proxy_backend_close_connection (session->master_conn);
 
 	if (session->ctx->max_retries &&
@@ -1187,6 +1391,15 @@ proxy_backend_master_finish_handler (struct rspamd_http_connection *conn,
 
 	rspamd_upstream_ok (bk_conn->up);
 
+	if (session->ctx->keepalive_max > 0 &&
+			rspamd_http_connection_is_keepalive (bk_conn->backend_conn)) {
+		/* Backend connection can be reused by the next session */
+		proxy_idle_conn_release (session->ctx, bk_conn->up,
+				bk_conn->backend_conn, bk_conn->backend_sock);
+		bk_conn->backend_conn = NULL;
+		bk_conn->flags |= RSPAMD_BACKEND_CLOSED;
+	}
+
 	rspamd_http_connection_write_message (session->client_conn,
 			msg, NULL, NULL, session, session->client_sock,
 			bk_conn->io_tv, session->ctx->ev_base);
@@ -1240,28 +1453,40 @@ retry:
 			goto err;
 		}
 
-		session->master_conn->backend_sock = rspamd_inet_address_connect (
-				rspamd_upstream_addr (session->master_conn->up),
-				SOCK_STREAM, TRUE);
+		if (proxy_idle_conn_get (session->ctx, session->master_conn->up,
+				&session->master_conn->backend_conn,
+				&session->master_conn->backend_sock)) {
+			session->master_conn->flags |= RSPAMD_BACKEND_REUSED;
+		}
+		else {
+			session->master_conn->flags &= ~RSPAMD_BACKEND_REUSED;
+			session->master_conn->backend_sock = rspamd_inet_address_connect (
+					rspamd_upstream_addr (session->master_conn->up),
+					SOCK_STREAM, TRUE);
+
+			if (session->master_conn->backend_sock == -1) {
+				msg_err_session ("cannot connect upstream: %s(%s)",
+						host ? hostbuf : "default",
+								rspamd_inet_address_to_string (rspamd_upstream_addr (
+										session->master_conn->up)));
+				rspamd_upstream_fail (session->master_conn->up);
+				proxy_idle_conns_purge (session->ctx, session->master_conn->up);
+				session->retries ++;
+				goto retry;
+			}
 
-		if (session->master_conn->backend_sock == -1) {
-			msg_err_session ("cannot connect upstream: %s(%s)",
-					host ? hostbuf : "default",
-							rspamd_inet_address_to_string (rspamd_upstream_addr (
-									session->master_conn->up)));
-			rspamd_upstream_fail (session->master_conn->up);
-			session->retries ++;
-			goto retry;
+			session->master_conn->backend_conn = rspamd_http_connection_new (
+					NULL,
+					proxy_backend_master_error_handler,
+					proxy_backend_master_finish_handler,
+					RSPAMD_HTTP_CLIENT_SIMPLE |
+					(session->ctx->keepalive_max > 0 ?
+							RSPAMD_HTTP_CLIENT_KEEP_ALIVE : 0),
+					RSPAMD_HTTP_CLIENT,
+					session->ctx->keys_cache,
+					NULL);
 		}
 
-		session->master_conn->backend_conn = rspamd_http_connection_new (
-				NULL,
-				proxy_backend_master_error_handler,
-				proxy_backend_master_finish_handler,
-				RSPAMD_HTTP_CLIENT_SIMPLE,
-				RSPAMD_HTTP_CLIENT,
-				session->ctx->keys_cache,
-				NULL);
 		session->master_conn->flags &= ~RSPAMD_BACKEND_CLOSED;
 		session->master_conn->parser_from_ref = backend->parser_from_ref;
 		session->master_conn->parser_to_ref = backend->parser_to_ref;
@@ -1394,9 +1619,12 @@ proxy_accept_socket (gint fd, short what, void *arg)
 	}
 	/* Check for EAGAIN */
 	if (nfd == 0) {
+		worker->accept_wakeups ++;
 		return;
 	}
 
+	worker->accepted ++;
+
 	session = g_slice_alloc0 (sizeof (*session));
 	REF_INIT_RETAIN (session, proxy_session_dtor);
 	session->client_sock = nfd;
@@ -1460,7 +1688,9 @@ start_rspamd_proxy (struct rspamd_worker *worker)
 	ctx->resolver = dns_resolver_init (worker->srv->logger,
 			ctx->ev_base,
 			worker->srv->cfg);
+	ctx->resolver->stat = worker->srv->stat;
 	double_to_tv (ctx->timeout, &ctx->io_tv);
+	double_to_tv (ctx->keepalive_timeout, &ctx->keepalive_tv);
 	rspamd_map_watch (worker->srv->cfg, ctx->ev_base, ctx->resolver);
 
 	rspamd_upstreams_library_config (worker->srv->cfg, ctx->cfg->ups_ctx,
@@ -44,6 +44,10 @@
 #define DEFAULT_WORKER_IO_TIMEOUT 60000
 /* Timeout for task processing */
 #define DEFAULT_TASK_TIMEOUT 8.0
+/* Idle timeout for keep-alive connections */
+#define DEFAULT_KEEPALIVE_TIMEOUT 10.0
+/* Interval to check whether tasks using the old rules are finished */
+#define RELOAD_RULES_WAIT_INTERVAL 0.1
 
 gpointer init_worker (struct rspamd_config *cfg);
 void start_worker (struct rspamd_worker *worker);
@@ -91,12 +95,11 @@ static gboolean
 rspamd_worker_call_finish_handlers (struct rspamd_worker *worker)
 {
 	struct rspamd_task *task;
-	struct rspamd_config *cfg = worker->srv->cfg;
-	struct rspamd_worker_ctx *ctx;
+	struct rspamd_worker_ctx *ctx = worker->ctx;
+	struct rspamd_config *cfg = ctx->cfg;
 	struct rspamd_config_post_load_script *sc;
 
 	if (cfg->finish_callbacks) {
-		ctx = worker->ctx;
 		/* Create a fake task object for async events */
 		task = rspamd_task_new (worker, cfg);
 		task->resolver = ctx->resolver;
@@ -179,6 +182,15 @@ rspamd_worker_guard_handler (gint fd, short what, void *data)
 
 	if (r > 0) {
 		msg_warn_task ("received extra data after task is loaded, ignoring");
+
+		if (task->http_conn &&
+				(task->http_conn->opts & RSPAMD_HTTP_CLIENT_KEEP_ALIVE)) {
+			/*
+			 * Pipelined requests are not supported, and the data read
+			 * is lost anyway, so close the connection after the reply
+			 */
+			task->http_conn->opts &= ~RSPAMD_HTTP_CLIENT_KEEP_ALIVE;
+		}
 	}
 	else {
 		if (r == 0) {
@@ -212,6 +224,35 @@ rspamd_worker_guard_handler (gint fd, short what, void *data)
 	}
 }
 
+static void
+rspamd_worker_count_task (struct rspamd_worker *worker,
+		struct rspamd_task *task)
+{
+	worker->nconns++;
+	rspamd_mempool_add_destructor (task->task_pool,
+		(rspamd_mempool_destruct_t)reduce_tasks_count, worker);
+}
+
+/*
+ * Decide whether the connection could be kept alive after the reply
+ */
+static void
+rspamd_worker_check_keepalive (struct rspamd_task *task)
+{
+	struct rspamd_worker_ctx *ctx = task->worker->ctx;
+
+	if (!(task->http_conn->opts & RSPAMD_HTTP_CLIENT_KEEP_ALIVE)) {
+		return;
+	}
+
+	/* Legacy protocol clients read reply till EOF */
+	if (!RSPAMD_TASK_IS_JSON (task) || RSPAMD_TASK_IS_SPAMC (task) ||
+			task->worker->wanna_die || ctx->reload_pending ||
+			task->conn_requests + 1 >= ctx->keepalive_max_requests) {
+		task->http_conn->opts &= ~RSPAMD_HTTP_CLIENT_KEEP_ALIVE;
+	}
+}
+
 static gint
 rspamd_worker_body_handler (struct rspamd_http_connection *conn,
 	struct rspamd_http_message *msg,
@@ -224,6 +265,11 @@ rspamd_worker_body_handler (struct rspamd_http_connection *conn,
 
 	ctx = task->worker->ctx;
 
+	if (task->conn_requests > 0) {
+		/* Idle keep-alive connections are not counted as tasks */
+		rspamd_worker_count_task (task->worker, task);
+	}
+
 	if (!rspamd_protocol_handle_request (task, msg)) {
 		msg_err_task ("cannot handle request: %e", task->err);
 		task->flags |= RSPAMD_TASK_FLAG_SKIP;
@@ -240,6 +286,8 @@ rspamd_worker_body_handler (struct rspamd_http_connection *conn,
 		}
 	}
 
+	rspamd_worker_check_keepalive (task);
+
 	/* Set global timeout for the task */
 	if (ctx->task_timeout > 0.0) {
 		event_set (&task->timeout_ev, -1, EV_TIMEOUT, rspamd_task_timeout,
@@ -274,6 +322,17 @@ rspamd_worker_error_handler (struct rspamd_http_connection *conn, GError *err)
 	struct rspamd_http_message *msg;
 	rspamd_fstring_t *reply;
 
+	if (task->conn_requests > 0 && task->processed_stages == 0) {
+		/* Keep-alive connection has been closed or timed out while idle */
+		msg_debug_task ("closing keep-alive connection from: %s after "
+				"%ud requests: %e",
+				rspamd_inet_address_to_string (task->client_addr),
+				task->conn_requests, err);
+		rspamd_session_destroy (task->s);
+
+		return;
+	}
+
 	msg_info_task ("abnormally closing connection from: %s, error: %e",
 		rspamd_inet_address_to_string (task->client_addr), err);
 	if (task->processed_stages & RSPAMD_TASK_STAGE_REPLIED) {
@@ -300,6 +359,7 @@ rspamd_worker_error_handler (struct rspamd_http_connection *conn, GError *err)
 		reply = rspamd_fstring_sized_new (msg->status->len + 16);
 		rspamd_printf_fstring (&reply, "{\"error\":\"%V\"}", msg->status);
 		rspamd_http_message_set_body_from_fstring_steal (msg, reply);
+		task->http_conn->opts &= ~RSPAMD_HTTP_CLIENT_KEEP_ALIVE;
 		rspamd_http_connection_reset (task->http_conn);
 		rspamd_http_connection_write_message (task->http_conn,
 				msg,
@@ -312,6 +372,121 @@ rspamd_worker_error_handler (struct rspamd_http_connection *conn, GError *err)
 	}
 }
 
+static struct rspamd_task *
+rspamd_worker_new_task (struct rspamd_worker *worker,
+		struct rspamd_http_connection *conn,
+		gint fd,
+		rspamd_inet_addr_t *addr,
+		guint conn_requests)
+{
+	struct rspamd_worker_ctx *ctx = worker->ctx;
+	struct rspamd_task *task;
+
+	task = rspamd_task_new (worker, ctx->cfg);
+
+	/* Copy some variables */
+	if (ctx->is_mime) {
+		task->flags |= RSPAMD_TASK_FLAG_MIME;
+	}
+	else {
+		task->flags &= ~RSPAMD_TASK_FLAG_MIME;
+	}
+
+	task->sock = fd;
+	task->client_addr = addr;
+	task->conn_requests = conn_requests;
+	task->resolver = ctx->resolver;
+	/* TODO: allow to disable autolearn in protocol */
+	task->flags |= RSPAMD_TASK_FLAG_LEARN_AUTO;
+	task->http_conn = conn;
+	task->ev_base = ctx->ev_base;
+
+	if (conn_requests == 0) {
+		rspamd_worker_count_task (worker, task);
+	}
+
+	/* Set up async session */
+	task->s = rspamd_session_create (task->task_pool, rspamd_task_fin,
+			rspamd_task_restore, (event_finalizer_t )rspamd_task_free, task);
+
+	return task;
+}
+
+static void
+rspamd_worker_keepalive_handler (gint fd, short what, gpointer ud)
+{
+	struct rspamd_task *task = ud;
+	struct rspamd_worker_ctx *ctx = task->worker->ctx;
+
+	if (what == EV_TIMEOUT) {
+		msg_debug_task ("closing idle keep-alive connection from: %s after "
+				"%ud requests",
+				rspamd_inet_address_to_string (task->client_addr),
+				task->conn_requests);
+		rspamd_session_destroy (task->s);
+
+		return;
+	}
+
+	/* Time spent while idle should not be accounted for the new request */
+	gettimeofday (&task->tv, NULL);
+	task->time_real = rspamd_get_ticks ();
+	task->time_virtual = rspamd_get_virtual_ticks ();
+
+	/* EOF is reported to the error handler by the http code */
+	rspamd_http_connection_read_message (task->http_conn,
+			task,
+			fd,
+			&ctx->io_tv,
+			ctx->ev_base);
+}
+
+/*
+ * Pass connection of the replied task to a new task waiting for the next
+ * request from the same peer
+ */
+static void
+rspamd_worker_keepalive (struct rspamd_task *task)
+{
+	struct rspamd_worker *worker = task->worker;
+	struct rspamd_worker_ctx *ctx = worker->ctx;
+	struct rspamd_http_connection *conn = task->http_conn;
+	struct rspamd_task *new_task;
+
+	msg_debug_task ("keeping connection from: %s alive after %ud requests",
+		rspamd_inet_address_to_string (task->client_addr),
+		task->conn_requests + 1);
+
+	new_task = rspamd_worker_new_task (worker, conn, task->sock,
+			rspamd_inet_address_copy (task->client_addr),
+			task->conn_requests + 1);
+
+	/* Socket and connection are now owned by the new task */
+	if (task->guard_ev) {
+		event_del (task->guard_ev);
+		task->guard_ev = NULL;
+	}
+
+	task->http_conn = NULL;
+	task->sock = -1;
+
+	rspamd_http_connection_reset (conn);
+
+	if (ctx->key) {
+		rspamd_http_connection_set_key (conn, ctx->key);
+	}
+
+	/*
+	 * Idle timeout is applied until the next request starts arriving, task
+	 * timeout event is not used until the request is read
+	 */
+	conn->ud = new_task;
+	event_set (&new_task->timeout_ev, new_task->sock, EV_READ,
+			rspamd_worker_keepalive_handler, new_task);
+	event_base_set (ctx->ev_base, &new_task->timeout_ev);
+	event_add (&new_task->timeout_ev, &ctx->keepalive_tv);
+}
+
 static gint
 rspamd_worker_finish_handler (struct rspamd_http_connection *conn,
 	struct rspamd_http_message *msg)
@@ -320,8 +495,17 @@ rspamd_worker_finish_handler (struct rspamd_http_connection *conn,
 
 	if (task->processed_stages & RSPAMD_TASK_STAGE_REPLIED) {
 		/* We are done here */
-		msg_debug_task ("normally closing connection from: %s",
-			rspamd_inet_address_to_string (task->client_addr));
+		if (msg->type == HTTP_RESPONSE &&
+				rspamd_http_connection_is_keepalive (conn) &&
+				!task->worker->wanna_die) {
+			/* Reply has been written, wait for the next request */
+			rspamd_worker_keepalive (task);
+		}
+		else {
+			msg_debug_task ("normally closing connection from: %s",
+				rspamd_inet_address_to_string (task->client_addr));
+		}
+
 		rspamd_session_destroy (task->s);
 	}
 	else if (task->processed_stages & RSPAMD_TASK_STAGE_DONE) {
@@ -339,6 +523,7 @@ accept_socket (gint fd, short what, void *arg)
 {
 	struct rspamd_worker *worker = (struct rspamd_worker *) arg;
 	struct rspamd_worker_ctx *ctx;
+	struct rspamd_http_connection *conn;
 	struct rspamd_task *task;
 	rspamd_inet_addr_t *addr;
 	gint nfd;
@@ -359,48 +544,29 @@ accept_socket (gint fd, short what, void *arg)
 	}
 	/* Check for EAGAIN */
 	if (nfd == 0) {
+		worker->accept_wakeups ++;
 		return;
 	}
 
-	task = rspamd_task_new (worker, ctx->cfg);
-
-	msg_info_task ("accepted connection from %s port %d, task ptr: %p",
-		rspamd_inet_address_to_string (addr),
-		rspamd_inet_address_get_port (addr),
-		task);
-
-	/* Copy some variables */
-	if (ctx->is_mime) {
-		task->flags |= RSPAMD_TASK_FLAG_MIME;
-	}
-	else {
-		task->flags &= ~RSPAMD_TASK_FLAG_MIME;
-	}
-
-	task->sock = nfd;
-	task->client_addr = addr;
-
-	worker->srv->stat->connections_count++;
-	task->resolver = ctx->resolver;
-	/* TODO: allow to disable autolearn in protocol */
-	task->flags |= RSPAMD_TASK_FLAG_LEARN_AUTO;
+	worker->accepted ++;
 
-	task->http_conn = rspamd_http_connection_new (rspamd_worker_body_handler,
+	conn = rspamd_http_connection_new (rspamd_worker_body_handler,
 			rspamd_worker_error_handler,
 			rspamd_worker_finish_handler,
-			0,
+			ctx->keepalive_max_requests > 0 ? RSPAMD_HTTP_CLIENT_KEEP_ALIVE : 0,
 			RSPAMD_HTTP_SERVER,
 			ctx->keys_cache,
 			NULL);
-	rspamd_http_connection_set_max_size (task->http_conn, task->cfg->max_message);
-	task->ev_base = ctx->ev_base;
-	worker->nconns++;
-	rspamd_mempool_add_destructor (task->task_pool,
-		(rspamd_mempool_destruct_t)reduce_tasks_count, worker);
+	rspamd_http_connection_set_max_size (conn, ctx->cfg->max_message);
 
-	/* Set up async session */
-	task->s = rspamd_session_create (task->task_pool, rspamd_task_fin,
-			rspamd_task_restore, (event_finalizer_t )rspamd_task_free, task);
+	task = rspamd_worker_new_task (worker, conn, nfd, addr, 0);
+
+	msg_info_task ("accepted connection from %s port %d, task ptr: %p",
+		rspamd_inet_address_to_string (addr),
+		rspamd_inet_address_get_port (addr),
+		task);
+
+	worker->srv->stat->connections_count++;
 
 	if (ctx->key) {
 		rspamd_http_connection_set_key (task->http_conn, ctx->key);
@@ -421,8 +587,9 @@ rspamd_worker_hyperscan_ready (struct rspamd_main *rspamd_main,
 		struct rspamd_control_command *cmd,
 		gpointer ud)
 {
+	struct rspamd_worker_ctx *ctx = ud;
 	struct rspamd_control_reply rep;
-	struct rspamd_re_cache *cache = worker->srv->cfg->re_cache;
+	struct rspamd_re_cache *cache = ctx->cfg->re_cache;
 
 	memset (&rep, 0, sizeof (rep));
 	rep.type = RSPAMD_CONTROL_HYPERSCAN_LOADED;
@@ -433,7 +600,8 @@ rspamd_worker_hyperscan_ready (struct rspamd_main *rspamd_main,
 				(!rspamd_re_cache_is_hs_loaded (cache)) ?
 						"new db" : "forced update");
 		rep.reply.hs_loaded.status = rspamd_re_cache_load_hyperscan (
-				worker->srv->cfg->re_cache, cmd->cmd.hs_loaded.cache_dir);
+				cache, cmd->cmd.hs_loaded.cache_dir,
+				cmd->cmd.hs_loaded.forced);
 	}
 
 	if (write (fd, &rep, sizeof (rep)) != sizeof (rep)) {
@@ -480,6 +648,169 @@ rspamd_worker_log_pipe_handler (struct rspamd_main *rspamd_main,
 	return TRUE;
 }
 
+static void
+rspamd_worker_enable_accept (struct rspamd_worker *worker, gboolean enable)
+{
+	GList *cur;
+	struct event *events;
+
+	for (cur = worker->accept_events; cur != NULL; cur = g_list_next (cur)) {
+		events = cur->data;
+
+		if (enable) {
+			event_add (&events[0], NULL);
+		}
+		else {
+			event_del (&events[0]);
+
+			/* Accept might be throttled and then enabled by timer */
+			if (event_get_base (&events[1])) {
+				event_del (&events[1]);
+			}
+		}
+	}
+}
+
+/*
+ * Read rules from the same config file as the current config does, the
+ * worker's own settings are not changed
+ */
+static struct rspamd_config *
+rspamd_worker_read_rules (struct rspamd_worker *worker,
+		struct rspamd_worker_ctx *ctx)
+{
+	struct rspamd_config *cfg, *old_cfg = ctx->cfg;
+
+	cfg = rspamd_config_new ();
+	g_hash_table_unref (cfg->c_modules);
+	cfg->c_modules = g_hash_table_ref (old_cfg->c_modules);
+	cfg->libs_ctx = old_cfg->libs_ctx;
+	REF_RETAIN (cfg->libs_ctx);
+	cfg->cfg_name = rspamd_mempool_strdup (cfg->cfg_pool, old_cfg->cfg_name);
+	cfg->compiled_modules = old_cfg->compiled_modules;
+	cfg->compiled_workers = old_cfg->compiled_workers;
+
+	if (!rspamd_config_read (cfg, cfg->cfg_name, NULL, NULL, NULL,
+			worker->srv->ucl_vars)) {
+		REF_RELEASE (cfg);
+
+		return NULL;
+	}
+
+	if (!cfg->temp_dir) {
+		cfg->temp_dir = rspamd_mempool_strdup (cfg->cfg_pool,
+				old_cfg->temp_dir);
+	}
+
+	/* C modules are reconfigured here, so no tasks should use the old rules */
+	rspamd_lua_post_load_config (cfg);
+	rspamd_init_filters (cfg, TRUE);
+	rspamd_config_post_load (cfg,
+			RSPAMD_CONFIG_INIT_VALIDATE|RSPAMD_CONFIG_INIT_SYMCACHE);
+
+	return cfg;
+}
+
+static void
+rspamd_worker_reload_rules (gint fd, short what, gpointer ud)
+{
+	struct rspamd_worker *worker = ud;
+	struct rspamd_worker_ctx *ctx = worker->ctx;
+	struct rspamd_config *cfg, *old_cfg = ctx->cfg;
+	struct timeval tv;
+
+	if (worker->wanna_die) {
+		return;
+	}
+
+	if (worker->nconns > 0) {
+		/* Tasks reference regexps and modules of the old rules */
+		double_to_tv (RELOAD_RULES_WAIT_INTERVAL, &tv);
+		event_add (&ctx->reload_ev, &tv);
+
+		return;
+	}
+
+	msg_info_ctx ("reloading rules from %s", old_cfg->cfg_name);
+	cfg = rspamd_worker_read_rules (worker, ctx);
+
+	if (cfg == NULL) {
+		msg_err_ctx ("cannot read new rules, keep the old ones");
+	}
+	else {
+		rspamd_symbols_cache_inherit (cfg->cache, old_cfg->cache);
+		rspamd_re_cache_compare (cfg->re_cache, old_cfg->re_cache);
+#ifdef WITH_HYPERSCAN
+		if (!cfg->disable_hyperscan) {
+			/* Unchanged classes have the same hash and thus the same files */
+			rspamd_re_cache_load_hyperscan (cfg->re_cache,
+					cfg->hs_cache_dir ? cfg->hs_cache_dir : RSPAMD_DBDIR "/",
+					FALSE);
+		}
+#endif
+		rspamd_symbols_cache_stop_refresh (old_cfg->cache);
+		rspamd_symbols_cache_start_refresh (cfg->cache, ctx->ev_base, worker);
+		rspamd_map_watch (cfg, ctx->ev_base, ctx->resolver);
+		rspamd_upstreams_library_config (cfg, cfg->ups_ctx,
+				ctx->ev_base, ctx->resolver->r);
+		rspamd_monitored_ctx_config (cfg->monitored_ctx,
+				cfg, ctx->ev_base, ctx->resolver->r);
+#ifdef WITH_HIREDIS
+		rspamd_redis_pool_config (cfg->redis_pool, cfg, ctx->ev_base);
+#endif
+		ctx->cfg = cfg;
+		rspamd_lua_run_postloads (cfg->lua_state, cfg, ctx->ev_base, worker);
+
+		/* Logger and statistics still use the config the worker started with */
+		if (old_cfg != worker->srv->cfg) {
+			REF_RELEASE (old_cfg);
+		}
+
+		msg_info_ctx ("rules have been reloaded");
+	}
+
+	ctx->reload_pending = FALSE;
+	rspamd_worker_enable_accept (worker, TRUE);
+}
+
+static gboolean
+rspamd_worker_reload_rules_handler (struct rspamd_main *rspamd_main,
+		struct rspamd_worker *worker, gint fd,
+		gint attached_fd,
+		struct rspamd_control_command *cmd,
+		gpointer ud)
+{
+	struct rspamd_worker_ctx *ctx = ud;
+	struct rspamd_control_reply rep;
+	struct timeval tv = {.tv_sec = 0, .tv_usec = 0};
+
+	memset (&rep, 0, sizeof (rep));
+	rep.type = RSPAMD_CONTROL_RELOAD_RULES;
+
+	if (ctx->reload_pending || worker->wanna_die) {
+		rep.reply.reload_rules.status = EBUSY;
+	}
+	else {
+		/*
+		 * Reply now as main does not wait for long, new connections are
+		 * not accepted until the active tasks are finished
+		 */
+		ctx->reload_pending = TRUE;
+		rspamd_worker_enable_accept (worker, FALSE);
+		event_set (&ctx->reload_ev, -1, EV_TIMEOUT, rspamd_worker_reload_rules,
+				worker);
+		event_base_set (ctx->ev_base, &ctx->reload_ev);
+		event_add (&ctx->reload_ev, &tv);
+	}
+
+	if (write (fd, &rep, sizeof (rep)) != sizeof (rep)) {
+		msg_err ("cannot write reply to the control socket: %s",
+				strerror (errno));
+	}
+
+	return TRUE;
+}
+
 gpointer
 init_worker (struct rspamd_config *cfg)
 {
@@ -496,6 +827,7 @@ init_worker (struct rspamd_config *cfg)
 	ctx->timeout = DEFAULT_WORKER_IO_TIMEOUT;
 	ctx->cfg = cfg;
 	ctx->task_timeout = DEFAULT_TASK_TIMEOUT;
+	ctx->keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
 
 	rspamd_rcl_register_worker_option (cfg,
 			type,
@@ -565,6 +897,30 @@ init_worker (struct rspamd_config *cfg)
 			RSPAMD_CL_FLAG_INT_32,
 			"Maximum count of parallel tasks processed by a single worker process");
 
+	rspamd_rcl_register_worker_option (cfg,
+			type,
+			"keepalive_max_requests",
+			rspamd_rcl_parse_struct_integer,
+			ctx,
+			G_STRUCT_OFFSET (struct rspamd_worker_ctx,
+						keepalive_max_requests),
+			RSPAMD_CL_FLAG_INT_32,
+			"Maximum count of requests served over a single keep-alive "
+			"connection, default: 0 (keep-alive is disabled)");
+
+	rspamd_rcl_register_worker_option (cfg,
+			type,
+			"keepalive_timeout",
+			rspamd_rcl_parse_struct_time,
+			ctx,
+			G_STRUCT_OFFSET (struct rspamd_worker_ctx,
+						keepalive_timeout),
+			RSPAMD_CL_FLAG_TIME_FLOAT,
+			"Time to wait for the next request on a keep-alive connection, "
+			"default: "
+					G_STRINGIFY(DEFAULT_KEEPALIVE_TIMEOUT)
+					" seconds");
+
 	rspamd_rcl_register_worker_option (cfg,
 			type,
 			"keypair",
@@ -603,12 +959,14 @@ start_worker (struct rspamd_worker *worker)
 	ctx->cfg = worker->srv->cfg;
 	ctx->ev_base = rspamd_prepare_worker (worker, "normal", accept_socket, TRUE);
 	msec_to_tv (ctx->timeout, &ctx->io_tv);
+	double_to_tv (ctx->keepalive_timeout, &ctx->keepalive_tv);
 	rspamd_symbols_cache_start_refresh (worker->srv->cfg->cache, ctx->ev_base,
 			worker);
 
 	ctx->resolver = dns_resolver_init (worker->srv->logger,
 			ctx->ev_base,
 			worker->srv->cfg);
+	ctx->resolver->stat = worker->srv->stat;
 	rspamd_map_watch (worker->srv->cfg, ctx->ev_base, ctx->resolver);
 
 	rspamd_upstreams_library_config (worker->srv->cfg, ctx->cfg->ups_ctx,
@@ -623,6 +981,16 @@ start_worker (struct rspamd_worker *worker)
 			(gpointer) rspamd_worker_on_terminate);
 
 #ifdef WITH_HYPERSCAN
+	if (!ctx->cfg->disable_hyperscan) {
+		/*
+		 * Classes that have not been changed since the previous config are
+		 * already compiled, so load them without waiting for hs_helper
+		 */
+		rspamd_re_cache_load_hyperscan (ctx->cfg->re_cache,
+				ctx->cfg->hs_cache_dir ? ctx->cfg->hs_cache_dir :
+						RSPAMD_DBDIR "/", FALSE);
+	}
+
 	rspamd_control_worker_add_cmd_handler (worker,
 			RSPAMD_CONTROL_HYPERSCAN_LOADED,
 			rspamd_worker_hyperscan_ready,
@@ -633,6 +1001,10 @@ start_worker (struct rspamd_worker *worker)
 			RSPAMD_CONTROL_LOG_PIPE,
 			rspamd_worker_log_pipe_handler,
 			ctx);
+	rspamd_control_worker_add_cmd_handler (worker,
+			RSPAMD_CONTROL_RELOAD_RULES,
+			rspamd_worker_reload_rules_handler,
+			ctx);
 	event_base_loop (ctx->ev_base, 0);
 	rspamd_worker_block_signals ();
 
@@ -646,7 +1018,11 @@ start_worker (struct rspamd_worker *worker)
 		g_slice_free1 (sizeof (*lp), lp);
 	}
 
-	REF_RELEASE (ctx->cfg);
+	if (ctx->cfg != worker->srv->cfg) {
+		REF_RELEASE (ctx->cfg);
+	}
+
+	REF_RELEASE (worker->srv->cfg);
 
 	exit (EXIT_SUCCESS);
 }
@@ -52,6 +52,11 @@ struct rspamd_worker_ctx {
 	guint32 max_tasks;
 	/* Maximum time for task processing */
 	gdouble task_timeout;
+	/* Maximum number of requests per keep-alive connection */
+	guint32 keepalive_max_requests;
+	/* Idle timeout for keep-alive connections */
+	gdouble keepalive_timeout;
+	struct timeval keepalive_tv;
 	/* Events base */
 	struct event_base *ev_base;
 	/* Encryption key */
@@ -62,6 +67,9 @@ struct rspamd_worker_ctx {
 	struct rspamd_config *cfg;
 	/* Log pipe */
 	struct rspamd_worker_log_pipe *log_pipes;
+	/* Rules reload waiting for active tasks */
+	gboolean reload_pending;
+	struct event reload_ev;
 };
 
 #endif
@@ -0,0 +1,59 @@
+context("Task FFI accessors", function()
+  local ffi = require("ffi")
+  local rspamd_util = require("rspamd_util")
+  local task_ffi = require("task_ffi")
+
+  ffi.cdef[[
+  struct rspamd_config;
+  struct rspamd_worker;
+  struct rspamd_task;
+  struct rspamd_task * rspamd_task_new(struct rspamd_worker *worker, struct rspamd_config *cfg);
+  void rspamd_task_free (struct rspamd_task *task);
+  void * rspamd_task_insert_result (struct rspamd_task *task,
+    const char *symbol, double flag, const char *opt);
+  ]]
+
+  local config = {
+    logging = {
+      type = 'console',
+      level = 'info'
+    },
+    metric = {
+      name = 'default',
+      actions = {
+        reject = 100500,
+      },
+    }
+  }
+
+  test("Access task results", function()
+    local cfg = rspamd_util.config_from_ucl(config)
+    assert_not_nil(cfg)
+    assert_true(task_ffi.has_ffi)
+
+    cfg:set_metric_symbol('FFI_TEST_POS', 2.5)
+    cfg:set_metric_symbol('FFI_TEST_NEG', -1.0)
+
+    local t = ffi.C.rspamd_task_new(nil,
+      ffi.cast('struct rspamd_config **', cfg)[0])
+
+    assert_equal(task_ffi.get_size(t), 0)
+    assert_equal(task_ffi.get_message_id(t), 'undef')
+    assert_false(task_ffi.has_symbol(t, 'FFI_TEST_POS'))
+    assert_nil(task_ffi.get_symbol_score(t, 'FFI_TEST_POS'))
+    assert_equal(task_ffi.get_score(t), 0)
+
+    ffi.C.rspamd_task_insert_result(t, 'FFI_TEST_POS', 1.0, nil)
+    ffi.C.rspamd_task_insert_result(t, 'FFI_TEST_NEG', 2.0, nil)
+
+    assert_true(task_ffi.has_symbol(t, 'FFI_TEST_POS'))
+    assert_true(task_ffi.has_symbol(t, 'FFI_TEST_NEG'))
+    assert_false(task_ffi.has_symbol(t, 'FFI_TEST_UNKNOWN'))
+    assert_equal(task_ffi.get_symbol_score(t, 'FFI_TEST_POS'), 2.5)
+    assert_equal(task_ffi.get_symbol_score(t, 'FFI_TEST_NEG'), -2.0)
+    assert_nil(task_ffi.get_symbol_score(t, 'FFI_TEST_UNKNOWN'))
+    assert_equal(task_ffi.get_score(t), 0.5)
+
+    ffi.C.rspamd_task_free(t)
+  end)
+end)
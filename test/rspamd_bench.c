@@ -0,0 +1,636 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Benchmark of the scanning hot path over a directory of sample messages:
+ *
+ * rspamd-bench [-c rspamd.conf] [-n passes] [-j] <dir>
+ *
+ * Parsing, url extraction and images normalization are always measured,
+ * classification and the full scan require a configuration file.
+ *
+ * rspamd-bench -m [-n passes] runs micro benchmarks of separate subsystems
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "message.h"
+#include "url.h"
+#include "images.h"
+#include "dns.h"
+#include "libserver/re_cache.h"
+#include "libstat/stat_api.h"
+#include "libstat/stat_internal.h"
+#include "lua/lua_common.h"
+#include "unix-std.h"
+#include "rspamd_bench.h"
+
+struct rspamd_main *rspamd_main = NULL;
+worker_t *workers[] = { NULL };
+/* Defined in modules.c */
+extern module_t *modules[];
+
+static gchar *config_file = NULL;
+static gint passes = 1;
+static gboolean json = FALSE;
+static gboolean verbose = FALSE;
+static gboolean micro = FALSE;
+
+static GOptionEntry entries[] = {
+	{"config", 'c', 0, G_OPTION_ARG_FILENAME, &config_file,
+		"Config file used for classification and full scan", NULL},
+	{"passes", 'n', 0, G_OPTION_ARG_INT, &passes,
+		"Number of passes over the messages (default: 1)", NULL},
+	{"json", 'j', 0, G_OPTION_ARG_NONE, &json,
+		"Print results as JSON", NULL},
+	{"verbose", 'v', 0, G_OPTION_ARG_NONE, &verbose,
+		"Log warnings from the scanned messages", NULL},
+	{"micro", 'm', 0, G_OPTION_ARG_NONE, &micro,
+		"Run micro benchmarks instead of messages processing", NULL},
+	{NULL, 0, 0, G_OPTION_ARG_NONE, NULL, NULL, NULL}
+};
+
+enum rspamd_bench_stage_type {
+	RSPAMD_BENCH_PARSE = 0,
+	RSPAMD_BENCH_URLS,
+	RSPAMD_BENCH_IMAGES,
+	RSPAMD_BENCH_CLASSIFY,
+	RSPAMD_BENCH_SCAN,
+	RSPAMD_BENCH_MAX
+};
+
+static const gchar *stage_names[RSPAMD_BENCH_MAX] = {
+	[RSPAMD_BENCH_PARSE] = "parse",
+	[RSPAMD_BENCH_URLS] = "urls",
+	[RSPAMD_BENCH_IMAGES] = "images",
+	[RSPAMD_BENCH_CLASSIFY] = "classify",
+	[RSPAMD_BENCH_SCAN] = "scan",
+};
+
+struct rspamd_bench_message {
+	gchar *fname;
+	gchar *data;
+	gsize len;
+	gboolean images_done;
+};
+
+struct rspamd_bench_stage {
+	GArray *latencies;
+	gdouble total;
+	guint64 bytes_allocated;
+	guint64 chunks_allocated;
+	guint64 tokens;
+};
+
+struct rspamd_bench_ctx {
+	struct rspamd_config *cfg;
+	struct event_base *ev_base;
+	struct rspamd_dns_resolver *resolver;
+	GPtrArray *messages;
+	struct rspamd_bench_stage stages[RSPAMD_BENCH_MAX];
+	guint64 re_bytes_scanned;
+	guint64 re_checked;
+	guint64 re_matched;
+	guint failed;
+	gboolean full;
+};
+
+static void
+rspamd_bench_logger (rspamd_mempool_t *pool, gpointer ud)
+{
+	struct rspamd_main *rm = ud;
+
+	rm->cfg->log_type = RSPAMD_LOG_CONSOLE;
+	rm->cfg->log_level = verbose ? G_LOG_LEVEL_WARNING : G_LOG_LEVEL_CRITICAL;
+
+	rspamd_set_logger (rm->cfg, g_quark_from_static_string ("rspamd-bench"),
+			&rm->logger, rm->server_pool);
+
+	if (rspamd_log_open (rm->logger) == -1) {
+		fprintf (stderr, "Fatal error, cannot open logfile, exiting\n");
+		exit (EXIT_FAILURE);
+	}
+}
+
+static gboolean
+rspamd_bench_load_config (struct rspamd_bench_ctx *ctx)
+{
+	struct rspamd_config *cfg = ctx->cfg;
+
+	cfg->cache = rspamd_symbols_cache_new (cfg);
+	cfg->compiled_modules = modules;
+	cfg->compiled_workers = workers;
+	cfg->cfg_name = config_file;
+
+	if (!rspamd_config_read (cfg, cfg->cfg_name, NULL,
+			rspamd_bench_logger, rspamd_main, NULL)) {
+		return FALSE;
+	}
+
+	rspamd_lua_post_load_config (cfg);
+
+	if (!rspamd_init_filters (cfg, FALSE)) {
+		return FALSE;
+	}
+
+	return rspamd_config_post_load (cfg, RSPAMD_CONFIG_LOAD_ALL);
+}
+
+static gboolean
+rspamd_bench_load_messages (struct rspamd_bench_ctx *ctx, const gchar *dir)
+{
+	GDir *d;
+	GError *err = NULL;
+	const gchar *name;
+	struct rspamd_bench_message *m;
+	gchar *path;
+
+	d = g_dir_open (dir, 0, &err);
+
+	if (d == NULL) {
+		rspamd_fprintf (stderr, "cannot open %s: %e\n", dir, err);
+		g_error_free (err);
+
+		return FALSE;
+	}
+
+	while ((name = g_dir_read_name (d)) != NULL) {
+		path = g_build_filename (dir, name, NULL);
+
+		if (!g_file_test (path, G_FILE_TEST_IS_REGULAR)) {
+			g_free (path);
+			continue;
+		}
+
+		m = g_slice_alloc0 (sizeof (*m));
+
+		if (!g_file_get_contents (path, &m->data, &m->len, &err)) {
+			rspamd_fprintf (stderr, "cannot read %s: %e\n", path, err);
+			g_error_free (err);
+			err = NULL;
+			g_slice_free1 (sizeof (*m), m);
+			g_free (path);
+			continue;
+		}
+
+		m->fname = path;
+		g_ptr_array_add (ctx->messages, m);
+	}
+
+	g_dir_close (d);
+
+	return ctx->messages->len > 0;
+}
+
+static gboolean
+rspamd_bench_task_fin (struct rspamd_task *task, void *ud)
+{
+	return TRUE;
+}
+
+static struct rspamd_task *
+rspamd_bench_task_new (struct rspamd_bench_ctx *ctx,
+		struct rspamd_bench_message *m)
+{
+	struct rspamd_task *task;
+
+	task = rspamd_task_new (NULL, ctx->cfg);
+	task->ev_base = ctx->ev_base;
+	task->resolver = ctx->resolver;
+	task->msg.begin = m->data;
+	task->msg.len = m->len;
+	task->fin_callback = rspamd_bench_task_fin;
+	task->s = rspamd_session_create (task->task_pool, rspamd_task_fin,
+			rspamd_task_restore, (event_finalizer_t)rspamd_task_free, task);
+
+	if (!rspamd_task_load_message (task, NULL, m->data, m->len)) {
+		rspamd_session_destroy (task->s);
+
+		return NULL;
+	}
+
+	return task;
+}
+
+/* Run the specified stages and wait for all asynchronous events */
+static void
+rspamd_bench_task_run (struct rspamd_bench_ctx *ctx, struct rspamd_task *task,
+		guint stages)
+{
+	if (rspamd_task_process (task, stages) &&
+			rspamd_session_events_pending (task->s) > 0) {
+		event_base_loop (ctx->ev_base, 0);
+	}
+}
+
+static void
+rspamd_bench_stage_add (struct rspamd_bench_stage *st, gdouble elapsed,
+		rspamd_mempool_stat_t *before, rspamd_mempool_stat_t *after)
+{
+	g_array_append_val (st->latencies, elapsed);
+	st->total += elapsed;
+	st->bytes_allocated += (guint)(after->bytes_allocated -
+			before->bytes_allocated);
+	st->chunks_allocated += (guint)(after->chunks_allocated -
+			before->chunks_allocated);
+}
+
+static void
+rspamd_bench_message (struct rspamd_bench_ctx *ctx,
+		struct rspamd_bench_message *m)
+{
+	struct rspamd_task *task;
+	struct rspamd_mime_text_part *part;
+	struct rspamd_mime_part *mime_part;
+	const struct rspamd_re_cache_stat *re_stat;
+	rspamd_mempool_stat_t before, after;
+	gdouble t1, t2;
+	guint i;
+
+	rspamd_mempool_stat (&before);
+	t1 = rspamd_get_ticks ();
+	task = rspamd_bench_task_new (ctx, m);
+
+	if (task == NULL || !rspamd_message_parse (task)) {
+		msg_err ("cannot parse message %s", m->fname);
+		ctx->failed ++;
+
+		if (task) {
+			rspamd_session_destroy (task->s);
+		}
+
+		return;
+	}
+
+	t2 = rspamd_get_ticks ();
+	rspamd_mempool_stat (&after);
+	rspamd_bench_stage_add (&ctx->stages[RSPAMD_BENCH_PARSE], t2 - t1,
+			&before, &after);
+
+	/* Urls are extracted on parsing, so here we extract them one more time */
+	rspamd_mempool_stat (&before);
+	t1 = rspamd_get_ticks ();
+
+	for (i = 0; i < task->text_parts->len; i ++) {
+		part = g_ptr_array_index (task->text_parts, i);
+
+		if (!IS_PART_EMPTY (part)) {
+			rspamd_url_text_extract (task->task_pool, task, part,
+					IS_PART_HTML (part));
+		}
+	}
+
+	t2 = rspamd_get_ticks ();
+	rspamd_mempool_stat (&after);
+	rspamd_bench_stage_add (&ctx->stages[RSPAMD_BENCH_URLS], t2 - t1,
+			&before, &after);
+
+	/*
+	 * Image fingerprints are cached by the parts digests, so only the first
+	 * pass measures the real decoding and normalization
+	 */
+	if (!m->images_done) {
+		gboolean has_images = FALSE;
+
+		m->images_done = TRUE;
+		rspamd_mempool_stat (&before);
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < task->parts->len; i ++) {
+			mime_part = g_ptr_array_index (task->parts, i);
+
+			if ((mime_part->flags & RSPAMD_MIME_PART_IMAGE) &&
+					mime_part->specific.img != NULL &&
+					!mime_part->specific.img->is_normalized) {
+				rspamd_image_normalize (task, mime_part->specific.img);
+				has_images = TRUE;
+			}
+		}
+
+		t2 = rspamd_get_ticks ();
+		rspamd_mempool_stat (&after);
+
+		if (has_images) {
+			rspamd_bench_stage_add (&ctx->stages[RSPAMD_BENCH_IMAGES], t2 - t1,
+					&before, &after);
+		}
+	}
+
+	if (ctx->full) {
+		task->processed_stages |= RSPAMD_TASK_STAGE_CONNECT |
+				RSPAMD_TASK_STAGE_ENVELOPE |
+				RSPAMD_TASK_STAGE_READ_MESSAGE;
+		rspamd_mempool_stat (&before);
+		t1 = rspamd_get_ticks ();
+		rspamd_bench_task_run (ctx, task, RSPAMD_TASK_STAGE_CLASSIFIERS_PRE |
+				RSPAMD_TASK_STAGE_CLASSIFIERS |
+				RSPAMD_TASK_STAGE_CLASSIFIERS_POST);
+		t2 = rspamd_get_ticks ();
+		rspamd_mempool_stat (&after);
+		rspamd_bench_stage_add (&ctx->stages[RSPAMD_BENCH_CLASSIFY], t2 - t1,
+				&before, &after);
+
+		if (task->tokens) {
+			ctx->stages[RSPAMD_BENCH_CLASSIFY].tokens += task->tokens->len;
+		}
+	}
+
+	rspamd_session_destroy (task->s);
+
+	if (!ctx->full) {
+		return;
+	}
+
+	/* Full scan from the raw message to the result */
+	rspamd_mempool_stat (&before);
+	t1 = rspamd_get_ticks ();
+	task = rspamd_bench_task_new (ctx, m);
+
+	if (task == NULL) {
+		ctx->failed ++;
+
+		return;
+	}
+
+	rspamd_bench_task_run (ctx, task, RSPAMD_TASK_PROCESS_ALL);
+	t2 = rspamd_get_ticks ();
+	rspamd_mempool_stat (&after);
+	rspamd_bench_stage_add (&ctx->stages[RSPAMD_BENCH_SCAN], t2 - t1,
+			&before, &after);
+
+	re_stat = rspamd_re_cache_get_stat (task->re_rt);
+
+	if (re_stat) {
+		ctx->re_bytes_scanned += re_stat->bytes_scanned;
+		ctx->re_checked += re_stat->regexp_checked;
+		ctx->re_matched += re_stat->regexp_matched;
+	}
+
+	rspamd_session_destroy (task->s);
+}
+
+static gint
+rspamd_bench_latency_cmp (gconstpointer a, gconstpointer b)
+{
+	const gdouble *d1 = a, *d2 = b;
+
+	if (*d1 < *d2) {
+		return -1;
+	}
+	else if (*d1 > *d2) {
+		return 1;
+	}
+
+	return 0;
+}
+
+static gdouble
+rspamd_bench_percentile (GArray *sorted, gdouble pct)
+{
+	guint idx;
+
+	if (sorted->len == 0) {
+		return 0;
+	}
+
+	idx = (guint)(pct * (sorted->len - 1) / 100.0 + 0.5);
+
+	return g_array_index (sorted, gdouble, MIN (idx, sorted->len - 1));
+}
+
+static ucl_object_t *
+rspamd_bench_stage_to_ucl (struct rspamd_bench_stage *st)
+{
+	ucl_object_t *obj;
+	guint n = st->latencies->len;
+
+	g_array_sort (st->latencies, rspamd_bench_latency_cmp);
+	obj = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (obj, ucl_object_fromint (n), "messages", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromdouble (st->total > 0 ? n / st->total : 0),
+			"msgs_per_sec", 0, false);
+	/* All latencies are in milliseconds */
+	ucl_object_insert_key (obj,
+			ucl_object_fromdouble (rspamd_bench_percentile (st->latencies,
+					50) * 1000.0),
+			"p50_ms", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromdouble (rspamd_bench_percentile (st->latencies,
+					90) * 1000.0),
+			"p90_ms", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromdouble (rspamd_bench_percentile (st->latencies,
+					99) * 1000.0),
+			"p99_ms", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromdouble (rspamd_bench_percentile (st->latencies,
+					100) * 1000.0),
+			"max_ms", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (n > 0 ? st->bytes_allocated / n : 0),
+			"pool_bytes_per_msg", 0, false);
+	ucl_object_insert_key (obj,
+			ucl_object_fromint (n > 0 ? st->chunks_allocated / n : 0),
+			"pool_chunks_per_msg", 0, false);
+
+	if (st->tokens > 0) {
+		ucl_object_insert_key (obj,
+				ucl_object_fromdouble (st->total > 0 ? st->tokens / st->total : 0),
+				"tokens_per_sec", 0, false);
+	}
+
+	return obj;
+}
+
+static void
+rspamd_bench_report (struct rspamd_bench_ctx *ctx)
+{
+	ucl_object_t *top, *stages, *obj, *re;
+	const ucl_object_t *cur;
+	ucl_object_iter_t it = NULL;
+	guchar *out;
+	guint i;
+
+	top = ucl_object_typed_new (UCL_OBJECT);
+	ucl_object_insert_key (top, ucl_object_fromstring (RVERSION),
+			"version", 0, false);
+	ucl_object_insert_key (top, ucl_object_fromint (ctx->messages->len),
+			"messages", 0, false);
+	ucl_object_insert_key (top, ucl_object_fromint (passes),
+			"passes", 0, false);
+	ucl_object_insert_key (top, ucl_object_fromint (ctx->failed),
+			"failed", 0, false);
+	stages = ucl_object_typed_new (UCL_OBJECT);
+
+	for (i = 0; i < RSPAMD_BENCH_MAX; i ++) {
+		if (ctx->stages[i].latencies->len > 0) {
+			ucl_object_insert_key (stages,
+					rspamd_bench_stage_to_ucl (&ctx->stages[i]),
+					stage_names[i], 0, false);
+		}
+	}
+
+	ucl_object_insert_key (top, stages, "stages", 0, false);
+
+	if (ctx->full) {
+		re = ucl_object_typed_new (UCL_OBJECT);
+		ucl_object_insert_key (re, ucl_object_fromint (ctx->re_bytes_scanned),
+				"bytes_scanned", 0, false);
+		ucl_object_insert_key (re, ucl_object_fromint (ctx->re_checked),
+				"regexp_checked", 0, false);
+		ucl_object_insert_key (re, ucl_object_fromint (ctx->re_matched),
+				"regexp_matched", 0, false);
+		ucl_object_insert_key (top, re, "re_cache", 0, false);
+	}
+
+	if (json) {
+		out = ucl_object_emit (top, UCL_EMIT_JSON);
+		rspamd_printf ("%s\n", out);
+		free (out);
+	}
+	else {
+		rspamd_printf ("rspamd %s: %ud messages, %d passes, %ud failed\n",
+				RVERSION, ctx->messages->len, passes, ctx->failed);
+		/* Padded columns are not supported by rspamd_printf */
+		printf ("%-10s %10s %10s %10s %10s %10s %12s\n",
+				"stage", "msgs/sec", "p50 ms", "p90 ms", "p99 ms", "max ms",
+				"bytes/msg");
+
+		while ((cur = ucl_object_iterate (stages, &it, true)) != NULL) {
+			printf ("%-10s %10.1f %10.3f %10.3f %10.3f %10.3f %12lld\n",
+					ucl_object_key (cur),
+					ucl_object_todouble (ucl_object_lookup (cur, "msgs_per_sec")),
+					ucl_object_todouble (ucl_object_lookup (cur, "p50_ms")),
+					ucl_object_todouble (ucl_object_lookup (cur, "p90_ms")),
+					ucl_object_todouble (ucl_object_lookup (cur, "p99_ms")),
+					ucl_object_todouble (ucl_object_lookup (cur, "max_ms")),
+					(long long)ucl_object_toint (ucl_object_lookup (cur,
+							"pool_bytes_per_msg")));
+		}
+
+		cur = ucl_object_lookup_path (stages, "classify.tokens_per_sec");
+
+		if (cur) {
+			rspamd_printf ("classify: %.1f tokens/sec\n",
+					ucl_object_todouble (cur));
+		}
+
+		if (ctx->full) {
+			rspamd_printf ("re cache: %L bytes scanned, %L regexps checked, "
+					"%L matched\n",
+					ctx->re_bytes_scanned, ctx->re_checked, ctx->re_matched);
+		}
+	}
+
+	ucl_object_unref (top);
+}
+
+int
+main (int argc, char **argv)
+{
+	struct rspamd_config *cfg;
+	struct rspamd_bench_ctx ctx;
+	struct rspamd_bench_message *m;
+	GOptionContext *context;
+	GError *err = NULL;
+	gint i;
+	guint j;
+
+	context = g_option_context_new ("<dir> - benchmark messages processing");
+	g_option_context_add_main_entries (context, entries, NULL);
+
+	if (!g_option_context_parse (context, &argc, &argv, &err)) {
+		rspamd_fprintf (stderr, "option parsing failed: %e\n", err);
+		g_error_free (err);
+		exit (EXIT_FAILURE);
+	}
+
+	if ((argc < 2 && !micro) || passes <= 0) {
+		rspamd_fprintf (stderr, "%s", g_option_context_get_help (context,
+				TRUE, NULL));
+		exit (EXIT_FAILURE);
+	}
+
+	rspamd_main = (struct rspamd_main *)g_malloc0 (sizeof (struct rspamd_main));
+	rspamd_main->server_pool = rspamd_mempool_new (rspamd_mempool_suggest_size (),
+			NULL);
+	cfg = rspamd_config_new ();
+	rspamd_main->cfg = cfg;
+	cfg->cfg_pool = rspamd_mempool_new (rspamd_mempool_suggest_size (), NULL);
+	rspamd_bench_logger (cfg->cfg_pool, rspamd_main);
+	g_log_set_default_handler (rspamd_glib_log_function, rspamd_main->logger);
+	cfg->libs_ctx = rspamd_init_libs ();
+
+	memset (&ctx, 0, sizeof (ctx));
+	ctx.cfg = cfg;
+	ctx.messages = g_ptr_array_new ();
+
+	for (i = 0; i < RSPAMD_BENCH_MAX; i ++) {
+		ctx.stages[i].latencies = g_array_new (FALSE, FALSE, sizeof (gdouble));
+	}
+
+	if (config_file) {
+		if (!rspamd_bench_load_config (&ctx)) {
+			rspamd_fprintf (stderr, "cannot load config %s\n", config_file);
+			exit (EXIT_FAILURE);
+		}
+
+		ctx.full = TRUE;
+	}
+	else {
+		rspamd_url_init (NULL);
+	}
+
+	ctx.ev_base = event_init ();
+	ctx.resolver = dns_resolver_init (rspamd_main->logger, ctx.ev_base, cfg);
+	rspamd_stat_init (cfg, ctx.ev_base);
+
+	if (micro) {
+		rspamd_bench_micro_run (passes);
+
+		exit (EXIT_SUCCESS);
+	}
+
+	if (!rspamd_bench_load_messages (&ctx, argv[1])) {
+		rspamd_fprintf (stderr, "no messages loaded from %s\n", argv[1]);
+		exit (EXIT_FAILURE);
+	}
+
+	for (i = 0; i < passes; i ++) {
+		for (j = 0; j < ctx.messages->len; j ++) {
+			m = g_ptr_array_index (ctx.messages, j);
+			rspamd_bench_message (&ctx, m);
+		}
+	}
+
+	rspamd_bench_report (&ctx);
+
+	for (j = 0; j < ctx.messages->len; j ++) {
+		m = g_ptr_array_index (ctx.messages, j);
+		g_free (m->data);
+		g_free (m->fname);
+		g_slice_free1 (sizeof (*m), m);
+	}
+
+	for (i = 0; i < RSPAMD_BENCH_MAX; i ++) {
+		g_array_free (ctx.stages[i].latencies, TRUE);
+	}
+
+	g_ptr_array_free (ctx.messages, TRUE);
+	g_option_context_free (context);
+	rspamd_regexp_library_finalize ();
+
+	return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef RSPAMD_BENCH_H
+#define RSPAMD_BENCH_H
+
+/*
+ * Micro benchmarks of separate subsystems, they are run by
+ * `rspamd-bench -m` and print their throughput to stdout
+ */
+void rspamd_bench_micro_run (gint passes);
+
+#endif
@@ -0,0 +1,523 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+/*
+ * Micro benchmarks that used to live in the unit tests: they measure a single
+ * subsystem on synthetic data, the unit tests check correctness only
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "fuzzy_wire.h"
+#include "fuzzy_backend_sqlite.h"
+#include "stat_internal.h"
+#include "libmime/mime_encoding.h"
+#include "lua/lua_common.h"
+#include "ottery.h"
+#include "unix-std.h"
+#include "rspamd_bench.h"
+#include <iconv.h>
+
+struct rspamd_bench_micro {
+	const gchar *name;
+	void (*func) (gint passes);
+};
+
+static void
+rspamd_bench_fuzzy_shingle_cmd (struct rspamd_fuzzy_shingle_cmd *cmd)
+{
+	memset (cmd, 0, sizeof (*cmd));
+	cmd->basic.version = RSPAMD_FUZZY_VERSION;
+	cmd->basic.cmd = FUZZY_WRITE;
+	cmd->basic.shingles_count = RSPAMD_SHINGLE_SIZE;
+	cmd->basic.flag = 1;
+	cmd->basic.value = 1;
+	ottery_rand_bytes (cmd->basic.digest, sizeof (cmd->basic.digest));
+	ottery_rand_bytes (cmd->sgl.hashes, sizeof (cmd->sgl.hashes));
+}
+
+/* Shingles lookups in the sqlite fuzzy backend */
+static void
+rspamd_bench_fuzzy_sqlite (gint passes)
+{
+	const guint hashes_count = 20000, checks_count = 20000;
+	struct rspamd_fuzzy_backend_sqlite *bk;
+	struct rspamd_fuzzy_shingle_cmd *cmds, cmd;
+	GError *err = NULL;
+	gchar path[PATH_MAX];
+	gdouble t1, t2;
+	guint i;
+	gint fd, n;
+
+	rspamd_snprintf (path, sizeof (path), "%s%crspamd-fuzzy-bench-XXXXXX",
+			g_get_tmp_dir (), G_DIR_SEPARATOR);
+	fd = mkstemp (path);
+	g_assert (fd != -1);
+	close (fd);
+	unlink (path);
+
+	bk = rspamd_fuzzy_backend_sqlite_open (path, FALSE, &err);
+
+	if (bk == NULL) {
+		rspamd_fprintf (stderr, "cannot open %s: %e\n", path, err);
+		g_error_free (err);
+
+		return;
+	}
+
+	cmds = g_malloc (sizeof (*cmds) * hashes_count);
+	t1 = rspamd_get_ticks ();
+	rspamd_fuzzy_backend_sqlite_prepare_update (bk, "bench");
+
+	for (i = 0; i < hashes_count; i ++) {
+		rspamd_bench_fuzzy_shingle_cmd (&cmds[i]);
+		rspamd_fuzzy_backend_sqlite_add (bk, &cmds[i].basic);
+	}
+
+	rspamd_fuzzy_backend_sqlite_finish_update (bk, "bench", TRUE);
+	t2 = rspamd_get_ticks ();
+	rspamd_printf ("fuzzy_sqlite: %.0f adds/sec\n", hashes_count / (t2 - t1));
+
+	for (n = 0; n < passes; n ++) {
+		/* Direct digests are unknown, so shingles are used */
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < checks_count; i ++) {
+			memcpy (&cmd, &cmds[ottery_rand_range (hashes_count - 1)],
+					sizeof (cmd));
+			cmd.basic.cmd = FUZZY_CHECK;
+			ottery_rand_bytes (cmd.basic.digest, sizeof (cmd.basic.digest));
+			cmd.sgl.hashes[ottery_rand_range (RSPAMD_SHINGLE_SIZE - 1)] =
+					ottery_rand_uint64 ();
+			(void)rspamd_fuzzy_backend_sqlite_check (bk, &cmd.basic, 86400);
+		}
+
+		t2 = rspamd_get_ticks ();
+		rspamd_printf ("fuzzy_sqlite: %.0f shingle matches/sec\n",
+				checks_count / (t2 - t1));
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < checks_count; i ++) {
+			rspamd_bench_fuzzy_shingle_cmd (&cmd);
+			cmd.basic.cmd = FUZZY_CHECK;
+			(void)rspamd_fuzzy_backend_sqlite_check (bk, &cmd.basic, 86400);
+		}
+
+		t2 = rspamd_get_ticks ();
+		rspamd_printf ("fuzzy_sqlite: %.0f shingle misses/sec\n",
+				checks_count / (t2 - t1));
+	}
+
+	rspamd_fuzzy_backend_sqlite_close (bk);
+	g_free (cmds);
+	unlink (path);
+}
+
+#ifdef WITH_HIREDIS
+/*
+ * Per token printf based encoding used before batching: HMGET query or
+ * a separate HINCRBY/HINCRBYFLOAT command for each learned token
+ */
+static rspamd_fstring_t *
+rspamd_bench_legacy_tokens_to_query (struct rspamd_stat_tokens *tokens,
+		const gchar *arg0, const gchar *arg1, gboolean learn, gint idx,
+		gboolean intvals)
+{
+	rspamd_fstring_t *out;
+	gchar n0[64], n1[64];
+	guint i, l0, l1, larg0, larg1;
+	gdouble *values;
+
+	larg0 = strlen (arg0);
+	larg1 = strlen (arg1);
+	values = rspamd_stat_tokens_values (tokens, idx);
+	out = rspamd_fstring_sized_new (1024);
+
+	if (!learn) {
+		rspamd_printf_fstring (&out, ""
+				"*%d\r\n"
+				"$%d\r\n"
+				"%s\r\n"
+				"$%d\r\n"
+				"%s\r\n",
+				(tokens->len + 2),
+				larg0, arg0,
+				larg1, arg1);
+	}
+
+	for (i = 0; i < tokens->len; i ++) {
+		l0 = rspamd_snprintf (n0, sizeof (n0), "%uL", tokens->data[i]);
+
+		if (learn) {
+			rspamd_printf_fstring (&out, ""
+					"*4\r\n"
+					"$%d\r\n"
+					"%s\r\n"
+					"$%d\r\n"
+					"%s\r\n",
+					larg0, arg0,
+					larg1, arg1);
+
+			if (intvals) {
+				l1 = rspamd_snprintf (n1, sizeof (n1), "%L",
+						(gint64)values[i]);
+			}
+			else {
+				l1 = rspamd_snprintf (n1, sizeof (n1), "%f", values[i]);
+			}
+
+			rspamd_printf_fstring (&out, ""
+					"$%d\r\n"
+					"%s\r\n"
+					"$%d\r\n"
+					"%s\r\n", l0, n0, l1, n1);
+		}
+		else {
+			rspamd_printf_fstring (&out, ""
+					"$%d\r\n"
+					"%s\r\n", l0, n0);
+		}
+	}
+
+	return out;
+}
+
+/* Encoding of statistics tokens for redis: legacy printf against batched */
+static void
+rspamd_bench_redis_stat (gint passes)
+{
+	const guint tokens_count = 5000, iterations = 200;
+	struct rspamd_stat_tokens *tokens;
+	rspamd_fstring_t *out;
+	gdouble t1, t2;
+	guint i;
+	gint n, binary;
+
+	tokens = rspamd_stat_tokens_new (tokens_count, 1);
+
+	for (i = 0; i < tokens_count; i ++) {
+		rspamd_stat_tokens_add (tokens,
+				ottery_rand_uint64 () >> ottery_rand_range (63), 1);
+		rspamd_stat_tokens_values (tokens, 0)[i] = (i % 2) ? 1.0 : -1.0;
+	}
+
+	for (n = 0; n < passes; n ++) {
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < iterations; i ++) {
+			out = rspamd_bench_legacy_tokens_to_query (tokens, "HMGET",
+					"BAYES_SPAM", FALSE, 0, FALSE);
+			rspamd_fstring_free (out);
+		}
+
+		t2 = rspamd_get_ticks ();
+		rspamd_printf ("redis_stat: legacy HMGET of %ud tokens: %.3f ms\n",
+				tokens_count, (t2 - t1) * 1000.0 / iterations);
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < iterations; i ++) {
+			out = rspamd_bench_legacy_tokens_to_query (tokens, "HINCRBYFLOAT",
+					"BAYES_SPAM", TRUE, 0, FALSE);
+			rspamd_fstring_free (out);
+		}
+
+		t2 = rspamd_get_ticks ();
+		rspamd_printf ("redis_stat: legacy HINCRBYFLOAT per token of %ud "
+				"tokens: %.3f ms\n",
+				tokens_count, (t2 - t1) * 1000.0 / iterations);
+
+		for (binary = 0; binary <= 1; binary ++) {
+			t1 = rspamd_get_ticks ();
+
+			for (i = 0; i < iterations; i ++) {
+				out = rspamd_redis_tokens_to_query (tokens, "HMGET",
+						"BAYES_SPAM", binary);
+				rspamd_fstring_free (out);
+			}
+
+			t2 = rspamd_get_ticks ();
+			rspamd_printf ("redis_stat: %s HMGET of %ud tokens: %.3f ms\n",
+					binary ? "binary" : "text", tokens_count,
+					(t2 - t1) * 1000.0 / iterations);
+			t1 = rspamd_get_ticks ();
+
+			for (i = 0; i < iterations; i ++) {
+				out = rspamd_redis_tokens_to_learn_args (tokens, 0, FALSE,
+						binary);
+				rspamd_fstring_free (out);
+			}
+
+			t2 = rspamd_get_ticks ();
+			rspamd_printf ("redis_stat: %s learn args of %ud tokens: %.3f ms\n",
+					binary ? "binary" : "text", tokens_count,
+					(t2 - t1) * 1000.0 / iterations);
+		}
+	}
+
+	rspamd_stat_tokens_free (tokens);
+}
+#endif
+
+/* Charset conversions: cached converters against iconv_open per call */
+static void
+rspamd_bench_charsets (gint passes)
+{
+	static const struct {
+		const gchar *charset;
+		const gchar *sample;
+	} charsets[] = {
+		{"windows-1251", "Съешь же ещё этих мягких французских булок, да выпей чаю. "},
+		{"koi8-r", "Съешь же ещё этих мягких французских булок, да выпей чаю. "},
+		{"iso-8859-7", "Ταχίστη αλώπηξ βαφής ψημένη γη, δρασκελίζει υπέρ νωθρού κυνός. "},
+		{"windows-1250", "Příliš žluťoučký kůň úpěl ďábelské ódy. "},
+		{"shift_jis", "いろはにほへと ちりぬるを わかよたれそ つねならむ "},
+	};
+	const guint conversions_count = 20000;
+	const gsize message_size = 4096;
+	GByteArray *utf, *in, *out;
+	iconv_t ic;
+	gchar *enc, *src, *dst;
+	gsize slen, enclen, inremain, remain;
+	gdouble t1, t2, t3;
+	guint i, j;
+	gint n;
+
+	out = g_byte_array_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (charsets); i ++) {
+		slen = strlen (charsets[i].sample);
+		utf = g_byte_array_sized_new (message_size + slen);
+
+		while (utf->len < message_size) {
+			g_byte_array_append (utf, (const guint8 *)charsets[i].sample, slen);
+		}
+
+		enc = g_convert ((const gchar *)utf->data, utf->len, charsets[i].charset,
+				"UTF-8", NULL, &enclen, NULL);
+		g_assert (enc != NULL);
+		in = g_byte_array_new_take ((guint8 *)enc, enclen);
+
+		for (n = 0; n < passes; n ++) {
+			t1 = rspamd_get_ticks ();
+
+			for (j = 0; j < conversions_count; j ++) {
+				ic = iconv_open ("UTF-8", charsets[i].charset);
+				g_byte_array_set_size (out, in->len * 3);
+				src = (gchar *)in->data;
+				dst = (gchar *)out->data;
+				inremain = in->len;
+				remain = out->len;
+				(void)iconv (ic, &src, &inremain, &dst, &remain);
+				iconv_close (ic);
+			}
+
+			t2 = rspamd_get_ticks ();
+
+			for (j = 0; j < conversions_count; j ++) {
+				(void)rspamd_mime_to_utf8_byte_array (in, out,
+						charsets[i].charset);
+			}
+
+			t3 = rspamd_get_ticks ();
+			rspamd_printf ("charsets: %s, %ud bytes: iconv per call "
+					"%.0f conversions/sec, cached %.0f conversions/sec\n",
+					charsets[i].charset, in->len,
+					conversions_count / (t2 - t1),
+					conversions_count / (t3 - t2));
+		}
+
+		g_byte_array_free (in, TRUE);
+		g_byte_array_free (utf, TRUE);
+	}
+
+	g_byte_array_free (out, TRUE);
+}
+
+/* Per character glib based histogram as it has been done before */
+static guint
+rspamd_bench_legacy_scripts_histogram (const gchar *p, gsize len, guint *hist)
+{
+	const gchar *pp;
+	gunichar c;
+	gssize remain = len;
+	GUnicodeScript sc;
+	guint nalpha = 0;
+
+	while (remain > 0) {
+		c = g_utf8_get_char_validated (p, remain);
+
+		if (c == (gunichar) -2 || c == (gunichar) -1) {
+			break;
+		}
+
+		if (g_unichar_isalpha (c)) {
+			sc = g_unichar_get_script (c);
+
+			if (sc >= 0 && sc < RSPAMD_UNICODE_SCRIPTS_MAX) {
+				hist[sc] ++;
+			}
+
+			nalpha ++;
+		}
+
+		pp = g_utf8_next_char (p);
+		remain -= pp - p;
+		p = pp;
+	}
+
+	return nalpha;
+}
+
+/* Unicode scripts histogram of text parts */
+static void
+rspamd_bench_scripts (gint passes)
+{
+	const gsize corpus_size = 4 * 1024 * 1024;
+	static const struct {
+		const gchar *name;
+		const gchar *sample;
+	} corpora[] = {
+		{"latin", "The quick brown fox jumps over the lazy dog, 1234567890. "},
+		{"cyrillic", "Съешь же ещё этих мягких французских булок, да выпей чаю. "},
+		{"han", "我能吞下玻璃而不伤身体。天地玄黄，宇宙洪荒。"},
+	};
+	guint hist[RSPAMD_UNICODE_SCRIPTS_MAX];
+	GString *corpus;
+	gsize slen;
+	gdouble t1, t2, t3;
+	guint i;
+	gint n;
+
+	for (i = 0; i < G_N_ELEMENTS (corpora); i ++) {
+		slen = strlen (corpora[i].sample);
+		corpus = g_string_sized_new (corpus_size + slen);
+
+		while (corpus->len < corpus_size) {
+			g_string_append_len (corpus, corpora[i].sample, slen);
+		}
+
+		for (n = 0; n < passes; n ++) {
+			memset (hist, 0, sizeof (hist));
+			t1 = rspamd_get_ticks ();
+			(void)rspamd_bench_legacy_scripts_histogram (corpus->str,
+					corpus->len, hist);
+			t2 = rspamd_get_ticks ();
+			memset (hist, 0, sizeof (hist));
+			(void)rspamd_str_scripts_histogram (corpus->str, corpus->len, hist);
+			t3 = rspamd_get_ticks ();
+			rspamd_printf ("scripts: %s, %uz bytes: legacy %.2f Mb/sec, "
+					"table %.2f Mb/sec\n",
+					corpora[i].name, corpus->len,
+					corpus->len / (t2 - t1) / (1024.0 * 1024.0),
+					corpus->len / (t3 - t2) / (1024.0 * 1024.0));
+		}
+
+		g_string_free (corpus, TRUE);
+	}
+}
+
+/* Class check as it has been done before metatables got registry keys */
+static void *
+rspamd_bench_lua_check_by_name (lua_State *L, gint pos, const gchar *classname)
+{
+	void *p = lua_touserdata (L, pos);
+
+	if (p && lua_getmetatable (L, pos)) {
+		luaL_getmetatable (L, classname);
+
+		if (!lua_rawequal (L, -1, -2)) {
+			p = NULL;
+		}
+
+		lua_pop (L, 2);
+	}
+	else {
+		p = NULL;
+	}
+
+	return p;
+}
+
+/* Checks of lua userdata class: names lookup against registry keys */
+static void
+rspamd_bench_lua_class (gint passes)
+{
+	const guint checks_count = 10000000;
+	struct rspamd_lua_text *t;
+	lua_State *L, *thread;
+	gdouble t1, t2, t3, t4;
+	guint i, found;
+	gint n;
+
+	L = rspamd_lua_init ();
+	t = lua_newuserdata (L, sizeof (*t));
+	memset (t, 0, sizeof (*t));
+	rspamd_lua_setclass (L, "rspamd{text}", -1);
+	/* Coroutines share registry with the main state */
+	thread = lua_newthread (L);
+	lua_pushvalue (L, -2);
+	lua_xmove (L, thread, 1);
+
+	for (n = 0; n < passes; n ++) {
+		found = 0;
+		t1 = rspamd_get_ticks ();
+
+		for (i = 0; i < checks_count; i ++) {
+			found += rspamd_bench_lua_check_by_name (L, -2,
+					"rspamd{text}") != NULL;
+		}
+
+		t2 = rspamd_get_ticks ();
+
+		for (i = 0; i < checks_count; i ++) {
+			found += lua_check_text (L, -2) != NULL;
+		}
+
+		t3 = rspamd_get_ticks ();
+
+		for (i = 0; i < checks_count; i ++) {
+			found += lua_check_text (thread, -1) != NULL;
+		}
+
+		t4 = rspamd_get_ticks ();
+		g_assert (found == checks_count * 3);
+		rspamd_printf ("lua_class: names lookup %.1f ns/check, registry key "
+				"%.1f ns/check, registry key in coroutine %.1f ns/check\n",
+				(t2 - t1) * 1e9 / checks_count,
+				(t3 - t2) * 1e9 / checks_count,
+				(t4 - t3) * 1e9 / checks_count);
+	}
+
+	lua_close (L);
+}
+
+static const struct rspamd_bench_micro micro_benches[] = {
+	{"fuzzy_sqlite", rspamd_bench_fuzzy_sqlite},
+#ifdef WITH_HIREDIS
+	{"redis_stat", rspamd_bench_redis_stat},
+#endif
+	{"charsets", rspamd_bench_charsets},
+	{"scripts", rspamd_bench_scripts},
+	{"lua_class", rspamd_bench_lua_class},
+};
+
+void
+rspamd_bench_micro_run (gint passes)
+{
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (micro_benches); i ++) {
+		micro_benches[i].func (passes);
+	}
+}
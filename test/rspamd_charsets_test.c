@@ -0,0 +1,106 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "libmime/mime_encoding.h"
+#include "tests.h"
+#include <iconv.h>
+
+static const guint conversions_rounds = 3;
+static const gsize message_size = 4096;
+
+static const struct {
+	const gchar *charset;
+	const gchar *sample;
+} charsets[] = {
+	{"windows-1251", "Съешь же ещё этих мягких французских булок, да выпей чаю. "},
+	{"koi8-r", "Съешь же ещё этих мягких французских булок, да выпей чаю. "},
+	{"iso-8859-7", "Ταχίστη αλώπηξ βαφής ψημένη γη, δρασκελίζει υπέρ νωθρού κυνός. "},
+	{"windows-1250", "Příliš žluťoučký kůň úpěl ďábelské ódy. "},
+	{"shift_jis", "いろはにほへと ちりぬるを わかよたれそ つねならむ "},
+};
+
+/* Conversion with a new iconv descriptor per call as used previously */
+static void
+legacy_to_utf8 (GByteArray *in, GByteArray *out, const gchar *enc)
+{
+	iconv_t ic;
+	gchar *s, *d;
+	gsize inremain, remain;
+
+	ic = iconv_open ("UTF-8", enc);
+	g_assert (ic != (iconv_t)-1);
+	g_byte_array_set_size (out, in->len * 3);
+	s = (gchar *)in->data;
+	d = (gchar *)out->data;
+	inremain = in->len;
+	remain = out->len;
+	g_assert (iconv (ic, &s, &inremain, &d, &remain) != (gsize)-1);
+	out->len = d - (gchar *)out->data;
+	iconv_close (ic);
+}
+
+void
+rspamd_charsets_test_func (void)
+{
+	GByteArray *utf, *in[G_N_ELEMENTS (charsets)], *old_out, *new_out;
+	gchar *enc;
+	gsize slen, enclen;
+	guint i, round;
+
+	old_out = g_byte_array_new ();
+	new_out = g_byte_array_new ();
+
+	for (i = 0; i < G_N_ELEMENTS (charsets); i ++) {
+		slen = strlen (charsets[i].sample);
+		utf = g_byte_array_sized_new (message_size + slen);
+
+		while (utf->len < message_size) {
+			g_byte_array_append (utf, (const guint8 *)charsets[i].sample, slen);
+		}
+
+		enc = g_convert ((const gchar *)utf->data, utf->len, charsets[i].charset,
+				"UTF-8", NULL, &enclen, NULL);
+		g_assert (enc != NULL);
+		in[i] = g_byte_array_new_take ((guint8 *)enc, enclen);
+
+		legacy_to_utf8 (in[i], old_out, charsets[i].charset);
+		g_assert_cmpuint (old_out->len, ==, utf->len);
+		g_assert (memcmp (old_out->data, utf->data, utf->len) == 0);
+		g_byte_array_free (utf, TRUE);
+	}
+
+	/*
+	 * Charsets are interleaved, so the cached converters are reused after
+	 * other conversions and must give the same output as a fresh iconv
+	 */
+	for (round = 0; round < conversions_rounds; round ++) {
+		for (i = 0; i < G_N_ELEMENTS (charsets); i ++) {
+			legacy_to_utf8 (in[i], old_out, charsets[i].charset);
+			g_assert (rspamd_mime_to_utf8_byte_array (in[i], new_out,
+					charsets[i].charset));
+			g_assert_cmpuint (new_out->len, ==, old_out->len);
+			g_assert (memcmp (new_out->data, old_out->data, old_out->len) == 0);
+		}
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (charsets); i ++) {
+		g_byte_array_free (in[i], TRUE);
+	}
+
+	g_byte_array_free (old_out, TRUE);
+	g_byte_array_free (new_out, TRUE);
+}
@@ -19,11 +19,14 @@
 #include "fstring.h"
 #include "ottery.h"
 #include "cryptobox.h"
+#include "libcryptobox/base64/base64.h"
 #include "unix-std.h"
 
 static const int mapping_size = 64 * 8192 + 1;
 static const int max_seg = 32;
 static const int random_fuzz_cnt = 10000;
+static const gsize base64_bench_len = 1024 * 1024;
+static const gsize base64_bench_iters = 100;
 enum rspamd_cryptobox_mode mode = RSPAMD_CRYPTOBOX_MODE_25519;
 
 static void *
@@ -152,6 +155,105 @@ create_constrainted_split (struct rspamd_cryptobox_segment *seg, int mseg,
 	return used;
 }
 
+static void
+base64_bench (void)
+{
+	gdouble t;
+	gdouble mb = (gdouble)base64_bench_len * base64_bench_iters / (1024 * 1024);
+
+	t = base64_test (TRUE, base64_bench_iters, base64_bench_len, FALSE);
+	msg_info ("base64 generic encode: %.1f Mb/sec", mb / t);
+	t = base64_test (FALSE, base64_bench_iters, base64_bench_len, FALSE);
+	msg_info ("base64 optimized encode: %.1f Mb/sec", mb / t);
+	t = base64_test (TRUE, base64_bench_iters, base64_bench_len, TRUE);
+	msg_info ("base64 generic decode: %.1f Mb/sec", mb / t);
+	t = base64_test (FALSE, base64_bench_iters, base64_bench_len, TRUE);
+	msg_info ("base64 optimized decode: %.1f Mb/sec", mb / t);
+}
+
+static void
+base64_check_folded (void)
+{
+	guchar in[1024], out[1024 + 32];
+	gchar *enc;
+	gsize len, enclen, outlen;
+
+	ottery_rand_bytes (in, sizeof (in));
+
+	/* MIME bodies have CRLF after each 76 characters */
+	for (len = 1; len <= sizeof (in); len ++) {
+		enc = rspamd_encode_base64 (in, len, 76, &enclen);
+		base64_test_decode (enc, enclen);
+
+		/* Padding split by line break is not decoded, even by generic code */
+		if (len % 3 == 0) {
+			while (enclen > 0 && g_ascii_isspace (enc[enclen - 1])) {
+				enclen --;
+			}
+
+			g_assert (rspamd_cryptobox_base64_decode (enc, enclen,
+					out, &outlen));
+			g_assert_cmpuint (outlen, ==, len);
+			g_assert (memcmp (in, out, len) == 0);
+		}
+
+		g_free (enc);
+	}
+}
+
+static void
+base64_check_invalid (void)
+{
+	static const gchar invalid[] = {'!', '-', '.', '\0', '\x80', '\xff', '\n'};
+	guchar in[96];
+	gchar *enc, *tmp;
+	gsize enclen;
+	guint pos, i;
+
+	ottery_rand_bytes (in, sizeof (in));
+	enc = rspamd_encode_base64 (in, sizeof (in), 0, &enclen);
+	tmp = g_malloc (enclen);
+
+	/* Invalid character at every position of two 32 bytes blocks */
+	for (pos = 0; pos < 64; pos ++) {
+		for (i = 0; i < G_N_ELEMENTS (invalid); i ++) {
+			memcpy (tmp, enc, enclen);
+			tmp[pos] = invalid[i];
+			base64_test_decode (tmp, enclen);
+		}
+	}
+
+	g_free (tmp);
+	g_free (enc);
+}
+
+static void
+base64_check_padding (void)
+{
+	guchar in[96];
+	gchar *enc, *tmp;
+	gsize enclen;
+	guint pos;
+
+	ottery_rand_bytes (in, sizeof (in));
+	enc = rspamd_encode_base64 (in, sizeof (in), 0, &enclen);
+	tmp = g_malloc (enclen);
+
+	for (pos = 0; pos < 64; pos ++) {
+		memcpy (tmp, enc, enclen);
+		tmp[pos] = '=';
+		base64_test_decode (tmp, enclen);
+		tmp[pos + 1] = '=';
+		base64_test_decode (tmp, enclen);
+		/* Input ends right after padding */
+		base64_test_decode (tmp, pos + 2);
+		base64_test_decode (tmp, pos + 1);
+	}
+
+	g_free (tmp);
+	g_free (enc);
+}
+
 void
 rspamd_cryptobox_test_func (void)
 {
@@ -165,6 +267,18 @@ rspamd_cryptobox_test_func (void)
 	gint i, cnt, ms;
 	gboolean checked_openssl = FALSE;
 
+	/* Optimized base64 must round trip with the generic decoder */
+	for (i = 1; i < 256; i ++) {
+		base64_test (FALSE, 1, i, FALSE);
+		base64_test (FALSE, 1, i, TRUE);
+	}
+
+	/* Vector decoders must handle bad input as the generic one does */
+	base64_check_folded ();
+	base64_check_invalid ();
+	base64_check_padding ();
+	base64_bench ();
+
 	map = create_mapping (mapping_size, &begin, &end);
 
 	ottery_rand_bytes (key, sizeof (key));
@@ -0,0 +1,117 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "fuzzy_wire.h"
+#include "fuzzy_backend_sqlite.h"
+#include "ottery.h"
+#include "unix-std.h"
+#include "tests.h"
+
+static const guint hashes_count = 1000;
+static const guint checks_count = 1000;
+static const gint64 test_expire = 86400;
+
+static void
+generate_shingle_cmd (struct rspamd_fuzzy_shingle_cmd *cmd)
+{
+	memset (cmd, 0, sizeof (*cmd));
+	cmd->basic.version = RSPAMD_FUZZY_VERSION;
+	cmd->basic.cmd = FUZZY_WRITE;
+	cmd->basic.shingles_count = RSPAMD_SHINGLE_SIZE;
+	cmd->basic.flag = 1;
+	cmd->basic.value = 1;
+	ottery_rand_bytes (cmd->basic.digest, sizeof (cmd->basic.digest));
+	ottery_rand_bytes (cmd->sgl.hashes, sizeof (cmd->sgl.hashes));
+}
+
+void
+rspamd_fuzzy_sqlite_test_func (void)
+{
+	struct rspamd_fuzzy_backend_sqlite *bk;
+	struct rspamd_fuzzy_shingle_cmd *cmds, cmd;
+	struct rspamd_fuzzy_reply rep;
+	GError *err = NULL;
+	gchar path[PATH_MAX];
+	guint i, found;
+	gint fd;
+
+	rspamd_snprintf (path, sizeof (path), "%s%crspamd-fuzzy-test-XXXXXX",
+			g_get_tmp_dir (), G_DIR_SEPARATOR);
+	fd = mkstemp (path);
+	g_assert (fd != -1);
+	close (fd);
+	unlink (path);
+
+	bk = rspamd_fuzzy_backend_sqlite_open (path, FALSE, &err);
+	g_assert (bk != NULL);
+
+	cmds = g_malloc (sizeof (*cmds) * hashes_count);
+
+	/* Synthetic database */
+	g_assert (rspamd_fuzzy_backend_sqlite_prepare_update (bk, "test"));
+
+	for (i = 0; i < hashes_count; i ++) {
+		generate_shingle_cmd (&cmds[i]);
+		g_assert (rspamd_fuzzy_backend_sqlite_add (bk, &cmds[i].basic));
+	}
+
+	g_assert (rspamd_fuzzy_backend_sqlite_finish_update (bk, "test", TRUE));
+	g_assert (rspamd_fuzzy_backend_sqlite_count (bk) == hashes_count);
+
+	/* Fuzzy matches: direct digest is unknown, so shingles are used */
+	found = 0;
+
+	for (i = 0; i < checks_count; i ++) {
+		memcpy (&cmd, &cmds[ottery_rand_range (hashes_count - 1)],
+				sizeof (cmd));
+		cmd.basic.cmd = FUZZY_CHECK;
+		ottery_rand_bytes (cmd.basic.digest, sizeof (cmd.basic.digest));
+		/* Change some shingles to emulate a similar message */
+		cmd.sgl.hashes[ottery_rand_range (RSPAMD_SHINGLE_SIZE - 1)] =
+				ottery_rand_uint64 ();
+		cmd.sgl.hashes[ottery_rand_range (RSPAMD_SHINGLE_SIZE - 1)] =
+				ottery_rand_uint64 ();
+
+		rep = rspamd_fuzzy_backend_sqlite_check (bk, &cmd.basic, test_expire);
+
+		if (rep.prob > 0.5) {
+			found ++;
+		}
+	}
+
+	g_assert_cmpuint (found, ==, checks_count);
+
+	/* Misses */
+	found = 0;
+
+	for (i = 0; i < checks_count; i ++) {
+		generate_shingle_cmd (&cmd);
+		cmd.basic.cmd = FUZZY_CHECK;
+
+		rep = rspamd_fuzzy_backend_sqlite_check (bk, &cmd.basic, test_expire);
+
+		if (rep.prob > 0.5) {
+			found ++;
+		}
+	}
+
+	g_assert_cmpuint (found, ==, 0);
+
+	rspamd_fuzzy_backend_sqlite_close (bk);
+	g_free (cmds);
+	unlink (path);
+}
@@ -221,7 +221,8 @@ rspamd_http_start_servers (pid_t *sfd, rspamd_inet_addr_t *addr,
 	guint i;
 	gint fd;
 
-	g_assert ((fd = rspamd_inet_address_listen (addr, SOCK_STREAM, TRUE)) != -1);
+	g_assert ((fd = rspamd_inet_address_listen (addr, SOCK_STREAM,
+			RSPAMD_INET_ADDRESS_LISTEN_ASYNC)) != -1);
 
 	for (i = 0; i < nservers; i ++) {
 		sfd[i] = fork ();
@@ -494,3 +495,167 @@ rspamd_http_test_func (void)
 	unlink (filepath);
 	rspamd_http_stop_servers (sfd);
 }
+
+/*
+ * Keep-alive server that passes connection to a new request after each reply
+ * like the normal worker does
+ */
+struct keepalive_test_req {
+	struct event_base *ev_base;
+	gint fd;
+	guint nreq;
+};
+
+static guint keepalive_live_reqs = 0;
+static gboolean keepalive_eof = FALSE;
+
+static struct keepalive_test_req *
+rspamd_keepalive_req_new (struct event_base *ev_base, gint fd, guint nreq)
+{
+	struct keepalive_test_req *req;
+
+	req = g_malloc0 (sizeof (*req));
+	req->ev_base = ev_base;
+	req->fd = fd;
+	req->nreq = nreq;
+	keepalive_live_reqs ++;
+
+	return req;
+}
+
+static void
+rspamd_keepalive_req_free (struct keepalive_test_req *req)
+{
+	g_assert (keepalive_live_reqs > 0);
+	keepalive_live_reqs --;
+	g_free (req);
+}
+
+static void
+rspamd_keepalive_server_err (struct rspamd_http_connection *conn, GError *err)
+{
+	struct keepalive_test_req *req = conn->ud;
+
+	/* Peer has closed idle connection after the first request */
+	g_assert (strstr (err->message, "EOF") != NULL);
+	g_assert_cmpuint (req->nreq, ==, 1);
+	keepalive_eof = TRUE;
+	close (req->fd);
+	event_base_loopexit (req->ev_base, NULL);
+	rspamd_keepalive_req_free (req);
+	rspamd_http_connection_unref (conn);
+}
+
+static gint
+rspamd_keepalive_server_finish (struct rspamd_http_connection *conn,
+	struct rspamd_http_message *msg)
+{
+	struct keepalive_test_req *req = conn->ud, *next;
+	struct rspamd_http_message *reply;
+
+	if (msg->type == HTTP_REQUEST) {
+		reply = rspamd_http_new_message (HTTP_RESPONSE);
+		reply->date = time (NULL);
+		reply->code = 200;
+		reply->status = rspamd_fstring_new_init ("OK", 2);
+		rspamd_http_connection_reset (conn);
+		rspamd_http_connection_write_message (conn, reply, NULL,
+				"text/plain", req, req->fd, NULL, req->ev_base);
+	}
+	else {
+		/* Reply has been written, wait for the next request */
+		g_assert (rspamd_http_connection_is_keepalive (conn));
+		next = rspamd_keepalive_req_new (req->ev_base, req->fd,
+				req->nreq + 1);
+		rspamd_keepalive_req_free (req);
+		rspamd_http_connection_reset (conn);
+		rspamd_http_connection_read_message (conn, next, next->fd, NULL,
+				next->ev_base);
+	}
+
+	return 0;
+}
+
+struct keepalive_test_client {
+	struct event ev;
+	GString *reply;
+};
+
+static void
+rspamd_keepalive_client_read (gint fd, short what, void *arg)
+{
+	struct keepalive_test_client *cl = arg;
+	gchar buf[512];
+	gssize r;
+
+	r = read (fd, buf, sizeof (buf));
+	g_assert (r > 0);
+	g_string_append_len (cl->reply, buf, r);
+
+	if (strstr (cl->reply->str, "\r\n\r\n") != NULL) {
+		/* Reply has no body, so close connection once headers are read */
+		g_assert (g_str_has_prefix (cl->reply->str, "HTTP/1.1 200"));
+		g_assert (strstr (cl->reply->str, "Connection: keep-alive") != NULL);
+		event_del (&cl->ev);
+		close (fd);
+	}
+}
+
+static void
+rspamd_keepalive_timeout (gint fd, short what, void *arg)
+{
+	struct event_base *ev_base = arg;
+
+	event_base_loopexit (ev_base, NULL);
+}
+
+void
+rspamd_http_keepalive_test_func (void)
+{
+	struct event_base *ev_base = event_base_new ();
+	struct rspamd_http_connection *conn;
+	struct keepalive_test_client cl;
+	struct event timeout_ev;
+	struct timeval tv = {5, 0};
+	const gchar req[] = "POST /check HTTP/1.1\r\n"
+			"Connection: keep-alive\r\n"
+			"Content-Length: 4\r\n\r\n"
+			"test";
+	gint sp[2];
+
+	g_assert (socketpair (AF_UNIX, SOCK_STREAM, 0, sp) == 0);
+	rspamd_socket_nonblocking (sp[0]);
+	rspamd_socket_nonblocking (sp[1]);
+
+	conn = rspamd_http_connection_new (NULL,
+			rspamd_keepalive_server_err,
+			rspamd_keepalive_server_finish,
+			RSPAMD_HTTP_CLIENT_KEEP_ALIVE,
+			RSPAMD_HTTP_SERVER,
+			NULL,
+			NULL);
+	rspamd_http_connection_read_message (conn,
+			rspamd_keepalive_req_new (ev_base, sp[0], 0),
+			sp[0], NULL, ev_base);
+
+	g_assert (write (sp[1], req, sizeof (req) - 1) == sizeof (req) - 1);
+	cl.reply = g_string_new (NULL);
+	event_set (&cl.ev, sp[1], EV_READ | EV_PERSIST,
+			rspamd_keepalive_client_read, &cl);
+	event_base_set (ev_base, &cl.ev);
+	event_add (&cl.ev, NULL);
+
+	/* EOF on idle connection must not be ignored */
+	evtimer_set (&timeout_ev, rspamd_keepalive_timeout, ev_base);
+	event_base_set (ev_base, &timeout_ev);
+	evtimer_add (&timeout_ev, &tv);
+
+	event_base_loop (ev_base, 0);
+
+	g_assert (keepalive_eof);
+	g_assert_cmpuint (keepalive_live_reqs, ==, 0);
+
+	evtimer_del (&timeout_ev);
+	g_string_free (cl.reply, TRUE);
+	event_base_free (ev_base);
+}
@@ -0,0 +1,189 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "unix-std.h"
+#include "tests.h"
+
+extern struct rspamd_main *rspamd_main;
+
+/* Lines do not divide the ring size, so they are padded at its end */
+static const guint line_len = 200;
+static const time_t base_ts = 1000000000;
+
+struct log_ring_test_ctx {
+	rspamd_logger_t *logger;
+	struct rspamd_log_ring *ring;
+	gchar path[PATH_MAX];
+	gsize consumed;
+	guint pushed;
+};
+
+static gboolean
+push_line (struct log_ring_test_ctx *ctx, time_t ts)
+{
+	gchar line[256];
+	struct iovec iov[2];
+	guint len;
+
+	len = rspamd_snprintf (line, sizeof (line), "line %ud ", ctx->pushed);
+	memset (line + len, 'x', line_len - len - 1);
+	line[line_len - 1] = '\n';
+	/* Record consists of several iovecs as in file logger */
+	iov[0].iov_base = line;
+	iov[0].iov_len = len;
+	iov[1].iov_base = line + len;
+	iov[1].iov_len = line_len - len;
+
+	if (rspamd_log_ring_push (ctx->ring, G_LOG_LEVEL_INFO, ts, iov, 2)) {
+		ctx->pushed ++;
+
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+/*
+ * Checks that the log has got lines starting from `first` with the expected
+ * timestamps and returns unparsed tail of the log (e.g. warnings)
+ */
+static gchar *
+check_lines (struct log_ring_test_ctx *ctx, guint first, guint count,
+		guint ts_step)
+{
+	gchar *content, *p, *tail, expected[32], prefix[32];
+	gsize len, tlen;
+	time_t ts;
+	struct tm *tms;
+	guint i;
+
+	g_assert (g_file_get_contents (ctx->path, &content, &len, NULL));
+	g_assert_cmpuint (len, >=, ctx->consumed);
+	p = content + ctx->consumed;
+
+	for (i = first; i < first + count; i ++) {
+		ts = base_ts + (ts_step ? i / ts_step : 0);
+		tms = localtime (&ts);
+		tlen = strftime (expected, sizeof (expected), "%F %H:%M:%S ", tms);
+		rspamd_snprintf (prefix, sizeof (prefix), "line %ud ", i);
+
+		g_assert (content + len - p >= (gssize)(tlen + line_len));
+		/* Each line must have time of its own record */
+		g_assert (memcmp (p, expected, tlen) == 0);
+		p += tlen;
+		g_assert (memcmp (p, prefix, strlen (prefix)) == 0);
+		g_assert (p[line_len - 2] == 'x' && p[line_len - 1] == '\n');
+		p += line_len;
+	}
+
+	ctx->consumed = len;
+	tail = g_strndup (p, content + len - p);
+	g_free (content);
+
+	return tail;
+}
+
+void
+rspamd_log_ring_test_func (void)
+{
+	struct log_ring_test_ctx ctx;
+	struct rspamd_config *cfg;
+	gchar *tail;
+	guint i, round, first, per_round;
+	gint fd;
+
+	memset (&ctx, 0, sizeof (ctx));
+	rspamd_snprintf (ctx.path, sizeof (ctx.path), "%s%crspamd-log-ring-XXXXXX",
+			g_get_tmp_dir (), G_DIR_SEPARATOR);
+	fd = mkstemp (ctx.path);
+	g_assert (fd != -1);
+	close (fd);
+
+	cfg = g_malloc0 (sizeof (*cfg));
+	cfg->log_type = RSPAMD_LOG_FILE;
+	cfg->log_file = ctx.path;
+	cfg->log_level = G_LOG_LEVEL_INFO;
+	cfg->log_extended = TRUE;
+	rspamd_set_logger (cfg, g_quark_from_static_string ("rspamd-test"),
+			&ctx.logger, NULL);
+	g_assert (rspamd_log_open (ctx.logger) == 0);
+	ctx.ring = rspamd_log_ring_new (0);
+	g_assert (ctx.ring != NULL);
+
+	/* Batches are flushed on time change, as they share the time buffer */
+	for (i = 0; i < 10; i ++) {
+		g_assert (push_line (&ctx, base_ts + i / 3));
+	}
+
+	g_assert_cmpuint (rspamd_log_ring_drain (ctx.logger, ctx.ring), ==, 10);
+	tail = check_lines (&ctx, 0, 10, 3);
+	g_assert_cmpstr (tail, ==, "");
+	g_free (tail);
+
+	/* Wrap the ring several times, records are padded at its end */
+	per_round = RSPAMD_LOGBUF_SIZE * 8 / 2 / line_len;
+
+	for (round = 0; round < 8; round ++) {
+		first = ctx.pushed;
+
+		for (i = 0; i < per_round; i ++) {
+			g_assert (push_line (&ctx, base_ts));
+		}
+
+		g_assert_cmpuint (rspamd_log_ring_drain (ctx.logger, ctx.ring), ==,
+				per_round);
+		tail = check_lines (&ctx, first, per_round, 0);
+		g_assert_cmpstr (tail, ==, "");
+		g_free (tail);
+	}
+
+	/* Full ring drops lines and drain reports them */
+	first = ctx.pushed;
+
+	while (push_line (&ctx, base_ts)) {}
+
+	g_assert_cmpuint (ctx.pushed - first, <,
+			RSPAMD_LOGBUF_SIZE * 8 / line_len);
+
+	/* One line has been dropped by the loop above */
+	for (i = 0; i < 2; i ++) {
+		g_assert (!push_line (&ctx, base_ts));
+	}
+
+	g_assert_cmpuint (rspamd_log_ring_drain (ctx.logger, ctx.ring), ==,
+			ctx.pushed - first);
+	tail = check_lines (&ctx, first, ctx.pushed - first, 0);
+	g_assert (strstr (tail, "is full, 3 lines have been dropped") != NULL);
+	g_free (tail);
+
+	/* Drops are reported once and the ring is usable again */
+	first = ctx.pushed;
+	g_assert (push_line (&ctx, base_ts));
+	g_assert_cmpuint (rspamd_log_ring_drain (ctx.logger, ctx.ring), ==, 1);
+	tail = check_lines (&ctx, first, 1, 0);
+	g_assert_cmpstr (tail, ==, "");
+	g_free (tail);
+
+	rspamd_log_ring_free (ctx.ring);
+	rspamd_log_close (ctx.logger);
+	unlink (ctx.path);
+	/* Restore the default logger */
+	rspamd_set_logger (rspamd_main->cfg,
+			g_quark_from_static_string ("rspamd-test"),
+			&rspamd_main->logger, rspamd_main->server_pool);
+	g_free (cfg);
+}
@@ -76,8 +76,10 @@ rspamd_lua_test_func (void)
 	lua_getfield (L, -1, "path");
 	old_path = luaL_checkstring (L, -1);
 
-	rspamd_snprintf (path_buf, sizeof (path_buf), "%s;%s/?.lua;%s/unit/?.lua",
-			old_path, dir, dir);
+	/* Rules modules are found in the source tree for in source builds */
+	rspamd_snprintf (path_buf, sizeof (path_buf),
+			"%s;%s/?.lua;%s/unit/?.lua;%s/../../rules/?.lua",
+			old_path, dir, dir, dir);
 	lua_pop (L, 1);
 	lua_pushstring (L, path_buf);
 	lua_setfield (L, -2, "path");
@@ -0,0 +1,155 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "libutil/map.h"
+#include "libutil/map_private.h"
+#include "unix-std.h"
+#include "tests.h"
+
+static const guint hosts_count = 1000;
+
+/* Reads map data in two chunks as backends do */
+static struct rspamd_map_snapshot *
+load_snapshot (struct rspamd_map *map, map_cb_t read_cb, const gchar *text,
+		struct rspamd_map_snapshot *prev)
+{
+	struct map_cb_data cbdata;
+	gchar *copy;
+	gsize len = strlen (text);
+
+	copy = g_strdup (text);
+	memset (&cbdata, 0, sizeof (cbdata));
+	cbdata.map = map;
+	cbdata.prev_data = prev;
+	read_cb (copy, len / 2, &cbdata, FALSE);
+	read_cb (copy + len / 2, len - len / 2, &cbdata, TRUE);
+	rspamd_map_snapshot_fin (&cbdata);
+	g_free (copy);
+
+	g_assert (cbdata.cur_data != NULL);
+
+	return cbdata.cur_data;
+}
+
+static void
+check_hosts (struct rspamd_map_snapshot *snap)
+{
+	gchar key[64];
+	guint i, len;
+
+	for (i = 0; i < hosts_count; i ++) {
+		len = rspamd_snprintf (key, sizeof (key), "HOST%ud.example.com", i);
+		g_assert_cmpstr (rspamd_map_snapshot_lookup (snap, key, len), ==, "1");
+	}
+
+	g_assert (rspamd_map_snapshot_lookup (snap, "host.example.com",
+			sizeof ("host.example.com") - 1) == NULL);
+	/* Prefix of a key must not match */
+	g_assert (rspamd_map_snapshot_lookup (snap, "host1.example",
+			sizeof ("host1.example") - 1) == NULL);
+}
+
+static void
+test_hosts_snapshot (struct rspamd_map *map)
+{
+	struct rspamd_map_snapshot *snap, *attached;
+	GString *text;
+	gchar shm_name[sizeof (map->cache->snapshot_shmem_name)];
+	guint i;
+
+	text = g_string_new ("# hosts list\n");
+
+	for (i = 0; i < hosts_count; i ++) {
+		rspamd_printf_gstring (text, "host%ud.example.com\n", i);
+	}
+
+	snap = load_snapshot (map, rspamd_hosts_snapshot_read, text->str, NULL);
+	check_hosts (snap);
+
+	if (map->cache->snapshot_available) {
+		/* The same data is not compiled again but attached */
+		rspamd_strlcpy (shm_name, map->cache->snapshot_shmem_name,
+				sizeof (shm_name));
+		attached = load_snapshot (map, rspamd_hosts_snapshot_read, text->str,
+				snap);
+		g_assert_cmpstr (map->cache->snapshot_shmem_name, ==, shm_name);
+		check_hosts (attached);
+		snap = attached;
+	}
+
+	/* Changed data replaces the previous snapshot */
+	snap = load_snapshot (map, rspamd_hosts_snapshot_read, "other.example.com",
+			snap);
+	g_assert_cmpstr (rspamd_map_snapshot_lookup (snap, "other.example.com",
+			sizeof ("other.example.com") - 1), ==, "1");
+	g_assert (rspamd_map_snapshot_lookup (snap, "host1.example.com",
+			sizeof ("host1.example.com") - 1) == NULL);
+
+	g_string_free (text, TRUE);
+}
+
+static void
+test_kv_snapshot (struct rspamd_map *map)
+{
+	struct rspamd_map_snapshot *snap;
+
+	snap = load_snapshot (map, rspamd_kv_snapshot_read,
+			"key1 value1\n"
+			"\"quoted key\" value2 # comment\n"
+			"key3\n"
+			"KEY1 replaced\n",
+			NULL);
+
+	g_assert_cmpstr (rspamd_map_snapshot_lookup (snap, "key1", 4), ==,
+			"replaced");
+	g_assert_cmpstr (rspamd_map_snapshot_lookup (snap, "quoted key", 10), ==,
+			"value2");
+	g_assert_cmpstr (rspamd_map_snapshot_lookup (snap, "Key3", 4), ==, "");
+	g_assert (rspamd_map_snapshot_lookup (snap, "key", 3) == NULL);
+}
+
+static void
+unlink_snapshot (struct rspamd_map *map)
+{
+	if (map->cache->snapshot_available) {
+#ifdef HAVE_SANE_SHMEM
+		shm_unlink (map->cache->snapshot_shmem_name);
+#else
+		unlink (map->cache->snapshot_shmem_name);
+#endif
+	}
+
+	memset (map->cache, 0, sizeof (*map->cache));
+}
+
+void
+rspamd_map_snapshot_test_func (void)
+{
+	struct rspamd_map map;
+
+	memset (&map, 0, sizeof (map));
+	map.name = (gchar *)"test";
+	map.description = (gchar *)"snapshot test map";
+	map.cache = g_malloc0 (sizeof (*map.cache));
+
+	test_hosts_snapshot (&map);
+	unlink_snapshot (&map);
+	test_kv_snapshot (&map);
+	unlink_snapshot (&map);
+
+	g_free (map.cache);
+}
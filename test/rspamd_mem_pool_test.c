@@ -10,13 +10,16 @@
 
 #define TEST_BUF "test bufffer"
 #define TEST2_BUF "test bufffertest bufffer"
+/* Multiple of MEM_ALIGNMENT, so learned sizes fit allocations exactly */
+#define TEST_ALLOC_SIZE 16
 
 void
 rspamd_mem_pool_test_func ()
 {
 	rspamd_mempool_t *pool;
-	rspamd_mempool_stat_t st;
+	rspamd_mempool_stat_t st, before;
 	char *tmp, *tmp2, *tmp3;
+	guint i, j;
 	pid_t pid;
 	int ret;
 
@@ -35,5 +38,44 @@ rspamd_mem_pool_test_func ()
 	
 	rspamd_mempool_delete (pool);
 	rspamd_mempool_stat (&st);
-	
+
+	/* Tagged pools learn their size and reuse chunks of the deleted ones */
+	before = st;
+
+	for (i = 0; i < 256; i ++) {
+		pool = rspamd_mempool_new (sizeof (TEST_BUF), "test");
+
+		for (j = 0; j < 1024; j ++) {
+			tmp = rspamd_mempool_alloc (pool, TEST_ALLOC_SIZE);
+			memcpy (tmp, TEST_BUF, sizeof (TEST_BUF));
+		}
+
+		g_assert (strncmp (tmp, TEST_BUF, sizeof (TEST_BUF)) == 0);
+		rspamd_mempool_delete (pool);
+	}
+
+	rspamd_mempool_stat (&st);
+	g_assert_cmpuint (st.pools_allocated - before.pools_allocated, ==, 256);
+	g_assert_cmpuint (st.chunks_allocated, ==, before.chunks_allocated);
+	g_assert_cmpuint (st.bytes_allocated, ==, before.bytes_allocated);
+	/* Chunks of the deleted pools must have been recycled */
+	g_assert_cmpuint (st.chunks_reused, >, before.chunks_reused);
+
+	/*
+	 * Without learning each allocation would require an oversized chunk, as
+	 * the initial size is too small, whilst the learned size is enough to
+	 * serve all allocations from the first chunk
+	 */
+	before = st;
+	pool = rspamd_mempool_new (sizeof (TEST_BUF), "test");
+
+	for (j = 0; j < 1024; j ++) {
+		tmp = rspamd_mempool_alloc (pool, TEST_ALLOC_SIZE);
+		memcpy (tmp, TEST_BUF, sizeof (TEST_BUF));
+	}
+
+	rspamd_mempool_stat (&st);
+	g_assert_cmpuint (st.chunks_allocated - before.chunks_allocated, ==, 1);
+	g_assert_cmpuint (st.oversized_chunks, ==, before.oversized_chunks);
+	rspamd_mempool_delete (pool);
 }
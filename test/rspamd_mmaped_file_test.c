@@ -0,0 +1,267 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "stat_internal.h"
+#include "ottery.h"
+#include "unix-std.h"
+#include "tests.h"
+
+static const guint tokens_count = 1000;
+/* Header and section of statfile take 320 bytes, each bucket is 64 bytes */
+static const gsize two_buckets_size = 320 + 64 * 2;
+
+/* Layout of the chained statfile (version 1.2), see mmaped_file.c */
+struct test_stat_header {
+	u_char magic[3];
+	u_char version[2];
+	u_char padding[3];
+	guint64 create_time;
+	guint64 revision;
+	guint64 rev_time;
+	guint64 used_blocks;
+	guint64 total_blocks;
+	guint64 tokenizer_conf_len;
+	u_char unused[231];
+};
+
+struct test_stat_section {
+	guint64 code;
+	guint64 length;
+};
+
+struct test_stat_block {
+	guint32 hash1;
+	guint32 hash2;
+	double value;
+};
+
+struct test_token {
+	guint32 h1;
+	guint32 h2;
+	double value;
+};
+
+static void
+gen_tokens (struct test_token *tokens, guint count)
+{
+	guint i;
+
+	for (i = 0; i < count; i ++) {
+		/* Zero hashes mark free blocks */
+		tokens[i].h1 = ottery_rand_uint32 () | 1;
+		tokens[i].h2 = ottery_rand_uint32 ();
+		tokens[i].value = i + 1;
+	}
+}
+
+static void
+write_chained_file (const gchar *path, struct test_token *tokens,
+		guint count, guint nblocks)
+{
+	struct test_stat_header header;
+	struct test_stat_section section;
+	struct test_stat_block *blocks;
+	guint i, j;
+	gint fd;
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, "rsd", sizeof (header.magic));
+	header.version[0] = '1';
+	header.version[1] = '2';
+	header.revision = 42;
+	header.rev_time = 100500;
+	header.used_blocks = count;
+	header.total_blocks = nblocks;
+	section.code = 1;
+	section.length = nblocks;
+
+	/* Tokens are stored in chains starting from h1 % nblocks */
+	blocks = g_malloc0 (sizeof (*blocks) * nblocks);
+
+	for (i = 0; i < count; i ++) {
+		/* Chains cannot wrap around the end of file */
+		if (tokens[i].h1 % nblocks >= nblocks - 128) {
+			tokens[i].h1 -= 128;
+		}
+
+		for (j = tokens[i].h1 % nblocks; blocks[j].hash1 != 0; j ++) {
+			g_assert (j + 1 < nblocks);
+		}
+
+		blocks[j].hash1 = tokens[i].h1;
+		blocks[j].hash2 = tokens[i].h2;
+		blocks[j].value = tokens[i].value;
+	}
+
+	fd = open (path, O_WRONLY|O_CREAT|O_TRUNC, 00600);
+	g_assert (fd != -1);
+	g_assert (write (fd, &header, sizeof (header)) == sizeof (header));
+	g_assert (write (fd, &section, sizeof (section)) == sizeof (section));
+	g_assert (write (fd, blocks, sizeof (*blocks) * nblocks) ==
+			(gssize)(sizeof (*blocks) * nblocks));
+	close (fd);
+	g_free (blocks);
+}
+
+void
+rspamd_mmaped_file_test_func (void)
+{
+	struct rspamd_tokenizer_config tkcf;
+	struct rspamd_classifier_config clcf;
+	struct rspamd_statfile_config stcf;
+	struct test_token *tokens, extra[2];
+	rspamd_mmaped_file_t *mf;
+	rspamd_mempool_t *pool;
+	gchar path[PATH_MAX], buf[PATH_MAX];
+	guint64 rev;
+	time_t rev_time;
+	guint i;
+	gint fd;
+
+	memset (&tkcf, 0, sizeof (tkcf));
+	memset (&clcf, 0, sizeof (clcf));
+	memset (&stcf, 0, sizeof (stcf));
+	tkcf.name = "osb";
+	clcf.tokenizer = &tkcf;
+	stcf.clcf = &clcf;
+	pool = rspamd_mempool_new (rspamd_mempool_suggest_size (), NULL);
+	tokens = g_malloc (sizeof (*tokens) * tokens_count);
+	gen_tokens (tokens, tokens_count);
+
+	rspamd_snprintf (path, sizeof (path), "%s%crspamd-statfile-XXXXXX",
+			g_get_tmp_dir (), G_DIR_SEPARATOR);
+	fd = mkstemp (path);
+	g_assert (fd != -1);
+	close (fd);
+	unlink (path);
+
+	/* Bucket insert and lookup */
+	g_assert (rspamd_mmaped_file_create (path, 65536, &stcf, pool) == 0);
+	mf = rspamd_mmaped_file_open (pool, path, 65536, &stcf);
+	g_assert (mf != NULL);
+
+	for (i = 0; i < tokens_count; i ++) {
+		rspamd_mmaped_file_set_block (pool, mf, tokens[i].h1, tokens[i].h2,
+				tokens[i].value);
+	}
+
+	g_assert_cmpuint (rspamd_mmaped_file_get_used (mf), ==, tokens_count);
+
+	for (i = 0; i < tokens_count; i ++) {
+		g_assert (rspamd_mmaped_file_get_block (mf, tokens[i].h1,
+				tokens[i].h2) == tokens[i].value);
+	}
+
+	/* Existing tokens are updated in place */
+	rspamd_mmaped_file_set_block (pool, mf, tokens[0].h1, tokens[0].h2, 100.0);
+	g_assert (rspamd_mmaped_file_get_block (mf, tokens[0].h1,
+			tokens[0].h2) == 100.0);
+	g_assert_cmpuint (rspamd_mmaped_file_get_used (mf), ==, tokens_count);
+	tokens[0].value = 100.0;
+	/* Same first hash with another second one is another token */
+	g_assert (rspamd_mmaped_file_get_block (mf, tokens[0].h1,
+			tokens[0].h2 + 1) == 0);
+	rspamd_mmaped_file_close_file (pool, mf);
+
+	/* Tokens persist after reopening */
+	mf = rspamd_mmaped_file_open (pool, path, 65536, &stcf);
+	g_assert (mf != NULL);
+
+	for (i = 0; i < tokens_count; i ++) {
+		g_assert (rspamd_mmaped_file_get_block (mf, tokens[i].h1,
+				tokens[i].h2) == tokens[i].value);
+	}
+
+	rspamd_mmaped_file_close_file (pool, mf);
+	unlink (path);
+
+	/*
+	 * With two buckets all tokens share the same buckets, so the ninth token
+	 * exhausts cuckoo kicks and the block with the minimum value expires
+	 */
+	g_assert (rspamd_mmaped_file_create (path, two_buckets_size,
+			&stcf, pool) == 0);
+	mf = rspamd_mmaped_file_open (pool, path, two_buckets_size, &stcf);
+	g_assert (mf != NULL);
+
+	for (i = 0; i < 8; i ++) {
+		rspamd_mmaped_file_set_block (pool, mf, tokens[i].h1, tokens[i].h2,
+				i + 2);
+	}
+
+	g_assert_cmpuint (rspamd_mmaped_file_get_used (mf), ==, 8);
+	gen_tokens (extra, G_N_ELEMENTS (extra));
+	rspamd_mmaped_file_set_block (pool, mf, extra[0].h1, extra[0].h2, 100.0);
+	g_assert_cmpuint (rspamd_mmaped_file_get_used (mf), ==, 8);
+	g_assert (rspamd_mmaped_file_get_block (mf, extra[0].h1,
+			extra[0].h2) == 100.0);
+	g_assert (rspamd_mmaped_file_get_block (mf, tokens[0].h1,
+			tokens[0].h2) == 0);
+
+	/* Tokens evicted by kicks are kept */
+	for (i = 1; i < 8; i ++) {
+		g_assert (rspamd_mmaped_file_get_block (mf, tokens[i].h1,
+				tokens[i].h2) == i + 2);
+	}
+
+	/* Token with the minimum value expires itself */
+	rspamd_mmaped_file_set_block (pool, mf, extra[1].h1, extra[1].h2, 1.0);
+	g_assert (rspamd_mmaped_file_get_block (mf, extra[1].h1,
+			extra[1].h2) == 0);
+
+	for (i = 1; i < 8; i ++) {
+		g_assert (rspamd_mmaped_file_get_block (mf, tokens[i].h1,
+				tokens[i].h2) == i + 2);
+	}
+
+	g_assert (rspamd_mmaped_file_get_block (mf, extra[0].h1,
+			extra[0].h2) == 100.0);
+	rspamd_mmaped_file_close_file (pool, mf);
+	unlink (path);
+
+	/* Chained file is converted on open keeping all tokens */
+	gen_tokens (tokens, tokens_count);
+	write_chained_file (path, tokens, tokens_count, 4096);
+	mf = rspamd_mmaped_file_open (pool, path, 65536, &stcf);
+	g_assert (mf != NULL);
+	g_assert_cmpuint (rspamd_mmaped_file_get_used (mf), ==, tokens_count);
+
+	for (i = 0; i < tokens_count; i ++) {
+		g_assert (rspamd_mmaped_file_get_block (mf, tokens[i].h1,
+				tokens[i].h2) == tokens[i].value);
+	}
+
+	g_assert (rspamd_mmaped_file_get_revision (mf, &rev, &rev_time));
+	g_assert_cmpuint (rev, ==, 42);
+	g_assert_cmpint (rev_time, ==, 100500);
+	rspamd_mmaped_file_close_file (pool, mf);
+
+	/* New file has replaced the old one and no temporary files are left */
+	fd = open (path, O_RDONLY);
+	g_assert (fd != -1);
+	g_assert (read (fd, buf, 5) == 5);
+	g_assert (memcmp (buf, "rsd13", 5) == 0);
+	close (fd);
+	rspamd_snprintf (buf, sizeof (buf), "%s.lock", path);
+	g_assert (access (buf, F_OK) == -1);
+	rspamd_snprintf (buf, sizeof (buf), "%s.new", path);
+	g_assert (access (buf, F_OK) == -1);
+
+	unlink (path);
+	g_free (tokens);
+	rspamd_mempool_delete (pool);
+}
@@ -0,0 +1,143 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "stat_internal.h"
+#include "ottery.h"
+#include "tests.h"
+
+static const guint tokens_count = 5000;
+
+#ifdef WITH_HIREDIS
+/* Per token printf based encoding used previously */
+static rspamd_fstring_t *
+legacy_tokens_to_query (struct rspamd_stat_tokens *tokens, const gchar *arg0,
+		const gchar *arg1)
+{
+	rspamd_fstring_t *out;
+	gchar n0[64];
+	guint i, l0, larg0, larg1;
+
+	larg0 = strlen (arg0);
+	larg1 = strlen (arg1);
+	out = rspamd_fstring_sized_new (1024);
+	rspamd_printf_fstring (&out, ""
+			"*%d\r\n"
+			"$%d\r\n"
+			"%s\r\n"
+			"$%d\r\n"
+			"%s\r\n",
+			(tokens->len + 2),
+			larg0, arg0,
+			larg1, arg1);
+
+	for (i = 0; i < tokens->len; i ++) {
+		l0 = rspamd_snprintf (n0, sizeof (n0), "%uL", tokens->data[i]);
+		rspamd_printf_fstring (&out, ""
+				"$%d\r\n"
+				"%s\r\n", l0, n0);
+	}
+
+	return out;
+}
+
+static void
+check_learn_args (struct rspamd_stat_tokens *tokens, rspamd_fstring_t *args,
+		gboolean binary_keys)
+{
+	const gchar *p = args->str;
+	gchar field[64];
+	guint i, flen;
+	guint64 num, bits;
+	gdouble val;
+
+	for (i = 0; i < tokens->len; i ++) {
+		num = tokens->data[i];
+		flen = (guchar)*p++;
+
+		if (binary_keys) {
+			g_assert_cmpuint (flen, ==, sizeof (num));
+			memcpy (&bits, p, sizeof (bits));
+			g_assert_cmpuint (GUINT64_FROM_LE (bits), ==, num);
+		}
+		else {
+			rspamd_snprintf (field, sizeof (field), "%uL", num);
+			g_assert_cmpuint (flen, ==, strlen (field));
+			g_assert (memcmp (p, field, flen) == 0);
+		}
+
+		p += flen;
+		memcpy (&bits, p, sizeof (bits));
+		bits = GUINT64_FROM_LE (bits);
+		memcpy (&val, &bits, sizeof (val));
+		g_assert (val == rspamd_stat_tokens_values (tokens, 0)[i]);
+		p += sizeof (bits);
+	}
+
+	g_assert (p == args->str + args->len);
+}
+#endif
+
+void
+rspamd_redis_stat_test_func (void)
+{
+#ifdef WITH_HIREDIS
+	struct rspamd_stat_tokens *tokens;
+	rspamd_fstring_t *old, *new;
+	guint i;
+	guint64 num;
+
+	tokens = rspamd_stat_tokens_new (tokens_count, 1);
+
+	for (i = 0; i < tokens_count; i ++) {
+		/* Make sure that extreme values are encoded correctly */
+		switch (i) {
+		case 0:
+			num = 0;
+			break;
+		case 1:
+			num = G_MAXUINT64;
+			break;
+		case 2:
+			num = 10;
+			break;
+		default:
+			num = ottery_rand_uint64 () >> ottery_rand_range (63);
+			break;
+		}
+
+		rspamd_stat_tokens_add (tokens, num, 1);
+		rspamd_stat_tokens_values (tokens, 0)[i] = (i % 2) ? 1.0 : -1.0;
+	}
+
+	/* Text fields must stay compatible with the existing databases */
+	old = legacy_tokens_to_query (tokens, "HMGET", "BAYES_SPAM");
+	new = rspamd_redis_tokens_to_query (tokens, "HMGET", "BAYES_SPAM", FALSE);
+	g_assert_cmpuint (old->len, ==, new->len);
+	g_assert (memcmp (old->str, new->str, old->len) == 0);
+	rspamd_fstring_free (old);
+	rspamd_fstring_free (new);
+
+	new = rspamd_redis_tokens_to_learn_args (tokens, 0, FALSE, FALSE);
+	check_learn_args (tokens, new, FALSE);
+	rspamd_fstring_free (new);
+	new = rspamd_redis_tokens_to_learn_args (tokens, 0, FALSE, TRUE);
+	check_learn_args (tokens, new, TRUE);
+	rspamd_fstring_free (new);
+
+	rspamd_stat_tokens_free (tokens);
+#endif
+}
@@ -0,0 +1,128 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "tests.h"
+
+static const gsize corpus_size = 64 * 1024;
+
+static const struct {
+	const gchar *name;
+	const gchar *sample;
+	GUnicodeScript expected;
+} corpora[] = {
+	{"latin", "The quick brown fox jumps over the lazy dog, 1234567890. ",
+			G_UNICODE_SCRIPT_LATIN},
+	{"cyrillic", "Съешь же ещё этих мягких французских булок, да выпей чаю. ",
+			G_UNICODE_SCRIPT_CYRILLIC},
+	{"greek", "Ταχίστη αλώπηξ βαφής ψημένη γη, δρασκελίζει υπέρ νωθρού κυνός. ",
+			G_UNICODE_SCRIPT_GREEK},
+	{"han", "我能吞下玻璃而不伤身体。天地玄黄，宇宙洪荒。",
+			G_UNICODE_SCRIPT_HAN},
+	{"mixed", "Сheар viаgrа online Дешевые таблетки здесь ",
+			G_UNICODE_SCRIPT_CYRILLIC},
+};
+
+/* Per character glib based histogram as used previously */
+static guint
+legacy_scripts_histogram (const gchar *p, gsize len, guint *hist)
+{
+	const gchar *pp;
+	gunichar c;
+	gssize remain = len;
+	GUnicodeScript sc;
+	guint nalpha = 0;
+
+	while (remain > 0) {
+		c = g_utf8_get_char_validated (p, remain);
+
+		if (c == (gunichar) -2 || c == (gunichar) -1) {
+			break;
+		}
+
+		if (g_unichar_isalpha (c)) {
+			sc = g_unichar_get_script (c);
+
+			if (sc >= 0 && sc < RSPAMD_UNICODE_SCRIPTS_MAX) {
+				hist[sc] ++;
+			}
+
+			nalpha ++;
+		}
+
+		pp = g_utf8_next_char (p);
+		remain -= pp - p;
+		p = pp;
+	}
+
+	return nalpha;
+}
+
+static GUnicodeScript
+dominant_script (const guint *hist)
+{
+	guint i, max = 0;
+	GUnicodeScript sel = G_UNICODE_SCRIPT_COMMON;
+
+	for (i = 0; i < RSPAMD_UNICODE_SCRIPTS_MAX; i ++) {
+		if (hist[i] > max) {
+			max = hist[i];
+			sel = i;
+		}
+	}
+
+	return sel;
+}
+
+void
+rspamd_scripts_test_func (void)
+{
+	guint old_hist[RSPAMD_UNICODE_SCRIPTS_MAX], new_hist[RSPAMD_UNICODE_SCRIPTS_MAX];
+	guint i, old_alpha, new_alpha;
+	GString *corpus;
+	gsize slen;
+
+	/* Invalid sequences are skipped */
+	memset (new_hist, 0, sizeof (new_hist));
+	new_alpha = rspamd_str_scripts_histogram ("ab\xc0\xafcd\xed\xa0\x80" "\xd0\xb6",
+			sizeof ("ab\xc0\xafcd\xed\xa0\x80" "\xd0\xb6") - 1, new_hist);
+	g_assert_cmpuint (new_alpha, ==, 5);
+	g_assert_cmpuint (new_hist[G_UNICODE_SCRIPT_LATIN], ==, 4);
+	g_assert_cmpuint (new_hist[G_UNICODE_SCRIPT_CYRILLIC], ==, 1);
+
+	for (i = 0; i < G_N_ELEMENTS (corpora); i ++) {
+		slen = strlen (corpora[i].sample);
+		corpus = g_string_sized_new (corpus_size + slen);
+
+		while (corpus->len < corpus_size) {
+			g_string_append_len (corpus, corpora[i].sample, slen);
+		}
+
+		memset (old_hist, 0, sizeof (old_hist));
+		memset (new_hist, 0, sizeof (new_hist));
+
+		old_alpha = legacy_scripts_histogram (corpus->str, corpus->len,
+				old_hist);
+		new_alpha = rspamd_str_scripts_histogram (corpus->str, corpus->len,
+				new_hist);
+
+		g_assert_cmpuint (old_alpha, ==, new_alpha);
+		g_assert (memcmp (old_hist, new_hist, sizeof (old_hist)) == 0);
+		g_assert_cmpint (dominant_script (new_hist), ==, corpora[i].expected);
+
+		g_string_free (corpus, TRUE);
+	}
+}
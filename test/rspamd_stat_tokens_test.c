@@ -0,0 +1,90 @@
+/*-
+ * Copyright 2016 Vsevolod Stakhov
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "config.h"
+#include "rspamd.h"
+#include "stat_internal.h"
+#include "tests.h"
+
+static const guint tokens_nvalues = 3;
+static const guint tokens_count = 1000;
+
+static gdouble
+test_token_value (guint row, guint i)
+{
+	return row * 100000.0 + i;
+}
+
+static void
+check_tokens (struct rspamd_stat_tokens *tokens, guint count)
+{
+	guint i, row;
+
+	g_assert_cmpuint (tokens->len, ==, count);
+	g_assert_cmpuint (tokens->allocated, >=, count);
+
+	for (i = 0; i < count; i ++) {
+		g_assert_cmpuint (tokens->data[i], ==, (guint64)i * 7);
+		g_assert_cmpuint (tokens->window_idx[i], ==, i % 5);
+
+		for (row = 0; row < tokens_nvalues; row ++) {
+			g_assert (rspamd_stat_tokens_values (tokens, row)[i] ==
+					test_token_value (row, i));
+		}
+	}
+
+	/* Reserved space after the last token must be zeroed */
+	for (row = 0; row < tokens_nvalues; row ++) {
+		for (i = count; i < tokens->allocated; i ++) {
+			g_assert (rspamd_stat_tokens_values (tokens, row)[i] == 0.0);
+		}
+	}
+}
+
+void
+rspamd_stat_tokens_test_func (void)
+{
+	struct rspamd_stat_tokens *tokens;
+	guint i, row, allocated;
+
+	tokens = rspamd_stat_tokens_new (0, tokens_nvalues);
+	allocated = tokens->allocated;
+
+	/* Values rows are moved on each growth caused by adding tokens */
+	for (i = 0; i < tokens_count; i ++) {
+		rspamd_stat_tokens_add (tokens, (guint64)i * 7, i % 5);
+
+		for (row = 0; row < tokens_nvalues; row ++) {
+			rspamd_stat_tokens_values (tokens, row)[i] =
+					test_token_value (row, i);
+		}
+	}
+
+	g_assert_cmpuint (tokens->allocated, >, allocated);
+	check_tokens (tokens, tokens_count);
+
+	/* Explicit reserve that fits must not move anything */
+	allocated = tokens->allocated;
+	rspamd_stat_tokens_reserve (tokens, allocated - tokens_count);
+	g_assert_cmpuint (tokens->allocated, ==, allocated);
+	check_tokens (tokens, tokens_count);
+
+	/* And the one that does not fit must keep all rows */
+	rspamd_stat_tokens_reserve (tokens, allocated * 3);
+	g_assert_cmpuint (tokens->allocated, >=, tokens_count + allocated * 3);
+	check_tokens (tokens, tokens_count);
+
+	rspamd_stat_tokens_free (tokens);
+}
@@ -43,15 +43,24 @@ main (int argc, char **argv)
 
 	g_test_add_func ("/rspamd/mem_pool", rspamd_mem_pool_test_func);
 	g_test_add_func ("/rspamd/radix", rspamd_radix_test_func);
+	g_test_add_func ("/rspamd/map_snapshot", rspamd_map_snapshot_test_func);
 	g_test_add_func ("/rspamd/dns", rspamd_dns_test_func);
 	g_test_add_func ("/rspamd/dkim", rspamd_dkim_test_func);
 	g_test_add_func ("/rspamd/rrd", rspamd_rrd_test_func);
 	g_test_add_func ("/rspamd/upstream", rspamd_upstream_test_func);
 	g_test_add_func ("/rspamd/shingles", rspamd_shingles_test_func);
 	g_test_add_func ("/rspamd/http", rspamd_http_test_func);
+	g_test_add_func ("/rspamd/http_keepalive", rspamd_http_keepalive_test_func);
 	g_test_add_func ("/rspamd/lua", rspamd_lua_test_func);
 	g_test_add_func ("/rspamd/cryptobox", rspamd_cryptobox_test_func);
 	g_test_add_func ("/rspamd/heap", rspamd_heap_test_func);
+	g_test_add_func ("/rspamd/fuzzy_sqlite", rspamd_fuzzy_sqlite_test_func);
+	g_test_add_func ("/rspamd/redis_stat", rspamd_redis_stat_test_func);
+	g_test_add_func ("/rspamd/stat_tokens", rspamd_stat_tokens_test_func);
+	g_test_add_func ("/rspamd/mmaped_file", rspamd_mmaped_file_test_func);
+	g_test_add_func ("/rspamd/scripts", rspamd_scripts_test_func);
+	g_test_add_func ("/rspamd/charsets", rspamd_charsets_test_func);
+	g_test_add_func ("/rspamd/log_ring", rspamd_log_ring_test_func);
 
 #if 0
 	g_test_add_func ("/rspamd/url", rspamd_url_test_func);
@@ -20,6 +20,7 @@
 
 const char *test_upstream_list = "microsoft.com:443:1,google.com:80:2,kernel.org:443:3";
 const char *new_upstream_list = "freebsd.org:80";
+const char *consistent_upstream_list = "consistent:microsoft.com:443,google.com:80,kernel.org:443";
 char test_key[32];
 
 static void
@@ -41,6 +42,98 @@ rspamd_upstream_test_method (struct upstream_list *ls,
 	}
 }
 
+static void
+rspamd_upstream_test_consistent (struct rspamd_config *cfg, gint assumptions)
+{
+	struct upstream_list *cls, *nls;
+	struct upstream *up, *upn, *failed;
+	struct upstream **selected;
+	guint dist[3];
+	const gchar *names[] = {"microsoft.com", "google.com", "kernel.org"};
+	gint i, j, success = 0, moved = 0;
+	gdouble p;
+
+	cls = rspamd_upstreams_create (cfg->ups_ctx);
+	g_assert (rspamd_upstreams_parse_line (cls, consistent_upstream_list,
+			443, NULL));
+	nls = rspamd_upstreams_create (cfg->ups_ctx);
+	g_assert (rspamd_upstreams_parse_line (nls, consistent_upstream_list,
+			443, NULL));
+	g_assert (rspamd_upstreams_parse_line (nls, new_upstream_list, 443, NULL));
+	selected = g_malloc (sizeof (*selected) * assumptions);
+	memset (dist, 0, sizeof (dist));
+
+	for (i = 0; i < assumptions; i ++) {
+		ottery_rand_bytes (test_key, sizeof (test_key));
+		/* Rotation algorithm is defined by the `consistent:` prefix */
+		up = rspamd_upstream_get (cls, RSPAMD_UPSTREAM_RANDOM, test_key,
+				sizeof (test_key));
+		upn = rspamd_upstream_get (nls, RSPAMD_UPSTREAM_RANDOM, test_key,
+				sizeof (test_key));
+		g_assert (up != NULL && upn != NULL);
+		g_assert (up == rspamd_upstream_get (cls, RSPAMD_UPSTREAM_RANDOM,
+				test_key, sizeof (test_key)));
+
+		for (j = 0; j < (gint)G_N_ELEMENTS (names); j ++) {
+			if (strcmp (rspamd_upstream_name (up), names[j]) == 0) {
+				dist[j] ++;
+			}
+		}
+
+		if (strcmp (rspamd_upstream_name (up), rspamd_upstream_name (upn)) == 0) {
+			success ++;
+		}
+	}
+
+	/* Keys should be distributed evenly between upstreams */
+	for (j = 0; j < (gint)G_N_ELEMENTS (names); j ++) {
+		p = (gdouble)dist[j] / (gdouble)assumptions;
+		msg_debug ("consistent hash share for %s: %.3f", names[j], p);
+		g_assert (p > 0.2 && p < 0.47);
+	}
+
+	/* Only keys that belong to a new upstream should move */
+	p = 1.0 - fabs (3.0 / 4.0 - (gdouble)success / (gdouble)assumptions);
+	msg_debug ("p value for consistent hash: %.6f", p);
+	g_assert (p > 0.9);
+
+	rspamd_upstreams_destroy (nls);
+
+	/* Upstream failure must not move keys of other upstreams */
+	failed = rspamd_upstream_get (cls, RSPAMD_UPSTREAM_MASTER_SLAVE, NULL, 0);
+
+	for (i = 0; i < assumptions; i ++) {
+		memset (test_key, 0, sizeof (test_key));
+		memcpy (&test_key[0], &i, sizeof (i));
+		selected[i] = rspamd_upstream_get_forced (cls,
+				RSPAMD_UPSTREAM_CONSISTENT, test_key, sizeof (test_key));
+	}
+
+	for (i = 0; i < 100; i ++) {
+		rspamd_upstream_fail (failed);
+	}
+
+	g_assert (rspamd_upstreams_alive (cls) == 2);
+
+	for (i = 0; i < assumptions; i ++) {
+		memset (test_key, 0, sizeof (test_key));
+		memcpy (&test_key[0], &i, sizeof (i));
+		up = rspamd_upstream_get_forced (cls,
+				RSPAMD_UPSTREAM_CONSISTENT, test_key, sizeof (test_key));
+		g_assert (up != failed);
+
+		if (up != selected[i]) {
+			g_assert (selected[i] == failed);
+			moved ++;
+		}
+	}
+
+	msg_debug ("keys moved after upstream failure: %d", moved);
+
+	g_free (selected);
+	rspamd_upstreams_destroy (cls);
+}
+
 static void
 rspamd_upstream_timeout_handler (int fd, short what, void *arg)
 {
@@ -157,6 +250,8 @@ rspamd_upstream_test_func (void)
 
 	rspamd_upstreams_destroy (nls);
 
+	/* Test consistent hashing */
+	rspamd_upstream_test_consistent (cfg, assumptions);
 
 	/* Upstream fail test */
 	evtimer_set (&ev, rspamd_upstream_timeout_handler, resolver);
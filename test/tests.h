@@ -17,6 +17,9 @@ void rspamd_statfile_test_func (void);
 /* Radix test */
 void rspamd_radix_test_func (void);
 
+/* Shared maps snapshots */
+void rspamd_map_snapshot_test_func (void);
+
 /* DNS resolving */
 void rspamd_dns_test_func (void);
 
@@ -35,10 +38,25 @@ void rspamd_shingles_test_func (void);
 
 void rspamd_http_test_func (void);
 
+void rspamd_http_keepalive_test_func (void);
+
 void rspamd_lua_test_func (void);
 
 void rspamd_cryptobox_test_func (void);
 
 void rspamd_heap_test_func (void);
 
+void rspamd_fuzzy_sqlite_test_func (void);
+
+void rspamd_redis_stat_test_func (void);
+
+void rspamd_stat_tokens_test_func (void);
+void rspamd_mmaped_file_test_func (void);
+
+void rspamd_scripts_test_func (void);
+
+void rspamd_charsets_test_func (void);
+
+void rspamd_log_ring_test_func (void);
+
 #endif
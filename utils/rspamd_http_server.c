@@ -201,7 +201,8 @@ rspamd_http_start_servers (pid_t *sfd, rspamd_inet_addr_t *addr)
 	guint i;
 	gint fd;
 
-	fd = rspamd_inet_address_listen (addr, SOCK_STREAM, TRUE);
+	fd = rspamd_inet_address_listen (addr, SOCK_STREAM,
+			RSPAMD_INET_ADDRESS_LISTEN_ASYNC);
 	g_assert (fd != -1);
 
 	for (i = 0; i < nworkers; i++) {